@@ -82,16 +82,62 @@ void initArrayAPI()
 }
 void initUFuncAPI()
 {
-  // partially recreates _import_umath(void) from __ufunc_api.h - not yet tested
+  // partially recreates _import_umath(void) from __ufunc_api.h
+  // On failure, PyUFunc_API stays null and rsMakeUFunc will raise an ImportError. The error set 
+  // by the failing call is cleared, such that it doesn't surface later at some unrelated place:
   PyObject* numpy = PyImport_ImportModule("numpy.core.umath");
+  if(numpy == nullptr) {
+    PyErr_Clear();
+    return; }
   PyObject* c_api = PyObject_GetAttrString(numpy, "_UFUNC_API");
+  if(c_api == nullptr) {
+    PyErr_Clear();
+    return; }
   PyUFunc_API = (void**)PyCapsule_GetPointer(c_api, NULL);
+  if(PyUFunc_API == nullptr)
+    PyErr_Clear();
   //PyUFunc_API = (void**)PyCObject_AsVoidPtr(c_api);  // other #ifdef branch
 }
 void initNumPy()
 {
   initArrayAPI();
-  initUFuncAPI(); // not yet tested
+  initUFuncAPI();
+}
+
+boost::python::object rsMakeUFunc(const char* name, const char* doc, int numInputs, 
+  int numOutputs, const std::vector<rsUFuncLoop>& loops, const std::vector<rsNumPyType>& types)
+{
+  static_assert(rsNpyFloat32   == NPY_FLOAT  && rsNpyFloat64    == NPY_DOUBLE
+             && rsNpyComplex64 == NPY_CFLOAT && rsNpyComplex128 == NPY_CDOUBLE, 
+    "rsNumPyType doesn't match NumPy's type numbers");
+
+  using namespace boost::python;
+  if(PyUFunc_API == nullptr) {
+    PyErr_SetString(PyExc_ImportError, "NumPy's ufunc API is not available, call initNumPy()");
+    throw_error_already_set(); }
+  if(loops.empty() || types.size() != loops.size() * (numInputs + numOutputs)) {
+    PyErr_SetString(PyExc_ValueError, "rsMakeUFunc: need numInputs + numOutputs types per loop");
+    throw_error_already_set(); }
+
+  // NumPy doesn't copy the arrays of loops, data pointers and types, so they must live as long as
+  // the ufunc, which in practice means until the interpreter shuts down. So, we allocate them 
+  // here and never free them (it's a few bytes per registered function):
+  int numLoops = (int) loops.size();
+  PyUFuncGenericFunction* f = new PyUFuncGenericFunction[numLoops];
+  void** d = new void*[numLoops];
+  char*  t = new char[types.size()];
+  for(int i = 0; i < numLoops; i++) {
+    f[i] = reinterpret_cast<PyUFuncGenericFunction>(loops[i]); // older NumPys use non-const ptrs
+    d[i] = nullptr; }
+  for(size_t i = 0; i < types.size(); i++)
+    t[i] = (char) types[i];
+
+  PyObject* u = PyUFunc_FromFuncAndData(f, d, t, numLoops, numInputs, numOutputs, PyUFunc_None,
+    name, doc, 0);
+  if(u == nullptr) {
+    delete[] f; delete[] d; delete[] t;
+    throw_error_already_set(); }
+  return object(handle<>(u));
 }
 
 
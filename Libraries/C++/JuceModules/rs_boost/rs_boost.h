@@ -46,11 +46,40 @@
 #include <boost/python.hpp>
 //#include <boost/python/detail/wrap_python.hpp> // alternative - recommended by documentation
 #include <boost/python/numpy.hpp>
+#include <vector>
 
 void initNumPy();
 // This should be called in the definition of BOOST_PYTHON_MODULE before using any numpy 
 // functionality. It sets up the pointers to the array- and ufunc APIs. Actually, this is 
 // supposed to be the job of numpy::initialize(), but for some reason, it doesn't seem to work, 
 // so i wrote my own replacement function to get the job done. My version works for me but the 
-// boost function doesn't - this is really weird! ...but the ufunc stuff has not yet been tested. 
-// Only the array-api stuff is known to work.
+// boost function doesn't - this is really weird! The ufunc API is used by rsMakeUFunc.
+
+typedef void (*rsUFuncLoop)(char** args, const Py_intptr_t* dimensions, const Py_intptr_t* steps,
+  void* data);
+// Signature of the typed inner loops of a NumPy ufunc (same as PyUFuncGenericFunction, which we 
+// can't use here because this header doesn't include the numpy C headers). NumPy calls such a 
+// loop for 1D runs of elements: dimensions[0] is the number of elements, args[i] points to the 
+// first element of the i-th operand (inputs first, then outputs) and steps[i] is its stride in 
+// bytes. A stride of 0 means that the operand is broadcast, i.e. the same value for all elements.
+
+enum rsNumPyType
+{
+  rsNpyFloat32    = 11,  // NPY_FLOAT
+  rsNpyFloat64    = 12,  // NPY_DOUBLE
+  rsNpyComplex64  = 14,  // NPY_CFLOAT
+  rsNpyComplex128 = 15   // NPY_CDOUBLE
+};
+// NumPy's type numbers of the types for which we provide ufunc loops. They are checked against 
+// the NPY_... constants in rs_boost.cpp.
+
+boost::python::object rsMakeUFunc(const char* name, const char* doc, int numInputs, 
+  int numOutputs, const std::vector<rsUFuncLoop>& loops, const std::vector<rsNumPyType>& types);
+// Creates a NumPy ufunc with the given inner loops. For each loop, the types array must contain 
+// numInputs + numOutputs type numbers (inputs first). The loops should be ordered from the 
+// smallest to the largest types because NumPy uses the first loop to which the inputs can be 
+// safely cast, for example, int64 arrays will be processed by a float64 loop. NumPy handles 
+// broadcasting, type casting, the out= argument and the iteration over multidimensional arrays. 
+// The name and doc must be string literals (NumPy keeps the pointers) and initNumPy must have 
+// been called before. Assign the result to an attribute of the module, like:
+//   scope().attr("sin") = rsMakeUFunc("sin", "Sine", 1, 1, loops, types);
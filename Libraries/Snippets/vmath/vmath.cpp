@@ -57,6 +57,14 @@ template class Quaternion<float>;
 template class Quaternion<double>;
 template class Aabb3<float>;
 template class Aabb3<double>;
+template struct Vector3Array<float>;
+template struct Vector3Array<double>;
+template struct Vector4Array<float>;
+template struct Vector4Array<double>;
+template struct QuaternionArray<float>;
+template struct QuaternionArray<double>;
+template class Bvh3<float>;
+template class Bvh3<double>;
 
 #ifdef VMATH_NAMESPACE
 }
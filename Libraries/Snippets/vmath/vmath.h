@@ -123,10 +123,16 @@
 
 #include <cmath>
 #include <cstring>
+#include <cstdint>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <cassert>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include <utility>
 
 #ifdef VMATH_NAMESPACE
 namespace VMATH_NAMESPACE
@@ -4022,6 +4028,1015 @@ namespace VMATH_NAMESPACE
 	typedef Aabb3<float> Aabb3f;
 	typedef Aabb3<double> Aabb3d;
 
+	//--------------------------[ batch operations ]------------------------------
+
+	/*
+	 * The classes above operate on one vector at a time, so transforming a mesh means one
+	 * operator* call per vertex with the matrix elements reloaded each time. The functions below
+	 * process whole arrays instead. They use a structure-of-arrays (SoA) layout, where the x, y,
+	 * z (and w) coordinates of all vectors are stored in separate arrays. The matrix elements are
+	 * loaded once per batch and the iterations of the loops are independent of each other, so the
+	 * compiler can vectorize them with SIMD instructions (SSE, AVX, NEON). Outputs may be the
+	 * same arrays as the inputs (in-place operation) but must not partially overlap them.
+	 *
+	 * Separately allocated arrays tend to lie a few bytes apart modulo 4096. Then a load from one
+	 * array a few elements ahead of a store to another one hits the same address bits, which
+	 * makes x86 CPUs wait for the store ("4K aliasing"). With std::vector members for the
+	 * coordinates, this made the batch transforms slower than a loop over operator* at -O3
+	 * -march=native. The array classes below therefore keep their coordinates in one allocation.
+	 */
+
+	/**
+	 * Storage for C arrays of n elements each ("components") in one allocation. The components
+	 * start at addresses that are 1024 bytes apart modulo 4096, for any two arrays, so loads
+	 * from one never alias with the recent stores to another one. This costs up to 5 KB of
+	 * padding per component.
+	 */
+	template<class T, size_t C>
+	struct SoaArray
+	{
+		SoaArray(size_t n = 0)
+		{
+			resize(n);
+		}
+
+		SoaArray(const SoaArray& a)
+		{
+			*this = a;
+		}
+
+		SoaArray(SoaArray&& a)
+		{
+			*this = std::move(a);
+		}
+
+		SoaArray& operator=(const SoaArray& a)
+		{
+			resize(a.n);
+			for (size_t c = 0; c < C; c++)
+				std::copy(a.component(c), a.component(c) + n, component(c));
+			return *this;
+		}
+
+		SoaArray& operator=(SoaArray&& a)
+		{
+			storage.swap(a.storage);
+			std::swap(n, a.n);
+			std::swap(stride, a.stride);
+			std::swap(offset, a.offset);
+			return *this;
+		}
+
+		size_t size() const { return n; }
+
+		/**
+		 * Resizes all components, keeping the first min(size(), newSize) elements. New elements
+		 * are zero.
+		 */
+		void resize(size_t newSize)
+		{
+			if (newSize > stride)
+			{
+				const size_t page = 4096 / sizeof(T), skew = 1024 / sizeof(T);
+				const size_t newStride = (newSize + page - 1) / page * page + skew;
+				std::vector<T> s(C * newStride + page);
+				const size_t misalignment = reinterpret_cast<uintptr_t>(s.data()) % 4096 / sizeof(T);
+				const size_t newOffset = (page - misalignment) % page;
+				for (size_t c = 0; c < C; c++)
+					std::copy(component(c), component(c) + n, s.data() + newOffset + c * newStride);
+				storage.swap(s);
+				stride = newStride;
+				offset = newOffset;
+			}
+			else
+				for (size_t c = 0; c < C && newSize > n; c++)
+					std::fill(component(c) + n, component(c) + newSize, T(0));
+			n = newSize;
+		}
+
+		T* component(size_t c) { return storage.data() + offset + c * stride; }
+
+		const T* component(size_t c) const { return storage.data() + offset + c * stride; }
+
+	private:
+		std::vector<T> storage;
+		size_t n = 0, stride = 0, offset = 0;   // offset aligns the components to 4096 bytes
+	};
+
+	/**
+	 * Array of 3D vectors in structure-of-arrays layout.
+	 */
+	template<class T>
+	struct Vector3Array : SoaArray<T, 3>
+	{
+		Vector3Array(size_t n = 0)
+			: SoaArray<T, 3>(n)
+		{}
+
+		T* x() { return this->component(0); }
+		T* y() { return this->component(1); }
+		T* z() { return this->component(2); }
+		const T* x() const { return this->component(0); }
+		const T* y() const { return this->component(1); }
+		const T* z() const { return this->component(2); }
+
+		Vector3<T> get(size_t i) const { return Vector3<T>(x()[i], y()[i], z()[i]); }
+
+		void set(size_t i, const Vector3<T>& v) { x()[i] = v.x; y()[i] = v.y; z()[i] = v.z; }
+
+		/**
+		 * Creates the array from @a n vectors in array-of-structures layout.
+		 */
+		static Vector3Array<T> fromAoS(const Vector3<T>* v, size_t n)
+		{
+			Vector3Array<T> a(n);
+			for (size_t i = 0; i < n; i++)
+				a.set(i, v[i]);
+			return a;
+		}
+	};
+
+	/**
+	 * Array of 4D (homogeneous) vectors in structure-of-arrays layout.
+	 */
+	template<class T>
+	struct Vector4Array : SoaArray<T, 4>
+	{
+		Vector4Array(size_t n = 0)
+			: SoaArray<T, 4>(n)
+		{}
+
+		T* x() { return this->component(0); }
+		T* y() { return this->component(1); }
+		T* z() { return this->component(2); }
+		T* w() { return this->component(3); }
+		const T* x() const { return this->component(0); }
+		const T* y() const { return this->component(1); }
+		const T* z() const { return this->component(2); }
+		const T* w() const { return this->component(3); }
+
+		Vector4<T> get(size_t i) const { return Vector4<T>(x()[i], y()[i], z()[i], w()[i]); }
+
+		void set(size_t i, const Vector4<T>& v) { x()[i] = v.x; y()[i] = v.y; z()[i] = v.z; w()[i] = v.w; }
+	};
+
+	/**
+	 * Array of quaternions (e.g. the rotations of the keyframes of an animation) in
+	 * structure-of-arrays layout. Element i is w()[i] + x()[i]i + y()[i]j + z()[i]k.
+	 */
+	template<class T>
+	struct QuaternionArray : SoaArray<T, 4>
+	{
+		QuaternionArray(size_t n = 0)
+			: SoaArray<T, 4>(n)
+		{}
+
+		T* w() { return this->component(0); }
+		T* x() { return this->component(1); }
+		T* y() { return this->component(2); }
+		T* z() { return this->component(3); }
+		const T* w() const { return this->component(0); }
+		const T* x() const { return this->component(1); }
+		const T* y() const { return this->component(2); }
+		const T* z() const { return this->component(3); }
+
+		Quaternion<T> get(size_t i) const { return Quaternion<T>(w()[i], x()[i], y()[i], z()[i]); }
+
+		void set(size_t i, const Quaternion<T>& q) { w()[i] = q.w; x()[i] = q.v.x; y()[i] = q.v.y; z()[i] = q.v.z; }
+	};
+
+	/**
+	 * Number of vectors that the batch functions process per block.
+	 */
+	const size_t batchSize = 64;
+
+	/**
+	 * Calls @a f with the NI input and NO output pointers as separate arguments.
+	 */
+	template<class T, class F, size_t... I, size_t... O>
+	void batchCall(F& f, const T* const* p, T* const* o, std::index_sequence<I...>, std::index_sequence<O...>)
+	{
+		f(p[I]..., o[O]...);
+	}
+
+	/**
+	 * Runs the kernel @a f over @a n elements of the @a NI input and @a NO output arrays. The
+	 * kernel gets pointers to the current block of each input and each output and always
+	 * processes batchSize elements, which gives its loop a fixed trip count. Its parameters are
+	 * declared __restrict, so compilers vectorize it even at -O2 and without runtime alias checks.
+	 * Full blocks are written directly into @a out. The last, partial block is padded with ones
+	 * and goes through local buffers. When an output is one of the inputs, the restrict promise
+	 * would be broken, so then all blocks go through the buffers and are copied into @a out
+	 * afterwards.
+	 */
+	template<class T, size_t NI, size_t NO, class F>
+	void batchApply(const T* const (&in)[NI], T* const (&out)[NO], size_t n, F f)
+	{
+		const size_t B = batchSize;
+		bool inPlace = false;
+		for (size_t c = 0; c < NI; c++)
+			for (size_t d = 0; d < NO; d++)
+				inPlace |= in[c] == out[d];
+		T bi[NI][B], bo[NO][B];
+		const T* p[NI];
+		T* o[NO];
+		for (size_t i = 0; i < n; i += B)
+		{
+			const size_t nb = std::min(B, n - i);
+			const bool direct = nb == B && !inPlace;
+			for (size_t c = 0; c < NI; c++)
+			{
+				if (nb == B)
+					p[c] = in[c] + i;
+				else
+				{
+					std::fill(bi[c] + nb, bi[c] + B, T(1));
+					std::memcpy(bi[c], in[c] + i, sizeof(T) * nb);
+					p[c] = bi[c];
+				}
+			}
+			for (size_t c = 0; c < NO; c++)
+				o[c] = direct ? out[c] + i : bo[c];
+			batchCall(f, p, o, std::make_index_sequence<NI>(), std::make_index_sequence<NO>());
+			if (!direct)
+				for (size_t c = 0; c < NO; c++)
+					std::memcpy(out[c] + i, bo[c], sizeof(T) * nb);
+		}
+	}
+
+	/**
+	 * Transforms @a n points by the affine part of @a m, i.e. p' = M p + t where M is the upper
+	 * left 3x3 part and t the translation column. The projective (bottom) row is ignored, so
+	 * this is Matrix4 * Vector4(p, 1) without the w-coordinate of the result.
+	 */
+	template<class T>
+	void transformPoints(const Matrix4<T>& m, const T* x, const T* y, const T* z, T* ox, T* oy, T* oz, size_t n)
+	{
+		const T* d = m.data;
+		const T m00 = d[0], m01 = d[4], m02 = d[8],  t0 = d[12];
+		const T m10 = d[1], m11 = d[5], m12 = d[9],  t1 = d[13];
+		const T m20 = d[2], m21 = d[6], m22 = d[10], t2 = d[14];
+		batchApply<T, 3, 3>({ x, y, z }, { ox, oy, oz }, n, [=](const T* __restrict px, const T* __restrict py, const T* __restrict pz,
+				T* __restrict qx, T* __restrict qy, T* __restrict qz)
+		{
+			for (size_t i = 0; i < batchSize; i++)
+			{
+				const T xi = px[i], yi = py[i], zi = pz[i];
+				qx[i] = m00 * xi + m01 * yi + m02 * zi + t0;
+				qy[i] = m10 * xi + m11 * yi + m12 * zi + t1;
+				qz[i] = m20 * xi + m21 * yi + m22 * zi + t2;
+			}
+		});
+	}
+
+	/**
+	 * Transforms @a n directions by the upper left 3x3 part of @a m (without translation), like
+	 * Matrix4 * Vector3 does.
+	 */
+	template<class T>
+	void transformDirections(const Matrix4<T>& m, const T* x, const T* y, const T* z, T* ox, T* oy, T* oz, size_t n)
+	{
+		const T* d = m.data;
+		const T m00 = d[0], m01 = d[4], m02 = d[8];
+		const T m10 = d[1], m11 = d[5], m12 = d[9];
+		const T m20 = d[2], m21 = d[6], m22 = d[10];
+		batchApply<T, 3, 3>({ x, y, z }, { ox, oy, oz }, n, [=](const T* __restrict px, const T* __restrict py, const T* __restrict pz,
+				T* __restrict qx, T* __restrict qy, T* __restrict qz)
+		{
+			for (size_t i = 0; i < batchSize; i++)
+			{
+				const T xi = px[i], yi = py[i], zi = pz[i];
+				qx[i] = m00 * xi + m01 * yi + m02 * zi;
+				qy[i] = m10 * xi + m11 * yi + m12 * zi;
+				qz[i] = m20 * xi + m21 * yi + m22 * zi;
+			}
+		});
+	}
+
+	/**
+	 * Transforms @a n surface normals for a mesh that is transformed by @a m and normalizes them.
+	 * Normals must be transformed by the inverse transpose of the upper left 3x3 part of the
+	 * matrix to stay perpendicular to the surface under non-uniform scaling. That matrix is
+	 * computed once for the whole batch.
+	 * @note The square root only vectorizes with -fno-math-errno (implied by -ffast-math).
+	 */
+	template<class T>
+	void transformNormals(const Matrix4<T>& m, const T* x, const T* y, const T* z, T* ox, T* oy, T* oz, size_t n)
+	{
+		const T* d = m.data;
+		const T a = d[0], b = d[4], c = d[8];   // upper left 3x3 part, row by row
+		const T e = d[1], f = d[5], g = d[9];
+		const T h = d[2], k = d[6], l = d[10];
+
+		// The inverse transpose is the cofactor matrix divided by the determinant:
+		const T c00 = f * l - g * k, c01 = g * h - e * l, c02 = e * k - f * h;
+		const T c10 = c * k - b * l, c11 = a * l - c * h, c12 = b * h - a * k;
+		const T c20 = b * g - c * f, c21 = c * e - a * g, c22 = a * f - b * e;
+		const T s = T(1) / (a * c00 + b * c01 + c * c02);
+
+		batchApply<T, 3, 3>({ x, y, z }, { ox, oy, oz }, n, [=](const T* __restrict px, const T* __restrict py, const T* __restrict pz,
+				T* __restrict qx, T* __restrict qy, T* __restrict qz)
+		{
+			for (size_t i = 0; i < batchSize; i++)
+			{
+				const T xi = px[i], yi = py[i], zi = pz[i];
+				T nx = s * (c00 * xi + c01 * yi + c02 * zi);
+				T ny = s * (c10 * xi + c11 * yi + c12 * zi);
+				T nz = s * (c20 * xi + c21 * yi + c22 * zi);
+				T r = T(1) / std::sqrt(nx * nx + ny * ny + nz * nz);
+				qx[i] = nx * r;
+				qy[i] = ny * r;
+				qz[i] = nz * r;
+			}
+		});
+	}
+
+	/**
+	 * Transforms @a n homogeneous vectors by @a m, like Matrix4 * Vector4 does.
+	 */
+	template<class T>
+	void transformHomogeneous(const Matrix4<T>& m, const T* x, const T* y, const T* z, const T* w,
+			T* ox, T* oy, T* oz, T* ow, size_t n)
+	{
+		const T* d = m.data;
+		const T m00 = d[0], m01 = d[4], m02 = d[8],  m03 = d[12];
+		const T m10 = d[1], m11 = d[5], m12 = d[9],  m13 = d[13];
+		const T m20 = d[2], m21 = d[6], m22 = d[10], m23 = d[14];
+		const T m30 = d[3], m31 = d[7], m32 = d[11], m33 = d[15];
+		batchApply<T, 4, 4>({ x, y, z, w }, { ox, oy, oz, ow }, n, [=](const T* __restrict px, const T* __restrict py, const T* __restrict pz, const T* __restrict pw,
+				T* __restrict qx, T* __restrict qy, T* __restrict qz, T* __restrict qw)
+		{
+			for (size_t i = 0; i < batchSize; i++)
+			{
+				const T xi = px[i], yi = py[i], zi = pz[i], wi = pw[i];
+				qx[i] = m00 * xi + m01 * yi + m02 * zi + m03 * wi;
+				qy[i] = m10 * xi + m11 * yi + m12 * zi + m13 * wi;
+				qz[i] = m20 * xi + m21 * yi + m22 * zi + m23 * wi;
+				qw[i] = m30 * xi + m31 * yi + m32 * zi + m33 * wi;
+			}
+		});
+	}
+
+	/**
+	 * Transforms the points of @a in by @a m into @a out (which is resized, if necessary).
+	 * @see transformPoints(const Matrix4<T>&, const T*, const T*, const T*, T*, T*, T*, size_t)
+	 */
+	template<class T>
+	void transformPoints(const Matrix4<T>& m, const Vector3Array<T>& in, Vector3Array<T>& out)
+	{
+		out.resize(in.size());
+		transformPoints(m, in.x(), in.y(), in.z(), out.x(), out.y(), out.z(), in.size());
+	}
+
+	/**
+	 * Transforms the directions of @a in by @a m into @a out (which is resized, if necessary).
+	 */
+	template<class T>
+	void transformDirections(const Matrix4<T>& m, const Vector3Array<T>& in, Vector3Array<T>& out)
+	{
+		out.resize(in.size());
+		transformDirections(m, in.x(), in.y(), in.z(), out.x(), out.y(), out.z(), in.size());
+	}
+
+	/**
+	 * Transforms the normals of @a in for a mesh transformed by @a m into @a out (which is
+	 * resized, if necessary).
+	 */
+	template<class T>
+	void transformNormals(const Matrix4<T>& m, const Vector3Array<T>& in, Vector3Array<T>& out)
+	{
+		out.resize(in.size());
+		transformNormals(m, in.x(), in.y(), in.z(), out.x(), out.y(), out.z(), in.size());
+	}
+
+	/**
+	 * Transforms the homogeneous vectors of @a in by @a m into @a out (which is resized, if
+	 * necessary).
+	 */
+	template<class T>
+	void transformHomogeneous(const Matrix4<T>& m, const Vector4Array<T>& in, Vector4Array<T>& out)
+	{
+		out.resize(in.size());
+		transformHomogeneous(m, in.x(), in.y(), in.z(), in.w(),
+				out.x(), out.y(), out.z(), out.w(), in.size());
+	}
+
+	/**
+	 * Normalizes all quaternions of @a q to unit length.
+	 */
+	template<class T>
+	void normalize(QuaternionArray<T>& q)
+	{
+		T* w = q.w(); T* x = q.x(); T* y = q.y(); T* z = q.z();
+		batchApply<T, 4, 4>({ w, x, y, z }, { w, x, y, z }, q.size(), [](const T* __restrict pw, const T* __restrict px, const T* __restrict py, const T* __restrict pz,
+				T* __restrict qw, T* __restrict qx, T* __restrict qy, T* __restrict qz)
+		{
+			for (size_t i = 0; i < batchSize; i++)
+			{
+				const T wi = pw[i], xi = px[i], yi = py[i], zi = pz[i];
+				T r = T(1) / std::sqrt(wi * wi + xi * xi + yi * yi + zi * zi);
+				qw[i] = wi * r; qx[i] = xi * r; qy[i] = yi * r; qz[i] = zi * r;
+			}
+		});
+	}
+
+	/**
+	 * Computes the spherical interpolations between the quaternions of @a a and @a b with the
+	 * ratios @a r (in [0, 1]) and writes them into @a out (which is resized, if necessary). Element
+	 * i is a[i].slerp(r[i], b[i]) and the special cases are treated the same way as there, but
+	 * without branches: the weights of both special cases and of the general case are computed
+	 * and the right ones selected, so the loop can be vectorized. Unlike Quaternion::slerp, it
+	 * computes in T instead of double.
+	 * @note acos and sin only vectorize with a vector math library, e.g. glibc's libmvec with
+	 * -ffast-math.
+	 */
+	template<class T>
+	void slerp(const QuaternionArray<T>& a, const QuaternionArray<T>& b, const T* r, QuaternionArray<T>& out)
+	{
+		out.resize(a.size());
+		batchApply<T, 9, 4>({ a.w(), a.x(), a.y(), a.z(), b.w(), b.x(), b.y(), b.z(), r },
+				{ out.w(), out.x(), out.y(), out.z() }, a.size(),
+				[](const T* __restrict aw, const T* __restrict ax, const T* __restrict ay, const T* __restrict az,
+				const T* __restrict bw, const T* __restrict bx, const T* __restrict by, const T* __restrict bz,
+				const T* __restrict ri, T* __restrict qw, T* __restrict qx, T* __restrict qy, T* __restrict qz)
+		{
+			for (size_t i = 0; i < batchSize; i++)
+			{
+				const T cosTheta = aw[i] * bw[i] + ax[i] * bx[i] + ay[i] * by[i] + az[i] * bz[i];
+				const T theta = std::acos(cosTheta);
+				const T sinTheta = std::sqrt(T(1) - cosTheta * cosTheta);
+				const bool same = std::fabs(theta) < T(epsilon);
+				const bool opposite = std::fabs(sinTheta) < T(epsilon);
+				const T s = T(1) / (same || opposite ? T(1) : sinTheta);
+				T rA = std::sin((T(1) - ri[i]) * theta) * s;
+				T rB = std::sin(ri[i] * theta) * s;
+				rA = same ? T(1) : opposite ? T(0.5) : rA;
+				rB = same ? T(0) : opposite ? T(0.5) : rB;
+				qw[i] = aw[i] * rA + bw[i] * rB;
+				qx[i] = ax[i] * rA + bx[i] * rB;
+				qy[i] = ay[i] * rA + by[i] * rB;
+				qz[i] = az[i] * rA + bz[i] * rB;
+			}
+		});
+	}
+
+	/**
+	 * Converts the @a n quaternions w[i] + x[i]i + y[i]j + z[i]k into rotation matrices in
+	 * structure-of-arrays layout: element j of the column major matrix i is m[j][i].
+	 */
+	template<class T>
+	void rotMatrices(const T* w, const T* x, const T* y, const T* z, T* const (&m)[9], size_t n)
+	{
+		batchApply<T, 4, 9>({ w, x, y, z }, m, n,
+				[](const T* __restrict pw, const T* __restrict px, const T* __restrict py, const T* __restrict pz,
+				T* __restrict d0, T* __restrict d1, T* __restrict d2, T* __restrict d3, T* __restrict d4,
+				T* __restrict d5, T* __restrict d6, T* __restrict d7, T* __restrict d8)
+		{
+			for (size_t i = 0; i < batchSize; i++)
+			{
+				const T xi = px[i], yi = py[i], zi = pz[i], wi = pw[i];
+				const T xx = xi * xi, xy = xi * yi, xz = xi * zi, xw = xi * wi;
+				const T yy = yi * yi, yz = yi * zi, yw = yi * wi;
+				const T zz = zi * zi, zw = zi * wi;
+				d0[i] = 1 - 2 * (yy + zz);
+				d3[i] = 2 * (xy - zw);
+				d6[i] = 2 * (xz + yw);
+				d1[i] = 2 * (xy + zw);
+				d4[i] = 1 - 2 * (xx + zz);
+				d7[i] = 2 * (yz - xw);
+				d2[i] = 2 * (xz - yw);
+				d5[i] = 2 * (yz + xw);
+				d8[i] = 1 - 2 * (xx + yy);
+			}
+		});
+	}
+
+	/**
+	 * Converts the quaternions of @a q into rotation matrices, i.e. out[i] = q[i].rotMatrix().
+	 * The matrices are computed blockwise in structure-of-arrays layout and then interleaved.
+	 * @param out Array with room for q.size() matrices.
+	 */
+	template<class T>
+	void rotMatrices(const QuaternionArray<T>& q, Matrix3<T>* out)
+	{
+		T m[9][batchSize];
+		T* const pm[9] = { m[0], m[1], m[2], m[3], m[4], m[5], m[6], m[7], m[8] };
+		for (size_t i = 0; i < q.size(); i += batchSize)
+		{
+			const size_t nb = std::min(batchSize, q.size() - i);
+			rotMatrices(q.w() + i, q.x() + i, q.y() + i, q.z() + i, pm, nb);
+			for (size_t k = 0; k < nb; k++)
+				for (size_t j = 0; j < 9; j++)
+					out[i + k].data[j] = m[j][k];
+		}
+	}
+
+	//--------------------------[ bounding volume hierarchy ]------------------------------
+
+	/**
+	 * Bounding volume hierarchy (BVH) over a set of axes-aligned bounding-boxes. It answers
+	 * which of the boxes contain a point, overlap a box or are hit first by a ray in about
+	 * O(log N) instead of testing all N boxes.
+	 *
+	 * The tree is built top-down with the binned surface area heuristic (SAH): at each node, the
+	 * box centers are sorted into bins along each axis and the split between two bins is chosen
+	 * that minimizes the expected cost of a query (sum over both children of surface area times
+	 * number of boxes). Subtrees are built in parallel on several threads. The nodes are stored
+	 * flattened in depth-first order in one array, so the left child of a node directly follows
+	 * it in memory and a node takes 32 bytes for float. The boxes themselves are stored in leaf
+	 * order, so each leaf tests a contiguous range.
+	 *
+	 * If the objects move, refit() updates the node boxes for the new object boxes in O(N)
+	 * without changing the structure of the tree. This keeps queries correct but they become
+	 * slower when the objects have moved far, in which case the tree should be rebuilt.
+	 * @code
+	 * std::vector<Aabb3f> boxes = ...;
+	 * Bvh3f bvh(boxes, 4);
+	 * std::vector<int> hits = bvh.findIntersecting(Aabb3f(0,0,0, 1,1,1));
+	 * @endcode
+	 */
+	template<class T>
+	class Bvh3
+	{
+	public:
+		/**
+		 * Node of the flattened tree. For a leaf, count > 0 and the boxes with the leaf order
+		 * indices index ... index+count-1 belong to it. For an inner node, count == 0, the left
+		 * child is the next node in the array and index is the array index of the right child.
+		 */
+		struct Node
+		{
+			Aabb3<T> box;
+			int index;
+			int count;
+		};
+
+		/**
+		 * Creates an empty hierarchy.
+		 */
+		Bvh3()
+		{}
+
+		/**
+		 * Creates the hierarchy for @a boxes.
+		 * @see build()
+		 */
+		Bvh3(const std::vector<Aabb3<T> >& boxes, int numThreads = 1, int maxLeafSize = 4)
+		{
+			build(boxes, numThreads, maxLeafSize);
+		}
+
+		/**
+		 * Builds the hierarchy for the (valid) @a boxes, using up to @a numThreads threads.
+		 * @param maxLeafSize Leaves with up to this number of boxes are not split, even if the SAH
+		 * would suggest it.
+		 */
+		void build(const std::vector<Aabb3<T> >& boxes, int numThreads = 1, int maxLeafSize = 4)
+		{
+			assert(numThreads >= 1 && maxLeafSize >= 1);
+			size_t n = boxes.size();
+			nodes.clear();
+			leafBoxes.clear();
+			order.resize(n);
+			if (n == 0)
+				return;
+			refs.resize(n);
+			for (size_t i = 0; i < n; i++)
+			{
+				refs[i].box = boxes[i];
+				refs[i].center = boxes[i].center();
+				refs[i].index = int(i);
+			}
+
+			// A subtree over m boxes has at most 2m-1 nodes. Each subtree is built into its own
+			// region of that size in a sparse array, so the threads never write to the same
+			// nodes. The sparse tree is then compacted into depth-first order.
+			leafSize = maxLeafSize;
+			std::vector<Node> sparse(2 * n - 1);
+			buildNode(sparse, 0, 0, int(n), 0, numThreads);
+			nodes.reserve(sparse.size());
+			compact(sparse);
+
+			leafBoxes.resize(n);
+			for (size_t i = 0; i < n; i++)
+			{
+				leafBoxes[i] = refs[i].box;
+				order[i] = refs[i].index;
+			}
+			refs.clear();
+			refs.shrink_to_fit();
+		}
+
+		/**
+		 * Updates the bounding-boxes of the nodes for new @a boxes of the same objects (element i
+		 * of @a boxes must belong to the same object as element i of the boxes that the hierarchy
+		 * was built for). The tree structure is kept.
+		 */
+		void refit(const std::vector<Aabb3<T> >& boxes)
+		{
+			assert(boxes.size() == order.size());
+			for (size_t i = 0; i < order.size(); i++)
+				leafBoxes[i] = boxes[order[i]];
+
+			// Children come after their parents in the array, so a backward pass sees the
+			// children of each node before the node itself:
+			for (size_t i = nodes.size(); i-- > 0; )
+			{
+				Node& nd = nodes[i];
+				if (nd.count > 0)
+					nd.box = boundsOf(&leafBoxes[nd.index], nd.count);
+				else
+					nd.box = unite(nodes[i + 1].box, nodes[nd.index].box);
+			}
+		}
+
+		/**
+		 * Calls @a f(i) for the index i of each box that contains the point @a p.
+		 */
+		template<class F>
+		void forEachContaining(const Vector3<T>& p, F f) const
+		{
+			traverse([&](const Aabb3<T>& b) { return contains(b, p); }, f);
+		}
+
+		/**
+		 * Calls @a f(i) for the index i of each box that overlaps (even partially) with @a box.
+		 */
+		template<class F>
+		void forEachIntersecting(const Aabb3<T>& box, F f) const
+		{
+			traverse([&](const Aabb3<T>& b) { return overlaps(b, box); }, f);
+		}
+
+		/**
+		 * Gets the indices of all boxes that contain the point @a p.
+		 */
+		std::vector<int> findContaining(const Vector3<T>& p) const
+		{
+			std::vector<int> r;
+			forEachContaining(p, [&](int i) { r.push_back(i); });
+			return r;
+		}
+
+		/**
+		 * Gets the indices of all boxes that overlap with @a box.
+		 */
+		std::vector<int> findIntersecting(const Aabb3<T>& box) const
+		{
+			std::vector<int> r;
+			forEachIntersecting(box, [&](int i) { r.push_back(i); });
+			return r;
+		}
+
+		/**
+		 * Finds the box that is hit first by the ray @a origin + t * @a dir with 0 <= t <= @a tMax.
+		 * Boxes that contain the origin are hit at t = 0.
+		 * @param tHit Receives the ray parameter t of the hit.
+		 * @return Index of the box or -1, if no box is hit.
+		 */
+		int intersectRay(const Vector3<T>& origin, const Vector3<T>& dir, T& tHit,
+				T tMax = std::numeric_limits<T>::max()) const
+		{
+			int hit = -1;
+			tHit = tMax;
+			if (nodes.empty())
+				return hit;
+			const Vector3<T> inv(T(1) / dir.x, T(1) / dir.y, T(1) / dir.z);
+			int stack[maxDepth + 1];
+			T stackT[maxDepth + 1];                 // entry parameters of the stacked nodes
+			int top = 0;
+			int i = 0;
+			T t;
+			if (!slabs(nodes[0].box, origin, inv, tHit, t))
+				return hit;
+			while (true)
+			{
+				const Node& nd = nodes[i];
+				if (nd.count > 0)
+				{
+					for (int k = nd.index; k < nd.index + nd.count; k++)
+					{
+						if (slabs(leafBoxes[k], origin, inv, tHit, t) && (t < tHit || hit == -1))
+						{
+							tHit = t;
+							hit = order[k];
+						}
+					}
+				}
+				else
+				{
+					// Visit the nearer child first, so more of the farther one can be culled:
+					T tl, tr;
+					int l = i + 1, r = nd.index;
+					bool hl = slabs(nodes[l].box, origin, inv, tHit, tl);
+					bool hr = slabs(nodes[r].box, origin, inv, tHit, tr);
+					if (hl && hr)
+					{
+						if (tr < tl)
+						{
+							std::swap(l, r);
+							std::swap(tl, tr);
+						}
+						stackT[top] = tr;
+						stack[top++] = r;
+						i = l;
+						continue;
+					}
+					if (hl || hr)
+					{
+						i = hl ? l : r;
+						continue;
+					}
+				}
+				do                                      // skip nodes behind the current hit
+				{
+					if (top == 0)
+						return hit;
+					i = stack[--top];
+				} while (stackT[top] > tHit);
+			}
+		}
+
+		/**
+		 * Gets the number of boxes.
+		 */
+		size_t getNumBoxes() const { return order.size(); }
+
+		/**
+		 * Gets the nodes of the tree. The first one is the root.
+		 */
+		const std::vector<Node>& getNodes() const { return nodes; }
+
+	protected:
+		/// Maximum depth of the tree, nodes below become leaves regardless of their size.
+		static const int maxDepth = 64;
+
+		/// Number of bins per axis for the SAH.
+		static const int numBins = 16;
+
+		static T halfArea(const Aabb3<T>& b)
+		{
+			Vector3<T> d = b.max - b.min;
+			return d.x * d.y + d.y * d.z + d.z * d.x;
+		}
+
+		static Aabb3<T> unite(const Aabb3<T>& a, const Aabb3<T>& b)
+		{
+			Aabb3<T> r;
+			r.min = Vector3<T>(std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z));
+			r.max = Vector3<T>(std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z));
+			return r;
+		}
+
+		static Aabb3<T> boundsOf(const Aabb3<T>* b, int n)
+		{
+			Aabb3<T> r = b[0];
+			for (int i = 1; i < n; i++)
+				r = unite(r, b[i]);
+			return r;
+		}
+
+		static bool contains(const Aabb3<T>& b, const Vector3<T>& p)
+		{
+			return b.min.x <= p.x && p.x <= b.max.x && b.min.y <= p.y && p.y <= b.max.y
+				&& b.min.z <= p.z && p.z <= b.max.z;
+		}
+
+		static bool overlaps(const Aabb3<T>& a, const Aabb3<T>& b)
+		{
+			return a.min.x <= b.max.x && b.min.x <= a.max.x && a.min.y <= b.max.y && b.min.y <= a.max.y
+				&& a.min.z <= b.max.z && b.min.z <= a.max.z;
+		}
+
+		/**
+		 * Slab test of the ray with origin @a o and inverse direction @a inv against box @a b.
+		 * On a hit in [0, tMax], it returns true and the entry parameter in @a tEnter.
+		 */
+		static bool slabs(const Aabb3<T>& b, const Vector3<T>& o, const Vector3<T>& inv, T tMax, T& tEnter)
+		{
+			T tMin = -std::numeric_limits<T>::infinity(), tFar = std::numeric_limits<T>::infinity();
+			slab(b.min.x, b.max.x, o.x, inv.x, tMin, tFar);
+			slab(b.min.y, b.max.y, o.y, inv.y, tMin, tFar);
+			slab(b.min.z, b.max.z, o.z, inv.z, tMin, tFar);
+			tEnter = std::max(tMin, T(0));
+			return tEnter <= tFar && tEnter <= tMax;
+		}
+
+		/**
+		 * Narrows [tMin, tFar] to the parameters for which the ray lies between the planes at
+		 * @a lo and @a hi of one axis. A ray that is parallel to them (infinite @a inv) lies
+		 * between them for all or for no t. That case is tested directly, because 0 * inf = NaN
+		 * when the origin is on one of the planes.
+		 */
+		static void slab(T lo, T hi, T o, T inv, T& tMin, T& tFar)
+		{
+			if (std::isinf(inv))
+			{
+				if (o < lo || o > hi)
+					tFar = -std::numeric_limits<T>::infinity();
+				return;
+			}
+			const T t0 = (lo - o) * inv, t1 = (hi - o) * inv;
+			tMin = std::max(tMin, std::min(t0, t1));
+			tFar = std::min(tFar, std::max(t0, t1));
+		}
+
+		/**
+		 * Visits all leaf boxes for which @a test is true (inner nodes are entered if @a test is
+		 * true for their box) and calls @a f with their indices.
+		 */
+		template<class Test, class F>
+		void traverse(Test test, F f) const
+		{
+			if (nodes.empty() || !test(nodes[0].box))
+				return;
+			int stack[maxDepth + 1];
+			int top = 0;
+			int i = 0;
+			while (true)
+			{
+				const Node& nd = nodes[i];
+				if (nd.count > 0)
+				{
+					for (int k = nd.index; k < nd.index + nd.count; k++)
+						if (test(leafBoxes[k]))
+							f(order[k]);
+				}
+				else
+				{
+					int l = i + 1, r = nd.index;
+					bool hl = test(nodes[l].box), hr = test(nodes[r].box);
+					if (hl && hr)
+						stack[top++] = r;
+					if (hl || hr)
+					{
+						i = hl ? l : r;
+						continue;
+					}
+				}
+				if (top == 0)
+					break;
+				i = stack[--top];
+			}
+		}
+
+		/**
+		 * Builds the subtree over refs[begin ... end-1] into @a sparse, starting at node @a k.
+		 */
+		void buildNode(std::vector<Node>& sparse, int k, int begin, int end, int depth, int numThreads)
+		{
+			Node& nd = sparse[k];
+			int n = end - begin;
+			Aabb3<T> cb(refs[begin].center);      // bounds of the centers
+			nd.box = refs[begin].box;
+			for (int i = begin + 1; i < end; i++)
+			{
+				nd.box = unite(nd.box, refs[i].box);
+				cb = unite(cb, Aabb3<T>(refs[i].center));
+			}
+			nd.index = begin;
+			nd.count = n;
+			if (n <= leafSize || depth >= maxDepth)
+				return;
+
+			// Sort the boxes into the bins of all 3 axes in one pass:
+			T lo[3], scale[3];
+			for (int a = 0; a < 3; a++)
+			{
+				T ext = cb.max[a] - cb.min[a];
+				lo[a] = cb.min[a];
+				scale[a] = ext > T(0) ? numBins / ext : T(0);
+			}
+			Aabb3<T> binBox[3][numBins];
+			int binCount[3][numBins] = {};
+			for (int i = begin; i < end; i++)
+			{
+				for (int a = 0; a < 3; a++)
+				{
+					int b = binIndex(refs[i].center[a], lo[a], scale[a]);
+					binBox[a][b] = binCount[a][b]++ ? unite(binBox[a][b], refs[i].box) : refs[i].box;
+				}
+			}
+
+			// Find the split with the lowest SAH cost over all axes and bins:
+			int bestAxis = -1, bestBin = 0;
+			T bestCost = halfArea(nd.box) * n;    // cost of not splitting
+			for (int a = 0; a < 3; a++)
+			{
+				if (scale[a] == T(0))
+					continue;
+				T rightArea[numBins];
+				int rightCount[numBins];
+				Aabb3<T> acc;
+				int cnt = 0;
+				for (int b = numBins - 1; b > 0; b--)
+				{
+					if (binCount[a][b])
+						acc = cnt ? unite(acc, binBox[a][b]) : binBox[a][b];
+					cnt += binCount[a][b];
+					rightArea[b] = cnt ? halfArea(acc) : T(0);
+					rightCount[b] = cnt;
+				}
+				cnt = 0;
+				for (int b = 0; b < numBins - 1; b++)
+				{
+					if (binCount[a][b])
+						acc = cnt ? unite(acc, binBox[a][b]) : binBox[a][b];
+					cnt += binCount[a][b];
+					if (cnt == 0 || rightCount[b + 1] == 0)
+						continue;
+					T cost = halfArea(acc) * cnt + rightArea[b + 1] * rightCount[b + 1];
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestAxis = a;
+						bestBin = b;
+					}
+				}
+			}
+
+			int mid;
+			if (bestAxis >= 0)
+			{
+				int a = bestAxis;
+				mid = int(std::partition(refs.begin() + begin, refs.begin() + end, [&](const Ref& r)
+				{ return binIndex(r.center[a], lo[a], scale[a]) <= bestBin; }) - refs.begin());
+			}
+			else if (n > 4 * leafSize)
+				mid = begin + n / 2;     // too large for a leaf, e.g. many boxes with equal centers
+			else
+				return;
+
+			nd.count = 0;
+			int l = k + 1, r = k + 2 * (mid - begin);  // left subtree needs 2 * (mid-begin) - 1 nodes
+			nd.index = r;
+			if (numThreads > 1 && n > 4096)
+			{
+				int nl = numThreads / 2;
+				std::thread t([&]() { buildNode(sparse, l, begin, mid, depth + 1, nl); });
+				buildNode(sparse, r, mid, end, depth + 1, numThreads - nl);
+				t.join();
+			}
+			else
+			{
+				buildNode(sparse, l, begin, mid, depth + 1, 1);
+				buildNode(sparse, r, mid, end, depth + 1, 1);
+			}
+		}
+
+		static int binIndex(T c, T lo, T scale)
+		{
+			return std::min(int((c - lo) * scale), numBins - 1);
+		}
+
+		/**
+		 * Copies the nodes of the sparse tree into the dense array in depth-first order.
+		 */
+		void compact(const std::vector<Node>& sparse)
+		{
+			// Stack of (sparse index, dense index of the parent whose right child it is):
+			std::vector<std::pair<int, int> > stack;
+			stack.push_back(std::make_pair(0, -1));
+			while (!stack.empty())
+			{
+				int k = stack.back().first, parent = stack.back().second;
+				stack.pop_back();
+				while (true)
+				{
+					if (parent >= 0)
+						nodes[parent].index = int(nodes.size());
+					nodes.push_back(sparse[k]);
+					if (sparse[k].count > 0)
+						break;
+					stack.push_back(std::make_pair(sparse[k].index, int(nodes.size()) - 1));
+					k = k + 1;
+					parent = -1;
+				}
+			}
+		}
+
+		/// Nodes in depth-first order, the root is the first.
+		std::vector<Node> nodes;
+
+		/// Boxes in leaf order and their indices in the original array.
+		std::vector<Aabb3<T> > leafBoxes;
+		std::vector<int> order;
+
+		/// A box, its center and index, only used during the build.
+		struct Ref
+		{
+			Aabb3<T> box;
+			Vector3<T> center;
+			int index;
+		};
+		std::vector<Ref> refs;
+
+		int leafSize = 4;
+	};
+
+	typedef Bvh3<float> Bvh3f;
+	typedef Bvh3<double> Bvh3d;
+
 #ifdef VMATH_NAMESPACE
 }
 #endif //VMATH_NAMESPACE
@@ -1,5 +1,97 @@
 ﻿import rsPy as rs
 import numpy as np
+import time
+
+def checkArrayKernels():
+    # The kernels must give the same results as numpy for all supported dtypes and for strided
+    # views and must reject arrays they can't process in place:
+    ok = True
+    for dt in [np.float32, np.float64, np.complex64, np.complex128]:
+        a = (np.arange(24) + 1j*(np.arange(24) % 5)).astype(dt) if np.iscomplexobj(np.zeros(1, dt)) \
+            else np.arange(24).astype(dt)
+        a = a.reshape(2, 3, 4)
+        for v in [a, a.T, a[:, ::2, 1:3], a[::-1]]:
+            ok &= np.isclose(rs.eucnorm(v), np.linalg.norm(v.ravel()), rtol=1e-6)
+        b = a.copy()
+        rs.scale(b[:, ::2, 1:3], 2)                # scales only the elements of the view
+        c = a.copy()
+        c[:, ::2, 1:3] *= 2
+        ok &= np.array_equal(b, c)
+    for bad in [np.arange(4), np.arange(4, dtype='>f8')]:  # int and byte-swapped double
+        try:
+            rs.eucnorm(bad); ok = False
+        except TypeError:
+            pass
+    ro = np.ones(4); ro.flags.writeable = False
+    try:
+        rs.scale(ro, 2); ok = False
+    except ValueError:
+        pass
+    return ok
+
+def benchmarkArrayKernels(n = 10000000):
+    # Compares the kernel layer to the naive implementations on n-element arrays. The naive 
+    # eucnorm extracts each element via Python-level indexing, so it's measured on a smaller 
+    # array and extrapolated:
+    def timeIt(f):
+        t = time.perf_counter(); f(); return time.perf_counter() - t
+    a = np.random.rand(n)
+    t1 = timeIt(lambda: rs.scale_naive(a, 1.0))
+    t2 = timeIt(lambda: rs.scale(a, 1.0))
+    print("scale:   naive %.3f s, kernel %.3f s, speedup %.1f" % (t1, t2, t1/t2))
+    m  = n // 100
+    t1 = timeIt(lambda: rs.eucnorm_naive(a[:m])) * (n/m)
+    t2 = timeIt(lambda: rs.eucnorm(a))
+    print("eucnorm: naive %.3f s (extrapolated), kernel %.3f s, speedup %.0f" % (t1, t2, t1/t2))
+    for dt in [np.float32, np.complex128]:
+        b = a.astype(dt)
+        print("eucnorm %s: kernel %.3f s, numpy %.3f s" % (np.dtype(dt).name,
+            timeIt(lambda: rs.eucnorm(b)), timeIt(lambda: np.linalg.norm(b))))
+    print("eucnorm a[::2]: kernel %.3f s (no copy)" % timeIt(lambda: rs.eucnorm(a[::2])))
+
+def checkUFuncs():
+    # The math functions are ufuncs now, so they must accept scalars and arrays of any shape and 
+    # dtype, broadcast their arguments, write into out= arrays and preserve float32:
+    ok = True
+    x = np.linspace(-4, 4, 24).reshape(2, 3, 4)
+    for v in [x, x.T, x[:, ::2, 1:3], x.astype(np.float32), np.arange(5), x + 0.5j*x]:
+        ok &= np.allclose(rs.sin(v), np.sin(v), rtol=1e-6, atol=1e-6)
+        ok &= np.allclose(rs.exp(v), np.exp(v), rtol=1e-6)
+    ok &= rs.sin(x.astype(np.float32)).dtype == np.float32
+    ok &= rs.exp(x + 0j).dtype == np.complex128
+    ok &= np.isclose(rs.sin(0.5), np.sin(0.5))
+    y = np.empty_like(x)
+    rs.sin(x, out=y)
+    ok &= np.array_equal(y, rs.sin(x))
+    u = np.linspace(0, 3, 7)
+    k = np.array([0.0, 0.5, 0.9])
+    cn = rs.ellipj_cn(u[:, None], k[None, :])  # broadcasts to shape (7, 3)
+    ok &= cn.shape == (7, 3)
+    ok &= np.allclose(cn[:, 0], np.cos(u))     # cn(u, 0) = cos(u)
+    ok &= np.allclose(cn[:, 2], [rs.ellipj_cn_scalar(ui, 0.9) for ui in u])
+    ok &= np.allclose(rs.sin(u), [rs.sin_scalar(ui) for ui in u])
+    ok &= np.allclose(rs.exp(u + 1j), [rs.exp_scalar(ui + 1j) for ui in u])
+    return bool(ok)
+
+def benchmarkUFuncs(n = 10000000):
+    # Compares the ufuncs to numpy and to one Python-level call of the scalar binding per element 
+    # (which is what we had to do before - measured on a smaller array and extrapolated):
+    def timeIt(f):
+        t = time.perf_counter(); f(); return time.perf_counter() - t
+    a = np.random.rand(n)
+    m = n // 100
+    t1 = timeIt(lambda: [rs.sin_scalar(v) for v in a[:m]]) * (n/m)
+    t2 = timeIt(lambda: rs.sin(a))
+    t3 = timeIt(lambda: np.sin(a))
+    print("sin: scalar per element %.3f s (extrapolated), ufunc %.3f s, numpy %.3f s" 
+        % (t1, t2, t3))
+    b = a.astype(np.float32)
+    print("sin float32: ufunc %.3f s, numpy %.3f s" % (timeIt(lambda: rs.sin(b)), 
+        timeIt(lambda: np.sin(b))))
+    t1 = timeIt(lambda: [rs.ellipj_cn_scalar(v, 0.9) for v in a[:m]]) * (n/m)
+    t2 = timeIt(lambda: rs.ellipj_cn(a, 0.9))
+    print("ellipj_cn(a, 0.9): scalar per element %.3f s (extrapolated), ufunc %.3f s" 
+        % (t1, t2))
 
 if __name__ == "__main__":
     hi = rs.hello("Germany");
@@ -17,6 +109,11 @@ if __name__ == "__main__":
     rs.scale(a, 2)                      # scale a by factor 2
     print(norm)
 
+    print("array kernels ok:", checkArrayKernels())
+    benchmarkArrayKernels()
+    print("ufuncs ok:", checkUFuncs())
+    benchmarkUFuncs()
+
     #dummy = 0                          # to allow a breakpoint here
 
 
@@ -1,4 +1,6 @@
 ﻿#include "Tools.cpp"  // this includes rapt and rosic
+#define VMATH_NAMESPACE vmath
+#include "../../../Libraries/Snippets/vmath/vmath.h"
 
 //-------------------------------------------------------------------------------------------------
 // move some of this code to rapt:
@@ -2384,22 +2386,19 @@ bool testManifoldPolar()
   using Tens = rsMultiArray<double>;
 
   // Forward and inverse trafo between polar and cartesian coodinates:
+  rsCoordinateConverter<double> conv;
   std::function<void(const std::vector<double>&, std::vector<double>&)> u2x, x2u, u2v;
   u2x = [=](const Vec& u, Vec& x)
   {
     rsAssert(u.size() == 2);
     rsAssert(x.size() == 2);
-    double r = u[0], phi = u[1]; // radius, phi
-    x[0] = r * cos(phi);  // x 
-    x[1] = r * sin(phi);  // y
+    conv.polarToCartesian(&u[0], &u[1], &x[0], &x[1], 1);   // x = r*cos(phi), y = r*sin(phi)
   };
   x2u = [=](const Vec& X, Vec& u)
   {
     rsAssert(u.size() == 2);
     rsAssert(X.size() == 2);
-    double x = X[0], y = X[1];
-    u[0] = sqrt(x*x + y*y);
-    u[1] = atan2(y, x);
+    conv.cartesianToPolar(&X[0], &X[1], &u[0], &u[1], 1);   // r, phi = atan2(y, x)
   };
 
   // Create and set up manifold:
@@ -2758,26 +2757,21 @@ bool testManifoldSphere()
   using Vec = std::vector<double>;
   using Mat = rsMatrix<double>;
 
-  // Forward and backward trafo:
+  // Forward and backward trafo. The converter uses the same convention as (1), Eq. 12, i.e. 
+  // x = r*sin(theta)*cos(phi), y = r*sin(theta)*sin(phi), z = r*cos(theta):
+  rsCoordinateConverter<double> conv;
   std::function<void(const std::vector<double>&, std::vector<double>&)> u2x, x2u, u2v;
   u2x = [=](const Vec& u, Vec& x)
   {
     rsAssert(u.size() == 3);
     rsAssert(x.size() == 3);
-    double r = u[0], theta = u[1], phi = u[2]; // radius, theta, phi
-    x[0] = r * sin(theta) * cos(phi);  // x   (1), Eq. 12
-    x[1] = r * sin(theta) * sin(phi);  // y
-    x[2] = r * cos(theta);             // z
+    conv.sphericalToCartesian(&u[0], &u[1], &u[2], &x[0], &x[1], &x[2], 1);
   };
   x2u = [=](const Vec& X, Vec& u)
   {
     rsAssert(u.size() == 3);
     rsAssert(X.size() == 3);
-    double x = X[0], y = X[1], z = X[2];
-    double r     = sqrt(x*x + y*y + z*z);
-    double theta = acos(z/r);
-    double phi   = atan2(y,x);
-    u[0] = r; u[1] = theta; u[2] = phi;
+    conv.cartesianToSpherical(&X[0], &X[1], &X[2], &u[0], &u[1], &u[2], 1);
   };
 
 
@@ -2847,10 +2841,39 @@ bool testManifoldSphere()
   result &= rsIsCloseTo(c323, C(2,1,2), tol);  // 352
   result &= rsIsCloseTo(c323, C(2,2,1), tol);  // symmetry
 
-
-
-  // test Riemmann tensor:
-  // ...
+  // Now the same with exact derivatives of the coordinate map computed by automatic 
+  // differentiation. The numerical version above has errors of around 5.e-7 (for c323), the AD 
+  // version gets it right up to roundoff, so we can use a much tighter tolerance:
+  using VecAD = rsManifold<double>::VecAD;
+  using Dual  = rsManifold<double>::Dual3;
+  mf.setCurvilinearToCartesianAD([=](const VecAD& u, VecAD& x)
+  {
+    Dual r = u[0], theta = u[1], phi = u[2];
+    x[0] = r * rsSin(theta) * rsCos(phi);
+    x[1] = r * rsSin(theta) * rsSin(phi);
+    x[2] = r * rsCos(theta);
+  });
+  C = mf.getChristoffelSymbols2ndKind(u);
+  double tolAD = 1.e-13;
+  result &= rsIsCloseTo(c122, C(0,1,1), tolAD);
+  result &= rsIsCloseTo(c133, C(0,2,2), tolAD);
+  result &= rsIsCloseTo(c212, C(1,0,1), tolAD);
+  result &= rsIsCloseTo(c212, C(1,1,0), tolAD);
+  result &= rsIsCloseTo(c233, C(1,2,2), tolAD);
+  result &= rsIsCloseTo(c313, C(2,0,2), tolAD);
+  result &= rsIsCloseTo(c313, C(2,2,0), tolAD);
+  result &= rsIsCloseTo(c323, C(2,1,2), tolAD);
+  result &= rsIsCloseTo(c323, C(2,2,1), tolAD);
+
+  // test Riemmann tensor - spherical coordinates describe flat space, so it should be zero. With 
+  // numerical derivatives, the entries are up to 1.e-6 off, with AD, they are around 1.e-16:
+  rsMultiArray<double> R = mf.getRiemannTensor2ndKind(u);
+  for(int i = 0; i < 3; i++)
+    for(int j = 0; j < 3; j++)
+      for(int k = 0; k < 3; k++)
+        for(int l = 0; l < 3; l++)
+          result &= rsIsCloseTo(R(i,j,k,l), 0.0, tolAD);
+  mf.setCurvilinearToCartesianAD(nullptr);  // switch back to numerical derivatives
 
 
 
@@ -3223,6 +3246,32 @@ bool testManifoldEarth()
   // R has wrong sign - but absolute values look good - but only when the radius is of order 1
   // smells like numerical approximation errors
 
+  // Compute it again with exact derivatives via automatic differentiation. With numerical 
+  // derivatives, the relative error of the absolute value is around 1.e-3, with AD it's around 
+  // 1.e-15. The timings of both versions are printed below. The sign is still wrong, so that's not
+  // a numerical problem but must be a matter of convention (or a bug) in the formulas:
+  using VecAD = rsManifold<double>::VecAD;
+  using Dual  = rsManifold<double>::Dual3;
+  mf.setCurvilinearToCartesianAD([=](const VecAD& u, VecAD& x)
+  {
+    Dual phi = (PI/180) * u[0];
+    Dual lam = (PI/180) * u[1];
+    x[0] = radius * rsCos(phi) * rsCos(lam);
+    x[1] = radius * rsCos(phi) * rsSin(lam);
+    x[2] = radius * rsSin(phi);
+  });
+  double R_AD = mf.getRicciScalar(u);
+  result &= rsIsCloseTo(rsAbs(R_AD), Rt, 1.e-13);
+  auto t0 = std::chrono::high_resolution_clock::now();
+  for(int n = 0; n < 1000; n++) R_AD = mf.getRicciScalar(u);
+  auto t1 = std::chrono::high_resolution_clock::now();
+  mf.setCurvilinearToCartesianAD(nullptr);
+  for(int n = 0; n < 1000; n++) R = mf.getRicciScalar(u);
+  auto t2 = std::chrono::high_resolution_clock::now();
+  std::cout << "Ricci scalar, microseconds per call, AD: "
+    << std::chrono::duration<double, std::micro>(t1 - t0).count() / 1000 << ", numerical: "
+    << std::chrono::duration<double, std::micro>(t2 - t1).count() / 1000 << "\n";
+
   // from here, it gets wrong:
   Vec berlin  = Vec({52.52,     13.405});  // a contravariant position (of Berlin)
   Vec phoenix = Vec({33.4484, -112.0740}); // Phoenix, Arizona
@@ -3308,6 +3357,415 @@ bool testManifoldEarth()
 // more tensors defined (schouten, weyl, etc.)
 // http://www2.math.uu.se/~svante/papers/sjN15.pdf
 
+bool testManifoldBatch()
+{
+  // Evaluates metric, Christoffel symbols and Ricci curvature on a grid of coordinates on a
+  // sphere using the batch API with multiple threads, compares the results to the single-point
+  // functions and measures the time taken for different numbers of threads.
+
+  bool result = true;
+
+  using Vec = std::vector<double>;
+  using Mat = rsMatrix<double>;
+  using Tens = rsMultiArray<double>;
+
+  double radius = 3.5;
+  int N = 2, M = 3;
+  rsManifold<double> mf(N, M);
+  mf.setCurvilinearToCartesian([=](const Vec& u, Vec& x)
+  {
+    double phi = (PI/180) * u[0];        // latitude
+    double lam = (PI/180) * u[1];        // longitude
+    x[0] = radius * cos(phi) * cos(lam);
+    x[1] = radius * cos(phi) * sin(lam);
+    x[2] = radius * sin(phi);
+  });
+  mf.setCartesianToCurvilinear([=](const Vec& X, Vec& u)
+  {
+    double ri = 1 / sqrt(X[0]*X[0] + X[1]*X[1] + X[2]*X[2]);
+    u[0] = (180/PI) * asin(ri * X[2]);
+    u[1] = (180/PI) * atan2(X[1], X[0]);
+  });
+  mf.setApproximationStepSize(1.e-3);
+
+  // create the grid, avoiding the poles and the longitude wrap-around:
+  int numLat = 512, numLon = 512;
+  Vec lat(numLat), lon(numLon);
+  rsArrayTools::fillWithRangeLinear(&lat[0], numLat, -80.0,  80.0);
+  rsArrayTools::fillWithRangeLinear(&lon[0], numLon, -170.0, 170.0);
+  int numPoints = numLat * numLon;
+  Vec g(numPoints*N*N), G(numPoints*N*N*N), r(numPoints*N*N), R(numPoints);
+
+  // evaluate with 1,2,4,8 threads and measure the time:
+  double tol = 1.e-3;
+  Vec R1;
+  for(int numThreads = 1; numThreads <= 8; numThreads *= 2)
+  {
+    auto t0 = std::chrono::high_resolution_clock::now();
+    mf.evaluateFieldsOnGrid(&lat[0], numLat, &lon[0], numLon, &g[0], &G[0], &r[0], &R[0],
+      numThreads);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    std::cout << numThreads << " threads: " << ms << " ms\n";
+    if(numThreads == 1)
+      R1 = R;
+    else
+      result &= R == R1;  // results must not depend on the number of threads
+  }
+
+  // compare to the single-point functions at some grid points:
+  for(int i = 0; i < numLat; i += 37) {
+    for(int j = 0; j < numLon; j += 41) {
+      int p = i*numLon + j;
+      Vec u({ lat[i], lon[j] });
+      Mat  gs = mf.getCovariantMetric(u);
+      Tens Gs = mf.getChristoffelSymbols2ndKind(u);
+      Mat  rs = mf.getRicciTensor1stKind(u);
+      for(int a = 0; a < N; a++) {
+        for(int b = 0; b < N; b++) {
+          result &= rsIsCloseTo(g[p*N*N + a*N + b], gs(a, b), tol);
+          result &= rsIsCloseTo(r[p*N*N + a*N + b], rs(a, b), tol);
+          for(int c = 0; c < N; c++)
+            result &= rsIsCloseTo(G[p*N*N*N + (a*N+b)*N + c], Gs(a, b, c), tol); }}
+      result &= rsIsCloseTo(rsAbs(R[p]), 2 / (radius*radius), tol); }}
+      // we compare absolute values because of the sign issue noted in testManifoldEarth
+
+  rsAssert(result == true);
+  return result;
+}
+
+bool testManifoldPacked()
+{
+  // Tests the packed storage of Christoffel symbols, Riemann and Ricci tensors. We use a 4-sphere
+  // embedded in 5D space - it has constant curvature, so we know the Riemann tensor analytically.
+
+  bool result = true;
+
+  using Vec  = std::vector<double>;
+  using Mat  = rsMatrix<double>;
+  using Tens = rsMultiArray<double>;
+  using TP   = rsTensorPacking;
+
+  // Check the component counts - the Bianchi identity removes one component for each set of 4 
+  // distinct indices:
+  for(int n = 1; n <= 6; n++) {
+    int numBianchi = n*(n-1)*(n-2)*(n-3)/24;
+    result &= TP::numRiemannComponents(n) - numBianchi == TP::numIndependentRiemannComponents(n); }
+
+  // The coordinate map for hyperspherical coordinates - as generic lambda, so we can use it for 
+  // regular and automatic differentiation:
+  int N = 4, M = 5;
+  double radius = 2.0;
+  auto u2x = [=](const auto& u, auto& x)
+  {
+    x[0] = radius * rsCos(u[0]);
+    x[1] = radius * rsSin(u[0]) * rsCos(u[1]);
+    x[2] = radius * rsSin(u[0]) * rsSin(u[1]) * rsCos(u[2]);
+    x[3] = radius * rsSin(u[0]) * rsSin(u[1]) * rsSin(u[2]) * rsCos(u[3]);
+    x[4] = radius * rsSin(u[0]) * rsSin(u[1]) * rsSin(u[2]) * rsSin(u[3]);
+  };
+  rsManifold<double> mf(N, M);
+  mf.setCurvilinearToCartesian(u2x);
+  mf.setCurvilinearToCartesianAD(u2x);
+  Vec u({ 0.7, 1.1, 1.9, 0.4 });
+
+  // Packed Christoffel symbols must match the full ones:
+  double tol = 1.e-12;
+  Tens G  = mf.getChristoffelSymbols2ndKind(u);
+  Vec  Gp = mf.getChristoffelSymbols2ndKindPacked(u);
+  int  S  = TP::numSymmetricPairs(N);
+  for(int k = 0; k < N; k++)
+    for(int i = 0; i < N; i++)
+      for(int j = 0; j < N; j++)
+        result &= rsIsCloseTo(G(k,i,j), Gp[k*S + TP::symmetricIndex(i, j, N)], tol);
+
+  // For a sphere, R_ijkl = (g_ik g_jl - g_il g_jk) / r^2. We also compare with the full Riemann 
+  // tensor of 2nd kind with lowered first index:
+  Mat  g  = mf.getCovariantMetric(u);
+  Vec  Rp = mf.getRiemannTensorPacked(u);
+  Tens R  = mf.unpackRiemannTensor(Rp);
+  Tens R2 = mf.getRiemannTensor2ndKind(u);
+  double k = 1 / (radius*radius);
+  for(int i = 0; i < N; i++)
+    for(int j = 0; j < N; j++)
+      for(int k2 = 0; k2 < N; k2++)
+        for(int l = 0; l < N; l++) {
+          double t = k * (g(i,k2)*g(j,l) - g(i,l)*g(j,k2));
+          double r = 0;
+          for(int m = 0; m < N; m++)
+            r += g(i,m) * R2(m,j,k2,l);
+          result &= rsIsCloseTo(R(i,j,k2,l), t, tol);
+          result &= rsIsCloseTo(R(i,j,k2,l), r, tol); }
+
+  // Ricci tensor and scalar. With our contraction convention (see getRicciTensor1stKind), we get 
+  // r_ij = -(N-1) g_ij / radius^2 and a Ricci scalar of -N(N-1) / radius^2:
+  Mat gu = mf.getContravariantMetric(u);
+  Vec rp = mf.getRicciTensorPacked(Rp, gu);
+  for(int i = 0; i < N; i++)
+    for(int j = 0; j < N; j++)
+      result &= rsIsCloseTo(rp[TP::symmetricIndex(i, j, N)], -(N-1) * k * g(i,j), tol);
+  result &= rsIsCloseTo(mf.getRicciScalarPacked(rp, gu), -N*(N-1) * k, tol);
+
+  // The same with numerical derivatives - we need a much larger tolerance:
+  mf.setCurvilinearToCartesianAD(nullptr);
+  mf.setApproximationStepSize(1.e-3);
+  Rp = mf.getRiemannTensorPacked(u);
+  R  = mf.unpackRiemannTensor(Rp);
+  for(int i = 0; i < N; i++)
+    for(int j = 0; j < N; j++)
+      for(int k2 = 0; k2 < N; k2++)
+        for(int l = 0; l < N; l++)
+          result &= rsIsCloseTo(R(i,j,k2,l), k * (g(i,k2)*g(j,l) - g(i,l)*g(j,k2)), 1.e-3);
+
+  // Compare the time for computing the full and packed Riemann tensor, first with numerical, then
+  // with automatic differentiation:
+  auto timeRiemann = [&]()
+  {
+    int numCalls = 100;
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for(int n = 0; n < numCalls; n++) R2 = mf.getRiemannTensor2ndKind(u);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for(int n = 0; n < numCalls; n++) Rp = mf.getRiemannTensorPacked(u);
+    auto t2 = std::chrono::high_resolution_clock::now();
+    std::cout << "Riemann tensor for N = 4, microseconds per call, full: "
+      << std::chrono::duration<double, std::micro>(t1 - t0).count() / numCalls << ", packed: "
+      << std::chrono::duration<double, std::micro>(t2 - t1).count() / numCalls << "\n";
+  };
+  timeRiemann();                         // numerical derivatives
+  mf.setCurvilinearToCartesianAD(u2x);
+  timeRiemann();                         // automatic differentiation
+  // With AD, the evaluations of the coordinate map dominate the cost, so the savings in the 
+  // tensor arithmetic don't show up much. They become more relevant for larger N.
+
+  rsAssert(result == true);
+  return result;
+}
+
+bool testManifoldFixed()
+{
+  // Compares the fixed-dimension rsFixedManifold to the dynamic rsManifold in terms of results
+  // and speed. We use spherical coordinates in 3D space.
+
+  bool result = true;
+
+  using Vec  = std::vector<double>;
+  using Arr3 = std::array<double, 3>;
+
+  // The coordinate maps for the dynamic and fixed version:
+  auto u2xDyn = [](const Vec& u, Vec& x)
+  {
+    x[0] = u[0] * sin(u[1]) * cos(u[2]);
+    x[1] = u[0] * sin(u[1]) * sin(u[2]);
+    x[2] = u[0] * cos(u[1]);
+  };
+  auto u2xFix = [](const Arr3& u, Arr3& x)
+  {
+    x[0] = u[0] * sin(u[1]) * cos(u[2]);
+    x[1] = u[0] * sin(u[1]) * sin(u[2]);
+    x[2] = u[0] * cos(u[1]);
+  };
+  double h = pow(2.0, -10);
+  rsManifold<double> mfDyn(3, 3);
+  mfDyn.setCurvilinearToCartesian(u2xDyn);
+  mfDyn.setApproximationStepSize(h);
+  auto mfFix = rsMakeFixedManifold<double, 3, 3>(u2xFix);
+  mfFix.setApproximationStepSize(h);
+
+  // Compute the Christoffel symbols of 2nd kind at a bunch of points with both implementations:
+  int numPoints = 10000;
+  std::vector<Arr3> points(numPoints);
+  for(int n = 0; n < numPoints; n++) {
+    double t = double(n) / numPoints;
+    points[n] = { 1.0 + t, 0.3 + 2.5*t, 6.0*t }; }
+  rsMultiArray<double> Gd;
+  decltype(mfFix)::Tens3 Gf;
+  double sumDyn = 0, sumFix = 0;    // prevents the compiler from optimizing the loops away
+  auto t0 = std::chrono::high_resolution_clock::now();
+  for(int n = 0; n < numPoints; n++) {
+    Gd = mfDyn.getChristoffelSymbols2ndKind(Vec(points[n].begin(), points[n].end()));
+    sumDyn += Gd(2,1,2); }
+  auto t1 = std::chrono::high_resolution_clock::now();
+  for(int n = 0; n < numPoints; n++) {
+    mfFix.getChristoffelSymbols2ndKind(points[n], Gf);
+    sumFix += Gf[2][1][2]; }
+  auto t2 = std::chrono::high_resolution_clock::now();
+  double tDyn = std::chrono::duration<double, std::micro>(t1 - t0).count() / numPoints;
+  double tFix = std::chrono::duration<double, std::micro>(t2 - t1).count() / numPoints;
+  std::cout << "Christoffel symbols, microseconds per point, dynamic: " << tDyn 
+            << ", fixed: " << tFix << "\n";
+  // Most of the remaining cost of the fixed version is in the sin/cos calls of the coordinate map.
+
+  // Both should compute the same numbers (up to roundoff - the order of operations may differ):
+  result &= rsIsCloseTo(sumDyn, sumFix, 1.e-8 * rsAbs(sumDyn));
+  Vec u({ 2.0, PI/3, PI/6 });
+  Gd = mfDyn.getChristoffelSymbols2ndKind(u);
+  mfFix.getChristoffelSymbols2ndKind({ 2.0, PI/3, PI/6 }, Gf);
+  for(int k = 0; k < 3; k++)
+    for(int i = 0; i < 3; i++)
+      for(int j = 0; j < 3; j++)
+        result &= rsIsCloseTo(Gd(k,i,j), Gf[k][i][j], 1.e-10);
+
+  // Check some Christoffel symbols against the analytic values (see testManifoldSphere):
+  double r = 2.0, sinTheta = sin(PI/3), cosTheta = cos(PI/3), tol = 1.e-5;
+  result &= rsIsCloseTo(Gf[0][1][1], -r,                  tol);
+  result &= rsIsCloseTo(Gf[1][0][1], 1/r,                 tol);
+  result &= rsIsCloseTo(Gf[1][2][2], -sinTheta*cosTheta,  tol);
+  result &= rsIsCloseTo(Gf[2][1][2], cosTheta / sinTheta, tol);
+
+  // The Riemann tensor of flat space should be zero:
+  decltype(mfFix)::Tens4 R;
+  mfFix.getRiemannTensor2ndKind({ 2.0, PI/3, PI/6 }, R);
+  for(int i = 0; i < 3; i++)
+    for(int j = 0; j < 3; j++)
+      for(int k = 0; k < 3; k++)
+        for(int l = 0; l < 3; l++)
+          result &= rsIsCloseTo(R[i][j][k][l], 0.0, 1.e-4);
+
+  rsAssert(result == true);
+  return result;
+}
+
+bool testGeodesics()
+{
+  // Integrates a bunch of geodesics on the unit sphere with rsGeodesicSolver. The geodesics are 
+  // great circles, so when starting on the equator with unit speed, they should return to their 
+  // starting points at t = 2*pi. We also check that the speed is conserved, compare the direct 
+  // and cached Christoffel symbols and check that the number of threads doesn't matter.
+
+  bool result = true;
+
+  using Vec = std::vector<double>;
+  using Mat = rsMatrix<double>;
+
+  // Unit sphere in latitude/longitude coordinates (in radians) with analytic Jacobian, such that
+  // only one level of numerical differentiation is needed for the Christoffel symbols:
+  rsManifold<double> mf(2, 3);
+  mf.setCurvilinearToCartesian([](const Vec& u, Vec& x)
+  {
+    x[0] = cos(u[0]) * cos(u[1]);
+    x[1] = cos(u[0]) * sin(u[1]);
+    x[2] = sin(u[0]);
+  });
+  mf.setCurvToCartJacobian([](const Vec& u, Mat& E)
+  {
+    E(0,0) = -sin(u[0]) * cos(u[1]); E(0,1) = -cos(u[0]) * sin(u[1]);
+    E(1,0) = -sin(u[0]) * sin(u[1]); E(1,1) =  cos(u[0]) * cos(u[1]);
+    E(2,0) =  cos(u[0]);             E(2,1) =  0;
+  });
+  mf.setApproximationStepSize(1.e-5);
+
+  // Initial conditions in structure-of-arrays layout - the geodesics start at different 
+  // longitudes on the equator and head off at angles between -1 and +1 radians (measured from 
+  // the east direction), so they stay away from the poles:
+  int numGeodesics = 1000;
+  Vec u0(2*numGeodesics), v0(2*numGeodesics);
+  double* lat0 = &u0[0]; double* lon0 = &u0[numGeodesics];
+  double* dLat = &v0[0]; double* dLon = &v0[numGeodesics];
+  for(int n = 0; n < numGeodesics; n++) {
+    double a = -1.0 + 2.0 * n / (numGeodesics-1);
+    lat0[n] = 0.0;
+    lon0[n] = -PI + 2*PI * n / numGeodesics;
+    dLat[n] = sin(a);
+    dLon[n] = cos(a); }  // the metric is the identity at the equator, so the speed is 1
+  double tEnd = 2*PI;
+
+  // Helper to measure the maximum position error and speed error after tEnd:
+  auto getErrors = [&](const Vec& u, const Vec& v, double* posErr, double* speedErr)
+  {
+    *posErr = *speedErr = 0;
+    for(int n = 0; n < numGeodesics; n++) {
+      double lat = u[n], lon = u[numGeodesics+n];
+      double vLat = v[n], vLon = v[numGeodesics+n];
+      double c = cos(lat);
+      *posErr   = rsMax(*posErr, rsAbs(lat - lat0[n]));
+      *posErr   = rsMax(*posErr, rsAbs(lon - (lon0[n] + 2*PI)));  // one revolution eastward
+      *speedErr = rsMax(*speedErr, rsAbs(vLat*vLat + c*c*vLon*vLon - 1)); }
+  };
+
+  // Helper to run the solver and measure the time:
+  rsGeodesicSolver<double> solver(mf);
+  auto run = [&](Vec& u, Vec& v, const char* name)
+  {
+    u = u0; v = v0;
+    auto t0 = std::chrono::high_resolution_clock::now();
+    int numSteps = solver.integrate(&u[0], &v[0], numGeodesics, tEnd);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    double posErr, speedErr;
+    getErrors(u, v, &posErr, &speedErr);
+    std::cout << name << ": " << ms << " ms, " << numSteps << " steps, position error: " 
+      << posErr << ", speed error: " << speedErr << "\n";
+    return posErr;
+  };
+
+  // Adaptive RK45 with direct Christoffel computation, with 1 and 4 threads:
+  Vec u1, v1, u4, v4;
+  solver.setTolerance(1.e-10);
+  result &= run(u1, v1, "RK45, 1 thread  ") < 1.e-6;
+  solver.setNumThreads(4);
+  result &= run(u4, v4, "RK45, 4 threads ") < 1.e-6;
+  result &= u1 == u4 && v1 == v4;
+
+  // Symplectic implicit midpoint method. The speed stays accurate even though the position 
+  // error is larger (it's a 2nd order method):
+  Vec u, v;
+  solver.setMethod(rsGeodesicSolver<double>::Method::implicitMidpoint);
+  solver.setStepSize(0.01);
+  result &= run(u, v, "Midpoint        ") < 1.e-3;
+  double posErr, speedErr;
+  getErrors(u, v, &posErr, &speedErr);
+  result &= speedErr < 1.e-8;
+
+  // Now with cached Christoffel symbols. The longitudes cover -pi..3*pi during the integration:
+  double uMin[2] = { -1.2, -PI-0.1 }, uMax[2] = { 1.2, 3*PI+0.1 };
+  int numNodes[2] = { 257, 257 };
+  auto t0 = std::chrono::high_resolution_clock::now();
+  solver.createChristoffelCache(uMin, uMax, numNodes);
+  auto t1 = std::chrono::high_resolution_clock::now();
+  std::cout << "Cache creation:   " 
+    << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms\n";
+  result &= run(u, v, "Midpoint, cached") < 1.e-3;
+  solver.setMethod(rsGeodesicSolver<double>::Method::rungeKutta45);
+  result &= run(u, v, "RK45, cached    ") < 1.e-3;
+  solver.clearChristoffelCache();
+
+  // Stream out some trajectories via the callback. Each geodesic writes only into its own 
+  // buffer, so this is thread-safe:
+  int numTraced = 8;
+  std::vector<Vec> traces(numTraced);   // entries: t, lat, lon, t, lat, lon, ...
+  auto recorder = [&](int n, double t, const double* u, const double* v)
+  {
+    traces[n].push_back(t);
+    traces[n].push_back(u[0]);
+    traces[n].push_back(u[1]);
+  };
+  u = u0; v = v0;
+  Vec uT(2*numTraced), vT(2*numTraced);
+  for(int n = 0; n < numTraced; n++) {
+    int k = n * (numGeodesics / numTraced);
+    uT[n] = u0[k]; uT[numTraced+n] = u0[numGeodesics+k];
+    vT[n] = v0[k]; vT[numTraced+n] = v0[numGeodesics+k]; }
+  solver.integrate(&uT[0], &vT[0], numTraced, tEnd, recorder);
+  for(int n = 0; n < numTraced; n++) {
+    Vec& tr = traces[n];
+    int numSamples = (int) tr.size() / 3;
+    result &= tr[0] == 0 && rsIsCloseTo(tr[3*(numSamples-1)], tEnd, 1.e-12);
+    for(int i = 1; i < numSamples; i++) {
+      result &= tr[3*i] > tr[3*(i-1)];             // t increases
+      double lat = tr[3*i+1], lon = tr[3*i+2];     // the great circle stays within the plane 
+      double x = cos(lat)*cos(lon), y = cos(lat)*sin(lon), z = sin(lat);  // spanned by the
+      int k = n * (numGeodesics / numTraced);      // initial position and velocity
+      double a = -1.0 + 2.0 * k / (numGeodesics-1), l0 = lon0[k];
+      double nx = sin(a)*sin(l0), ny = -sin(a)*cos(l0), nz = cos(a);   // normal of that plane
+      result &= rsAbs(x*nx + y*ny + z*nz) < 1.e-6; }}
+
+  // RK45 doesn't profit from the cache because the piecewise linear interpolant is not smooth, 
+  // so the stepsize control needs many more steps.
+
+  rsAssert(result == true);
+  return result;
+}
+
 void testManifoldEllipsoid()
 {
   // https://www.researchgate.net/publication/45877605_2D_Riemann-Christoffel_curvature_tensor_via_a_3D_space_using_a_specialized_permutation_scheme
@@ -3363,6 +3821,166 @@ void rsPascalTriangleLine(T* y, int N)
 // overflows for N >= 35 when T is a 32 bit signed integer, N <= 34 works
 // figure out, for which N it overflows for other common integer types
 
+/** Enumerates the k-combinations of {0,...,n-1}, i.e. its k-element subsets, each represented 
+by an ascending array of k indices. The binomial coefficients C(m, j) for m <= n, j <= k are 
+precomputed in O(n*k) from the left parts of the lines of the Pascal triangle, so ranking and 
+unranking (in lexicographic order) need only table lookups and additions instead of recomputing 
+binomials in each step. 
+Successors can be generated in lexicographic order or in the revolving door order, a Gray code 
+in which successive combinations differ by exchanging a single element. Both work in place on 
+the caller's array, so a stream of combinations does not allocate anything. */
+
+class rsCombinations
+{
+
+public:
+
+  rsCombinations(int n, int k) : n(n), k(k), table((n+1)*(k+1), 0)
+  {
+    rsAssert(n >= 0 && k >= 0 && k <= n);
+    for(int m = 0; m <= n; m++) {
+      uint64_t* t = &table[m*(k+1)];                 // C(m, 0..k)
+      t[0] = 1;
+      for(int j = 1; j <= rsMin(m, k); j++) {
+        t[j] = t[j-k-2] + t[j-k-1];                  // C(m-1, j-1) + C(m-1, j)
+        rsAssert(t[j] >= t[j-k-1], "Overflow"); }}
+  }
+
+  /** Returns the binomial coefficient C(m, j) = m! / (j! (m-j)!) for 0 <= m <= n. The table 
+  holds C(m, j) for j <= k, larger j are mapped into it via C(m, j) = C(m, m-j). When that 
+  doesn't help either, i.e. for k < j < m-k, the coefficient is not available. */
+  uint64_t binomial(int m, int j) const 
+  { 
+    rsAssert(m >= 0 && m <= n, "m out of range");
+    if(j < 0 || j > m) 
+      return 0;
+    if(j > k) 
+      j = m - j;
+    rsAssert(j <= k, "C(m, j) is not in the table");
+    return j <= k ? table[m*(k+1) + j] : 0;
+  }
+
+  uint64_t getNumCombinations() const { return binomial(n, k); }
+
+  /** Writes the first combination { 0, 1, ..., k-1 } into c. */
+  void first(int* c) const { for(int i = 0; i < k; i++) c[i] = i; }
+
+  /** Writes the combination with the given rank in lexicographic order into c. There are 
+  C(n-x-1, j-1) combinations with c[i] = x when j elements are still to choose, so we skip over 
+  candidates x by subtracting these counts from the rank until it falls into the block of the 
+  current x. The candidates only ever increase, so this takes O(n) lookups in total. */
+  void unrank(uint64_t rank, int* c) const
+  {
+    rsAssert(rank < getNumCombinations());
+    int x = 0;                                     // candidate for c[i]
+    for(int i = 0; i < k; i++) {
+      int j = k - i;                               // number of elements still to choose
+      for(uint64_t count = binomial(n-x-1, j-1); rank >= count; count = binomial(n-x-1, j-1)) {
+        rank -= count;
+        x++; }
+      c[i] = x++; }
+  }
+
+  /** Returns the lexicographic rank of the combination c. */
+  uint64_t rank(const int* c) const
+  {
+    uint64_t r = 0;
+    int s = 0;
+    for(int i = 0; i < k; i++) {
+      r += binomial(n-s, k-i) - binomial(n-c[i], k-i);
+      s = c[i] + 1; }
+    return r;
+  }
+
+  /** Replaces c with its successor in lexicographic order and returns true or returns false, if 
+  c was the last one. Amortized, this takes O(1). */
+  bool next(int* c) const
+  {
+    int i = k - 1;
+    while(i >= 0 && c[i] == n - k + i) i--;        // find the rightmost element that can grow
+    if(i < 0) return false;
+    c[i]++;
+    for(int j = i+1; j < k; j++) c[j] = c[j-1] + 1;
+    return true;
+  }
+
+  /** Replaces c with its successor in the revolving door order and returns true or returns 
+  false, if c was the last one. The sequence starts with first(c) as well. Successive 
+  combinations differ by removing one element and inserting another. This is Algorithm R from 
+  Knuth, TAOCP Vol. 4A, Section 7.2.1.3, where c[j-1] plays the role of c_j and c_{k+1} = n. */
+  bool nextRevolvingDoor(int* c) const
+  {
+    if(k == 0 || k == n) return false;
+    if(k == 1) { 
+      if(c[0] + 1 >= n) return false; 
+      c[0]++; 
+      return true; }
+    auto at = [&](int j) { return j <= k ? c[j-1] : n; };  // c_j with sentinel c_{k+1} = n
+    int j = 2;
+    bool decrease;                                 // whether to try step R4 or R5 first
+    if(k % 2 == 1) {
+      if(c[0] + 1 < c[1]) { c[0]++; return true; }
+      decrease = true; }
+    else {
+      if(c[0] > 0) { c[0]--; return true; }
+      decrease = false; }
+    while(j <= k) {
+      if(decrease) {                               // R4: try to decrease c_j
+        if(c[j-1] >= j) { c[j-1] = c[j-2]; c[j-2] = j - 2; return true; }
+        j++; 
+        if(j > k) return false; }
+      if(at(j) + 1 < at(j+1)) {                    // R5: try to increase c_j
+        c[j-2] = c[j-1]; c[j-1]++; return true; }
+      j++;
+      decrease = true; }
+    return false;
+  }
+
+  /** Calls f(c) for the combinations c with lexicographic ranks r0..r1-1. */
+  template<class TFunc>
+  void forEach(uint64_t r0, uint64_t r1, TFunc f) const
+  {
+    if(r0 >= r1) return;
+    std::vector<int> c(k);
+    unrank(r0, c.data());
+    for(uint64_t r = r0; r < r1; r++) {
+      f((const int*) c.data());
+      next(c.data()); }
+  }
+
+  /** Calls f(c) for all combinations. The range of ranks is split into numThreads contiguous 
+  chunks, each of which starts with an unranking and then steps through its combinations in one
+  thread. So f must be thread-safe. */
+  template<class TFunc>
+  void forEachParallel(TFunc f, int numThreads = 1) const
+  {
+    rsAssert(numThreads >= 1, "Need at least one thread");
+    uint64_t N = getNumCombinations();
+    numThreads = (int) rsMin(uint64_t(numThreads), N);
+    if(numThreads <= 1) {
+      forEach(0, N, f);
+      return;  }
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads);
+    uint64_t chunkSize = N / numThreads;
+    uint64_t remainder = N % numThreads;
+    uint64_t start = 0;
+    for(int t = 0; t < numThreads; t++) {
+      uint64_t end = start + chunkSize + (uint64_t(t) < remainder ? 1 : 0);
+      threads.push_back(std::thread([=, &f]() { forEach(start, end, f); }));
+      start = end; }
+    for(auto& t : threads)
+      t.join();
+  }
+
+
+protected:
+
+  int n, k;
+  std::vector<uint64_t> table;     // table[m*(k+1) + j] = C(m, j) for j <= min(m, k)
+
+};
+
 
 void testSortedSet()
 {
@@ -3462,6 +4080,1026 @@ void testSortedSet()
   int dummy = 0;
 }
 
+// Helpers for the tests of the set data structures below and for the benchmarks in other tests:
+
+/** Returns a vector of N random, strictly increasing integers. The gaps between successive 
+elements (and between start and the first element) are uniformly distributed in 1..2*gap-1, so 
+the average gap is gap. */
+std::vector<int> randomSortedSet(size_t N, int gap, int start, std::mt19937& rng)
+{
+  std::uniform_int_distribution<int> dist(1, 2*gap-1);
+  std::vector<int> A(N);
+  int x = start;
+  for(size_t i = 0; i < N; i++) { x += dist(rng); A[i] = x; }
+  return A;
+}
+
+using BenchClock = std::chrono::high_resolution_clock;
+
+/** Returns the time between the two time points in milliseconds. */
+double millisecondsBetween(BenchClock::time_point t0, BenchClock::time_point t1)
+{
+  return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+bool testSortedSetKernels()
+{
+  // Checks the adaptive merge kernels of rsSortedSet against the std::set_... algorithms for 
+  // random sets of various size ratios (which exercises all code paths) and benchmarks them.
+
+  bool ok = true;
+
+  std::mt19937 rng(1234);
+
+  using Set = rsSortedSet<int>;
+  using Vec = std::vector<int>;
+  auto check = [&](const Vec& A, const Vec& B)
+  {
+    Vec U, I, D, S;
+    std::set_union(                A.begin(), A.end(), B.begin(), B.end(), std::back_inserter(U));
+    std::set_intersection(         A.begin(), A.end(), B.begin(), B.end(), std::back_inserter(I));
+    std::set_difference(           A.begin(), A.end(), B.begin(), B.end(), std::back_inserter(D));
+    std::set_symmetric_difference( A.begin(), A.end(), B.begin(), B.end(), std::back_inserter(S));
+    return Set::unionSet(A, B) == U && Set::intersectionSet(A, B) == I
+      && Set::differenceSet(A, B) == D && Set::symmetricDifferenceSet(A, B) == S;
+  };
+  size_t sizes[7] = { 0, 1, 7, 50, 333, 1000, 5000 };
+  for(size_t Na : sizes) {
+    for(size_t Nb : sizes) {
+      int s = 3 * (int) rsMax(Na, size_t(1)) / (int) rsMax(Nb, size_t(1)) + 1;  // same range
+      Vec A = randomSortedSet(Na, 3, 0, rng), B = randomSortedSet(Nb, s, 0, rng);
+      ok &= check(A, B);
+      ok &= check(A, A); }}
+
+  // A non-arithmetic type uses the plain merge and galloping:
+  using SSet = rsSortedSet<std::string>;
+  std::vector<std::string> SA = { "a", "c", "d", "f" }, SB = { "b", "c", "f", "g", "h" };
+  ok &= SSet(SA) + SSet(SB) == SSet({ "a", "b", "c", "d", "f", "g", "h" });
+  ok &= SSet(SA) * SSet(SB) == SSet({ "c", "f" });
+  ok &= SSet(SA) - SSet(SB) == SSet({ "a", "d" });
+  ok &= SSet(SA) / SSet(SB) == SSet({ "a", "b", "d", "g", "h" });
+
+  // The sets above are too small for galloping, which needs size ratios above copyRatio and
+  // skipRatio. So we also check a set of 2000 strings against one of 10 in both orders:
+  auto key = [](int i)
+  {
+    std::string s = std::to_string(i);
+    return std::string(6 - s.size(), '0') + s;  // zero-padded, so the order is numeric
+  };
+  std::vector<std::string> SL, SS;
+  for(int i = 0; i < 2000; i++) SL.push_back(key(3*i));
+  for(int i = 0; i < 10;   i++) SS.push_back(key(600*i + (i % 2)));      // the even ones hit
+  for(int order = 0; order < 2; order++) {
+    const std::vector<std::string>& X = order == 0 ? SL : SS, & Y = order == 0 ? SS : SL;
+    std::vector<std::string> U, I, D, S;
+    std::set_union(               X.begin(), X.end(), Y.begin(), Y.end(), std::back_inserter(U));
+    std::set_intersection(        X.begin(), X.end(), Y.begin(), Y.end(), std::back_inserter(I));
+    std::set_difference(          X.begin(), X.end(), Y.begin(), Y.end(), std::back_inserter(D));
+    std::set_symmetric_difference(X.begin(), X.end(), Y.begin(), Y.end(), std::back_inserter(S));
+    ok &= !I.empty();
+    ok &= SSet::unionSet(X, Y) == U && SSet::intersectionSet(X, Y) == I
+      && SSet::differenceSet(X, Y) == D && SSet::symmetricDifferenceSet(X, Y) == S; }
+
+  // Benchmark the intersection and union against the two-pointer merges of the standard library
+  // for size ratios 1:1 to 1:100000. The elements of the small set are spread over the whole 
+  // range of the large set:
+  size_t Nl = 4000000;
+  Vec L = randomSortedSet(Nl, 4, 0, rng);
+  // The reference merges write into a fresh vector that was reserved for the worst case, like the
+  // old implementation did. Each measurement is the minimum over 5 runs:
+  std::cout << "ratio      intersection (std vs. ours)   union (std vs. ours) in ms\n";
+  for(size_t ratio = 1; ratio <= 100000; ratio *= 10)
+  {
+    Vec S = randomSortedSet(Nl / ratio, 4 * (int) ratio, 0, rng);
+    double t[4] = { 1.e10, 1.e10, 1.e10, 1.e10 };
+    for(int run = 0; run < 5; run++)
+    {
+      auto t0 = BenchClock::now();
+      Vec I1; I1.reserve(S.size());
+      std::set_intersection(S.begin(), S.end(), L.begin(), L.end(), std::back_inserter(I1));
+      auto t1 = BenchClock::now();
+      Vec I2 = Set::intersectionSet(S, L);
+      auto t2 = BenchClock::now();
+      Vec U1; U1.reserve(S.size() + L.size());
+      std::set_union(S.begin(), S.end(), L.begin(), L.end(), std::back_inserter(U1));
+      auto t3 = BenchClock::now();
+      Vec U2 = Set::unionSet(S, L);
+      auto t4 = BenchClock::now();
+      ok &= I1 == I2 && U1 == U2;
+      t[0] = rsMin(t[0], millisecondsBetween(t0, t1));
+      t[1] = rsMin(t[1], millisecondsBetween(t1, t2));
+      t[2] = rsMin(t[2], millisecondsBetween(t2, t3));
+      t[3] = rsMin(t[3], millisecondsBetween(t3, t4));
+    }
+    std::cout << "1:" << ratio << "\t" << t[0] << "\t" << t[1] << "\t" << t[2] << "\t" << t[3] << "\n";
+  }
+
+  // The gains of the intersection grow with the size ratio because the kernel gallops through the
+  // large set. For the union, the output has to be written anyway, so the gains are smaller. Our 
+  // unionSet also zero-initializes its result vector before the kernel writes into it.
+
+  rsAssert(ok);
+  return ok;
+}
+
+bool testSortedSetInPlace()
+{
+  // Checks the buffer, output iterator and in-place versions of the set operations against the 
+  // allocating ones, checks that chains of in-place operations stop allocating and compares the 
+  // speed of both.
+
+  bool ok = true;
+
+  std::mt19937 rng(4321);
+  using Set = rsSortedSet<int>;
+  using Vec = std::vector<int>;
+  Vec a = randomSortedSet(1000, 3, 0, rng), b = randomSortedSet(800, 4, 0, rng);
+  Vec c = randomSortedSet(3000, 1, 0, rng), d = randomSortedSet(50, 60, 0, rng);
+  Set A(a), B(b), C(c), D(d);
+
+  // Caller provided buffers and output iterators:
+  Vec buf(a.size() + b.size()), out;
+  size_t n = Set::unionSet(a.data(), a.size(), b.data(), b.size(), buf.data());
+  ok &= Vec(buf.begin(), buf.begin() + n) == (A + B).getData();
+  n = Set::intersectionSet(a.data(), a.size(), b.data(), b.size(), buf.data());
+  ok &= Vec(buf.begin(), buf.begin() + n) == (A * B).getData();
+  n = Set::differenceSet(a.data(), a.size(), b.data(), b.size(), buf.data());
+  ok &= Vec(buf.begin(), buf.begin() + n) == (A - B).getData();
+  n = Set::symmetricDifferenceSet(a.data(), a.size(), b.data(), b.size(), buf.data());
+  ok &= Vec(buf.begin(), buf.begin() + n) == (A / B).getData();
+  auto to = [&]() { out.clear(); return std::back_inserter(out); };
+  Set::unionSet(              a, d, to()); ok &= out == (A + D).getData();
+  Set::intersectionSet(       a, c, to()); ok &= out == (A * C).getData();
+  Set::differenceSet(         d, a, to()); ok &= out == (D - A).getData();
+  Set::symmetricDifferenceSet(a, b, to()); ok &= out == (A / B).getData();
+
+  // In-place operations:
+  Set R;
+  R = A; R += B; ok &= R == A + B;
+  R = A; R *= B; ok &= R == A * B;
+  R = A; R -= B; ok &= R == A - B;
+  R = A; R /= B; ok &= R == A / B;
+  R = A; R += R; ok &= R == A;        // aliasing
+  R = A; R -= R; ok &= R == Set();
+
+  // After a warm-up, a chain of in-place operations keeps working in the same memory. We check 
+  // that after each operation of the chain:
+  const int* p = nullptr;
+  size_t cap = 0;
+  auto same = [&]() { return R.getData().data() == p && R.getData().capacity() == cap; };
+  for(int i = 0; i < 5; i++)
+  {
+    R = A;  ok &= i == 0 || same();
+    R += B; ok &= i == 0 || same();
+    R *= C; ok &= i == 0 || same();
+    R -= D; ok &= i == 0 || same();
+    R /= B; ok &= i == 0 || same();
+    if(i == 0) { p = R.getData().data(); cap = R.getData().capacity(); }
+  }
+  ok &= R == (((A + B) * C) - D) / B;
+
+  // Benchmark chained set algebra with the allocating operators vs. the in-place operations:
+  a = randomSortedSet(100000, 3, 0, rng); b = randomSortedSet(80000, 4, 0, rng); 
+  c = randomSortedSet(300000, 1, 0, rng); d = randomSortedSet(5000, 60, 0, rng);
+  A = Set(a); B = Set(b); C = Set(c); D = Set(d);
+  int numRuns = 200;
+  auto t0 = BenchClock::now();
+  size_t sum1 = 0, sum2 = 0;
+  for(int i = 0; i < numRuns; i++) {
+    Set S = (((A + B) * C) - D) / B;
+    sum1 += S.getData().size(); }
+  auto t1 = BenchClock::now();
+  for(int i = 0; i < numRuns; i++) {
+    R = A; R += B; R *= C; R -= D; R /= B;
+    sum2 += R.getData().size(); }
+  auto t2 = BenchClock::now();
+  ok &= sum1 == sum2;
+  std::cout << "Chained set operations, allocating: " << millisecondsBetween(t0, t1) / numRuns 
+    << " ms, in-place: " << millisecondsBetween(t1, t2) / numRuns << " ms\n";
+
+  // The results of this size are allocated via mmap, so each allocating operation also pays for 
+  // the page faults of fresh memory.
+
+  rsAssert(ok);
+  return ok;
+}
+
+bool testSortedSetMultiWay()
+{
+  // Checks the multi-way union and intersection of many sets against pairwise folding, with and 
+  // without threads, and compares their speed.
+
+  bool ok = true;
+
+  std::mt19937 rng(2468);
+  using Set = rsSortedSet<int>;
+  auto foldUnion = [](const std::vector<Set>& S) 
+  { Set R; for(auto& s : S) R += s; return R; };
+  auto foldIntersection = [](const std::vector<Set>& S) 
+  { Set R = S.empty() ? Set() : S[0]; for(auto& s : S) R *= s; return R; };
+
+  // Random numbers of sets with random sizes, densities and offsets. The large ones exercise the
+  // threaded code path:
+  std::uniform_int_distribution<int> numSets(0, 40), density(1, 20), offset(0, 5000);
+  for(int i = 0; i < 200; i++)
+  {
+    std::vector<Set> S(numSets(rng));
+    size_t maxSize = i % 10 == 0 ? 50000 : 500;
+    for(auto& s : S)
+      s = Set(randomSortedSet(std::uniform_int_distribution<size_t>(0, maxSize)(rng), 
+        density(rng), offset(rng), rng));
+    Set U = foldUnion(S), I = foldIntersection(S);
+    for(int numThreads = 1; numThreads <= 8; numThreads *= 2) {
+      ok &= Set::unionOf(S, numThreads) == U;
+      ok &= Set::intersectionOf(S, numThreads) == I; }
+  }
+
+  // Many copies of the same set (such that the pivot sampling sees lots of duplicates), sets that
+  // are all empty but one and a large set together with many single element sets:
+  Set A(randomSortedSet(30000, 2, 0, rng));
+  std::vector<Set> S(16, A);
+  ok &= Set::unionOf(S, 4) == A && Set::intersectionOf(S, 4) == A;
+  S = std::vector<Set>(16); S[7] = A;
+  ok &= Set::unionOf(S, 4) == A && Set::intersectionOf(S, 4) == Set();
+  for(int i = 0; i < 16; i++) S.push_back(Set(std::vector<int>({ 1000*i + 1 })));
+  ok &= Set::unionOf(S, 4) == foldUnion(S) && Set::intersectionOf(S, 4) == Set();
+
+  // Benchmark the union and intersection of k sets via pairwise folding and via the multi-way 
+  // functions with 1 and 4 threads:
+  int k = 64, numRuns = 10;
+  S.resize(k);
+  for(auto& s : S) s = Set(randomSortedSet(50000, 8, 0, rng));
+  size_t sum[3] = { 0, 0, 0 };
+  auto t0 = BenchClock::now();
+  for(int i = 0; i < numRuns; i++) sum[0] += foldUnion(S).getData().size();
+  auto t1 = BenchClock::now();
+  for(int i = 0; i < numRuns; i++) sum[1] += Set::unionOf(S, 1).getData().size();
+  auto t2 = BenchClock::now();
+  for(int i = 0; i < numRuns; i++) sum[2] += Set::unionOf(S, 4).getData().size();
+  auto t3 = BenchClock::now();
+  ok &= sum[0] == sum[1] && sum[0] == sum[2];
+  std::cout << "Union of " << k << " sets, pairwise: " << millisecondsBetween(t0, t1) / numRuns 
+    << " ms, multi-way: " << millisecondsBetween(t1, t2) / numRuns << " ms, 4 threads: " 
+    << millisecondsBetween(t2, t3) / numRuns << " ms\n";
+  sum[0] = sum[1] = sum[2] = 0;
+  t0 = BenchClock::now();
+  for(int i = 0; i < numRuns; i++) sum[0] += foldIntersection(S).getData().size();
+  t1 = BenchClock::now();
+  for(int i = 0; i < numRuns; i++) sum[1] += Set::intersectionOf(S, 1).getData().size();
+  t2 = BenchClock::now();
+  for(int i = 0; i < numRuns; i++) sum[2] += Set::intersectionOf(S, 4).getData().size();
+  t3 = BenchClock::now();
+  ok &= sum[0] == sum[1] && sum[0] == sum[2];
+  std::cout << "Intersection of " << k << " sets, pairwise: " 
+    << millisecondsBetween(t0, t1) / numRuns << " ms, multi-way: " 
+    << millisecondsBetween(t1, t2) / numRuns << " ms, 4 threads: " 
+    << millisecondsBetween(t2, t3) / numRuns << " ms\n";
+
+  // The intersection gallops through the larger sets, so its cost depends mostly on the size of 
+  // the smallest one.
+
+  rsAssert(ok);
+  return ok;
+}
+
+bool testRoaringSet()
+{
+  // Checks the set operations of rsRoaringSet against those of rsSortedSet for sets of various 
+  // densities (which produce array, bitmap and run chunks), checks the membership test and 
+  // compares speed and memory usage of both.
+
+  bool ok = true;
+
+  std::mt19937 rng(1357);
+  auto runSet = [&](int numRuns, int start)         // runs of consecutive elements
+  {
+    std::uniform_int_distribution<int> len(1, 3000), gap(2, 500);
+    std::vector<int> A;
+    int x = start;
+    for(int r = 0; r < numRuns; r++) {
+      int n = len(rng);
+      for(int i = 0; i < n; i++) A.push_back(x++);
+      x += gap(rng); }
+    return A;
+  };
+
+  using Set = rsSortedSet<int>;
+  using RSet = rsRoaringSet<int>;
+  using Kind = RSet::ChunkKind;
+  std::vector<std::vector<int>> v = { {}, { -5, 0, 65535, 65536 }, 
+    randomSortedSet(50000, 50, -1000000, rng), randomSortedSet(200000, 2, -100000, rng), 
+    randomSortedSet(300000, 1, 0, rng), runSet(200, -300000), runSet(100, 0), 
+    randomSortedSet(100000, 4, -200000, rng) };
+  std::vector<RSet> R;
+  for(auto& a : v) {
+    R.push_back(RSet(a));
+    ok &= R.back().toVector() == a; 
+    ok &= R.back().getNumElements() == a.size(); }
+  ok &= R[2].getNumChunks(Kind::array) > 0 && R[3].getNumChunks(Kind::bitmap) > 0
+     && R[5].getNumChunks(Kind::runs)  > 0;
+
+  for(size_t i = 0; i < v.size(); i++) {
+    for(size_t j = 0; j < v.size(); j++) {
+      Set A(v[i]), B(v[j]);
+      ok &= (R[i] + R[j]).toSortedSet() == A + B;
+      ok &= (R[i] - R[j]).toSortedSet() == A - B;
+      ok &= (R[i] * R[j]).toSortedSet() == A * B;
+      ok &= (R[i] / R[j]).toSortedSet() == A / B;
+      ok &= (R[i] + R[j]) == RSet((A + B).getData()); }}   // canonical representation
+
+  // Membership:
+  std::uniform_int_distribution<int> val(-1100000, 400000);
+  for(size_t i = 0; i < v.size(); i++) {
+    for(int n = 0; n < 2000; n++) {
+      int x = val(rng);
+      ok &= R[i].contains(x) == std::binary_search(v[i].begin(), v[i].end(), x); }
+    for(int x : v[i])
+      ok &= R[i].contains(x); }
+
+  // Other integer types, including the extreme values:
+  std::vector<int64_t> w = { std::numeric_limits<int64_t>::min(), -1, 0, 1LL << 40, 
+    std::numeric_limits<int64_t>::max() };
+  ok &= rsRoaringSet<int64_t>(w).toVector() == w;
+  std::vector<unsigned char> u = { 0, 1, 2, 3, 200, 255 };
+  ok &= rsRoaringSet<unsigned char>(u).toVector() == u;
+
+  // Benchmark the set operations on dense sets:
+  Set A(randomSortedSet(1000000, 2, 0, rng)), B(randomSortedSet(1000000, 2, 0, rng));
+  RSet RA(A), RB(B);
+  int numRuns = 20;
+  size_t sum1 = 0, sum2 = 0;
+  auto t0 = BenchClock::now();
+  for(int i = 0; i < numRuns; i++) 
+    sum1 += (A + B).getData().size() + (A * B).getData().size() + (A - B).getData().size();
+  auto t1 = BenchClock::now();
+  for(int i = 0; i < numRuns; i++) 
+    sum2 += (RA + RB).getNumElements() + (RA * RB).getNumElements() + (RA - RB).getNumElements();
+  auto t2 = BenchClock::now();
+  ok &= sum1 == sum2;
+  std::cout << "Union, intersection and difference of dense sets with 1M elements, sorted: " 
+    << millisecondsBetween(t0, t1) / numRuns << " ms, roaring: " 
+    << millisecondsBetween(t1, t2) / numRuns << " ms\n";
+  std::cout << "Memory: sorted: " << A.getData().size() * sizeof(int) << " bytes, roaring: " 
+    << RA.getMemoryUsage() << " bytes\n";
+
+  // With an average gap of 2, the chunks are bitmaps, so each AND/OR/ANDNOT processes 64 
+  // elements.
+
+  rsAssert(ok);
+  return ok;
+}
+
+bool testChunkedSortedSet()
+{
+  // Checks insert, remove and find of rsChunkedSortedSet against std::set, the set operations 
+  // against rsSortedSet and compares the speed of incremental insertion with a sorted vector.
+
+  bool ok = true;
+
+  std::mt19937 rng(97531);
+
+  // Random sequences of inserts and removes. The tiny chunks of the 2nd set give deep trees, so 
+  // all the splitting, merging and refilling of inner nodes gets exercised:
+  auto testPointOps = [&](auto S, int numOps, int range)
+  {
+    std::uniform_int_distribution<int> val(0, range), coin(0, 2);
+    std::set<int> ref;
+    for(int i = 0; i < numOps; i++) {
+      int x = val(rng);
+      if(coin(rng) < 2 || i < numOps / 4)   // grow first, then insert and remove
+        ok &= S.insert(x) == ref.insert(x).second;
+      else
+        ok &= S.remove(x) == (ref.erase(x) == 1);
+      if(i % 997 == 0) {
+        ok &= S.isConsistent();
+        ok &= S.getNumElements() == ref.size(); }}
+    ok &= S.isConsistent() && std::equal(S.begin(), S.end(), ref.begin(), ref.end());
+    for(int i = 0; i < 1000; i++) {
+      int x = val(rng);
+      ok &= S.contains(x) == (ref.count(x) == 1); }
+    for(int x : ref)                        // remove everything
+      ok &= S.remove(x);
+    ok &= S.isConsistent() && S.getNumElements() == 0 && S.begin() == S.end();
+  };
+  testPointOps(rsChunkedSortedSet<int>(),       50000, 20000);
+  testPointOps(rsChunkedSortedSet<int, 4, 4>(), 50000, 20000);
+  testPointOps(rsChunkedSortedSet<int, 5, 7>(), 20000,  2000);
+
+  // Set operations and conversions:
+  using Set  = rsSortedSet<int>;
+  using CSet = rsChunkedSortedSet<int>;
+  std::vector<std::vector<int>> v = { {}, { 5 }, randomSortedSet(1000, 3, 0, rng), 
+    randomSortedSet(5000, 2, 500, rng), randomSortedSet(70, 100, 0, rng), 
+    randomSortedSet(20000, 1, -3000, rng) };
+  for(auto& a : v) {
+    for(auto& b : v) {
+      Set  A(a), B(b);
+      CSet CA(a), CB(b);
+      ok &= CA.isConsistent() && CA.toVector() == a;
+      CSet U = CA + CB, D = CA - CB, I = CA * CB, X = CA / CB;
+      ok &= U.isConsistent() && D.isConsistent() && I.isConsistent() && X.isConsistent();
+      ok &= U.toSortedSet() == A + B && D.toSortedSet() == A - B;
+      ok &= I.toSortedSet() == A * B && X.toSortedSet() == A / B; }}
+
+  // Copy, move and modify after bulk construction:
+  CSet A(v[3]), B = A, C = std::move(B);
+  ok &= C == A && B.getNumElements() == 0;
+  C.insert(-1); C.remove(v[3][17]);
+  ok &= C.isConsistent() && !(C == A) && *C.begin() == -1 && !C.contains(v[3][17]);
+
+  // Benchmark building a set from random elements one at a time:
+  int N = 200000;
+  std::vector<int> x(N);
+  std::uniform_int_distribution<int> val(0, 1000000000);
+  for(auto& xi : x) xi = val(rng);
+  auto t0 = BenchClock::now();
+  std::vector<int> sv;
+  for(int xi : x) {
+    auto it = std::lower_bound(sv.begin(), sv.end(), xi);
+    if(it == sv.end() || *it != xi) sv.insert(it, xi); }
+  auto t1 = BenchClock::now();
+  CSet cs;
+  for(int xi : x) cs.insert(xi);
+  auto t2 = BenchClock::now();
+  std::set<int> ss(x.begin(), x.end());
+  auto t3 = BenchClock::now();
+  bool found = true;
+  for(int xi : x) found &= cs.contains(xi);
+  auto t4 = BenchClock::now();
+  ok &= found && cs.toVector() == sv;
+  std::cout << "Inserting " << N << " random elements, sorted vector: " 
+    << millisecondsBetween(t0, t1) << " ms, chunked: " << millisecondsBetween(t1, t2) 
+    << " ms, std::set: " << millisecondsBetween(t2, t3) << " ms, finding them in the chunked "
+    << "set: " << millisecondsBetween(t3, t4) << " ms\n";
+
+  // The sorted vector is quadratic: it moves N/2 elements per insert on average.
+
+  rsAssert(ok);
+  return ok;
+}
+
+bool testRelation()
+{
+  // Checks the lazy cartesian product against the materialized one and the queries and 
+  // operations of rsRelation against brute force computations on lists of pairs.
+
+  bool ok = true;
+
+  using Set  = rsSortedSet<int>;
+  using Pair = std::pair<int, int>;
+  using Rel  = rsRelation<int, int>;
+
+  // Small product, compared to the materialized one:
+  Set A({ 1, 3, 4, 8 }), B({ -2, 0, 5 });
+  auto P = rsCartesianProduct(A, B);
+  std::vector<Pair> pairs = Set::cartesianProduct(A.getData(), B.getData());
+  ok &= P.size() == pairs.size();
+  ok &= std::equal(P.begin(), P.end(), pairs.begin(), pairs.end());
+  for(size_t k = 0; k < P.size(); k++) {
+    ok &= P[k] == pairs[k];
+    ok &= P.getRank(pairs[k].first, pairs[k].second) == k; }
+  ok &= !P.contains(2, 0) && !P.contains(3, 1) && P.contains(8, -2);
+  ok &= std::equal(P.getIterator(4), P.getIterator(9), pairs.begin() + 4, pairs.begin() + 9);
+  ok &= rsCartesianProduct(A, Set()).begin() == rsCartesianProduct(A, Set()).end();
+
+  // Large product that would need 10^10 pairs (80 GB) when materialized:
+  std::vector<int> a(100000), b(100000);
+  for(int i = 0; i < 100000; i++) { a[i] = 3*i; b[i] = 2*i + 1; }
+  Set LA(a), LB(b);
+  auto LP = rsCartesianProduct(LA, LB);
+  ok &= LP.size() == size_t(10000000000);
+  std::mt19937 rng(8642);
+  std::uniform_int_distribution<int> idx(0, 99999);
+  for(int n = 0; n < 1000; n++) {
+    int i = idx(rng), j = idx(rng);
+    size_t k = size_t(i) * 100000 + j;
+    ok &= LP[k] == Pair(3*i, 2*j+1) && LP.getRank(3*i, 2*j+1) == k;
+    ok &= !LP.contains(3*i+1, 2*j+1) && !LP.contains(3*i, 2*j); }
+  size_t k0 = 5000099990, k1 = 5000100010, k = k0;   // iterate a range across a row boundary
+  for(auto it = LP.getIterator(k0); it != LP.getIterator(k1); ++it, k++)
+    ok &= *it == Pair(3 * int(k / 100000), 2 * int(k % 100000) + 1);
+  ok &= k == k1;
+
+  // Relations from random pairs:
+  std::uniform_int_distribution<int> val(0, 60);
+  auto randomPairs = [&](int n)
+  {
+    std::vector<Pair> p(n);
+    for(auto& pi : p) pi = Pair(val(rng), val(rng));
+    return p;
+  };
+  auto sortedUnique = [](std::vector<Pair> p)
+  {
+    std::sort(p.begin(), p.end());
+    p.erase(std::unique(p.begin(), p.end()), p.end());
+    return p;
+  };
+  for(int trial = 0; trial < 20; trial++)
+  {
+    std::vector<Pair> pr = randomPairs(400), ps = randomPairs(300);
+    Rel R(pr), S(ps);
+    std::vector<Pair> refR = sortedUnique(pr), refS = sortedUnique(ps);
+    ok &= R.getPairs() == refR && R.getNumPairs() == refR.size();
+    for(int x = -1; x <= 61; x++) {
+      std::vector<int> img;
+      for(auto& p : refR) if(p.first == x) img.push_back(p.second);
+      ok &= R.getImage(x).getData() == img;
+      for(int y = -1; y <= 61; y++)
+        ok &= R.contains(x, y) == std::binary_search(refR.begin(), refR.end(), Pair(x, y)); }
+
+    // Projections:
+    std::vector<int> first, second;
+    for(auto& p : refR) { first.push_back(p.first); second.push_back(p.second); }
+    std::sort(second.begin(), second.end());
+    first.erase( std::unique(first.begin(),  first.end()),  first.end());
+    second.erase(std::unique(second.begin(), second.end()), second.end());
+    ok &= R.projectFirst().getData() == first && R.projectSecond().getData() == second;
+
+    // Inverse and composition:
+    std::vector<Pair> inv, comp;
+    for(auto& p : refR) inv.push_back(Pair(p.second, p.first));
+    for(auto& p : refR)
+      for(auto& q : refS)
+        if(p.second == q.first) comp.push_back(Pair(p.first, q.second));
+    ok &= R.getInverse().getPairs() == sortedUnique(inv);
+    ok &= R.compose(S).getPairs() == sortedUnique(comp);
+    ok &= R.getInverse().getInverse() == R;
+  }
+
+  // Relation defined by a predicate on the product:
+  Set C({ 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 });
+  Rel divides = Rel::fromPredicate(rsCartesianProduct(C, C), 
+    [](int x, int y) { return y % x == 0; });
+  ok &= divides.contains(3, 12) && !divides.contains(12, 3) && divides.getNumPairs() == 23;
+  ok &= divides.compose(divides) == divides;   // divisibility is transitive (and reflexive)
+
+  rsAssert(ok);
+  return ok;
+}
+
+bool testCombinations()
+{
+  // Checks ranking, unranking and the successor functions of rsCombinations against brute force
+  // enumeration, checks the parallel enumeration and compares the unranking speed with the 
+  // approach of the snippet in Libraries/Snippets/EnumerateCombinationSource.cpp.
+
+  bool ok = true;
+
+  for(int n = 0; n <= 12; n++) {
+    for(int k = 0; k <= n; k++) {
+      rsCombinations C(n, k);
+
+      // Reference: all k-subsets in lexicographic order, via permutations of a selection mask:
+      std::vector<std::vector<int>> ref;
+      std::vector<bool> mask(n, false);
+      std::fill(mask.begin(), mask.begin() + k, true);
+      do {
+        std::vector<int> c;
+        for(int i = 0; i < n; i++) if(mask[i]) c.push_back(i);
+        ref.push_back(c);
+      } while(std::prev_permutation(mask.begin(), mask.end()));
+      ok &= C.getNumCombinations() == ref.size();
+
+      // Lexicographic order, ranking and unranking:
+      std::vector<int> c(k), u(k);
+      C.first(c.data());
+      for(size_t r = 0; r < ref.size(); r++) {
+        ok &= c == ref[r] && C.rank(c.data()) == r;
+        C.unrank(r, u.data());
+        ok &= u == ref[r];
+        ok &= C.next(c.data()) == (r+1 < ref.size()); }
+
+      // Revolving door order: each combination is visited once and successive ones differ in 
+      // one element:
+      std::vector<bool> seen(ref.size(), false);
+      C.first(c.data());
+      size_t count = 0;
+      do {
+        uint64_t r = C.rank(c.data());
+        ok &= !seen[r];
+        seen[r] = true;
+        count++;
+        std::vector<int> prev = c;
+        if(!C.nextRevolvingDoor(c.data())) break;
+        std::vector<int> common;
+        std::set_intersection(prev.begin(), prev.end(), c.begin(), c.end(), 
+          std::back_inserter(common));
+        ok &= (int) common.size() == k-1 && std::is_sorted(c.begin(), c.end());
+      } while(count <= ref.size());
+      ok &= count == ref.size(); }}
+
+  // Some known binomials, including the largest one that fits into 64 bits with n <= 62:
+  rsCombinations B(62, 31);
+  ok &= B.binomial(62, 31) == 465428353255261088ULL;
+  ok &= B.binomial(40, 20) == 137846528820ULL && B.binomial(5, 7) == 0;
+  ok &= B.binomial(40, 35) == 658008 && B.binomial(62, 62) == 1;   // via C(m, j) = C(m, m-j)
+  std::vector<int> cb(31);
+  B.unrank(B.getNumCombinations() - 1, cb.data());                  // the last one is 31..61
+  ok &= cb[0] == 31 && cb[30] == 61 && B.rank(cb.data()) == B.getNumCombinations() - 1;
+
+  // Parallel enumeration: all combinations visited exactly once:
+  rsCombinations P(26, 6);
+  uint64_t N = P.getNumCombinations();
+  for(int numThreads = 1; numThreads <= 8; numThreads *= 2) {
+    std::vector<int> visits(N, 0);      // no race, unless a rank gets visited by 2 threads
+    P.forEachParallel([&](const int* c) { visits[P.rank(c)]++; }, numThreads);
+    bool once = true;
+    for(auto& v : visits) once &= v == 1;
+    ok &= once; }
+
+  // Benchmark unranking all combinations of 30 choose 6 with the snippet's approach (for each 
+  // element: recompute a binomial by gcd-reduced products and decide whether to take it) 
+  // against the table based unranking and against streaming them with next():
+  int n = 30, k = 6;
+  auto gcd = [](uint64_t a, uint64_t b) { while(b != 0) { uint64_t t = a % b; a = b; b = t; } 
+                                           return a; };
+  auto gcdBinomial = [&](uint64_t m, uint64_t j) -> uint64_t
+  {
+    if(j > m) return 0;
+    if(j > m - j) j = m - j;
+    uint64_t num = 1, den = 1;
+    for(uint64_t i = 0; i < j; i++) {
+      num *= m - i; den *= i + 1;
+      uint64_t g = gcd(num, den);
+      num /= g; den /= g; }
+    return num / den;
+  };
+  auto oldUnrank = [&](uint64_t rank, int* c)
+  {
+    int first = 0, r = k, i = 0;                   // first plays the role of ele.front()
+    while(r > 0) {
+      if(n - first == r) { while(r-- > 0) c[i++] = first++; break; }
+      uint64_t count = gcdBinomial(n - first - 1, r - 1);
+      if(rank < count) { c[i++] = first; r--; }
+      else rank -= count;
+      first++; }
+  };
+  rsCombinations C(n, k);
+  N = C.getNumCombinations();
+  std::vector<int> c(k), d(k);
+  uint64_t sum[3] = { 0, 0, 0 };
+  auto t0 = BenchClock::now();
+  for(uint64_t r = 0; r < N; r++) { oldUnrank(r, c.data()); sum[0] += c[k-1] + c[0]; }
+  auto t1 = BenchClock::now();
+  for(uint64_t r = 0; r < N; r++) { C.unrank(r, d.data()); sum[1] += d[k-1] + d[0]; }
+  auto t2 = BenchClock::now();
+  C.first(c.data());
+  do { sum[2] += c[k-1] + c[0]; } while(C.next(c.data()));
+  auto t3 = BenchClock::now();
+  ok &= sum[0] == sum[1] && sum[0] == sum[2];
+  std::cout << "All " << N << " combinations of 30 choose 6, old unranking: " 
+    << millisecondsBetween(t0, t1) << " ms, table unranking: " << millisecondsBetween(t1, t2) 
+    << " ms, successors: " << millisecondsBetween(t2, t3) << " ms\n";
+
+  // For enumerating ranges, unranking only the first one and then stepping is the way to go.
+
+  rsAssert(ok);
+  return ok;
+}
+
+bool testVmathBatch()
+{
+  // Checks the batch transforms and quaternion functions of vmath against the one-at-a-time 
+  // operators and member functions and measures the throughput of transforming a mesh.
+
+  using namespace vmath;
+  bool ok = true;
+
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> u(-10.f, 10.f);
+  size_t N = 1 << 20;
+  std::vector<Vector3f> aos(N);
+  for(auto& p : aos) p = Vector3f(u(rng), u(rng), u(rng));
+  Vector3Array<float> soa = Vector3Array<float>::fromAoS(aos.data(), N), out;
+  Matrix4f M = Matrix4f::createTranslation(1.f, -2.f, 3.f) 
+    * Matrix4f::createRotationAroundAxis(30.f, -45.f, 10.f) * Matrix4f::createScale(2.f, 0.5f, 1.5f);
+  auto close = [](const Vector3f& a, const Vector3f& b, float tol)
+  { return (a - b).length() <= tol * (1.f + a.length()); };
+
+  // Points, directions, homogeneous vectors:
+  transformPoints(M, soa, out);
+  for(size_t i = 0; i < N; i += 997) {
+    Vector4f p = M * Vector4f(aos[i].x, aos[i].y, aos[i].z, 1.f);
+    ok &= close(out.get(i), Vector3f(p.x, p.y, p.z), 1.e-6f); }
+  transformDirections(M, soa, out);
+  for(size_t i = 0; i < N; i += 997)
+    ok &= close(out.get(i), M * aos[i], 1.e-6f);
+
+  // In-place transforms go through the local buffers. Copies and growing keep the data:
+  Vector3Array<float> ip = soa;
+  transformDirections(M, ip.x(), ip.y(), ip.z(), ip.x(), ip.y(), ip.z(), N);
+  ip.resize(N + 100);
+  for(size_t i = 0; i < N; i += 997)
+    ok &= (ip.get(i) - out.get(i)).length() == 0.f;
+  ok &= ip.get(N-1).length() > 0.f && ip.get(N+99).length() == 0.f;
+  Vector4Array<float> h(1000), ho;
+  for(size_t i = 0; i < 1000; i++) h.set(i, Vector4f(u(rng), u(rng), u(rng), u(rng)));
+  Matrix4f P = Matrix4f::createFrustum(-1.f, 1.f, -1.f, 1.f, 1.f, 100.f) * M;
+  transformHomogeneous(P, h, ho);
+  for(size_t i = 0; i < 1000; i++)
+    ok &= (ho.get(i) - P * h.get(i)).length() <= 1.e-5f * (1.f + ho.get(i).length());
+
+  // Normals stay perpendicular to transformed tangents:
+  Vector3Array<float> tangents(1000), normals(1000), tOut, nOut;
+  for(size_t i = 0; i < 1000; i++) {
+    Vector3f t(u(rng), u(rng), u(rng)), a(u(rng), u(rng), u(rng));
+    Vector3f n = t.crossProduct(a);
+    n.normalize();
+    tangents.set(i, t); normals.set(i, n); }
+  transformDirections(M, tangents, tOut);
+  transformNormals(M, normals, nOut);
+  for(size_t i = 0; i < 1000; i++) {
+    Vector3f t = tOut.get(i), n = nOut.get(i);
+    ok &= fabs(t.dotProduct(n)) <= 1.e-5f * t.length() && fabs(n.length() - 1.f) < 1.e-6f; }
+
+  // Quaternions: normalize, slerp, rotation matrices:
+  size_t K = 1000;
+  QuaternionArray<float> qa(K), qb(K), qs;
+  std::vector<float> r(K);
+  std::uniform_real_distribution<float> u01(0.f, 1.f);
+  for(size_t i = 0; i < K; i++) {
+    qa.set(i, Quatf(u(rng), u(rng), u(rng), u(rng)));
+    qb.set(i, Quatf(u(rng), u(rng), u(rng), u(rng)));
+    r[i] = u01(rng); }
+  qa.set(0, qb.get(0) * 3.f);             // equal directions, so slerp has to take the 1st branch
+  normalize(qa); normalize(qb);
+  for(size_t i = 0; i < K; i++)
+    ok &= fabs(qa.get(i).length() - 1.f) < 1.e-6f;
+  slerp(qa, qb, r.data(), qs);
+  std::vector<Matrix3f> R(K);
+  rotMatrices(qs, R.data());
+  for(size_t i = 0; i < K; i++) {
+    Quatf q = qa.get(i).slerp(r[i], qb.get(i));
+    ok &= (q - qs.get(i)).length() < 1.e-6f;
+    Matrix3f Ri = q.rotMatrix();
+    for(int j = 0; j < 9; j++) 
+      ok &= fabs(Ri.data[j] - R[i].data[j]) < 1.e-5f; }
+
+  // Throughput of transforming the points of a mesh that fits into the cache and of a large one 
+  // (1M vertices) that doesn't:
+  for(size_t n : { size_t(4096), N }) {
+    int numRuns = int(20 * N / n);
+    std::vector<Matrix4f> Mk(numRuns);    // one matrix per run, so no run can be optimized away
+    for(int k = 0; k < numRuns; k++)
+      Mk[k] = M * Matrix4f::createRotationAroundAxis(0.f, 0.f, float(k % 360));
+    Vector3Array<float> in = Vector3Array<float>::fromAoS(aos.data(), n);
+    std::vector<Vector3f> aosOut(n);
+    auto t0 = BenchClock::now();
+    for(int k = 0; k < numRuns; k++)
+      for(size_t i = 0; i < n; i++) {
+        Vector4f p = Mk[k] * Vector4f(aos[i].x, aos[i].y, aos[i].z, 1.f);
+        aosOut[i] = Vector3f(p.x, p.y, p.z); }
+    auto t1 = BenchClock::now();
+    for(int k = 0; k < numRuns; k++)
+      transformPoints(Mk[k], in, out);
+    auto t2 = BenchClock::now();
+    auto rate = [&](BenchClock::time_point ta, BenchClock::time_point tb)
+    { return numRuns * n / millisecondsBetween(ta, tb) / 1.e3; };
+    std::cout << n << " point transforms in Mvertices/s, operator*: " << rate(t0, t1)
+      << ", batch: " << rate(t1, t2) << "\n"; }
+
+  // The large mesh is memory bound, so the advantage of the batch is smaller there. How the loop
+  // over operator* compares also depends on whether the compiler vectorizes it by itself (it may
+  // at -O3 with -march=native).
+
+  rsAssert(ok);
+  return ok;
+}
+
+bool testBvh()
+{
+  // Checks the query results of vmath::Bvh3 against brute force and measures the build time and
+  // query throughput for 1M boxes.
+
+  using namespace vmath;
+  bool ok = true;
+
+  std::mt19937 rng(4321);
+  std::uniform_real_distribution<float> u(0.f, 1.f);
+  auto randomBoxes = [&](size_t n, float size)
+  {
+    std::vector<Aabb3f> boxes(n);
+    for(auto& b : boxes) {
+      Vector3f c(u(rng), u(rng), u(rng)), e(size * u(rng), size * u(rng), size * u(rng));
+      b = Aabb3f(c.x - e.x, c.y - e.y, c.z - e.z, c.x + e.x, c.y + e.y, c.z + e.z); }
+    return boxes;
+  };
+  auto randomPoint = [&]() { return Vector3f(u(rng), u(rng), u(rng)); };
+  auto sorted = [](std::vector<int> v) { std::sort(v.begin(), v.end()); return v; };
+
+  // Brute force versions of the queries:
+  auto containing = [](const std::vector<Aabb3f>& boxes, const Vector3f& p)
+  {
+    std::vector<int> r;
+    for(size_t i = 0; i < boxes.size(); i++)
+      if(boxes[i].intersects(p)) r.push_back(int(i));
+    return r;
+  };
+  auto intersecting = [](const std::vector<Aabb3f>& boxes, const Aabb3f& b)
+  {
+    std::vector<int> r;
+    for(size_t i = 0; i < boxes.size(); i++)
+      if(boxes[i].intersects(b)) r.push_back(int(i));
+    return r;
+  };
+  auto firstHit = [](const std::vector<Aabb3f>& boxes, const Vector3f& o, const Vector3f& d)
+  {
+    float tBest = std::numeric_limits<float>::max();
+    Vector3f inv(1.f / d.x, 1.f / d.y, 1.f / d.z);
+    for(auto& b : boxes) {      // slab test of each box
+      float t0 = 0.f, t1 = tBest;
+      for(int a = 0; a < 3; a++) {
+        float ta = (b.min[a] - o[a]) * inv[a], tb = (b.max[a] - o[a]) * inv[a];
+        t0 = std::max(t0, std::min(ta, tb)); t1 = std::min(t1, std::max(ta, tb)); }
+      if(t0 <= t1) tBest = std::min(tBest, t0); }
+    return tBest;
+  };
+  auto check = [&](const Bvh3f& bvh, const std::vector<Aabb3f>& boxes)
+  {
+    for(int k = 0; k < 200; k++) {
+      Vector3f p = randomPoint();
+      ok &= sorted(bvh.findContaining(p)) == containing(boxes, p);
+      Aabb3f b(p.x, p.y, p.z, p.x + 0.05f * u(rng), p.y + 0.05f * u(rng), p.z + 0.05f * u(rng));
+      ok &= sorted(bvh.findIntersecting(b)) == intersecting(boxes, b);
+      Vector3f o = randomPoint() * 3.f - Vector3f(1.f, 1.f, 1.f), d = randomPoint() - o;
+      float t;
+      int i = bvh.intersectRay(o, d, t);
+      float tb = firstHit(boxes, o, d);
+      ok &= (i == -1) == (tb == std::numeric_limits<float>::max());
+      if(i >= 0)
+        ok &= t == tb && firstHit({ boxes[i] }, o, d) == t; }
+  };
+
+  // Queries on a static and on a moved set of boxes:
+  std::vector<Aabb3f> boxes = randomBoxes(20000, 0.02f);
+  boxes[7] = boxes[8] = boxes[9];         // coincident boxes
+  Bvh3f bvh(boxes), bvh4(boxes, 4);
+  check(bvh, boxes);
+  check(bvh4, boxes);
+  for(auto& b : boxes) {
+    Vector3f s(0.1f * u(rng), 0.1f * u(rng), 0.1f * u(rng));
+    b.min += s; b.max += s; }
+  bvh.refit(boxes);
+  check(bvh, boxes);
+  ok &= Bvh3f(std::vector<Aabb3f>()).findContaining(Vector3f(0, 0, 0)).empty();
+
+  // Axis-parallel rays whose origin lies on the plane of a face. Those give 0 * inf = NaN in a
+  // plain slab test. The box of the ray along the face is hit, the one above isn't:
+  std::vector<Aabb3f> faces = { Aabb3f(0, 0, 0, 1, 1, 1), Aabb3f(0, 2, 0, 1, 3, 1) };
+  Bvh3f fbvh(faces, 1, 1);
+  float t;
+  ok &= fbvh.intersectRay(Vector3f(0.5f, 1.f, -1.f), Vector3f(0, 0, 1), t) == 0 && t == 1.f;
+  ok &= fbvh.intersectRay(Vector3f(0.f, 0.5f, -1.f), Vector3f(0, 0, 1), t) == 0 && t == 1.f;
+  ok &= fbvh.intersectRay(Vector3f(1.f, 1.f, 2.f), Vector3f(0, 0, -1), t) == 0 && t == 1.f;
+  ok &= fbvh.intersectRay(Vector3f(0.5f, 1.5f, -1.f), Vector3f(0, 0, 1), t) == -1;
+  ok &= fbvh.intersectRay(Vector3f(-1.f, 3.f, 0.5f), Vector3f(1, 0, 0), t) == 1 && t == 1.f;
+
+  // Build time and query throughput at 1M boxes:
+  auto perSecond = [](int n, BenchClock::time_point t0, BenchClock::time_point t1)
+  { return 1000 * n / millisecondsBetween(t0, t1); };
+  size_t N = 1000000;
+  boxes = randomBoxes(N, 0.002f);
+  auto t0 = BenchClock::now();
+  Bvh3f big(boxes, 1);
+  auto t1 = BenchClock::now();
+  Bvh3f big4(boxes, 4);
+  auto t2 = BenchClock::now();
+  big.refit(boxes);
+  auto t3 = BenchClock::now();
+  std::cout << "Build 1M boxes: " << millisecondsBetween(t0, t1) << " ms, with 4 threads: " 
+    << millisecondsBetween(t1, t2) << " ms, refit: " << millisecondsBetween(t2, t3) << " ms\n";
+  int numQueries = 100000;
+  size_t numHits = 0;
+  std::vector<Vector3f> points(numQueries);
+  for(auto& p : points) p = randomPoint();
+  t0 = BenchClock::now();
+  for(auto& p : points)
+    big.forEachContaining(p, [&](int) { numHits++; });
+  t1 = BenchClock::now();
+  for(auto& p : points)
+    big.forEachIntersecting(Aabb3f(p.x, p.y, p.z, p.x + 0.01f, p.y + 0.01f, p.z + 0.01f), 
+      [&](int) { numHits++; });
+  t2 = BenchClock::now();
+  for(auto& p : points) {
+    float t;
+    numHits += big.intersectRay(Vector3f(-1.f, p.y, p.z), Vector3f(1.f, p.x - 0.5f, 0.f), t) >= 0; }
+  t3 = BenchClock::now();
+  for(int k = 0; k < 10; k++)
+    numHits += containing(boxes, points[k]).size();
+  auto t4 = BenchClock::now();
+  std::cout << "Queries per second, point: " << perSecond(numQueries, t0, t1) 
+    << ", box: " << perSecond(numQueries, t1, t2) << ", ray: " << perSecond(numQueries, t2, t3) 
+    << ", brute force point: " << perSecond(10, t3, t4) << " (hits: " << numHits << ")\n";
+
+  rsAssert(ok);
+  return ok;
+}
+
+bool testPlaneBatch()
+{
+  // Checks the cached-invariant and batch queries of rsParametricPlane3D against the direct 
+  // computations via the closest point and measures the throughput for a point cloud.
+
+  bool ok = true;
+
+  using Vec = rsVector3D<double>;
+  rsParametricPlane3D<double> plane;
+  plane.setVectors(Vec(1,2,3), Vec(2,4,3), Vec(2,6,8));
+  Vec nrm = plane.getNormal();
+  double tol = 1.e-12;
+  ok &= rsIsCloseTo(dot(nrm, nrm), 1.0, tol);
+  ok &= rsAbs(dot(nrm, Vec(2,4,3))) < tol && rsAbs(dot(nrm, Vec(2,6,8))) < tol;
+
+  // Scalar queries. The distance of a point from the plane must equal the distance to the closest
+  // point found via the match parameters and must have the sign of the projection onto the 
+  // normal:
+  std::mt19937 rng(5);
+  std::uniform_real_distribution<double> dist(-10.0, 10.0);
+  int N = 1000000;
+  std::vector<double> x(N), y(N), z(N);
+  for(int i = 0; i < N; i++) {
+    x[i] = dist(rng); y[i] = dist(rng); z[i] = dist(rng); }
+  for(int i = 0; i < 1000; i++) {
+    Vec p(x[i], y[i], z[i]);
+    double s, t;
+    plane.getMatchParameters(p, &s, &t);
+    Vec q = plane.getPointOnPlane(s, t);
+    double sd = plane.getSignedDistance(p);
+    ok &= rsIsCloseTo(rsAbs(sd), (p-q).getEuclideanNorm(), 1.e-9);
+    ok &= (sd >= 0) == (dot(p-q, nrm) >= 0) || rsAbs(sd) < 1.e-9;
+    ok &= plane.getDistance(p) == rsAbs(sd);
+    Vec r = plane.getClosestPointOnPlane(p);
+    ok &= (r-q).getEuclideanNorm() < 1.e-9; }
+
+  // Batch queries, single and multi-threaded:
+  std::vector<double> s(N), t(N), d(N), d4(N), px(N), py(N), pz(N);
+  plane.getMatchParameters(&x[0], &y[0], &z[0], &s[0], &t[0], N);
+  plane.getSignedDistances(&x[0], &y[0], &z[0], &d[0], N);
+  plane.getSignedDistances(&x[0], &y[0], &z[0], &d4[0], N, 4);
+  plane.getClosestPointsOnPlane(&x[0], &y[0], &z[0], &px[0], &py[0], &pz[0], N, 3);
+  ok &= d == d4;
+  for(int i = 0; i < N; i += 101) {
+    Vec p(x[i], y[i], z[i]);
+    double si, ti;
+    plane.getMatchParameters(p, &si, &ti);
+    ok &= rsIsCloseTo(s[i], si, tol) && rsIsCloseTo(t[i], ti, tol);
+    ok &= rsIsCloseTo(d[i], plane.getSignedDistance(p), tol);
+    Vec q = plane.getClosestPointOnPlane(p);
+    ok &= (Vec(px[i], py[i], pz[i]) - q).getEuclideanNorm() < 1.e-9; }
+  plane.getClosestPointsOnPlane(&x[0], &y[0], &z[0], &x[0], &y[0], &z[0], N);  // in place
+  ok &= x == px && y == py && z == pz;
+
+  // Throughput in points per second of the old way to compute the distance (via the closest point
+  // with the match parameters computed from scratch), the scalar and the batch functions (best of
+  // 5 runs each):
+  auto rate = [&](const std::function<void()>& f)
+  {
+    double best = 0;
+    for(int k = 0; k < 5; k++) {
+      auto t0 = BenchClock::now(); f(); auto t1 = BenchClock::now();
+      best = rsMax(best, N / millisecondsBetween(t0, t1) / 1.e3); }
+    return best;
+  };
+  for(int i = 0; i < N; i++) { 
+    x[i] = dist(rng); y[i] = dist(rng); z[i] = dist(rng); }
+  Vec u(1,2,3), v(2,4,3), w(2,6,8);
+  double rOld = rate([&]() 
+  { 
+    for(int i = 0; i < N; i++) {
+      Vec c = u - Vec(x[i], y[i], z[i]);
+      double A = dot(v,v), B = 2*dot(v,w), C = dot(w,w), D = 2*dot(c,v), E = 2*dot(c,w);
+      double k = 1 / (B*B - 4*A*C);
+      Vec q = u + ((2*C*D - B*E) * k)*v + ((2*A*E - B*D) * k)*w - Vec(x[i], y[i], z[i]);
+      d[i] = q.getEuclideanNorm(); }
+  });
+  double rScalar = rate([&]() 
+  { 
+    for(int i = 0; i < N; i++) 
+      d[i] = plane.getDistance(Vec(x[i], y[i], z[i])); 
+  });
+  double rBatch  = rate([&]() { plane.getSignedDistances(&x[0], &y[0], &z[0], &d[0], N); });
+  double rBatch4 = rate([&]() { plane.getSignedDistances(&x[0], &y[0], &z[0], &d[0], N, 4); });
+  double rProj   = rate([&]() 
+  { plane.getClosestPointsOnPlane(&x[0], &y[0], &z[0], &px[0], &py[0], &pz[0], N); });
+  std::cout << "Plane distances in Mpoints/s, old: " << rOld << ", scalar: " << rScalar 
+    << ", batch: " << rBatch << ", 4 threads: " << rBatch4 << ", projection batch: " << rProj 
+    << "\n";
+
+  // The old version isn't much slower than the scalar one because the compiler may hoist the 
+  // plane-dependent dot products out of the loop when it sees the whole loop.
+
+  rsAssert(ok);
+  return ok;
+}
+
+
+
+
+
+
+
+
+
 void testAutoDiff()
 {
   using DN = rsDualNumber<float, float>;
@@ -3841,146 +5479,711 @@ void testAutoDiffReverse1()
 {  
   using ADN = rsAutoDiffNumber<float, float>; 
 
-  std::vector<ADN::Operation> ops;
+  rsAutoDiffTape<float, float> tape;
 
   bool ok = true;
 
-  ADN x(2.f, ops);     // x = 2
-  ADN y(3.f, ops);     // y = 3
-  ADN z(5.f, ops);     // z = 5
-  ADN f(0.f, ops);     // f(x,y,z)
-  float d, t;          // derivative and target
-  float tol = 1.e-8f;  // tolerance for floating point comparisons
-
-
-  x.initLoc(); y.initLoc(); z.initLoc();  // get rid of these calls!
+  float t;             // target
+  float tol = 1.e-6f;  // tolerance for floating point comparisons
 
+  // Creates the inputs x = 2, y = 3, z = 5 on a fresh tape:
+  ADN x, y, z, f;
+  auto init = [&]()
+  {
+    tape.clear();
+    x = ADN(2.f, tape);
+    y = ADN(3.f, tape);
+    z = ADN(5.f, tape);
+  };
   
   // test derivatives of univariate functions:
-  ops.clear();
+  init();
   f = rsSqrt(x);
   f.computeDerivatives();
   t = 0.5f/rsSqrt(x.v);
-  ok &= rsIsCloseTo(x.d, t, tol);
+  ok &= rsIsCloseTo(x.getDerivative(), t, tol);
 
-  ops.clear();
+  init();
   f = rsSin(rsSqrt(x));
   f.computeDerivatives();
   t = (cos(sqrt(x.v)))/(2.f*sqrt(x.v));
-  ok &= rsIsCloseTo(x.d, t, tol);
+  ok &= rsIsCloseTo(x.getDerivative(), t, tol);
 
-  ops.clear();
+  init();
   f = rsExp(rsSin(rsSqrt(x)));
   f.computeDerivatives();
   t = (exp(sin(sqrt(x.v))) * cos(sqrt(x.v)))/(2.f*sqrt(x.v));
-  ok &= rsIsCloseTo(x.d, t, tol);
-
-  // ok - looks good so far
-  // the getDerivative doesn't seem to make sense anymore - instead, we need a call to 
-  // f.computeDerivatives() which should assign the x.d field and then compare x.d to t
-
+  ok &= rsIsCloseTo(x.getDerivative(), t, tol);
 
   // test derivatives of binary operators:
-  ops.clear();
+  init();
   f = x + y;
   f.computeDerivatives();
-  ok &= rsIsCloseTo(x.d, 1.f, tol);  // (x+y)_x = 1
-  ok &= rsIsCloseTo(y.d, 1.f, tol);  // (x+y)_y = 1
+  ok &= rsIsCloseTo(x.getDerivative(), 1.f, tol);  // (x+y)_x = 1
+  ok &= rsIsCloseTo(y.getDerivative(), 1.f, tol);  // (x+y)_y = 1
 
-  ops.clear();
+  init();
   f = x - y;
   f.computeDerivatives();
-  ok &= rsIsCloseTo(x.d,  1.f, tol);  // (x-y)_x =  1
-  ok &= rsIsCloseTo(y.d, -1.f, tol);  // (x-y)_y = -1
+  ok &= rsIsCloseTo(x.getDerivative(),  1.f, tol);  // (x-y)_x =  1
+  ok &= rsIsCloseTo(y.getDerivative(), -1.f, tol);  // (x-y)_y = -1
 
-  ops.clear();
+  init();
   f = x * y;
   f.computeDerivatives();
-  ok &= rsIsCloseTo(x.d, y.v, tol);  // (x*y)_x = y
-  ok &= rsIsCloseTo(y.d, x.v, tol);  // (x*y)_y = x
+  ok &= rsIsCloseTo(x.getDerivative(), y.v, tol);  // (x*y)_x = y
+  ok &= rsIsCloseTo(y.getDerivative(), x.v, tol);  // (x*y)_y = x
 
-  ops.clear();
+  init();
   f = x / y;
   f.computeDerivatives();
-  ok &= rsIsCloseTo(x.d,  1.f/ y.v,      tol);  // (x/y)_x =  1/y
-  ok &= rsIsCloseTo(y.d, -x.v/(y.v*y.v), tol);  // (x/y)_y = -x/y^2
+  ok &= rsIsCloseTo(x.getDerivative(),  1.f/ y.v,      tol);  // (x/y)_x =  1/y
+  ok &= rsIsCloseTo(y.getDerivative(), -x.v/(y.v*y.v), tol);  // (x/y)_y = -x/y^2
 
-  ops.clear();
+  // test derivatives of iterated binary operators - this was wrong with the old design that had 
+  // a single running derivative accumulator:
+  init();
   f = x * y * z;
   f.computeDerivatives();
-  ok &= rsIsCloseTo(x.d, y.v*z.v, tol);  // (x*y*z)_x = y*z
-  // wrong
+  ok &= rsIsCloseTo(x.getDerivative(), y.v*z.v, tol);  // (x*y*z)_x = y*z
+  ok &= rsIsCloseTo(y.getDerivative(), x.v*z.v, tol);  // (x*y*z)_y = x*z
+  ok &= rsIsCloseTo(z.getDerivative(), x.v*y.v, tol);  // (x*y*z)_z = x*y
+
+  // expressions, in which a variable is used several times (the expression graph is a DAG, not a
+  // tree):
+  init();
+  f = x + x;
+  f.computeDerivatives();
+  ok &= rsIsCloseTo(x.getDerivative(), 2.f, tol);
 
-  int dummy = 0;
+  init();
+  f = rsSin(x) + rsCos(x);
+  f.computeDerivatives();
+  ok &= rsIsCloseTo(x.getDerivative(), rsCos(x.v) - rsSin(x.v), tol);
 
-  //d = x.d
+  init();
+  ADN w = x*y;                      // intermediate that is used twice
+  f = rsSin(w) * w + z / w;
+  f.computeDerivatives();
+  float wv = x.v*y.v;
+  float fw = rsCos(wv)*wv + rsSin(wv) - z.v/(wv*wv);    // df/dw
+  ok &= rsIsCloseTo(x.getDerivative(), fw * y.v, tol);  
+  ok &= rsIsCloseTo(y.getDerivative(), fw * x.v, tol);
+  ok &= rsIsCloseTo(z.getDerivative(), 1.f / wv, tol);
+  ok &= rsIsCloseTo(w.getDerivative(), fw,       tol);  // intermediates have adjoints, too
+
+  // mixing in constants - they don't need to be on the tape:
+  init();
+  f = 3.f * x * x - 2.f / y + 1.f;
+  f.computeDerivatives();
+  ok &= rsIsCloseTo(x.getDerivative(), 6.f * x.v,       tol);
+  ok &= rsIsCloseTo(y.getDerivative(), 2.f / (y.v*y.v), tol);
+
+  // a neuron y = tanh(a0 + a1*x1 + a2*x2) - the weights are inputs, too:
+  tape.clear();
+  ADN a0(0.1f, tape), a1(0.2f, tape), a2(-0.3f, tape), x1(0.5f, tape), x2(0.7f, tape);
+  ADN s = a0 + a1*x1 + a2*x2;
+  ADN e = rsExp(2.f * s);
+  f = (e - 1.f) / (e + 1.f);
+  f.computeDerivatives();
+  float sv = 0.1f + 0.2f*0.5f - 0.3f*0.7f;
+  float fs = 1.f - tanh(sv)*tanh(sv);
+  ok &= rsIsCloseTo(a0.getDerivative(), fs,        tol);
+  ok &= rsIsCloseTo(a1.getDerivative(), fs * x1.v, tol);
+  ok &= rsIsCloseTo(x2.getDerivative(), fs * a2.v, tol);
 
+  rsAssert(ok);
 
-  // test derivatives of iterated binary operators, like f(x,y,z) = x*y*z, etc.
+  // Notes from the development of the reverse mode (the first version stored copies of the 
+  // operands in the records and had a single running derivative, which failed for x*y*z):
+  // -i think, the goals are quite different in forward and reverse mode: in forward mode, we want
+  //  that in y.d of an end result y = E(x) for some complicated expression E, we want the 
+  //  derivative of E with respect to x. in reverse mode, we want to evaluate a function of several
+  //  variables, say r = f(x,y,z) and at the end, we want the the x.d, y.d, z.d contain the partial
+  //  derivatives of f with respect to x,y,z - the reverse pass should assign them
+  // -the binary operations are more complicated because i can't just apply the chain-rule and 
+  //  move on to the next inner operand because there are now two operands, so the expression tree
+  //  actually branches (and when a variable is used several times, it's a DAG) - that's why each
+  //  record now stores the indices of its operands and the backward sweep accumulates adjoints
+  // -the sensitivity of a sum with respect to a summand is 1
+  // -the sensitivities of a difference a-b are 1 and -1 respectively
+  // -the sensitivity of a product with respect to one factor is the other factor
+  // -if underscore denotes partial derivative, we have: (x+y)_x = 1, (x+y)_y = 1, 
+  //  (x-y)_x = 1, (x-y)_y = -1, (x*y)_x = y, (x*y)_y = x, (x/y)_x = 1/y, (x/y)_y = -x/y^2
+  // -for a chain of elementary functions, the storage scheme is redundant - the result of 
+  //  operation i is the (first) operand of operation i+1
+  // -maybe distinguish between variables that have a memory location and temporaries - 
+  //  currently, every intermediate result gets a record and an adjoint
+}
 
+bool testAutoDiffReverseGradient()
+{
+  // Computes the gradient of a function of 10000 inputs in reverse mode with rsAutoDiffNumber and
+  // in forward mode with rsDualNumber and compares results and timings. In forward mode, we need 
+  // one evaluation of the function per input, in reverse mode, one evaluation plus one backward 
+  // sweep.
 
-  // ...but the binary operations are still wrong - these are more complicated because i can't just
-  // apply the chain-rule and move on to the next inner operand because there are now two operands, 
-  // so the expression tree actually branches ...maybe we need an actual tree to store the record?
+  bool ok = true;
 
+  // The function is a generalized Rosenbrock function with an additional coupling term. It's 
+  // written as generic lambda so we can use it with all the number types:
+  auto func = [](const auto* x, int n)
+  {
+    auto f = 0.0 * x[0];
+    for(int i = 0; i < n-1; i++) {
+      auto a = x[i+1] - x[i]*x[i];
+      auto b = 1.0 - x[i];
+      f = f + 100.0 * a*a + b*b + rsSin(x[i] * x[i+1]); }
+    return f;
+  };
 
+  int n = 10000;
+  std::vector<double> x(n), gradRev(n), gradFwd(n);
+  for(int i = 0; i < n; i++)
+    x[i] = 0.5 + 0.5 * sin(0.1*i);
+
+  // reverse mode:
+  using ADN = rsAutoDiffNumber<double, double>;
+  rsAutoDiffTape<double, double> tape;
+  std::vector<ADN> xr(n);
+  tape.reserve(12*n);
+  int numRuns = 10;
+  auto t0 = std::chrono::high_resolution_clock::now();
+  for(int r = 0; r < numRuns; r++) {
+    tape.clear();
+    for(int i = 0; i < n; i++)
+      xr[i] = ADN(x[i], tape);
+    ADN f = func(&xr[0], n);
+    f.computeDerivatives();
+    for(int i = 0; i < n; i++)
+      gradRev[i] = xr[i].getDerivative(); }
+  auto t1 = std::chrono::high_resolution_clock::now();
+  double tRev = std::chrono::duration<double, std::milli>(t1 - t0).count() / numRuns;
+
+  // forward mode - one sweep per input:
+  using DN = rsDualNumber<double, double>;
+  std::vector<DN> xf(n);
+  for(int i = 0; i < n; i++)
+    xf[i] = DN(x[i], 0.0);
+  t0 = std::chrono::high_resolution_clock::now();
+  for(int j = 0; j < n; j++) {
+    xf[j].d = 1.0;
+    gradFwd[j] = func(&xf[0], n).d;
+    xf[j].d = 0.0; }
+  t1 = std::chrono::high_resolution_clock::now();
+  double tFwd = std::chrono::duration<double, std::milli>(t1 - t0).count();
+
+  std::cout << "Gradient of 10000-input function, reverse mode: " << tRev 
+            << " ms, forward mode: " << tFwd << " ms, tape size: " << tape.getNumRecords() << "\n";
+
+  for(int i = 0; i < n; i++)
+    ok &= rsIsCloseTo(gradRev[i], gradFwd[i], 1.e-10 * (1.0 + rsAbs(gradFwd[i])));
+
+  rsAssert(ok);
+  return ok;
+}
 
+bool testAutoDiffVectorMode()
+{
+  // Tests vector-mode forward AD with rsDerivativeLanes and rsForwardGradient and compares the 
+  // speed of gradient computations to scalar forward mode (one sweep per input) and reverse mode.
 
-  // i think, i will need another field in rsAutoDiffNumber to store the "adjoint" - only in that 
-  // case it makes actually sense for function f: R^N -> R functions. The R^N inputs must be of 
-  // type rsAutoDiffNumber and in the reverse pass we compute df/dxn
-  /*
-  ops.clear();
-  f = x+x;
-  d = f.getDerivative();
-  t = 2.f;
+  bool ok = true;
 
-  ops.clear();
-  f = rsSin(x) + rsCos(x);
-  d = f.getDerivative();
-  t = rsCos(x.v) - rsSin(x.v);
-  */
+  // Jacobian of a function R^3 -> R^2 with K = 4 (1 sweep, one lane unused) and K = 2 (2 sweeps,
+  // in the 2nd, one lane unused):
+  auto f = [](const auto* x, int n, auto* y, int m)
+  {
+    y[0] = x[0] * x[1] * rsSin(x[2]);
+    y[1] = rsExp(x[0]) * rsSqrt(x[1]) + rsLog(x[2]) / x[0];
+  };
+  double x[3] = { 0.5, 2.0, 1.5 }, y[2], J4[6], J2[6], t[6];
+  rsForwardGradient<double, 4>::jacobian(f, x, 3, y, 2, J4);
+  rsForwardGradient<double, 2>::jacobian(f, x, 3, y, 2, J2);
+  t[0] = x[1] * sin(x[2]);                                      // dy0/dx0
+  t[1] = x[0] * sin(x[2]);                                      // dy0/dx1
+  t[2] = x[0] * x[1] * cos(x[2]);                               // dy0/dx2
+  t[3] = exp(x[0]) * sqrt(x[1]) - log(x[2]) / (x[0]*x[0]);      // dy1/dx0
+  t[4] = exp(x[0]) * 0.5 / sqrt(x[1]);                          // dy1/dx1
+  t[5] = 1.0 / (x[2] * x[0]);                                   // dy1/dx2
+  for(int i = 0; i < 6; i++) {
+    ok &= rsIsCloseTo(J4[i], t[i], 1.e-13);
+    ok &= rsIsCloseTo(J2[i], t[i], 1.e-13); }
+  ok &= rsIsCloseTo(y[0], x[0] * x[1] * sin(x[2]), 1.e-13);
+
+  // Gradient of the same function as in testAutoDiffReverseGradient, but with 1000 inputs:
+  auto func = [](const auto* x, int n)
+  {
+    auto f = 0.0 * x[0];
+    for(int i = 0; i < n-1; i++) {
+      auto a = x[i+1] - x[i]*x[i];
+      auto b = 1.0 - x[i];
+      f = f + 100.0 * a*a + b*b + rsSin(x[i] * x[i+1]); }
+    return f;
+  };
+  int n = 1000;
+  std::vector<double> xv(n), g1(n), g4(n), g8(n), g16(n), gr(n);
+  for(int i = 0; i < n; i++)
+    xv[i] = 0.5 + 0.5 * sin(0.1*i);
+  using Clock = std::chrono::high_resolution_clock;
+  auto ms = [](Clock::time_point t0, Clock::time_point t1)
+  { return std::chrono::duration<double, std::milli>(t1 - t0).count(); };
+
+  // scalar forward mode, one sweep per input:
+  using DN = rsDualNumber<double, double>;
+  std::vector<DN> xd(n);
+  for(int i = 0; i < n; i++)
+    xd[i] = DN(xv[i], 0.0);
+  auto t0 = Clock::now();
+  for(int j = 0; j < n; j++) {
+    xd[j].d = 1.0;
+    g1[j] = func(&xd[0], n).d;
+    xd[j].d = 0.0; }
+  auto t1 = Clock::now();
+  std::cout << "Gradient of 1000-input function, scalar forward: " << ms(t0, t1) << " ms\n";
+
+  // vector mode with 4, 8, 16 lanes:
+  t0 = Clock::now(); rsForwardGradient<double,  4>::gradient(func, &xv[0], n, &g4[0]);  t1 = Clock::now();
+  std::cout << "  4 lanes: " << ms(t0, t1) << " ms\n";
+  t0 = Clock::now(); rsForwardGradient<double,  8>::gradient(func, &xv[0], n, &g8[0]);  t1 = Clock::now();
+  std::cout << "  8 lanes: " << ms(t0, t1) << " ms\n";
+  t0 = Clock::now(); rsForwardGradient<double, 16>::gradient(func, &xv[0], n, &g16[0]); t1 = Clock::now();
+  std::cout << " 16 lanes: " << ms(t0, t1) << " ms\n";
+
+  // reverse mode:
+  using ADN = rsAutoDiffNumber<double, double>;
+  rsAutoDiffTape<double, double> tape;
+  std::vector<ADN> xr(n);
+  t0 = Clock::now();
+  for(int i = 0; i < n; i++)
+    xr[i] = ADN(xv[i], tape);
+  ADN r = func(&xr[0], n);
+  r.computeDerivatives();
+  for(int i = 0; i < n; i++)
+    gr[i] = xr[i].getDerivative();
+  t1 = Clock::now();
+  std::cout << "  reverse: " << ms(t0, t1) << " ms\n";
+  // The gain comes from evaluating the value parts (including the rsSin calls) only n/K times 
+  // and from the lane-parallel derivative arithmetic, which needs vector registers that are wide 
+  // enough to pay off for larger K.
+
+  for(int i = 0; i < n; i++) {
+    double tol = 1.e-12 * (1.0 + rsAbs(g1[i]));
+    ok &= rsIsCloseTo(g4[i],  g1[i], tol);
+    ok &= rsIsCloseTo(g8[i],  g1[i], tol);
+    ok &= rsIsCloseTo(g16[i], g1[i], tol);
+    ok &= rsIsCloseTo(gr[i],  g1[i], tol); }
+
+  rsAssert(ok);
+  return ok;
+}
 
+bool testTaylorAD()
+{
+  // Tests the truncated Taylor series AD type rsTaylorNumber: derivatives of elementary functions
+  // against closed form expressions, comparison with nested dual numbers, the integration into 
+  // rsManifold and the Newton and Halley root finders.
 
-  /*
-  ops.clear();
-  ADN y3 = rsSin(rsSqrt(x*x));
-  float d3 = y3.getDerivative();
-  */
+  bool ok = true;
 
-  // hmm - for a chain of elementary functions, the storage scheme is redundant - the result of 
-  // operation i is the (first) operand of operation n+1...but maybe that's the way it has to be 
-  // and will make more sense in binary operations?
-
-
-  // -maybe the numbers should actually store a derivative in a field and init it to NaN and 
-  //  actually set it in the backward pass?
-  // -the operands and results in the recorded operations should be AutoDiffNumbers, not TVal
-  // -maybe the record needs to store pointers to operands instead of the operands themselves?
-  // -then, when a binary operation is encountered, we call getDerivative recursively on both 
-  //  operands?
-  // -try a scalar function with 2 inputs, maybe something resembling a neural network - then 
-  //  actually the weights are also inputs to the function
-  // -how about y = tanh(a0 + a1*x1 + a2*x2) - after the backward pass, we want the derivative fields
-  //  of a0,a1,x1,a2,x2 contain the partial derivatives of y with respect to these variables
-  // -define z = a0 + a1*x1 + a2*x2, and compute the derivative of tanh with repect to z
-  // -compute derivatives of z: dz/da0 = 1, dz/da1 = x1, dz/dx1 = a1, dz/da2 = x2, dz/dx2=a2
-  // -the sensitivity of a sum with respect to a summand is 1
-  // -the sensitivities of a difference a-b are 1 and -1 respectively
-  // -the sensitivity of a product with respect to one factor is the other factor
-  // -maybe we need partial derivatives of the binary operators with respect to each of the 
-  //  operands. if underscore denotes partial derivative, we have: (x+y)_x = 1, (x+y)_y = 1, 
-  //  (x-y)_x = 1, (x-y)_y = -1, (x*y)_x = y, (x*y)_y = x, (x/y)_x = 1/y, (x/y)_y = -x/y^2
-  // -maybe when we encounter an add, we don't need recursion - instead just assign the derivative
-  //  fields for both operands - the operands are in positions i-1 and i-2 in the loop
-  // -i think, the goals are quite different in forward and reverse mode: in forward mode, we want
-  //  that in y.d of an end result y = E(x) for some complicated expression E, we want the 
-  //  derivative of E with respect to x. in reverse mode, we want to evaluate a function of several
-  //  variables, say r = f(x,y,z) and at the end, we want the the x.d, y.d, z.d contain the partial
-  //  derivatives of f with respect to x,y,z - the reverse pass should assign them - we may need to
-  //  distinguish between variables that have a memory location and temporaries and assign the 
-  //  memory variables in the reverse pass
+  const int D = 6;
+  using TN = rsTaylorNumber<double, D>;
+  double x0 = 0.7, tol = 1.e-12;
+  TN x = TN::variable(x0);
+  TN y;
+  double f = 1;  // (k-1)! in the loops below
+
+  // exp(2x), sin(3x), e^x cos(x), log(1+x), 1/(1+x), x^2.5, sqrt(x):
+  y = rsExp(2.0*x);
+  for(int k = 0; k <= D; k++)
+    ok &= rsIsCloseTo(y.getDerivative(k), pow(2.0, k) * exp(2*x0), tol * pow(2.0, k));
+  y = rsSin(3.0*x);
+  for(int k = 0; k <= D; k++)
+    ok &= rsIsCloseTo(y.getDerivative(k), pow(3.0, k) * sin(3*x0 + k*PI/2), tol * pow(3.0, k));
+  y = rsExp(x) * rsCos(x);
+  for(int k = 0; k <= D; k++)
+    ok &= rsIsCloseTo(y.getDerivative(k), pow(2.0, 0.5*k) * exp(x0) * cos(x0 + k*PI/4), tol*8);
+  y = rsLog(1.0 + x);
+  for(int k = 1; k <= D; k++) {
+    ok &= rsIsCloseTo(y.getDerivative(k), pow(-1.0, k-1) * f / pow(1+x0, k), tol * f);
+    f *= k; }
+  y = 1.0 / (1.0 + x);
+  f = 1;
+  for(int k = 0; k <= D; k++) {
+    ok &= rsIsCloseTo(y.getDerivative(k), pow(-1.0, k) * f / pow(1+x0, k+1), tol * f);
+    f *= k+1; }
+  auto powDeriv = [&](double p, int k)  // k-th derivative of x^p at x0
+  {
+    double c = 1;
+    for(int j = 0; j < k; j++)
+      c *= p - j;
+    return c * pow(x0, p-k);
+  };
+  y = rsPow(x, 2.5);
+  for(int k = 0; k <= D; k++)
+    ok &= rsIsCloseTo(y.getDerivative(k), powDeriv(2.5, k), tol * 1000);
+  y = rsSqrt(x);
+  for(int k = 0; k <= D; k++)
+    ok &= rsIsCloseTo(y.getDerivative(k), powDeriv(0.5, k), tol * 1000);
+
+  // Compare with nested dual numbers on the test function from testAutoDiff:
+  auto func = [](const auto& x)
+  {
+    return rsExp(-x/31.0) * rsSin(5.0*x/2.0) / (2.0 + x*x*(1.0 + rsCos(x)) + 1.0);
+  };
+  using D1 = rsDualNumber<double, double>;
+  using D2 = rsDualNumber<D1, D1>;
+  using D3 = rsDualNumber<D2, D2>;
+  D3 xd(D2(D1(x0, 1), D1(1, 0)), D2(D1(1, 0), D1(0, 0)));
+  int numRuns = 100000;
+  double sumD = 0, sumT = 0;
+  auto t0 = std::chrono::high_resolution_clock::now();
+  D3 yd;
+  for(int n = 0; n < numRuns; n++) {
+    xd.v.v.v = x0 + 1.e-7*n;
+    yd = func(xd);
+    sumD += yd.d.d.d; }
+  auto t1 = std::chrono::high_resolution_clock::now();
+  using TN3 = rsTaylorNumber<double, 3>;
+  TN3 xt = TN3::variable(x0), yt;
+  for(int n = 0; n < numRuns; n++) {
+    xt.c[0] = x0 + 1.e-7*n;
+    yt = func(xt);
+    sumT += yt.getDerivative(3); }
+  auto t2 = std::chrono::high_resolution_clock::now();
+  ok &= rsIsCloseTo(sumD, sumT, 1.e-12 * rsAbs(sumD));
+  ok &= rsIsCloseTo(yd.v.d.d, yt.getDerivative(2), 1.e-12);
+  ok &= rsIsCloseTo(yd.v.v.d, yt.getDerivative(1), 1.e-12);
+  double tD = std::chrono::duration<double, std::nano>(t1 - t0).count() / numRuns;
+  double tT = std::chrono::duration<double, std::nano>(t2 - t1).count() / numRuns;
+  std::cout << "Derivatives up to order 3, nanoseconds per evaluation, nested duals: " << tD 
+            << ", Taylor: " << tT << "\n";
+
+  // Integration into rsManifold - we compute the Riemann tensor of a sphere with nested duals and
+  // with Taylor series. The same generic lambda serves as coordinate map for both:
+  using Vec = std::vector<double>;
+  double r = 2.0;
+  auto u2x = [=](const auto& u, auto& x)
+  {
+    x[0] = r * rsSin(u[0]) * rsCos(u[1]);
+    x[1] = r * rsSin(u[0]) * rsSin(u[1]);
+    x[2] = r * rsCos(u[0]);
+  };
+  rsManifold<double> mfD(2, 3), mfT(2, 3);
+  mfD.setCurvilinearToCartesian(u2x);
+  mfD.setCurvilinearToCartesianAD(u2x);
+  mfT.setCurvilinearToCartesian(u2x);
+  mfT.setCurvilinearToCartesianTaylor(u2x);
+  Vec u({ 1.1, 0.4 });
+  rsMultiArray<double> RD, RT;
+  numRuns = 10000;
+  t0 = std::chrono::high_resolution_clock::now();
+  for(int n = 0; n < numRuns; n++)
+    RD = mfD.getRiemannTensor2ndKind(u);
+  t1 = std::chrono::high_resolution_clock::now();
+  for(int n = 0; n < numRuns; n++)
+    RT = mfT.getRiemannTensor2ndKind(u);
+  t2 = std::chrono::high_resolution_clock::now();
+  tD = std::chrono::duration<double, std::micro>(t1 - t0).count() / numRuns;
+  tT = std::chrono::duration<double, std::micro>(t2 - t1).count() / numRuns;
+  std::cout << "Riemann tensor, microseconds, nested duals: " << tD << ", Taylor: " << tT << "\n";
+  for(int i = 0; i < 2; i++)
+    for(int j = 0; j < 2; j++)
+      for(int k = 0; k < 2; k++)
+        for(int l = 0; l < 2; l++)
+          ok &= rsIsCloseTo(RD(i,j,k,l), RT(i,j,k,l), 1.e-12);
+  ok &= rsIsCloseTo(rsAbs(RT(0,1,0,1)), sin(u[0])*sin(u[0]), 1.e-12);  // R^theta_phi,theta,phi
+  // For the Riemann tensor, a good part of the time is spent in the std::vector and rsMultiArray
+  // allocations of the getters. The advantage of the Taylor series grows with the order.
+
+  // In 3D with spherical coordinates, we also need the triple mixed derivatives. Space is flat,
+  // so the Riemann tensor should be zero:
+  auto u2x3 = [](const auto& u, auto& x)
+  {
+    x[0] = u[0] * rsSin(u[1]) * rsCos(u[2]);
+    x[1] = u[0] * rsSin(u[1]) * rsSin(u[2]);
+    x[2] = u[0] * rsCos(u[1]);
+  };
+  rsManifold<double> mf3(3, 3);
+  mf3.setCurvilinearToCartesian(u2x3);
+  mf3.setCurvilinearToCartesianTaylor(u2x3);
+  RT = mf3.getRiemannTensor2ndKind(Vec({ 2.0, 1.0, 0.5 }));
+  for(int i = 0; i < 3; i++)
+    for(int j = 0; j < 3; j++)
+      for(int k = 0; k < 3; k++)
+        for(int l = 0; l < 3; l++)
+          ok &= rsIsCloseTo(RT(i,j,k,l), 0.0, 1.e-12);
+
+  // Newton and Halley iteration for x = cos(x) and x^3 = 2:
+  using RF = rsRootFinderAD<double>;
+  int itsN, itsH;
+  auto g1 = [](const auto& x) { return rsCos(x) - x; };
+  double rN = RF::newton(g1, 1.0, 1.e-15, 100, &itsN);
+  double rH = RF::halley(g1, 1.0, 1.e-15, 100, &itsH);
+  ok &= rsIsCloseTo(rN, 0.73908513321516064, 1.e-15);
+  ok &= rsIsCloseTo(rH, 0.73908513321516064, 1.e-15);
+  ok &= itsH < itsN;
+  auto g2 = [](const auto& x) { return x*x*x - 2.0; };
+  rN = RF::newton(g2, 1.0, 1.e-15, 100, &itsN);
+  rH = RF::halley(g2, 1.0, 1.e-15, 100, &itsH);
+  ok &= rsIsCloseTo(rN, cbrt(2.0), 1.e-15);
+  ok &= rsIsCloseTo(rH, cbrt(2.0), 1.e-15);
+  ok &= itsH < itsN;
+
+  rsAssert(ok);
+  return ok;
+}
+
+bool testCheckpointedGradient()
+{
+  // Computes gradients of the outcomes of two long simulations with respect to their parameters 
+  // via reverse mode AD with binomial checkpointing and checks them against finite differences. 
+  // The results must not depend on the number of checkpoints - only the amount of recomputation
+  // should.
+
+  bool ok = true;
 
+  // 1st example: the SIRP model from epidemic() on a small grid without the renormalization and
+  // clipping (they are not differentiable) with 800 steps. The parameters are the transmission 
+  // rate t, the recovery rate r and the diffusion d and the objective is the total number of 
+  // recovered people at the end:
+  int w = 12, h = 12, numSteps = 800, numCells = w*h;
+  double dt = 360 / 250.0;
+  auto sirpStep = [=](const auto* x, auto* y, const auto* p, int n)
+  {
+    const auto* S = &x[0];  const auto* I = &x[numCells];  const auto* R = &x[2*numCells];
+    auto* S1 = &y[0];  auto* I1 = &y[numCells];  auto* R1 = &y[2*numCells];
+    auto t = p[0], r = p[1], d = p[2];
+    auto idx = [=](int i, int j) { return rsClip(j, 0, h-1) * w + rsClip(i, 0, w-1); };
+    for(int j = 0; j < h; j++) {
+      for(int i = 0; i < w; i++) {
+        int k = j*w + i;
+        auto Iav =   I[idx(i,   j  )] * 0.25                              // 3x3 Gaussian blur
+                 + ( I[idx(i-1, j  )] + I[idx(i+1, j  )] + I[idx(i, j-1)] + I[idx(i, j+1)] ) * 0.125
+                 + ( I[idx(i-1, j-1)] + I[idx(i+1, j-1)] + I[idx(i-1, j+1)] + I[idx(i+1, j+1)] ) * 0.0625;
+        auto tSI = t * S[k] * (d * Iav + (1.0 - d) * I[k]);
+        auto rI  = r * I[k];
+        S1[k] = S[k] - tSI * dt;
+        I1[k] = I[k] + (tSI - rI) * dt;
+        R1[k] = R[k] + rI * dt; }}
+  };
+  auto sirpObjective = [=](const auto* x)
+  {
+    auto sum = x[2*numCells];
+    for(int k = 1; k < numCells; k++)
+      sum = sum + x[2*numCells + k];
+    return sum;
+  };
+  std::vector<double> x0(3*numCells);
+  for(int k = 0; k < numCells; k++) {
+    int i = k % w, j = k / w;
+    double I = (rsAbs(i-4) + rsAbs(j-5) <= 1) ? 0.1 : 0.0;  // small cluster of infections
+    x0[k] = 1.0 - I; x0[numCells+k] = I; x0[2*numCells+k] = 0.0; }
+  double p[3] = { 0.05, 0.002, 1.0 };
+
+  // simulate plainly with double, for the finite differences:
+  auto simulate = [&](const double* pp)
+  {
+    std::vector<double> x = x0, y(x.size());
+    for(int n = 0; n < numSteps; n++) {
+      sirpStep(&x[0], &y[0], pp, n);
+      std::swap(x, y); }
+    return sirpObjective(&x[0]);
+  };
+  double gFD[3];
+  for(int i = 0; i < 3; i++) {
+    double pp[3] = { p[0], p[1], p[2] }, eps = 1.e-6 * p[i];
+    pp[i] = p[i] + eps; double Jp = simulate(pp);
+    pp[i] = p[i] - eps; double Jm = simulate(pp);
+    gFD[i] = (Jp - Jm) / (2*eps); }
+
+  rsCheckpointedGradient<double> cg;
+  cg.setup(numSteps, 3*numCells, 3);
+  double gP0[3];
+  int budgets[6] = { 0, 2, 5, 10, 50, 800 };
+  std::cout << "SIRP model, 800 steps, " << numCells << " cells:\n";
+  for(int c : budgets)
+  {
+    double J, gP[3];
+    cg.setNumCheckpoints(c);
+    auto t0 = std::chrono::high_resolution_clock::now();
+    J = cg.computeGradient(sirpStep, sirpObjective, &x0[0], p, nullptr, gP);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    std::cout << "  checkpoints: " << c << ", forward steps: " << cg.getNumForwardSteps() 
+      << ", repetitions: " << cg.getRepetitionNumber(numSteps, c) << ", time: " 
+      << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms\n";
+    ok &= cg.getMaxNumSnapshotsUsed() <= c;
+    ok &= rsIsCloseTo(J, simulate(p), 1.e-12 * J);
+    for(int i = 0; i < 3; i++) {
+      ok &= rsIsCloseTo(gP[i], gFD[i], 1.e-5 * rsAbs(gFD[i]));
+      if(c == 0) gP0[i] = gP[i];
+      else       ok &= gP[i] == gP0[i]; }   // recomputation is deterministic
+  }
+  std::cout << "  records per step: " << cg.getMaxTapeSize() << ", taping all steps of the 360x360"
+    << " model would need " << 32.0 * cg.getMaxTapeSize() / numCells * 360*360 * numSteps / 1.e9 
+    << " GB\n";
+  // The tape for a single step of the 360x360 model needs ~116 MB, 800 of them ~93 GB. With 
+  // 10 checkpoints of 3*360*360 doubles (~31 MB), we need only 4 repetitions.
+  // The number of forward steps drops quickly with the number of checkpoints c, so the recorded
+  // backward steps dominate the time already for small c.
+
+  // 2nd example: a cascade of 2 biquad filters, run for 800 samples. The parameters are the 2*5 
+  // coefficients and the objective is the sum of squared differences of the output to a target 
+  // signal that was produced by a cascade with other coefficients. The state is (y1, y2) for 
+  // each biquad and the accumulated error:
+  numSteps = 800;
+  std::vector<double> in(numSteps), target(numSteps);
+  for(int n = 0; n < numSteps; n++)
+    in[n] = sin(0.05*n) + 0.5*sin(0.31*n) + 0.25*sin(1.7*n);
+  auto biquadStep = [&](const auto* x, auto* y, const auto* p, int n)
+  {
+    auto u = [&](int k) { return k >= 0 ? in[k] : 0.0; };
+    auto ya = p[0]*u(n) + p[1]*u(n-1) + p[2]*u(n-2) - p[3]*x[0] - p[4]*x[1];
+    // the input of the 2nd stage is the output of the 1st, so x[0], x[1] are its input history:
+    auto yb = p[5]*ya + p[6]*x[0] + p[7]*x[1] - p[8]*x[2] - p[9]*x[3];
+    auto e  = yb - target[n];
+    y[1] = x[0]; y[0] = ya;
+    y[3] = x[2]; y[2] = yb;
+    y[4] = x[4] + e*e;
+  };
+  auto biquadObjective = [](const auto* x) { return x[4]; };
+  double pRef[10] = { 0.2, 0.4, 0.2, -0.6, 0.3,   0.5, -0.2, 0.1, -0.3, 0.2  };
+  double pIir[10] = { 0.25, 0.35, 0.2, -0.5, 0.25,   0.45, -0.2, 0.15, -0.35, 0.2 };
+  std::vector<double> s0(5, 0.0), s(5), s1(5);
+  target.assign(numSteps, 0.0);
+  s = s0;
+  for(int n = 0; n < numSteps; n++) {       // produce the target signal
+    biquadStep(&s[0], &s1[0], pRef, n);
+    target[n] = s1[2];
+    s = s1; }
+  auto simulateIir = [&](const double* pp)
+  {
+    std::vector<double> x = s0, y(5);
+    for(int n = 0; n < numSteps; n++) {
+      biquadStep(&x[0], &y[0], pp, n);
+      std::swap(x, y); }
+    return x[4];
+  };
+  double gIirFD[10];
+  for(int i = 0; i < 10; i++) {
+    double pp[10], eps = 1.e-7;
+    rsArrayTools::copy(pIir, pp, 10);
+    pp[i] = pIir[i] + eps; double Jp = simulateIir(pp);
+    pp[i] = pIir[i] - eps; double Jm = simulateIir(pp);
+    gIirFD[i] = (Jp - Jm) / (2*eps); }
+  rsCheckpointedGradient<double> cgIir;
+  cgIir.setup(numSteps, 5, 10);
+  cgIir.setMemoryBudget(3 * 5 * sizeof(double));   // room for 3 snapshots
+  double gIir[10], gx0[5];
+  double E = cgIir.computeGradient(biquadStep, biquadObjective, &s0[0], pIir, gx0, gIir);
+  ok &= cgIir.getNumCheckpoints() == 3;
+  ok &= rsIsCloseTo(E, simulateIir(pIir), 1.e-12 * E);
+  for(int i = 0; i < 10; i++)
+    ok &= rsIsCloseTo(gIir[i], gIirFD[i], 1.e-5 * (1.0 + rsAbs(gIirFD[i])));
+  std::cout << "Biquad cascade, 800 steps, 3 checkpoints, forward steps: " 
+    << cgIir.getNumForwardSteps() << "\n";
+
+  rsAssert(ok);
+  return ok;
+}
+
+bool testDualExpressionTemplates()
+{
+  // Checks the expression templates for dual numbers against the regular operators and compares
+  // their speed for scalar and vector valued derivatives.
+
+  bool ok = true;
+
+  using DN = rsDualNumber<double, double>;
+  auto f  = [](DN x)->DN { return rsExp(-x/31)*rsSin(5*x/2) / (2 + x*x * (1+rsCos(x)) + 1); };
+  auto fe = [](const DN& x)->DN 
+  { 
+    auto X = rsDualLeaf(x); 
+    return rsExp(-X/31)*rsSin(5*X/2) / (2 + X*X * (1+rsCos(X)) + 1); 
+  };
+  auto close = [](double a, double b) { return rsAbs(a-b) <= 1.e-13 * (1 + rsAbs(a)); };
+  for(int n = 0; n <= 100; n++) {
+    DN x(0.08*n, 1.0), y = f(x), z = fe(x);
+    ok &= close(y.v, z.v) && close(y.d, z.d); }
+
+  // The target may appear in the expression:
+  DN x(0.7, 1.0), y = rsLog(x) + rsSqrt(x*x) - x/(1+x);
+  auto X = rsDualLeaf(x);
+  x = rsLog(X) + rsSqrt(X*X) - X/(1+X);
+  ok &= close(x.v, y.v) && close(x.d, y.d);
+
+  // Vector valued derivatives with fixed size lanes:
+  static const int K = 8;
+  using DL  = rsDerivativeLanes<double, K>;
+  using DNL = rsDualNumber<double, DL>;
+  auto fl  = [](DNL x)->DNL { return rsExp(-x/31)*rsSin(5*x/2) / (2 + x*x * (1+rsCos(x)) + 1); };
+  auto fle = [](const DNL& x)->DNL
+  { 
+    auto X = rsDualLeaf(x); 
+    return rsExp(-X/31)*rsSin(5*X/2) / (2 + X*X * (1+rsCos(X)) + 1); 
+  };
+  DL seed;
+  for(int k = 0; k < K; k++) seed[k] = k+1;
+  DNL yl = fl(DNL(0.9, seed)), zl = fle(DNL(0.9, seed));
+  for(int k = 0; k < K; k++)
+    ok &= close(yl.d[k], zl.d[k]);
+
+  // Vector valued derivatives with std::vector. Here, we use a bivariate function without scalar 
+  // constants because the regular operators of rsDualNumber convert scalars c into TDer(c) which
+  // for std::vector doesn't do the right thing:
+  using Vec = std::vector<double>;
+  using DNV = rsDualNumber<double, Vec>;
+  auto g = [](DNV x, DNV y)->DNV 
+  { return rsExp(x*y) * rsSin(x) / (x*x + y*rsSin(y) + rsExp(y)); };
+  auto ge = [](const DNV& x, const DNV& y, DNV& r)
+  { 
+    auto X = rsDualLeaf(x), Y = rsDualLeaf(y);
+    r = rsExp(X*Y) * rsSin(X) / (X*X + Y*rsSin(Y) + rsExp(Y));  // reuses the memory of r.d
+  };
+  Vec dx(K), dy(K);
+  for(int k = 0; k < K; k++) { dx[k] = k+1; dy[k] = 1 - 0.5*k; }
+  DNV xv(0.3, dx), yv(1.2, dy), rv = g(xv, yv), sv;
+  ge(xv, yv, sv);
+  for(int k = 0; k < K; k++)
+    ok &= close(rv.d[k], sv.d[k]);
+
+  // Benchmarks:
+  int N = 100000;
+  using Clock = std::chrono::high_resolution_clock;
+  auto ns = [&](Clock::time_point t0, Clock::time_point t1) 
+  { return std::chrono::duration<double, std::nano>(t1 - t0).count() / N; };
+  double sum1 = 0, sum2 = 0;
+  auto t0 = Clock::now();
+  for(int n = 0; n < N; n++) sum1 += f( DN(1.e-4*n, 1.0)).d;
+  auto t1 = Clock::now();
+  for(int n = 0; n < N; n++) sum2 += fe(DN(1.e-4*n, 1.0)).d;
+  auto t2 = Clock::now();
+  std::cout << "Scalar derivative:      " << ns(t0, t1) << " ns vs. " << ns(t1, t2) << " ns\n";
+  ok &= close(sum1, sum2);
+
+  sum1 = sum2 = 0;
+  t0 = Clock::now();
+  for(int n = 0; n < N; n++) sum1 += fl( DNL(1.e-4*n, seed)).d[K-1];
+  t1 = Clock::now();
+  for(int n = 0; n < N; n++) sum2 += fle(DNL(1.e-4*n, seed)).d[K-1];
+  t2 = Clock::now();
+  std::cout << "8 lanes:                " << ns(t0, t1) << " ns vs. " << ns(t1, t2) << " ns\n";
+  ok &= close(sum1, sum2);
+
+  sum1 = sum2 = 0;
+  t0 = Clock::now();
+  for(int n = 0; n < N; n++) { xv.v = 1.e-4*n; sum1 += g(xv, yv).d[K-1]; }
+  t1 = Clock::now();
+  for(int n = 0; n < N; n++) { xv.v = 1.e-4*n; ge(xv, yv, sv); sum2 += sv.d[K-1]; }
+  t2 = Clock::now();
+  std::cout << "std::vector of size 8:  " << ns(t0, t1) << " ns vs. " << ns(t1, t2) << " ns\n";
+  ok &= close(sum1, sum2);
+
+  // In the scalar case, both versions are dominated by the 5 calls to exp/sin/cos. With 
+  // std::vector, the regular operators allocate a temporary vector in each operation.
+
+  rsAssert(ok);
+  return ok;
 }
 
 void testDualComplex()
@@ -4054,6 +6257,114 @@ void testDualComplex()
 
 }
 
+bool testDualComplexFunctions()
+{
+  // Checks the derivatives of the elementary functions of rsDualComplexNumber against numeric 
+  // derivatives, the division against the quotient rule with std::complex and the batch evaluator
+  // for rational functions against the scalar evaluation.
+
+  bool ok = true;
+
+  using Real    = double;
+  using DCN     = rsDualComplexNumber<Real>;
+  using Complex = std::complex<Real>;
+
+  auto close = [](Complex a, Complex b, Real tol) { return std::abs(a-b) <= tol * (1 + std::abs(a)); };
+
+  // Check the derivatives against central differences with complex step h:
+  auto check = [&](auto f)
+  {
+    bool r = true;
+    Real h = 1.e-5;
+    Complex zs[3] = { Complex(0.3, 0.2), Complex(-0.4, 0.7), Complex(1.5, -0.3) };
+    for(Complex z : zs) {
+      DCN w = f(DCN(z.real(), z.imag(), 1, 0));
+      Complex dNum = (f(DCN(z.real() + h, z.imag())).getValue() 
+                    - f(DCN(z.real() - h, z.imag())).getValue()) / (2*h);
+      r &= close(w.getDerivative(), dNum, 1.e-8); }
+    return r;
+  };
+  ok &= check([](DCN z) { return rsExp(z);   });
+  ok &= check([](DCN z) { return rsLog(z);   });
+  ok &= check([](DCN z) { return rsSqrt(z);  });
+  ok &= check([](DCN z) { return rsPow(z, Complex(1.5, 0.5)); });
+  ok &= check([](DCN z) { return rsSin(z);   });
+  ok &= check([](DCN z) { return rsCos(z);   });
+  ok &= check([](DCN z) { return rsTan(z);   });
+  ok &= check([](DCN z) { return rsSinh(z);  });
+  ok &= check([](DCN z) { return rsCosh(z);  });
+  ok &= check([](DCN z) { return rsTanh(z);  });
+  ok &= check([](DCN z) { return rsAsin(z);  });
+  ok &= check([](DCN z) { return rsAcos(z);  });
+  ok &= check([](DCN z) { return rsAtan(z);  });
+  ok &= check([](DCN z) { return rsAsinh(z); });
+  ok &= check([](DCN z) { return rsAcosh(z); });
+  ok &= check([](DCN z) { return rsAtanh(z); });
+  ok &= check([](DCN z) { return rsSin(z*z) / (2.0 + rsExp(-z)); });  // chain and quotient rule
+
+  // Division of general dual complex numbers, i.e. with arbitrary dual parts:
+  DCN x(1, 2, 3, 4), y(5, -6, 7, 8), q = x / y;
+  Complex v = x.getValue(), u = x.getDerivative(), w = y.getValue(), e = y.getDerivative();
+  ok &= close(q.getValue(),      v/w,               1.e-15);
+  ok &= close(q.getDerivative(), (u*w - v*e)/(w*w), 1.e-15);
+  ok &= close((q*y).getValue(),      v, 1.e-15);
+  ok &= close((q*y).getDerivative(), u, 1.e-14);
+
+  // Batch evaluation of a 10th order rational function on the unit circle:
+  static const int K = 8;
+  int N = 4097;  // not a multiple of K, to test the tail
+  std::vector<Real> b = { 0.1, -0.3, 0.5, 0.2, -0.1, 0.05, 0.3, -0.2, 0.1, 0.02, 0.01 };
+  std::vector<Real> a = { 1.0,  0.2, 0.1, -0.05, 0.03, 0.01, -0.02, 0.01, 0.005, 0.001, 0.001 };
+  std::vector<Real> zr(N), zi(N), Hr(N), Hi(N), dr(N), di(N);
+  for(int n = 0; n < N; n++) {
+    Real w = PI * n / N;
+    zr[n] = cos(w); zi[n] = sin(w); }
+  using Batch = rsDualComplexBatch<Real, K>;
+  Batch::evaluateRational(&b[0], 11, &a[0], 11, &zr[0], &zi[0], N, &Hr[0], &Hi[0], &dr[0], &di[0]);
+  for(int n = 0; n < N; n += 97) {
+    DCN z(zr[n], zi[n], 1, 0);
+    DCN H = Batch::horner(&b[0], 11, z) / Batch::horner(&a[0], 11, z);
+    ok &= close(H.getValue(),      Complex(Hr[n], Hi[n]), 1.e-13);
+    ok &= close(H.getDerivative(), Complex(dr[n], di[n]), 1.e-13); }
+
+  // The generic path of the batch evaluator with a function that is written for any dual complex
+  // number type. The constants must be made from the lane type, too:
+  Batch::evaluate([](const auto& z)
+  {
+    using TC = std::decay_t<decltype(z)>;
+    using TL = decltype(z.a);
+    TC one(TL(1), TL(0), TL(0), TL(0));
+    return (z*z*z - one) / (z*z + one + one);
+  }, &zr[0], &zi[0], N, &Hr[0], &Hi[0], &dr[0], &di[0]);
+  for(int n = 0; n < N; n++) {
+    Complex z(zr[n], zi[n]), d = z*z + 2.0;
+    Complex f  = (z*z*z - 1.0) / d;
+    Complex fp = (3.0*z*z*d - (z*z*z - 1.0)*2.0*z) / (d*d);
+    ok &= close(f,  Complex(Hr[n], Hi[n]), 1.e-13);
+    ok &= close(fp, Complex(dr[n], di[n]), 1.e-13); }
+
+  // Benchmark:
+  using Clock = std::chrono::high_resolution_clock;
+  int numRuns = 100;
+  auto t0 = Clock::now();
+  for(int i = 0; i < numRuns; i++) {
+    for(int n = 0; n < N; n++) {
+      DCN z(zr[n], zi[n], 1, 0);
+      DCN H = Batch::horner(&b[0], 11, z) / Batch::horner(&a[0], 11, z);
+      Hr[n] = H.a; Hi[n] = H.b; dr[n] = H.c; di[n] = H.d; }}
+  auto t1 = Clock::now();
+  for(int i = 0; i < numRuns; i++)
+    Batch::evaluateRational(&b[0], 11, &a[0], 11, &zr[0], &zi[0], N, &Hr[0], &Hi[0], &dr[0], &di[0]);
+  auto t2 = Clock::now();
+  auto ns = [&](Clock::time_point t0, Clock::time_point t1) 
+  { return std::chrono::duration<double, std::nano>(t1 - t0).count() / (numRuns * N); };
+  std::cout << "Rational function, ns per point, scalar: " << ns(t0, t1) << ", K = 8: " 
+    << ns(t1, t2) << "\n";
+
+  rsAssert(ok);
+  return ok;
+}
+
 
 /*
      1    i  E  iE
@@ -4089,6 +6400,9 @@ void plotFunction(int N, T xMin, T xMax, const std::function<T(T)>& f)
 // x = r*cos(phi)*cos(theta), y = r*sin(phi)*cos(theta) z = r*cos(phi)*sin(theta)
 // can be used to create 3D mandelbrot sets (mandelbulbs)
 
+// These use their own angle convention for mul (both angles are measured from the x-axis) which 
+// is not a spherical coordinate system in the usual sense. For the standard spherical, 
+// cylindrical and polar coordinates, see rsCoordinateConverter.
 template<class T>
 void cartesianToSpherical(T x, T y, T z, T* r, T* p, T* t)
 {
@@ -4129,6 +6443,345 @@ rsVector3D<T> mul(const rsVector3D<T>& a, const rsVector3D<T> b)
 // (a.x + i*a.z) * (b.x + i*b.z). So the y and z components both behave like imaginary parts if the 
 // respective other component is 0. Can be used to create 3D Mandelbrot sets ("Mandelbulbs").
 
+/** Computes the n-th powers (n >= 1) of the 3D vectors (x[i], y[i], z[i]), i = 0...N-1, in the 
+sense of the spherical coordinates used by mul: the radius is raised to the n-th power and the two 
+angles are multiplied by n. For n = 2, this is the same as mul(a, a). For n > 2, it is not the same
+as multiplying n times because sphericalToCartesian does not preserve the radius, so the 
+conversions in mul are not inverse to each other. Instead of going through atan2, sin and cos, we 
+use that (cos(p), sin(p)) and (cos(t), sin(t)) are just (x,y) and (x,z) normalized, so cos(n*p), 
+sin(n*p) etc. are the real and imaginary parts of the n-th powers of the unit complex numbers 
+(x + i*y) / |x + i*y| and (x + i*z) / |x + i*z|. These are computed by repeated squaring. The 
+loops over i are branch-free, so the compiler can vectorize them. The outputs may be the same 
+arrays as the inputs. */
+template<class T>
+void powSpherical(const T* x, const T* y, const T* z, T* px, T* py, T* pz, int N, int n)
+{
+  rsAssert(n >= 1, "Exponent must be positive");
+  const int B = 16;  // block size
+  T ax[B], ay[B], bx[B], bz[B], r[B];    // bases: unit complex numbers and radius
+  T cx[B], cy[B], dx[B], dz[B], s[B];    // accumulated powers
+  for(int i0 = 0; i0 < N; i0 += B) {
+    int L = rsMin(B, N-i0);
+    for(int i = 0; i < L; i++) {
+      T xi = x[i0+i], yi = y[i0+i], zi = z[i0+i];
+      T rxy = rsSqrt(xi*xi + yi*yi), rxz = rsSqrt(xi*xi + zi*zi);
+      ax[i] = rxy > 0 ? xi/rxy : T(1);   ay[i] = rxy > 0 ? yi/rxy : T(0);  // atan2(0,0) = 0
+      bx[i] = rxz > 0 ? xi/rxz : T(1);   bz[i] = rxz > 0 ? zi/rxz : T(0);
+      r[i]  = rsSqrt(xi*xi + yi*yi + zi*zi);
+      cx[i] = dx[i] = s[i] = T(1);
+      cy[i] = dz[i] = T(0); }
+    for(int m = n; m > 0; m >>= 1) {
+      if(m & 1) {
+        for(int i = 0; i < L; i++) {
+          T t  = cx[i]*ax[i] - cy[i]*ay[i];
+          cy[i] = cx[i]*ay[i] + cy[i]*ax[i];
+          cx[i] = t;
+          t     = dx[i]*bx[i] - dz[i]*bz[i];
+          dz[i] = dx[i]*bz[i] + dz[i]*bx[i];
+          dx[i] = t;
+          s[i] *= r[i]; }}
+      if(m > 1) {
+        for(int i = 0; i < L; i++) {
+          T t  = ax[i]*ax[i] - ay[i]*ay[i];
+          ay[i] = 2*ax[i]*ay[i];
+          ax[i] = t;
+          t     = bx[i]*bx[i] - bz[i]*bz[i];
+          bz[i] = 2*bx[i]*bz[i];
+          bx[i] = t;
+          r[i] *= r[i]; }}}
+    for(int i = 0; i < L; i++) {
+      px[i0+i] = s[i]*cx[i]*dx[i];
+      py[i0+i] = s[i]*cy[i]*dx[i];
+      pz[i0+i] = s[i]*cx[i]*dz[i]; }}
+}
+
+/** Convenience function to compute the n-th power of a single vector. */
+template<class T>
+rsVector3D<T> powSpherical(const rsVector3D<T>& a, int n)
+{
+  rsVector3D<T> p;
+  powSpherical(&a.x, &a.y, &a.z, &p.x, &p.y, &p.z, 1, n);
+  return p;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/** Renders images of 3D Mandelbrot sets ("Mandelbulbs") based on the iteration z <- z^n + c with 
+the power computed by powSpherical. The images are rendered by ray marching with the distance 
+estimate
+
+  d = 0.5 * log(r) * r / dr,  with r = |z| and dr <- n * r^(n-1) * dr + 1
+
+which is the usual running-derivative estimator for Mandelbulbs. It is only a heuristic here 
+(powSpherical does not preserve the radius), so the step sizes are scaled down by a safety factor.
+The rays are clipped to a sphere with the bailout radius. Rays are processed in packets of L 
+adjacent pixels that are marched together through structure-of-arrays buffers, so the inner loops 
+over the lanes can be vectorized. A packet stops as soon as all its rays have hit the surface or 
+left the bounding sphere and the escape-time iteration stops as soon as all lanes have escaped. 
+The image is split into square tiles that are fetched by numThreads threads from a shared counter, 
+so the threads stay busy even though some tiles are much more expensive than others. Hits are 
+shaded with a diffuse term from the normal (the gradient of the distance estimate) and an ambient 
+occlusion term from the number of marching steps. Frames can be appended directly to an 
+rsVideoRGB:
+
+  rsMandelbulbRenderer<float> mb;
+  rsVideoRGB video(w, h);
+  for(int k = 0; k < numFrames; k++) {
+    mb.setCamera(cameraPositionAt(k), Vec3(0,0,0), 0.8f);
+    mb.addFrameTo(video); }  */
+
+template<class T, int L = 8>
+class rsMandelbulbRenderer
+{
+
+public:
+
+  using Vec3 = rsVector3D<T>;
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Setup
+
+  /** Sets the exponent n in z <- z^n + c. */
+  void setPower(int newPower) 
+  { 
+    rsAssert(newPower >= 2, "Power must be at least 2"); 
+    power = newPower; 
+  }
+
+  /** Sets the escape radius for the iteration which is also the radius of the bounding sphere 
+  that the rays are clipped to. */
+  void setBailout(T newBailout) { bailout = newBailout; }
+
+  /** Sets the maximum number of iterations for the escape-time iteration. */
+  void setMaxIterations(int newMax) { maxIts = newMax; }
+
+  /** Sets the parameters of the ray marching. A ray is considered to hit the surface when the 
+  distance estimate is below hitThreshold times the distance traveled (so the precision scales 
+  with the pixel size) and is given up after maxSteps steps. The step sizes are the distance 
+  estimates times stepScale. */
+  void setMarching(int newMaxSteps, T newHitThreshold, T newStepScale = T(0.9))
+  {
+    maxSteps  = newMaxSteps;
+    hitThresh = newHitThreshold;
+    stepScale = newStepScale;
+  }
+
+  /** Sets up the camera at the given position, looking at the given target, with the given 
+  horizontal field of view in radians. The z-axis points up in the image. */
+  void setCamera(const Vec3& position, const Vec3& target, T fieldOfView)
+  {
+    camPos = position;
+    fwd = target - position;
+    fwd = (T(1) / rsSqrt(dot(fwd, fwd))) * fwd;
+    right = Vec3(fwd.y, -fwd.x, T(0));              // cross(fwd, (0,0,1))
+    T rn = rsSqrt(dot(right, right));
+    right = rn > T(0) ? (T(1) / rn) * right : Vec3(T(1), T(0), T(0));
+    up = Vec3(right.y*fwd.z - right.z*fwd.y, right.z*fwd.x - right.x*fwd.z, 
+              right.x*fwd.y - right.y*fwd.x);       // cross(right, fwd)
+    tanHalfFov = rsTan(T(0.5) * fieldOfView);
+  }
+
+  /** Sets the number of threads that render the tiles. */
+  void setNumThreads(int newNumThreads) 
+  { 
+    rsAssert(newNumThreads >= 1, "Need at least one thread"); 
+    numThreads = newNumThreads; 
+  }
+
+  /** Sets the width and height of the square tiles in pixels. */
+  void setTileSize(int newSize) 
+  { 
+    rsAssert(newSize >= 1, "Tile size must be positive"); 
+    tileSize = newSize; 
+  }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Processing
+
+  /** Computes the distance estimates d[i] for the L points (x[i], y[i], z[i]). */
+  void getDistanceEstimates(const T* x, const T* y, const T* z, T* d) const
+  {
+    T zx[L], zy[L], zz[L], dr[L], r[L], rp[L];
+    for(int i = 0; i < L; i++) {
+      zx[i] = x[i]; zy[i] = y[i]; zz[i] = z[i];
+      r[i]  = rsSqrt(zx[i]*zx[i] + zy[i]*zy[i] + zz[i]*zz[i]);
+      dr[i] = T(1); }
+    for(int k = 0; k < maxIts; k++) {
+      int numActive = 0;
+      for(int i = 0; i < L; i++)
+        numActive += r[i] <= bailout;
+      if(numActive == 0)
+        break;                                      // early out: all lanes escaped
+      T wx[L], wy[L], wz[L];
+      powSpherical(zx, zy, zz, wx, wy, wz, L, power);
+      for(int i = 0; i < L; i++)
+        rp[i] = T(1);
+      for(int m = 1; m < power; m++)               // r^(n-1)
+        for(int i = 0; i < L; i++)
+          rp[i] *= r[i];
+      for(int i = 0; i < L; i++) {
+        bool a = r[i] <= bailout;                    // escaped lanes keep their values
+        dr[i] = a ? power * rp[i] * dr[i] + T(1) : dr[i];
+        zx[i] = a ? wx[i] + x[i] : zx[i];
+        zy[i] = a ? wy[i] + y[i] : zy[i];
+        zz[i] = a ? wz[i] + z[i] : zz[i];
+        r[i]  = a ? rsSqrt(zx[i]*zx[i] + zy[i]*zy[i] + zz[i]*zz[i]) : r[i]; }}
+    for(int i = 0; i < L; i++)
+      d[i] = r[i] > T(0) ? T(0.5) * rsLog(r[i]) * r[i] / dr[i] : T(0);  // d < 0 inside the set
+  }
+
+  /** Convenience function to compute the distance estimate for a single point. */
+  T getDistanceEstimate(const Vec3& p) const
+  {
+    T x[L], y[L], z[L], d[L];
+    for(int i = 0; i < L; i++) {
+      x[i] = p.x; y[i] = p.y; z[i] = p.z; }
+    getDistanceEstimates(x, y, z, d);
+    return d[0];
+  }
+
+  /** Renders an image into the red, green and blue channels R, G, B, which must all have the 
+  same shape. The values are in the range 0..1. */
+  void renderFrame(rsImage<float>& R, rsImage<float>& G, rsImage<float>& B) const
+  {
+    int w = R.getWidth(), h = R.getHeight();
+    rsAssert(G.hasShape(w, h) && B.hasShape(w, h), "Channels must have the same shape");
+    int tilesX = (w + tileSize - 1) / tileSize;
+    int tilesY = (h + tileSize - 1) / tileSize;
+    int numTiles = tilesX * tilesY;
+    std::atomic<int> nextTile(0);
+    auto work = [&]()
+    {
+      for(int t = nextTile++; t < numTiles; t = nextTile++) {
+        int x0 = (t % tilesX) * tileSize, y0 = (t / tilesX) * tileSize;
+        renderTile(R, G, B, x0, y0, rsMin(x0 + tileSize, w), rsMin(y0 + tileSize, h)); }
+    };
+    int numThr = rsMin(numThreads, numTiles);
+    if(numThr <= 1) {
+      work();
+      return; }
+    std::vector<std::thread> threads;
+    threads.reserve(numThr);
+    for(int i = 0; i < numThr; i++)
+      threads.push_back(std::thread(work));
+    for(auto& t : threads)
+      t.join();
+  }
+
+  /** Renders an image of the size of the video and appends it as new frame. */
+  void addFrameTo(rsVideoRGB& video) const
+  {
+    int w = video.getWidth(), h = video.getHeight();
+    rsImage<float> R(w, h), G(w, h), B(w, h);
+    renderFrame(R, G, B);
+    video.appendFrame(R, G, B);
+  }
+
+
+protected:
+
+  /** Renders the pixels x0 <= x < x1, y0 <= y < y1 in packets of L pixels along the rows. */
+  void renderTile(rsImage<float>& R, rsImage<float>& G, rsImage<float>& B, 
+    int x0, int y0, int x1, int y1) const
+  {
+    int w = R.getWidth(), h = R.getHeight();
+    T sx = 2 * tanHalfFov / w;                      // pixel size at unit distance
+    T ox[L], oy[L], oz[L], dx[L], dy[L], dz[L], t[L], tEnd[L];
+    T px[L], py[L], pz[L], d[L], shade[L];
+    int steps[L], state[L];                         // 0: marching, 1: hit, 2: missed
+    for(int y = y0; y < y1; y++) {
+      for(int xs = x0; xs < x1; xs += L) {
+
+        // Set up the rays and clip them to the bounding sphere:
+        int numActive = 0;
+        for(int i = 0; i < L; i++) {
+          T u = (xs + i + T(0.5) - T(0.5)*w) * sx;
+          T v = (T(0.5)*h - y - T(0.5)) * sx;
+          dx[i] = fwd.x + u*right.x + v*up.x;
+          dy[i] = fwd.y + u*right.y + v*up.y;
+          dz[i] = fwd.z + u*right.z + v*up.z;
+          T s = T(1) / rsSqrt(dx[i]*dx[i] + dy[i]*dy[i] + dz[i]*dz[i]);
+          dx[i] *= s; dy[i] *= s; dz[i] *= s;
+          ox[i] = camPos.x; oy[i] = camPos.y; oz[i] = camPos.z;
+          T b = ox[i]*dx[i] + oy[i]*dy[i] + oz[i]*dz[i];
+          T c = ox[i]*ox[i] + oy[i]*oy[i] + oz[i]*oz[i] - bailout*bailout;
+          T disc = b*b - c;
+          T sq = rsSqrt(rsMax(disc, T(0)));
+          t[i] = rsMax(-b - sq, T(0));
+          tEnd[i] = -b + sq;
+          state[i] = (disc < 0 || tEnd[i] < 0 || xs + i >= x1) ? 2 : 0;
+          steps[i] = 0;
+          numActive += state[i] == 0; }
+
+        // March all rays of the packet together until none is active anymore:
+        for(int k = 0; k < maxSteps && numActive > 0; k++) {
+          for(int i = 0; i < L; i++) {
+            px[i] = ox[i] + t[i]*dx[i];
+            py[i] = oy[i] + t[i]*dy[i];
+            pz[i] = oz[i] + t[i]*dz[i]; }
+          getDistanceEstimates(px, py, pz, d);
+          numActive = 0;
+          for(int i = 0; i < L; i++) {
+            if(state[i] != 0)
+              continue;
+            if(d[i] < hitThresh * t[i] * sx)
+              state[i] = 1;
+            else {
+              t[i] += stepScale * d[i];
+              steps[i]++;
+              if(t[i] > tEnd[i])
+                state[i] = 2; }
+            numActive += state[i] == 0; }}
+
+        // Shade the hits by the normal estimated from central differences of the distance:
+        int numHits = 0;
+        for(int i = 0; i < L; i++)
+          numHits += state[i] == 1;
+        T e = T(1.e-3);
+        T nx[L] = {}, ny[L] = {}, nz[L] = {}, dp[L], dm[L];
+        for(int i = 0; i < L; i++) {
+          px[i] = ox[i] + t[i]*dx[i];
+          py[i] = oy[i] + t[i]*dy[i];
+          pz[i] = oz[i] + t[i]*dz[i]; }
+        T* n[3] = { nx, ny, nz };
+        T* p[3] = { px, py, pz };
+        for(int a = 0; a < 3 && numHits > 0; a++) {
+          for(int i = 0; i < L; i++) p[a][i] += e;
+          getDistanceEstimates(px, py, pz, dp);
+          for(int i = 0; i < L; i++) p[a][i] -= 2*e;
+          getDistanceEstimates(px, py, pz, dm);
+          for(int i = 0; i < L; i++) {
+            p[a][i] += e;
+            n[a][i] = dp[i] - dm[i]; }}
+        for(int i = 0; i < L; i++) {
+          T nn = rsSqrt(nx[i]*nx[i] + ny[i]*ny[i] + nz[i]*nz[i]);
+          T diffuse = nn > 0 ? -(nx[i]*dx[i] + ny[i]*dy[i] + nz[i]*dz[i]) / nn : T(0);
+          T ao = T(1) - T(steps[i]) / T(maxSteps);
+          shade[i] = T(0.7) * rsMax(diffuse, T(0)) * ao + T(0.3) * ao * ao; }
+
+        // Write the pixels:
+        for(int i = 0; i < L && xs + i < x1; i++) {
+          int x = xs + i;
+          if(state[i] == 1) {
+            R(x, y) = float(shade[i]);
+            G(x, y) = float(0.85 * shade[i]);
+            B(x, y) = float(0.65 * shade[i]); }
+          else {
+            float bg = float(y) / float(h);             // background gradient
+            R(x, y) = 0.05f * bg;
+            G(x, y) = 0.05f * bg;
+            B(x, y) = 0.1f + 0.2f * bg; }}}}
+  }
+
+  int power = 8, maxIts = 10, maxSteps = 200, numThreads = 1, tileSize = 16;
+  T bailout = T(2), hitThresh = T(0.5), stepScale = T(0.9);
+  Vec3 camPos = Vec3(T(0), T(-3), T(0)), fwd = Vec3(T(0), T(1), T(0));
+  Vec3 right = Vec3(T(1), T(0), T(0)), up = Vec3(T(0), T(0), T(1));
+  T tanHalfFov = T(0.5);
+
+};
+
 
 void testVectorMultiplication3D()
 {
@@ -4148,6 +6801,279 @@ void testVectorMultiplication3D()
   int dummy = 0;
 }
 
+bool testMandelbulb()
+{
+  // Checks the spherical powers and the distance estimates of rsMandelbulbRenderer against 
+  // references that use the trigonometric functions, checks that rendering with several threads
+  // gives the same image as with one and measures the throughput of the distance estimator and
+  // the renderer.
+
+  bool ok = true;
+
+  using Vec3 = rsVector3D<double>;
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<double> dist(-1.5, 1.5);
+
+  // Compare powSpherical to the definition via spherical coordinates and, for n = 2, to mul:
+  auto powRef = [](const Vec3& a, int n)
+  {
+    double r, p, t; cartesianToSpherical(a.x, a.y, a.z, &r, &p, &t);
+    double x, y, z; sphericalToCartesian(pow(r, n), n*p, n*t, &x, &y, &z);
+    return Vec3(x, y, z);
+  };
+  auto close = [](const Vec3& a, const Vec3& b, double tol)
+  {
+    Vec3 d = a - b;
+    return d.getEuclideanNorm() <= tol * rsMax(1.0, b.getEuclideanNorm());
+  };
+  const int N = 37;  // not a multiple of the block size
+  std::vector<double> x(N), y(N), z(N), px(N), py(N), pz(N);
+  for(int i = 0; i < N; i++) {
+    x[i] = dist(gen); y[i] = dist(gen); z[i] = dist(gen); }
+  x[0] = y[0] = 0; z[0] = 1;       // on the z-axis
+  x[1] = z[1] = 0; y[1] = -1;      // on the y-axis
+  x[2] = -1; y[2] = z[2] = 0;      // on the negative x-axis
+  for(int n = 1; n <= 9; n++) {
+    powSpherical(&x[0], &y[0], &z[0], &px[0], &py[0], &pz[0], N, n);
+    for(int i = 0; i < N; i++) {
+      Vec3 a(x[i], y[i], z[i]);
+      ok &= close(Vec3(px[i], py[i], pz[i]), powRef(a, n), 1.e-12);
+      ok &= close(powSpherical(a, n), Vec3(px[i], py[i], pz[i]), 0.0);
+      if(n == 2)
+        ok &= close(Vec3(px[i], py[i], pz[i]), mul(a, a), 1.e-12); }}
+
+  // Compare the distance estimates to a scalar reference that uses the trigonometric functions:
+  rsMandelbulbRenderer<double> mb;
+  const int power = 8, maxIts = 10;
+  mb.setPower(power);
+  mb.setMaxIterations(maxIts);
+  auto distRef = [&](const Vec3& c)
+  {
+    Vec3 w = c;
+    double dr = 1, r = w.getEuclideanNorm();
+    for(int k = 0; k < maxIts && r <= 2; k++) {
+      dr = power * pow(r, power-1) * dr + 1;
+      w  = powRef(w, power) + c;
+      r  = w.getEuclideanNorm(); }
+    return r > 0 ? 0.5 * log(r) * r / dr : 0.0;
+  };
+  for(int i = 0; i < N; i++) {
+    Vec3 c(x[i], y[i], z[i]);
+    ok &= rsIsCloseTo(mb.getDistanceEstimate(c), distRef(c), 1.e-9); }
+  ok &= mb.getDistanceEstimate(Vec3(0, 0, 0)) == 0.0;
+  ok &= mb.getDistanceEstimate(Vec3(3, 0, 0)) > 0.0;
+
+  // Render with 1 and 3 threads with a size that is not a multiple of the tile size nor of the 
+  // packet size. The results must be equal:
+  rsMandelbulbRenderer<float> mbf;
+  int w = 67, h = 45;
+  mbf.setCamera(rsVector3D<float>(0.3f, -2.8f, 0.6f), rsVector3D<float>(0, 0, 0), 0.9f);
+  rsImage<float> R1(w, h), G1(w, h), B1(w, h), R3(w, h), G3(w, h), B3(w, h);
+  mbf.renderFrame(R1, G1, B1);
+  mbf.setNumThreads(3);
+  mbf.renderFrame(R3, G3, B3);
+  for(int j = 0; j < h; j++)
+    for(int i = 0; i < w; i++)
+      ok &= R1(i,j) == R3(i,j) && G1(i,j) == G3(i,j) && B1(i,j) == B3(i,j);
+  ok &= R1(w/2, h/2) > 0.1f;                  // center hits the bulb
+  ok &= R1(0, 0) < 0.01f && B1(0, 0) > 0.05f;  // corner shows the background
+
+  // Render some frames of a camera orbit into a video:
+  rsVideoRGB video(w, h);
+  int numFrames = 3;
+  for(int k = 0; k < numFrames; k++) {
+    float a = float(2*PI*k/numFrames);
+    mbf.setCamera(rsVector3D<float>(2.8f*sin(a), -2.8f*cos(a), 0.6f), 
+      rsVector3D<float>(0, 0, 0), 0.9f);
+    mbf.addFrameTo(video); }
+  ok &= video.getNumFrames() == numFrames;
+  //rsVideoFileWriter vw;
+  //vw.setFrameRate(25);
+  //vw.writeVideoToFile(video, "Mandelbulb");
+
+  // Benchmark the distance estimator against the scalar reference and the full renderer:
+  const int M = 20000;
+  std::vector<double> cx(M), cy(M), cz(M), d(M);
+  for(int i = 0; i < M; i++) {
+    cx[i] = 0.6*dist(gen); cy[i] = 0.6*dist(gen); cz[i] = 0.6*dist(gen); }
+  double sum = 0;
+  auto t0 = BenchClock::now();
+  for(int i = 0; i < M; i++)
+    sum += distRef(Vec3(cx[i], cy[i], cz[i]));
+  auto t1 = BenchClock::now();
+  for(int i = 0; i < M; i += 8)
+    mb.getDistanceEstimates(&cx[i], &cy[i], &cz[i], &d[i]);
+  auto t2 = BenchClock::now();
+  for(int i = 0; i < M; i++)
+    sum += d[i];
+  auto mps = [&](BenchClock::time_point a, BenchClock::time_point b, double n)
+  { return n / millisecondsBetween(a, b) / 1.e3; };
+  std::cout << "Mandelbulb distance estimates (Mpoints/s): "
+    << "trig " << mps(t0, t1, M) << ", packets " << mps(t1, t2, M) << "\n";
+  w = 320; h = 240;
+  rsImage<float> R(w, h), G(w, h), B(w, h);
+  mbf.setCamera(rsVector3D<float>(0.3f, -2.8f, 0.6f), rsVector3D<float>(0, 0, 0), 0.9f);
+  for(int numThreads = 1; numThreads <= 4; numThreads *= 4) {
+    mbf.setNumThreads(numThreads);
+    t0 = BenchClock::now();
+    mbf.renderFrame(R, G, B);
+    t1 = BenchClock::now();
+    std::cout << "Mandelbulb frame " << w << "x" << h << ", " << numThreads << " threads: " 
+      << mps(t0, t1, w*h) << " Mpixels/s\n"; }
+  std::cout << "(checksum " << sum << ")\n";
+
+  rsAssert(ok);
+  return ok;
+}
+
+bool testCoordinateConversion()
+{
+  // Checks the accuracy of the trigonometric kernels of rsCoordinateConverter against long double
+  // references, the special values of atan2 and the roundtrips between all coordinate systems and
+  // compares the speed of the accuracy settings.
+
+  bool ok = true;
+
+  using Conv = rsCoordinateConverter<double>;
+  using Acc  = Conv::Accuracy;
+  std::mt19937 gen(3);
+  std::uniform_real_distribution<double> dist(-1.0, 1.0);
+
+  // Measure the maximum errors of the kernels in units of the spacing of doubles at the exact 
+  // value (the "ulp") and as relative error, using long double as reference:
+  const int N = 100003;
+  std::vector<double> x(N), y(N), s(N), c(N), a(N);
+  for(int i = 0; i < N; i++) {
+    x[i] = 100 * dist(gen); y[i] = dist(gen); }
+  x[0] = 0; x[1] = PI/2; x[2] = -PI; x[3] = 1.e-300;
+  auto ulpErr = [](double v, long double ref)
+  {
+    if(ref == 0) return (long double)(rsAbs(v) > 0 ? 1.e300 : 0.0);
+    int e; frexp(double(ref), &e);
+    return rsAbs(v - ref) / ldexp(1.0L, e - 53);
+  };
+  auto relErr = [](double v, long double ref)
+  {
+    return ref == 0 ? (long double)rsAbs(v) : rsAbs((v - ref) / ref);
+  };
+  auto measureSinCos = [&](Acc acc, long double* maxUlp, long double* maxRel)
+  {
+    Conv::sinCos(&x[0], &s[0], &c[0], N, acc);
+    *maxUlp = *maxRel = 0;
+    for(int i = 0; i < N; i++) {
+      long double xi = x[i], rs = sinl(xi), rc = cosl(xi);
+      *maxUlp = rsMax(*maxUlp, rsMax(ulpErr(s[i], rs), ulpErr(c[i], rc)));
+      *maxRel = rsMax(*maxRel, rsMax(relErr(s[i], rs), relErr(c[i], rc))); }
+  };
+  auto measureAtan2 = [&](Acc acc, long double* maxUlp, long double* maxRel)
+  {
+    // Use y as given and x in -1..1 to cover all octants:
+    for(int i = 0; i < N; i++) s[i] = 0.01 * x[i];
+    Conv::atan2(&y[0], &s[0], &a[0], N, acc);
+    *maxUlp = *maxRel = 0;
+    for(int i = 0; i < N; i++) {
+      long double ref = atan2l((long double)y[i], (long double)s[i]);
+      *maxUlp = rsMax(*maxUlp, ulpErr(a[i], ref));
+      *maxRel = rsMax(*maxRel, relErr(a[i], ref)); }
+  };
+  long double u, r;
+  std::cout << "Maximum errors (ulp, relative):\n";
+  for(Acc acc : { Acc::libm, Acc::high, Acc::fast }) {
+    const char* name = acc == Acc::libm ? "libm" : (acc == Acc::high ? "high" : "fast");
+    measureSinCos(acc, &u, &r);
+    std::cout << "  sinCos " << name << ": " << double(u) << ", " << double(r) << "\n";
+    if(acc == Acc::high) ok &= u <= 1.5;
+    if(acc == Acc::fast) ok &= r <= 1.e-7;
+    measureAtan2(acc, &u, &r);
+    std::cout << "  atan2  " << name << ": " << double(u) << ", " << double(r) << "\n";
+    if(acc == Acc::high) ok &= u <= 2.5;
+    if(acc == Acc::fast) ok &= r <= 1.e-7; }
+
+  // Special values of atan2 on the axes, including signed zeros:
+  double ys[8] = { 0, 1, 0, -1,  0, -0.0, -0.0,  0    }; 
+  double xs[8] = { 1, 0, -1, 0,  0,  1,   -1,   -0.0 }, as[8], ls[8];
+  Conv::atan2(ys, xs, as, 8, Acc::high);
+  Conv::atan2(ys, xs, ls, 8, Acc::libm);
+  for(int i = 0; i < 8; i++)
+    ok &= as[i] == ls[i] && std::signbit(as[i]) == std::signbit(ls[i]);
+
+  // Roundtrips for all coordinate systems with all accuracies. Use some lengths that are not 
+  // multiples of the block size and convert in place:
+  Conv conv;
+  for(int M : { 1, 15, 16, 17, 100 }) {
+    std::vector<double> px(M), py(M), pz(M), qx, qy, qz;
+    for(int i = 0; i < M; i++) {
+      px[i] = dist(gen); py[i] = dist(gen); pz[i] = dist(gen); }
+    for(Acc acc : { Acc::libm, Acc::high, Acc::fast }) {
+      conv.setAccuracy(acc);
+      double tol = acc == Acc::fast ? 1.e-6 : 1.e-14;
+      auto check = [&]()
+      {
+        for(int i = 0; i < M; i++)
+          ok &= rsIsCloseTo(qx[i], px[i], tol) && rsIsCloseTo(qy[i], py[i], tol) 
+             && rsIsCloseTo(qz[i], pz[i], tol);
+      };
+      qx = px; qy = py; qz = pz;
+      conv.cartesianToPolar(&qx[0], &qy[0], &qx[0], &qy[0], M);
+      for(int i = 0; i < M; i++)
+        ok &= qx[i] >= 0 && rsAbs(qy[i]) <= PI;
+      conv.polarToCartesian(&qx[0], &qy[0], &qx[0], &qy[0], M);
+      check();
+      conv.cartesianToCylindrical(&qx[0], &qy[0], &qz[0], &qx[0], &qy[0], &qz[0], M);
+      conv.cylindricalToCartesian(&qx[0], &qy[0], &qz[0], &qx[0], &qy[0], &qz[0], M);
+      check();
+      conv.cartesianToSpherical(&qx[0], &qy[0], &qz[0], &qx[0], &qy[0], &qz[0], M);
+      for(int i = 0; i < M; i++)
+        ok &= qy[i] >= 0 && qy[i] <= PI;         // polar angle theta
+      conv.sphericalToCartesian(&qx[0], &qy[0], &qz[0], &qx[0], &qy[0], &qz[0], M);
+      check(); }}
+
+  // The spherical coordinates should agree with the textbook formulas:
+  {
+    double px = 0.3, py = -0.4, pz = 1.2, r, theta, phi;
+    conv.setAccuracy(Acc::high);
+    conv.cartesianToSpherical(&px, &py, &pz, &r, &theta, &phi, 1);
+    ok &= rsIsCloseTo(r, 1.3, 1.e-15);
+    ok &= rsIsCloseTo(theta, acos(pz / r), 1.e-15);
+    ok &= rsIsCloseTo(phi, atan2(py, px), 1.e-15);
+  }
+
+  // The float version:
+  {
+    using ConvF = rsCoordinateConverter<float>;
+    const int M = 1000;
+    std::vector<float> t(M), sf(M), cf(M);
+    for(int i = 0; i < M; i++) t[i] = float(10 * dist(gen));
+    ConvF::sinCos(&t[0], &sf[0], &cf[0], M, ConvF::Accuracy::fast);
+    for(int i = 0; i < M; i++)
+      ok &= rsIsCloseTo(sf[i], std::sin(t[i]), 5.e-7f) && rsIsCloseTo(cf[i], std::cos(t[i]), 5.e-7f);
+  }
+
+  // Benchmark the conversions:
+  std::vector<double> px(N), py(N), pz(N), r1(N), r2(N), r3(N);
+  for(int i = 0; i < N; i++) {
+    px[i] = dist(gen); py[i] = dist(gen); pz[i] = dist(gen); }
+  double sum = 0;
+  for(Acc acc : { Acc::libm, Acc::high, Acc::fast }) {
+    conv.setAccuracy(acc);
+    auto t0 = BenchClock::now();
+    conv.cartesianToSpherical(&px[0], &py[0], &pz[0], &r1[0], &r2[0], &r3[0], N);
+    auto t1 = BenchClock::now();
+    conv.sphericalToCartesian(&r1[0], &r2[0], &r3[0], &r1[0], &r2[0], &r3[0], N);
+    auto t2 = BenchClock::now();
+    sum += r1[N/2];
+    auto mps = [&](BenchClock::time_point a, BenchClock::time_point b)
+    { return N / millisecondsBetween(a, b) / 1.e3; };
+    std::cout << (acc == Acc::libm ? "libm" : (acc == Acc::high ? "high" : "fast")) 
+      << ": to spherical " << mps(t0, t1) << ", to cartesian " << mps(t1, t2) 
+      << " Mpoints/s\n"; }
+  std::cout << "(checksum " << sum << ")\n";
+
+  rsAssert(ok);
+  return ok;
+}
+
+
 
 
 
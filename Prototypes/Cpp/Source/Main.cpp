@@ -31,14 +31,36 @@ int main (int /*argc*/, char* /*argv[]*/)
   //testManifoldPolar();
   //testManifoldSphere();
   //testManifoldEarth();
+  //testManifoldBatch();
+  //testManifoldPacked();
+  //testManifoldFixed();
+  //testGeodesics();
   
   //testSortedSet();
+  //testSortedSetKernels();
+  //testSortedSetInPlace();
+  //testSortedSetMultiWay();
+  //testRoaringSet();
+  //testChunkedSortedSet();
+  //testRelation();
+  //testCombinations();
+  //testVmathBatch();
+  //testBvh();
+  //testPlaneBatch();
+  //testMandelbulb();
+  //testCoordinateConversion();
   //testAutoDiff();
   //testAutoDiff2();
   //testAutoDiff3();
   //testAutoDiff4();
   //testAutoDiffReverse1();
+  //testAutoDiffReverseGradient();
+  //testAutoDiffVectorMode();
+  //testTaylorAD();
+  //testCheckpointedGradient();
+  //testDualExpressionTemplates();
   //testDualComplex();
+  //testDualComplexFunctions();
   testVectorMultiplication3D();
   //testVertexMesh();  // moved to main codbase
 
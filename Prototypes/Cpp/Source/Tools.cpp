@@ -1,4 +1,11 @@
 #include "../JuceLibraryCode/JuceHeader.h"
+#include <thread>
+#include <chrono>
+#include <array>
+#include <random>
+#include <set>
+#include <atomic>
+#include <cstring>
 using namespace RAPT;
 using namespace rosic;
 
@@ -436,8 +443,13 @@ public:
     u = newU;
     v = newV;
     w = newW;
+    updateCoeffs();
   }
 
+  /** Returns the unit normal vector of the plane. It points to the side where 
+  getSignedDistance is positive and is the normalized cross product of v and w. */
+  rsVector3D<T> getNormal() const { return n; }
+
   /** Returns the point (x,y,z) on the plane that corresponds to the pair of parameters (s,t). */
   rsVector3D<T> getPointOnPlane(T s, T t) const
   {
@@ -483,26 +495,20 @@ public:
   to the given target point in the sense of minimizing the Euclidean distance. */
   void getMatchParameters(const rsVector3D<T>& target, T* s, T* t) const
   {
-    // Idea: minimize the squared norm of a-b where a = u + s*v + t*u is a vector produced by our 
-    // plane equation and b is the target vector. This leads to finding the minimum of the 
-    // quadratic form: err(s,t) = A*s^2 + B*s*t + C*t^2 + D*s + E*t + F with respect to s and t 
-    // with the coefficients defined as below:
-
-    rsVector3D<T> c = u-target;  // c := u-b -> now we minimize norm of c + s*v + t*w
-    T A =   dot(v,v);
-    T B = 2*dot(v,w);
-    T C =   dot(w,w);
-    T D = 2*dot(c,v);
-    T E = 2*dot(c,w);
-    T F =   dot(c,c);
-    T k = 1 / (B*B - 4*A*C); // can we get a division by zero here?
-    *s  = (2*C*D - B*E) * k;
-    *t  = (2*A*E - B*D) * k;
-
-    // Is it possible to derive simpler formulas? maybe involving the plane normal (which can be 
-    // computed via the cross-product of v and w)? There are a lot of multiplications being done 
-    // here....
+    // Idea: minimize the squared norm of a-b where a = u + s*v + t*w is a vector produced by our 
+    // plane equation and b is the target vector. Setting the partial derivatives with respect to 
+    // s and t to zero gives the 2x2 linear system A*s + B*t = c*v, B*s + C*t = c*w with c = b-u,
+    // A = v*v, B = v*w, C = w*w, which we solve by Cramer's rule. A, B, C and the reciprocal k of
+    // the determinant depend only on the plane, so they are computed once in updateCoeffs.
+    rsVector3D<T> c = target-u;
+    T cv = dot(c,v);
+    T cw = dot(c,w);
+    *s = (C*cv - B*cw) * k;
+    *t = (A*cw - B*cv) * k;
   }
+  // Derivation via the quadratic form err(s,t) = A*s^2 + B*s*t + C*t^2 + D*s + E*t + F with 
+  // A = v*v, B = 2*v*w, C = w*w, D = 2*c*v, E = 2*c*w, F = c*c where c = u-b (the B, D, E here 
+  // differ from the ones in the code by factors of +-2):
   // sage:
   // var("s t A B C D E F")
   // f(s,t) = A*s^2 + B*s*t + C*t^2 + D*s + E*t + F
@@ -530,27 +536,126 @@ public:
   the minimum Euclidean distance. */
   rsVector3D<T> getClosestPointOnPlane(const rsVector3D<T>& target) const
   {
-    T s, t;
-    getMatchParameters(target, &s, &t);
-    return getPointOnPlane(s, t);
+    return target - getSignedDistance(target) * n;
+  }
+
+  /** Computes the signed distance of the given point p from the plane. It is positive on the side
+  into which the normal (see getNormal) points and negative on the other side. */
+  T getSignedDistance(const rsVector3D<T>& p) const
+  {
+    return dot(n, p) - d;
   }
 
   /** Computes the distance of the given point p from the plane. */
   T getDistance(const rsVector3D<T>& p) const
   {
-    rsVector3D<T> q = getClosestPointOnPlane(p);
-    q -= p;
-    return q.getEuclideanNorm();
+    return rsAbs(getSignedDistance(p));
+  }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Batch processing
+
+  /** Computes the parameters s[i], t[i] of the points on the plane that are closest to the N 
+  points (x[i], y[i], z[i]), like getMatchParameters does for a single point. The work is split 
+  into contiguous chunks of points that are processed in numThreads threads. The loops are 
+  branch-free and work on separate coordinate arrays (structure-of-arrays layout), so compilers 
+  can vectorize them. */
+  void getMatchParameters(const T* x, const T* y, const T* z, T* s, T* t, int N, 
+    int numThreads = 1) const
+  {
+    rsVector3D<T> u = this->u, v = this->v, w = this->w;  // local copies can stay in registers
+    T A = this->A, B = this->B, C = this->C, k = this->k;
+    forChunks(N, numThreads, [=](int start, int end)
+    {
+      for(int i = start; i < end; i++) {
+        T cx = x[i] - u.x, cy = y[i] - u.y, cz = z[i] - u.z;
+        T cv = cx*v.x + cy*v.y + cz*v.z;
+        T cw = cx*w.x + cy*w.y + cz*w.z;
+        s[i] = (C*cv - B*cw) * k;
+        t[i] = (A*cw - B*cv) * k; }
+    });
+  }
+
+  /** Computes the signed distances dist[i] of the N points (x[i], y[i], z[i]) from the plane. 
+  @see getMatchParameters(const T*, const T*, const T*, T*, T*, int, int) */
+  void getSignedDistances(const T* x, const T* y, const T* z, T* dist, int N, 
+    int numThreads = 1) const
+  {
+    rsVector3D<T> n = this->n;
+    T d = this->d;
+    forChunks(N, numThreads, [=](int start, int end)
+    {
+      for(int i = start; i < end; i++)
+        dist[i] = n.x*x[i] + n.y*y[i] + n.z*z[i] - d;
+    });
   }
-  // needs test
-  // todo: compute the signed distance - maybe that requires translating to implicit form:
-  //   A*x + B*y + C*z + D = 0
 
+  /** Projects the N points (x[i], y[i], z[i]) orthogonally onto the plane and writes the 
+  projected points into (px[i], py[i], pz[i]). The outputs may be the same arrays as the inputs.
+  @see getMatchParameters(const T*, const T*, const T*, T*, T*, int, int) */
+  void getClosestPointsOnPlane(const T* x, const T* y, const T* z, T* px, T* py, T* pz, int N,
+    int numThreads = 1) const
+  {
+    rsVector3D<T> n = this->n;
+    T d = this->d;
+    forChunks(N, numThreads, [=](int start, int end)
+    {
+      for(int i = start; i < end; i++) {
+        T sd = n.x*x[i] + n.y*y[i] + n.z*z[i] - d;
+        px[i] = x[i] - sd*n.x;
+        py[i] = y[i] - sd*n.y;
+        pz[i] = z[i] - sd*n.z; }
+    });
+  }
+
+
+protected:
+
+  /** Computes the plane invariants that the queries need from u, v, w. */
+  void updateCoeffs()
+  {
+    A = dot(v,v);
+    B = dot(v,w);
+    C = dot(w,w);
+    k = 1 / (A*C - B*B);                  // Gram determinant, zero iff v,w are linearly dependent
+    n = rsVector3D<T>(v.y*w.z - v.z*w.y, v.z*w.x - v.x*w.z, v.x*w.y - v.y*w.x); // cross(v,w)
+    n = (T(1) / rsSqrt(dot(n,n))) * n;
+    d = dot(n,u);
+  }
+
+  /** Calls f(start, end) for contiguous chunks of the index range 0...N-1 in numThreads 
+  threads. */
+  template<class F>
+  static void forChunks(int N, int numThreads, F f)
+  {
+    rsAssert(numThreads >= 1, "Need at least one thread");
+    numThreads = rsMin(numThreads, N);
+    if(numThreads <= 1) {
+      f(0, N);
+      return; }
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads);
+    int chunkSize = N / numThreads;
+    int remainder = N % numThreads;
+    int start = 0;
+    for(int i = 0; i < numThreads; i++) {
+      int end = start + chunkSize + (i < remainder ? 1 : 0);
+      threads.push_back(std::thread(f, start, end));
+      start = end; }
+    for(auto& t : threads)
+      t.join();
+  }
 
 protected:
 
   rsVector3D<T> u, v, w;
 
+  // Cached invariants, computed in updateCoeffs:
+  T A = 0, B = 0, C = 0, k = 0;  // Gram matrix entries v*v, v*w, w*w and 1/det
+  rsVector3D<T> n;               // unit normal
+  T d = 0;                       // normal form: n*x = d for points x on the plane
+
 };
 // todo: clean up and move to rapt (into Math/Geometry)
 
@@ -933,6 +1038,76 @@ inline rsTensor<T> operator*(const T& s, const rsTensor<T>& A)
 
 //-------------------------------------------------------------------------------------------------
 
+/** Index computations for packed storage of tensors with the symmetries that occur in 
+differential geometry. For symmetric index pairs (i,j) (like the lower indices of Christoffel
+symbols, the metric or the Ricci tensor), only the components with i <= j are stored, for 
+antisymmetric pairs only those with i < j. The fully covariant Riemann tensor R_ijkl is 
+antisymmetric in (i,j) and in (k,l) and symmetric under exchange of the two pairs, so it's stored 
+as a symmetric matrix of antisymmetric pairs. That's P(P+1)/2 components where P = N(N-1)/2. The 
+first Bianchi identity R_ijkl + R_iklj + R_iljk = 0 reduces the number of independent components 
+further by N(N-1)(N-2)(N-3)/24 (one for each set of 4 distinct indices) to N^2 (N^2-1)/12. These 
+dependent components are still stored (that simplifies the indexing) but need not be computed by 
+the general formula. For N = 4, we store 21 and compute 20 instead of 256 components. */
+
+class rsTensorPacking
+{
+
+public:
+
+  /** Number of index pairs (i,j) with i <= j, i.e. the number of independent components of a 
+  symmetric NxN matrix. */
+  static int numSymmetricPairs(int N) { return N*(N+1)/2; }
+
+  /** Number of index pairs (i,j) with i < j, i.e. the number of independent components of an 
+  antisymmetric NxN matrix. */
+  static int numAntisymmetricPairs(int N) { return N*(N-1)/2; }
+
+  /** Position of the pair (i,j) in a row-wise packed upper triangle including the diagonal. The 
+  order of i,j doesn't matter. */
+  static int symmetricIndex(int i, int j, int N)
+  { if(i > j) rsSwap(i, j); return i*N - i*(i-1)/2 + j - i; }
+
+  /** Position of the pair (i,j), i != j, in a row-wise packed strict upper triangle. The order of 
+  i,j doesn't matter - for antisymmetric tensors, the caller must take care of the sign. */
+  static int antisymmetricIndex(int i, int j, int N)
+  { if(i > j) rsSwap(i, j); return i*N - i*(i+1)/2 + j - i - 1; }
+
+  /** Number of stored components for a packed Riemann tensor. */
+  static int numRiemannComponents(int N)
+  { int P = numAntisymmetricPairs(N); return P*(P+1)/2; }
+
+  /** Number of algebraically independent components of the Riemann tensor in N dimensions. */
+  static int numIndependentRiemannComponents(int N) { return N*N*(N*N-1)/12; }
+
+  /** Returns the position of R_ijkl in packed Riemann storage and assigns the sign with which the
+  stored value must be multiplied. Returns -1 (and sign 0) for the components that are zero due 
+  to antisymmetry, i.e. when i == j or k == l. */
+  static int riemannIndex(int i, int j, int k, int l, int N, int* sign)
+  {
+    if(i == j || k == l) { *sign = 0; return -1; }
+    *sign = 1;
+    if(i > j) { rsSwap(i, j); *sign = -*sign; }
+    if(k > l) { rsSwap(k, l); *sign = -*sign; }
+    int P = numAntisymmetricPairs(N);
+    return symmetricIndex(antisymmetricIndex(i, j, N), antisymmetricIndex(k, l, N), P);
+  }
+
+  /** Returns true, if the packed Riemann component R_ijkl with i < j, k < l is the one that we 
+  compute from the other two of its set by the first Bianchi identity. For 4 distinct indices 
+  a < b < c < d, these are the components with the pairs (a,d),(b,c). */
+  static bool isBianchiDependent(int i, int j, int k, int l)
+  {
+    if(i == k || i == l || j == k || j == l) return false;
+    return (i < k && l < j) || (k < i && j < l);
+  }
+
+};
+
+//-------------------------------------------------------------------------------------------------
+
+template<class TVal, class TDer> class rsDualNumber; // defined below, used in rsManifold
+template<class T, int D> class rsTaylorNumber;       // dito
+
 /** Class for doing computations with N-dimensional manifolds that are embedded in M-dimensional
 Euclidean space, where M >= N. The user must provide a function that takes as input an 
 N-dimensional vector of general curvilinear coordinates and produces a corresponding M-dimensional 
@@ -940,7 +1115,7 @@ vector of the resulting coordinates in the embedding space. The case N = M = 3 c
 work with cylindrical or spherical coordinates in 3D space. The class can compute various geometric
 entities on the manifold, such as the metric tensor...
 
-todo: compute lengths of curves, areas, angles, geodesics, ...
+todo: compute lengths of curves, areas, angles, ... (geodesics: see rsGeodesicSolver)
 
 References:
   (1) Principles of Tensor Calculus (Taha Sochi)
@@ -991,6 +1166,18 @@ public:
   using FuncVecToMat = std::function<void(const Vec&, Mat&)>;
   // 1st argument: input vector, 2nd argument: output Jacobian matrix
 
+  using Dual1 = rsDualNumber<T, T>;          // carries 1st derivatives
+  using Dual2 = rsDualNumber<Dual1, Dual1>;  // ...up to 2nd derivatives
+  using Dual3 = rsDualNumber<Dual2, Dual2>;  // ...up to 3rd derivatives
+  using VecAD = std::vector<Dual3>;
+  using FuncVecToVecAD = std::function<void(const VecAD&, VecAD&)>;
+  // coordinate map u2x for automatic differentiation
+
+  using Taylor3 = rsTaylorNumber<T, 3>;       // truncated Taylor series up to 3rd order
+  using VecTaylor = std::vector<Taylor3>;
+  using FuncVecToVecTaylor = std::function<void(const VecTaylor&, VecTaylor&)>;
+  // coordinate map u2x for automatic differentiation via Taylor series
+
   //-----------------------------------------------------------------------------------------------
   // \name Setup
 
@@ -1020,6 +1207,29 @@ public:
   void setCartToCurvJacobian(const FuncVecToMat& newFunc)
   { x2uJ = newFunc; }
 
+  /** Sets the function that converts from curvilinear to cartesian coordinates in a version that 
+  operates on 3-times nested dual numbers. It should implement the same mapping as the function 
+  passed to setCurvilinearToCartesian. When such a function is assigned, the basis vectors, 
+  metric, Christoffel symbols and Riemann tensor will be computed from exact derivatives obtained 
+  by automatic differentiation instead of by (nested) numerical differentiation. When both 
+  versions are written as a generic lambda, the same lambda can be passed to both setters. Pass an
+  empty function to switch back to numerical derivatives. */
+  void setCurvilinearToCartesianAD(const FuncVecToVecAD& newFunc)
+  { u2xAD = newFunc; }
+
+  /** Alternative to setCurvilinearToCartesianAD that uses truncated Taylor series of degree 3 
+  instead of nested dual numbers for the exact derivatives. It is more efficient because the 
+  arithmetic on rsTaylorNumber is cheaper. If both are assigned, this one is used. */
+  void setCurvilinearToCartesianTaylor(const FuncVecToVecTaylor& newFunc)
+  { u2xTaylor = newFunc; }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Inquiry
+
+  int getNumManifoldDimensions() const { return N; }
+
+  int getNumEmbeddingSpaceDimensions() const { return M; }
 
 
   //-----------------------------------------------------------------------------------------------
@@ -1044,6 +1254,8 @@ public:
   Mat getCovariantBasis(const Vec& u) const
   {
     rsAssert((int)u.size() == N);
+    if( hasAD() )
+      return getCovariantBasisAD(u);
     if( u2xJ ) {  // is this the right way to check, if std::function is not empty?
       Mat E(M, N); u2xJ(u, E); return E; }
     else
@@ -1213,10 +1425,29 @@ public:
 
   Mat getContravariantMetric(const Vec& u) const
   {
+    if( hasAD() || !(x2u || x2uJ) )
+      return getInverseMetric(getCovariantMetric(u));
+
     Mat E = getContravariantBasis(u);
     return E * E.getTranspose();  // (1), Eq. 214
   }
-  // when x2u is not assigned (empty): use as fallback: getCovariantMetric().getInverse() 
+  // When an AD coordinate map is assigned or no inverse mapping is available, we use the inverse 
+  // of the covariant metric. 
+
+  /** Returns the inverse of the given NxN metric tensor. */
+  Mat getInverseMetric(const Mat& g) const
+  {
+    Vec a(N*N), ai(N*N);
+    for(int i = 0; i < N; i++)
+      for(int j = 0; j < N; j++)
+        a[i*N+j] = g(i, j);
+    invertInPlace(&a[0], &ai[0], N);
+    Mat gi(N, N);
+    for(int i = 0; i < N; i++)
+      for(int j = 0; j < N; j++)
+        gi(i, j) = ai[i*N+j];
+    return gi;
+  }
 
 
   /** Computes the mixed dot product of a covariant covector and contravariant vector or vice 
@@ -1336,6 +1567,9 @@ public:
   important Christoffel symbols of the second kind - see below...  */
   Tens getChristoffelSymbols1stKind(const Vec& u) const
   {
+    if( hasAD() )
+      return getChristoffelSymbols1stKindAD(u);
+
     int i, j, l;
 
     // Create an array of the partial derivatives of the metric with respect to the coordinates:
@@ -1362,9 +1596,9 @@ public:
     // into an NxNxN 3D array:
     Tens C({N,N,N}); 
     for(i = 0; i < N; i++)
-      for(j = 0; j < N; j++)
+      for(j = i; j < N; j++)      // symmetric in i,j - compute only j >= i
         for(l = 0; l < N; l++)
-          C(i,j,l) = T(0.5) * (dg[j](i,l) + dg[i](j,l) - dg[l](i,j)); // (1), Eq. 307
+          C(i,j,l) = C(j,i,l) = T(0.5) * (dg[j](i,l) + dg[i](j,l) - dg[l](i,j)); // (1), Eq. 307
     return C;
   }
   // the notation G_kij is also used - 3 lowercase indices
@@ -1393,6 +1627,9 @@ public:
   partial derivatives is irrelevant (by Schwarz's theorem). */
   Tens getChristoffelSymbols2ndKind(const Vec& u) const
   {
+    if( hasAD() )
+      return getChristoffelSymbols2ndKindAD(u);
+
     int k, i, j;
     // k: derivative index
     // i: basis vector index
@@ -1404,7 +1641,7 @@ public:
     Tens G({N,N,N});
     G.setToZero();
     for(i = 0; i < N; i++)
-      for(j = 0; j < N; j++)
+      for(j = i; j < N; j++)      // symmetric in i,j - compute only j >= i and mirror
         for(k = 0; k < N; k++)
         {
           for(int l = 0; l < N; l++)
@@ -1415,6 +1652,7 @@ public:
             // first:
             // https://en.wikipedia.org/wiki/Christoffel_symbols#Christoffel_symbols_of_the_first_kind
           }
+          G(k,j,i) = G(k,i,j);
         }
     return G;
   }
@@ -1565,6 +1803,9 @@ public:
   /** Under construction... not yet tested */
   Tens getRiemannTensor1stKind(const Vec& u) const
   {
+    if( hasAD() )
+      return getRiemannTensor1stKindAD(u);
+
     int i, j, k, l, r;
     Vec up(u), um(u);         // wiggled u coordinate vectors
     Tens cp, cm;              // Christoffel symbols at up and um
@@ -1612,6 +1853,9 @@ public:
 
   Tens getRiemannTensor2ndKind(const Vec& u) const
   {
+    if( hasAD() )
+      return getRiemannTensor2ndKindAD(u);
+
     int i, j, k, l, r;
 
     // compute Christoffel symbols of 2nd kind:
@@ -1646,7 +1890,9 @@ public:
     for(i = 0; i < N; i++)
       for(j = 0; j < N; j++)
         for(k = 0; k < N; k++)
-          for(l = 0; l < N; l++)
+        {
+          R(i,j,k,k) = T(0);
+          for(l = k+1; l < N; l++)  // antisymmetric in k,l - compute only l > k
           {
             // (1), Eq. 560:
             //double test1 = dc[k](i,j,l);
@@ -1655,8 +1901,10 @@ public:
             R(i,j,k,l) = dc[k](i,j,l) - dc[l](i,j,k);
             for(r = 0; r < N; r++)
               R(i,j,k,l) += c(r,j,l)*c(i,r,k) - c(r,j,k)*c(i,r,l);
+            R(i,j,l,k) = -R(i,j,k,l);
             //int dummy = 0;
           }
+        }
     return R;
   }
 
@@ -1794,6 +2042,711 @@ public:
   */
 
 
+  //-----------------------------------------------------------------------------------------------
+  // \name Automatic differentiation. These functions are used instead of their numerical 
+  // counterparts when a coordinate map for nested dual numbers or Taylor series was assigned via 
+  // setCurvilinearToCartesianAD or setCurvilinearToCartesianTaylor. All geometric entities are 
+  // computed from the exact 1st, 2nd and 3rd partial derivatives of the coordinate map x(u), so 
+  // there is no dependency on the stepsize h and a Riemann tensor needs only N(N+1)(N+2)/6 
+  // evaluations of the map (4 for N=2, 10 for N=3) instead of O(N^3) evaluations of the numerical
+  // version. 
+
+  /** Evaluates the coordinate map x(u) with nested dual numbers and fills the arrays of partial 
+  derivatives of the cartesian coordinates x with respect to the curvilinear coordinates u up to 
+  the given order (1..3). The derivatives are stored as: dx[k*N+i] = dx_k/du_i, 
+  d2x[(k*N+i)*N+j] = d^2 x_k / du_i du_j, d3x[((k*N+i)*N+j)*N+l] = d^3 x_k / du_i du_j du_l. Each
+  evaluation seeds the 3 infinitesimals of the nesting levels with the coordinate directions 
+  a <= b <= c, so the number of evaluations is N, N(N+1)/2 or N(N+1)(N+2)/6 for order 1, 2 or 3 
+  respectively. */
+  void getCoordinateDerivativesAD(const Vec& u, int order, Vec& dx, Vec& d2x, Vec& d3x) const
+  {
+    if(u2xTaylor) {
+      getCoordinateDerivativesTaylor(u, order, dx, d2x, d3x);
+      return; }
+    rsAssert(u2xAD, "Coordinate map for automatic differentiation not assigned");
+    rsAssert(order >= 1 && order <= 3, "Order must be 1, 2 or 3");
+    dx.resize(M*N);
+    if(order >= 2) d2x.resize(M*N*N);
+    if(order >= 3) d3x.resize(M*N*N*N);
+    VecAD ua(N), xa(M);
+    auto s = [](bool seed) { return seed ? T(1) : T(0); };
+    for(int a = 0; a < N; a++) {
+      for(int b = a; b < (order >= 2 ? N : a+1); b++) {
+        for(int c = b; c < (order >= 3 ? N : b+1); c++) {
+
+          // Seed the infinitesimal of the innermost level with direction a, the middle one with
+          // b and the outermost with c. All mixed parts are zero for the independent variables:
+          for(int i = 0; i < N; i++)
+            ua[i] = Dual3(Dual2(Dual1(u[i], s(i==a)), Dual1(s(i==b), 0)),
+                          Dual2(Dual1(s(i==c), 0),    Dual1(0,        0)));
+          u2xAD(ua, xa);
+
+          // Extract the derivatives:
+          for(int k = 0; k < M; k++) {
+            const Dual3& x = xa[k];
+            dx[k*N+a] = x.v.v.d;
+            if(order >= 2) {
+              d2x[(k*N+a)*N+b] = d2x[(k*N+b)*N+a] = x.v.d.d;
+              if(order >= 3) {
+                d2x[(k*N+a)*N+c] = d2x[(k*N+c)*N+a] = x.d.v.d;
+                d2x[(k*N+b)*N+c] = d2x[(k*N+c)*N+b] = x.d.d.v;
+                int p[6][3] = { {a,b,c},{a,c,b},{b,a,c},{b,c,a},{c,a,b},{c,b,a} };
+                for(int q = 0; q < 6; q++)
+                  d3x[((k*N+p[q][0])*N+p[q][1])*N+p[q][2]] = x.d.d.d; }}}}}}
+  }
+  // todo: the evaluations for order 1 and 2 waste some work because all 3 nesting levels are 
+  // computed anyway - maybe use Dual1, Dual2 maps in these cases (would need more user callbacks)
+
+  /** Like getCoordinateDerivativesAD but uses the map for truncated Taylor series of degree 3 
+  that was assigned via setCurvilinearToCartesianTaylor. Each evaluation of the map yields the 
+  directional derivatives D^n x[v] = d^n/dt^n x(u + t*v) for n = 1,2,3 along a direction v. The 
+  mixed partials are recovered from directions along single coordinate axes e_a, pairs e_a + e_b,
+  e_a + 2*e_b and (for order 3) triples e_a + e_b + e_c by expanding the directional derivatives 
+  via the multinomial theorem and solving for the unknown mixed terms. For N = 2, that needs 4 
+  evaluations - the same as the nested dual numbers - but each operation on the Taylor numbers 
+  is much cheaper than on the 8-component nested dual numbers. */
+  void getCoordinateDerivativesTaylor(const Vec& u, int order, Vec& dx, Vec& d2x, Vec& d3x) const
+  {
+    rsAssert(u2xTaylor, "Coordinate map for Taylor series not assigned");
+    rsAssert(order >= 1 && order <= 3, "Order must be 1, 2 or 3");
+    int a, b, c, k;
+    dx.resize(M*N);
+    if(order >= 2) d2x.resize(M*N*N);
+    if(order >= 3) d3x.resize(M*N*N*N);
+    VecTaylor ut(N), xt(M);
+
+    // Evaluates the map along direction v = sa*e_a + sb*e_b + sc*e_c (pass -1 for unused 
+    // indices) and returns the n-th directional derivative of the k-th coordinate via D(k, n):
+    auto evaluate = [&](int a, T sa, int b, T sb, int c, T sc)
+    {
+      for(int i = 0; i < N; i++)
+        ut[i] = Taylor3(u[i], i == a ? sa : i == b ? sb : i == c ? sc : T(0));
+      u2xTaylor(ut, xt);
+    };
+    auto D = [&](int k, int n) { return xt[k].getDerivative(n); };
+    auto X2 = [&](int k, int i, int j) -> T& { return d2x[(k*N+i)*N+j]; };
+    auto setX3 = [&](int k, int i, int j, int l, T val)
+    {
+      int p[6][3] = { {i,j,l},{i,l,j},{j,i,l},{j,l,i},{l,i,j},{l,j,i} };
+      for(int q = 0; q < 6; q++)
+        d3x[((k*N+p[q][0])*N+p[q][1])*N+p[q][2]] = val;
+    };
+    auto X3 = [&](int k, int i, int j, int l) { return d3x[((k*N+i)*N+j)*N+l]; };
+
+    // pure derivatives along the coordinate axes:
+    for(a = 0; a < N; a++) {
+      evaluate(a, T(1), -1, T(0), -1, T(0));
+      for(k = 0; k < M; k++) {
+        dx[k*N+a] = D(k, 1);
+        if(order >= 2) X2(k, a, a) = D(k, 2);
+        if(order >= 3) setX3(k, a, a, a, D(k, 3)); }}
+    if(order < 2)
+      return;
+
+    // mixed derivatives with 2 different indices. Along e_a + e_b, we have:
+    //   D^2 = x_aa + 2 x_ab + x_bb,   D^3 = x_aaa + 3 x_aab + 3 x_abb + x_bbb
+    // and along e_a + 2 e_b:
+    //   D^3 = x_aaa + 6 x_aab + 12 x_abb + 8 x_bbb
+    for(a = 0; a < N; a++) {
+      for(b = a+1; b < N; b++) {
+        evaluate(a, T(1), b, T(1), -1, T(0));
+        for(k = 0; k < M; k++) {
+          X2(k, a, b) = X2(k, b, a) = T(0.5) * (D(k, 2) - X2(k, a, a) - X2(k, b, b));
+          if(order >= 3)
+            setX3(k, a, a, b, D(k, 3) - X3(k, a, a, a) - X3(k, b, b, b)); } // = 3 x_aab + 3 x_abb
+        if(order >= 3) {
+          evaluate(a, T(1), b, T(2), -1, T(0));
+          for(k = 0; k < M; k++) {
+            T e1  = X3(k, a, a, b);
+            T e2  = D(k, 3) - X3(k, a, a, a) - T(8) * X3(k, b, b, b);  // = 6 x_aab + 12 x_abb
+            T abb = (e2 - T(2)*e1) / T(6);
+            setX3(k, a, b, b, abb);
+            setX3(k, a, a, b, e1 / T(3) - abb); }}}}
+    if(order < 3)
+      return;
+
+    // mixed derivatives with 3 different indices. Along e_a + e_b + e_c, D^3 is the sum of all 27 
+    // x_ijl with i,j,l in {a,b,c}, in which x_abc appears 6 times:
+    for(a = 0; a < N; a++) {
+      for(b = a+1; b < N; b++) {
+        for(c = b+1; c < N; c++) {
+          evaluate(a, T(1), b, T(1), c, T(1));
+          for(k = 0; k < M; k++) {
+            int s[3] = { a, b, c };
+            T sum = T(0);
+            for(int i = 0; i < 3; i++) {
+              sum += X3(k, s[i], s[i], s[i]);
+              for(int j = 0; j < 3; j++)
+                if(j != i)
+                  sum += T(3) * X3(k, s[i], s[i], s[j]); }
+            setX3(k, a, b, c, (D(k, 3) - sum) / T(6)); }}}}
+  }
+
+  /** Computes the exact covariant metric g, contravariant metric gi, Christoffel symbols of 1st 
+  and 2nd kind C1, C2 and - if order == 3 - their partial derivatives dC1, dC2 from the derivatives
+  of the coordinate map. The layout is the same as in the batch functions and the derivative with 
+  respect to u_m is stored at offset m*N^3 in dC1, dC2. Order 2 is enough for the Christoffel 
+  symbols, order 3 is needed for the curvature tensors. */
+  void getConnectionAD(const Vec& u, int order, Vec& g, Vec& gi, Vec& C1, Vec& C2, Vec& dC1, 
+    Vec& dC2) const
+  {
+    int i, j, k, l, m, a, b;
+    int NN = N*N, NNN = N*N*N;
+    Vec dx, d2x, d3x;
+    getCoordinateDerivativesAD(u, order, dx, d2x, d3x);
+    auto E  = [&](int k, int i)               { return dx[k*N+i];              };
+    auto S  = [&](int k, int i, int j)        { return d2x[(k*N+i)*N+j];       };
+    auto U  = [&](int k, int i, int j, int l) { return d3x[((k*N+i)*N+j)*N+l]; };
+
+    // metric and its inverse, (1), Eq. 213:
+    g.resize(NN); gi.resize(NN);
+    for(i = 0; i < N; i++) {
+      for(j = i; j < N; j++) {
+        T sum = T(0);
+        for(k = 0; k < M; k++)
+          sum += E(k, i) * E(k, j);
+        g[i*N+j] = g[j*N+i] = sum; }}
+    Vec tmp = g;
+    invertInPlace(&tmp[0], &gi[0], N);
+
+    // Christoffel symbols of 1st kind [ij,l] = (d^2 x / du_i du_j) * (dx / du_l) - this is what 
+    // (1), Eq. 307 boils down to when the metric is expressed via the basis vectors:
+    C1.resize(NNN);
+    for(i = 0; i < N; i++)
+      for(j = i; j < N; j++)
+        for(l = 0; l < N; l++) {
+          T sum = T(0);
+          for(k = 0; k < M; k++)
+            sum += S(k, i, j) * E(k, l);
+          C1[(i*N+j)*N+l] = C1[(j*N+i)*N+l] = sum; }
+
+    // Christoffel symbols of 2nd kind, (1), Eq. 308:
+    C2.resize(NNN);
+    for(k = 0; k < N; k++)
+      for(i = 0; i < N; i++)
+        for(j = i; j < N; j++) {
+          T sum = T(0);
+          for(l = 0; l < N; l++)
+            sum += gi[k*N+l] * C1[(i*N+j)*N+l];
+          C2[(k*N+i)*N+j] = C2[(k*N+j)*N+i] = sum; }
+    if(order < 3)
+      return;
+
+    // Derivatives of the metric: d_m g_ij = S_im * E_j + E_i * S_jm (products are over the 
+    // cartesian components):
+    Vec dg(N*NN), dgi(N*NN);
+    for(m = 0; m < N; m++)
+      for(i = 0; i < N; i++)
+        for(j = 0; j < N; j++) {
+          T sum = T(0);
+          for(k = 0; k < M; k++)
+            sum += S(k, i, m) * E(k, j) + E(k, i) * S(k, j, m);
+          dg[m*NN+i*N+j] = sum; }
+
+    // Derivatives of the inverse metric: d_m g^kl = -g^ka * d_m g_ab * g^bl:
+    for(m = 0; m < N; m++)
+      for(k = 0; k < N; k++)
+        for(l = 0; l < N; l++) {
+          T sum = T(0);
+          for(a = 0; a < N; a++)
+            for(b = 0; b < N; b++)
+              sum += gi[k*N+a] * dg[m*NN+a*N+b] * gi[b*N+l];
+          dgi[m*NN+k*N+l] = -sum; }
+
+    // Derivatives of the Christoffel symbols of 1st kind: 
+    // d_m [ij,l] = U_ijm * E_l + S_ij * S_lm:
+    dC1.resize(N*NNN);
+    for(m = 0; m < N; m++)
+      for(i = 0; i < N; i++)
+        for(j = i; j < N; j++)
+          for(l = 0; l < N; l++) {
+            T sum = T(0);
+            for(k = 0; k < M; k++)
+              sum += U(k, i, j, m) * E(k, l) + S(k, i, j) * S(k, l, m);
+            dC1[m*NNN+(i*N+j)*N+l] = dC1[m*NNN+(j*N+i)*N+l] = sum; }
+
+    // Derivatives of the Christoffel symbols of 2nd kind by the product rule applied to Eq. 308:
+    dC2.resize(N*NNN);
+    for(m = 0; m < N; m++)
+      for(k = 0; k < N; k++)
+        for(i = 0; i < N; i++)
+          for(j = i; j < N; j++) {
+            T sum = T(0);
+            for(l = 0; l < N; l++)
+              sum += dgi[m*NN+k*N+l] * C1[(i*N+j)*N+l] + gi[k*N+l] * dC1[m*NNN+(i*N+j)*N+l];
+            dC2[m*NNN+(k*N+i)*N+j] = dC2[m*NNN+(k*N+j)*N+i] = sum; }
+  }
+
+  /** Computes the matrix of covariant basis vectors (i.e. the Jacobian) via automatic 
+  differentiation. */
+  Mat getCovariantBasisAD(const Vec& u) const
+  {
+    Vec dx, d2x, d3x;
+    getCoordinateDerivativesAD(u, 1, dx, d2x, d3x);
+    Mat E(M, N);
+    for(int k = 0; k < M; k++)
+      for(int i = 0; i < N; i++)
+        E(k, i) = dx[k*N+i];
+    return E;
+  }
+
+  /** Exact version of getChristoffelSymbols1stKind. */
+  Tens getChristoffelSymbols1stKindAD(const Vec& u) const
+  {
+    Vec g, gi, C1, C2, dC1, dC2;
+    getConnectionAD(u, 2, g, gi, C1, C2, dC1, dC2);
+    return toTensor3(C1);
+  }
+
+  /** Exact version of getChristoffelSymbols2ndKind. */
+  Tens getChristoffelSymbols2ndKindAD(const Vec& u) const
+  {
+    Vec g, gi, C1, C2, dC1, dC2;
+    getConnectionAD(u, 2, g, gi, C1, C2, dC1, dC2);
+    return toTensor3(C2);
+  }
+
+  /** Exact version of getRiemannTensor1stKind. Uses the same formula, (1), Eq. 558. */
+  Tens getRiemannTensor1stKindAD(const Vec& u) const
+  {
+    Vec g, gi, c1, c2, dc, dC2;
+    getConnectionAD(u, 3, g, gi, c1, c2, dc, dC2);
+    int NNN = N*N*N;
+    Tens R({N,N,N,N});
+    for(int i = 0; i < N; i++)
+      for(int j = 0; j < N; j++)
+        for(int k = 0; k < N; k++) {
+          R(i,j,k,k) = T(0);
+          for(int l = k+1; l < N; l++) {
+            T sum = dc[k*NNN+(j*N+l)*N+i] - dc[l*NNN+(j*N+k)*N+i];
+            for(int r = 0; r < N; r++)
+              sum += c1[(i*N+l)*N+r]*c2[(r*N+j)*N+k] - c1[(i*N+k)*N+r]*c2[(r*N+j)*N+l];
+            R(i,j,k,l) = sum; R(i,j,l,k) = -sum; }}
+    return R;
+  }
+
+  /** Exact version of getRiemannTensor2ndKind. Uses the same formula, (1), Eq. 560. */
+  Tens getRiemannTensor2ndKindAD(const Vec& u) const
+  {
+    Vec g, gi, C1, c, dC1, dc;
+    getConnectionAD(u, 3, g, gi, C1, c, dC1, dc);
+    int NNN = N*N*N;
+    Tens R({N,N,N,N});
+    for(int i = 0; i < N; i++)
+      for(int j = 0; j < N; j++)
+        for(int k = 0; k < N; k++) {
+          R(i,j,k,k) = T(0);
+          for(int l = k+1; l < N; l++) {
+            T sum = dc[k*NNN+(i*N+j)*N+l] - dc[l*NNN+(i*N+j)*N+k];
+            for(int r = 0; r < N; r++)
+              sum += c[(r*N+j)*N+l]*c[(i*N+r)*N+k] - c[(r*N+j)*N+k]*c[(i*N+r)*N+l];
+            R(i,j,k,l) = sum; R(i,j,l,k) = -sum; }}
+    return R;
+  }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Packed storage. These functions compute only the independent components of tensors 
+  // with symmetries and return them in packed form as described in rsTensorPacking. The 
+  // Christoffel symbols of 1st kind [ij,l] are stored at s(i,j)*N + l and those of 2nd kind G^k_ij
+  // at k*S + s(i,j) where S = N(N+1)/2 and s(i,j) = rsTensorPacking::symmetricIndex(i,j,N). The 
+  // Riemann tensor is the fully covariant one R_ijkl = g_im R^m_jkl. If a coordinate map for 
+  // automatic differentiation is assigned, exact derivatives will be used.
+
+  /** Christoffel symbols of the 1st kind in packed form with N*N(N+1)/2 entries. */
+  Vec getChristoffelSymbols1stKindPacked(const Vec& u) const
+  {
+    int S = rsTensorPacking::numSymmetricPairs(N);
+    Vec C(S*N);
+    if( hasAD() ) {
+      Vec g, gi, C1, C2, dC1, dC2;
+      getConnectionAD(u, 2, g, gi, C1, C2, dC1, dC2);
+      packChristoffel1stKind(C1, C);
+      return C; }
+
+    // metric derivatives - these are symmetric as well, so we store them packed, too:
+    int i, j, l;
+    Vec up(u), um(u);
+    Vec dg(N*S);
+    T s = 1/(2*h);
+    for(i = 0; i < N; i++) {
+      up[i] = u[i] + h; Mat gp = getCovariantMetric(up);
+      um[i] = u[i] - h; Mat gm = getCovariantMetric(um);
+      for(j = 0; j < N; j++)
+        for(l = j; l < N; l++)
+          dg[i*S + sym(j, l)] = s * (gp(j, l) - gm(j, l));
+      up[i] = u[i];
+      um[i] = u[i]; }
+
+    // Christoffel symbols, (1), Eq. 307, only for i <= j:
+    for(i = 0; i < N; i++)
+      for(j = i; j < N; j++)
+        for(l = 0; l < N; l++)
+          C[sym(i, j)*N + l] = T(0.5) * 
+            (dg[j*S + sym(i, l)] + dg[i*S + sym(j, l)] - dg[l*S + sym(i, j)]);
+    return C;
+  }
+
+  /** Christoffel symbols of the 2nd kind in packed form with N*N(N+1)/2 entries. */
+  Vec getChristoffelSymbols2ndKindPacked(const Vec& u) const
+  {
+    Mat g = getContravariantMetric(u);
+    Vec C = getChristoffelSymbols1stKindPacked(u);
+    Vec G;
+    raiseChristoffelIndex(g, C, G);
+    return G;
+  }
+
+  /** Computes the fully covariant Riemann tensor R_ijkl in packed form with 
+  rsTensorPacking::numRiemannComponents(N) entries. Only the components with i < j, k < l and 
+  (i,j) <= (k,l) are computed via R_ijkl = d_k [jl,i] - d_l [jk,i] + [il,m] G^m_jk - [ik,m] G^m_jl
+  which is obtained by lowering the first index in (1), Eq. 560 - and among those, the ones 
+  dependent via the Bianchi identity are computed from the other two of their set. */
+  Vec getRiemannTensorPacked(const Vec& u) const
+  {
+    int S = rsTensorPacking::numSymmetricPairs(N);
+    Vec c1(S*N), c2(S*N), dc1(N*S*N);  // Christoffel symbols and derivatives of 1st kind symbols
+    if( hasAD() ) {
+      Vec g, gi, C1, C2, dC1, dC2;
+      getConnectionAD(u, 3, g, gi, C1, C2, dC1, dC2);
+      packChristoffel1stKind(C1, c1);
+      packChristoffel2ndKind(C2, c2);
+      Vec tmp(S*N);
+      for(int m = 0; m < N; m++) {
+        Vec dC1m(dC1.begin() + m*N*N*N, dC1.begin() + (m+1)*N*N*N);
+        packChristoffel1stKind(dC1m, tmp);
+        rsArrayTools::copy(&tmp[0], &dc1[m*S*N], S*N); }}
+    else {
+      Vec up(u), um(u);
+      T s = 1/(2*h);
+      for(int m = 0; m < N; m++) {
+        up[m] = u[m] + h; Vec cp = getChristoffelSymbols1stKindPacked(up);
+        um[m] = u[m] - h; Vec cm = getChristoffelSymbols1stKindPacked(um);
+        for(int n = 0; n < S*N; n++)
+          dc1[m*S*N + n] = s * (cp[n] - cm[n]);
+        up[m] = u[m];
+        um[m] = u[m]; }
+      c1 = getChristoffelSymbols1stKindPacked(u);
+      raiseChristoffelIndex(getContravariantMetric(u), c1, c2); }
+
+    auto C1 = [&](int i, int j, int l) { return c1[sym(i, j)*N + l]; };
+    auto C2 = [&](int k, int i, int j) { return c2[k*S + sym(i, j)]; };
+    auto dC = [&](int m, int i, int j, int l) { return dc1[m*S*N + sym(i, j)*N + l]; };
+    Vec R(rsTensorPacking::numRiemannComponents(N));
+    int sign;
+    for(int pass = 0; pass < 2; pass++)  // 1st pass: general formula, 2nd pass: Bianchi
+      for(int i = 0; i < N; i++)
+        for(int j = i+1; j < N; j++)
+          for(int k = i; k < N; k++)
+            for(int l = k+1; l < N; l++) {
+              if(k == i && l < j) continue;  // pair (k,l) must not be less than (i,j)
+              int n = rsTensorPacking::riemannIndex(i, j, k, l, N, &sign);
+              if(rsTensorPacking::isBianchiDependent(i, j, k, l)) {
+                if(pass == 1) {  // i < k < l < j, R_ijkl = R_ikjl - R_iljk, packed as below
+                  R[n] = getPackedRiemann(R, i, k, j, l) - getPackedRiemann(R, i, l, j, k); }}
+              else if(pass == 0) {
+                T sum = dC(k, j, l, i) - dC(l, j, k, i);
+                for(int m = 0; m < N; m++)
+                  sum += C1(i, l, m) * C2(m, j, k) - C1(i, k, m) * C2(m, j, l);
+                R[n] = sum; }}
+    return R;
+  }
+
+  /** Reads the component R_ijkl from a packed Riemann tensor, taking care of zeros and signs. */
+  T getPackedRiemann(const Vec& R, int i, int j, int k, int l) const
+  {
+    int sign;
+    int n = rsTensorPacking::riemannIndex(i, j, k, l, N, &sign);
+    return n < 0 ? T(0) : T(sign) * R[n];
+  }
+
+  /** Unpacks a packed Riemann tensor into a full NxNxNxN multiarray. */
+  Tens unpackRiemannTensor(const Vec& Rp) const
+  {
+    Tens R({N,N,N,N});
+    for(int i = 0; i < N; i++)
+      for(int j = 0; j < N; j++)
+        for(int k = 0; k < N; k++)
+          for(int l = 0; l < N; l++)
+            R(i,j,k,l) = getPackedRiemann(Rp, i, j, k, l);
+    return R;
+  }
+
+  /** Computes the Ricci tensor (of 1st kind, as in getRicciTensor1stKind) in packed symmetric form
+  with N(N+1)/2 entries from a packed Riemann tensor by contraction with the contravariant metric 
+  g: r_ij = g^ab R_bija. */
+  Vec getRicciTensorPacked(const Vec& Rp, const Mat& g) const
+  {
+    int S = rsTensorPacking::numSymmetricPairs(N);
+    Vec r(S);
+    for(int i = 0; i < N; i++)
+      for(int j = i; j < N; j++) {
+        T sum = T(0);
+        for(int a = 0; a < N; a++)
+          for(int b = 0; b < N; b++)
+            sum += g(a, b) * getPackedRiemann(Rp, b, i, j, a);
+        r[sym(i, j)] = sum; }
+    return r;
+  }
+
+  /** Computes the packed Ricci tensor at u. */
+  Vec getRicciTensorPacked(const Vec& u) const
+  {
+    return getRicciTensorPacked(getRiemannTensorPacked(u), getContravariantMetric(u));
+  }
+
+  /** Computes the Ricci scalar from a packed Ricci tensor and the contravariant metric as 
+  R = g^ij r_ij. */
+  T getRicciScalarPacked(const Vec& r, const Mat& g) const
+  {
+    T sum = T(0);
+    for(int i = 0; i < N; i++)
+      for(int j = 0; j < N; j++)
+        sum += g(i, j) * r[sym(i, j)];
+    return sum;
+  }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Batch processing. These functions evaluate fields of geometric entities at many
+  // coordinate positions at once (for example, on a grid) and write the results into contiguous
+  // arrays. They don't allocate memory in the per-point computations - all intermediate results
+  // are stored in preallocated workspaces, one for each thread.
+
+  /** Holds all the temporary buffers that are needed for the non-allocating per-point
+  computations. Tensors are stored as flat arrays with row-major index order, i.e. the metric
+  g(i,j) is at g[i*N+j] and the Christoffel symbol G(k,i,j) at G[(k*N+i)*N+j]. Each thread needs
+  its own workspace. */
+  class Workspace
+  {
+  public:
+
+    Workspace(int numManifoldDimensions, int numEmbeddingSpaceDimensions)
+    {
+      int N = numManifoldDimensions, M = numEmbeddingSpaceDimensions;
+      up.resize(N); um.resize(N); uB.resize(N); uC.resize(N); uR.resize(N);
+      xp.resize(M); xm.resize(M);
+      E.setShape(M, N);
+      g.resize(N*N);  gi.resize(N*N); gt.resize(N*N); gp.resize(N*N); gm.resize(N*N);
+      dg.resize(N*N*N); C1.resize(N*N*N); G.resize(N*N*N); Gp.resize(N*N*N); Gm.resize(N*N*N);
+      dG.resize(N*N*N*N);
+    }
+
+    Vec up, um, uB;        // wiggled and copied coordinates for the basis computation
+    Vec uC, uR;            // wiggled coordinates on the Christoffel- and Riemann level
+    Vec xp, xm;            // cartesian coordinates at up, um
+    Mat E;                 // MxN matrix of covariant basis vectors
+    Vec g, gi, gt, gp, gm; // metric, its inverse, temporary and metric at wiggled positions
+    Vec dg, C1;            // metric derivatives, Christoffel symbols of 1st kind
+    Vec G, Gp, Gm, dG;     // Christoffel symbols of 2nd kind and their derivatives
+  };
+
+
+  /** Computes the covariant metric g_ij at u and writes it into the NxN array g. If the analytic
+  Jacobian is assigned, it will be used, otherwise the basis vectors are computed numerically.
+  Uses the u*-, x*- and E buffers of the workspace. */
+  void fillCovariantMetric(const T* u, T* g, Workspace& w) const
+  {
+    // compute the MxN matrix of the covariant basis vectors:
+    if( u2xJ ) {
+      rsArrayTools::copy(u, &w.uB[0], N);
+      u2xJ(w.uB, w.E); }
+    else {
+      T s = 1/(2*h);
+      rsArrayTools::copy(u, &w.up[0], N);
+      rsArrayTools::copy(u, &w.um[0], N);
+      for(int j = 0; j < N; j++) {
+        w.up[j] = u[j] + h;
+        w.um[j] = u[j] - h;
+        u2x(w.up, w.xp);
+        u2x(w.um, w.xm);
+        for(int i = 0; i < M; i++)
+          w.E(i, j) = s * (w.xp[i] - w.xm[i]);
+        w.up[j] = u[j];
+        w.um[j] = u[j]; }}
+
+    // g = E^T * E, (1), Eq. 213 - we compute only the upper triangle and mirror it:
+    for(int i = 0; i < N; i++) {
+      for(int j = i; j < N; j++) {
+        T sum = T(0);
+        for(int k = 0; k < M; k++)
+          sum += w.E(k, i) * w.E(k, j);
+        g[i*N+j] = g[j*N+i] = sum; }}
+  }
+
+  /** Computes the Christoffel symbols of the 2nd kind at u and writes them into the NxNxN array G.
+  The contravariant metric is obtained by inverting the covariant metric, so the inverse
+  coordinate mapping is not needed. When the function returns, w.g and w.gi contain the co- and
+  contravariant metric at u and w.C1 the Christoffel symbols of the 1st kind. */
+  void fillChristoffelSymbols2ndKind(const T* u, T* G, Workspace& w) const
+  {
+    int i, j, k, l;
+    int NN = N*N;
+
+    // partial derivatives of the metric, dg[i*NN + j*N + l] = d g_jl / d u^i:
+    T s = 1/(2*h);
+    rsArrayTools::copy(u, &w.uC[0], N);
+    for(i = 0; i < N; i++) {
+      w.uC[i] = u[i] + h; fillCovariantMetric(&w.uC[0], &w.gp[0], w);
+      w.uC[i] = u[i] - h; fillCovariantMetric(&w.uC[0], &w.gm[0], w);
+      w.uC[i] = u[i];
+      for(j = 0; j < NN; j++)
+        w.dg[i*NN+j] = s * (w.gp[j] - w.gm[j]); }
+
+    // Christoffel symbols of the 1st kind, C1(i,j,l), (1), Eq. 307:
+    for(i = 0; i < N; i++)
+      for(j = i; j < N; j++)
+        for(l = 0; l < N; l++)
+          w.C1[(i*N+j)*N+l] = w.C1[(j*N+i)*N+l] = T(0.5) *
+            (w.dg[j*NN+i*N+l] + w.dg[i*NN+j*N+l] - w.dg[l*NN+i*N+j]);
+
+    // contravariant metric at u:
+    fillCovariantMetric(u, &w.g[0], w);
+    rsArrayTools::copy(&w.g[0], &w.gt[0], NN);
+    invertInPlace(&w.gt[0], &w.gi[0], N);
+
+    // Christoffel symbols of the 2nd kind, G(k,i,j), (1), Eq. 308:
+    for(k = 0; k < N; k++)
+      for(i = 0; i < N; i++)
+        for(j = i; j < N; j++) {
+          T sum = T(0);
+          for(l = 0; l < N; l++)
+            sum += w.gi[k*N+l] * w.C1[(i*N+j)*N+l];
+          G[(k*N+i)*N+j] = G[(k*N+j)*N+i] = sum; }
+  }
+
+  /** Computes the Ricci tensor of the 1st kind at u and writes it into the NxN array r and
+  returns the Ricci scalar. The Riemann tensor is not stored - we directly compute its contraction
+  R^a_ija from (1), Eq. 560 and Eq. 589. If G is not a nullptr, the Christoffel symbols of the 2nd
+  kind at u will be written into it. */
+  T fillRicciTensor(const T* u, T* r, Workspace& w, T* G = nullptr) const
+  {
+    int i, j, a, b;
+    int NNN = N*N*N;
+
+    // derivatives of the Christoffel symbols of the 2nd kind, dG[m*NNN + (k*N+i)*N+j]:
+    T s = 1/(2*h);
+    rsArrayTools::copy(u, &w.uR[0], N);
+    for(int m = 0; m < N; m++) {
+      w.uR[m] = u[m] + h; fillChristoffelSymbols2ndKind(&w.uR[0], &w.Gp[0], w);
+      w.uR[m] = u[m] - h; fillChristoffelSymbols2ndKind(&w.uR[0], &w.Gm[0], w);
+      w.uR[m] = u[m];
+      for(j = 0; j < NNN; j++)
+        w.dG[m*NNN+j] = s * (w.Gp[j] - w.Gm[j]); }
+
+    // Christoffel symbols at u itself - this must come last, because it leaves the metric and its
+    // inverse at u in w.g, w.gi:
+    fillChristoffelSymbols2ndKind(u, &w.G[0], w);
+    if(G != nullptr)
+      rsArrayTools::copy(&w.G[0], G, NNN);
+
+    // Ricci tensor r_ij = R^a_ija, (1), Eq. 560, 589:
+    auto c  = [&](int k, int i, int j)        { return w.G[(k*N+i)*N+j];          };
+    auto dc = [&](int m, int k, int i, int j) { return w.dG[m*NNN+(k*N+i)*N+j]; };
+    T scalar = T(0);
+    for(i = 0; i < N; i++) {
+      for(j = 0; j < N; j++) {
+        T sum = T(0);
+        for(a = 0; a < N; a++) {
+          sum += dc(j, a, i, a) - dc(a, a, i, j);
+          for(b = 0; b < N; b++)
+            sum += c(b, i, a) * c(a, b, j) - c(b, i, j) * c(a, b, a); }
+        r[i*N+j] = sum; }}
+
+    // Ricci scalar as trace of the Ricci tensor with raised first index, (1), Eq. 593:
+    for(i = 0; i < N; i++)
+      for(j = 0; j < N; j++)
+        scalar += w.gi[i*N+j] * r[j*N+i];
+    return scalar;
+  }
+
+  /** Evaluates the metric, Christoffel symbols (of 2nd kind), Ricci tensor (of 1st kind) and Ricci
+  scalar at numPoints coordinate positions. The positions are given in the flat array u of length
+  numPoints*N where u[p*N + i] is the i-th coordinate of the p-th point. Outputs are written into
+  contiguous arrays with numPoints*N*N, numPoints*N*N*N, numPoints*N*N and numPoints entries
+  respectively, indexed as explained in Workspace. Each of the output arrays may be a nullptr, in
+  which case the corresponding entity will not be computed (the expensive part is the Ricci
+  stuff). The work is split into contiguous chunks of points that are processed in numThreads
+  threads, each having its own preallocated workspace. The user-supplied coordinate functions
+  (u2x and, if assigned, u2xJ) must be thread-safe and must not allocate memory for the whole
+  thing to be allocation-free in the inner loop. */
+  void evaluateFields(const T* u, int numPoints, T* metrics, T* christoffels, T* riccis,
+    T* ricciScalars, int numThreads = 1) const
+  {
+    rsAssert(numThreads >= 1, "Need at least one thread");
+    numThreads = rsMin(numThreads, numPoints);
+    if(numThreads <= 1) {
+      Workspace w(N, M);
+      evaluateFields(u, 0, numPoints, metrics, christoffels, riccis, ricciScalars, w);
+      return;  }
+
+    std::vector<Workspace> ws(numThreads, Workspace(N, M));
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads);
+    int chunkSize = numPoints / numThreads;
+    int remainder = numPoints % numThreads;
+    int start = 0;
+    for(int t = 0; t < numThreads; t++) {
+      int end = start + chunkSize + (t < remainder ? 1 : 0);
+      threads.push_back(std::thread([=, &ws]() {
+        evaluateFields(u, start, end, metrics, christoffels, riccis, ricciScalars, ws[t]); }));
+      start = end; }
+    for(auto& t : threads)
+      t.join();
+  }
+  // todo: maybe use a thread-pool instead of creating new threads on each call - for a 512x512
+  // grid, the thread creation overhead is negligible though
+
+  /** Inverts the NxN matrix A (stored row-major) by Gauss-Jordan elimination with partial
+  pivoting and writes the result into Ai. A is destroyed in the process. */
+  static void invertInPlace(T* A, T* Ai, int N)
+  {
+    int i, j, k;
+    for(i = 0; i < N; i++)
+      for(j = 0; j < N; j++)
+        Ai[i*N+j] = i == j ? T(1) : T(0);
+    for(j = 0; j < N; j++)
+    {
+      int p = j;  // pivot row
+      for(i = j+1; i < N; i++)
+        if(rsAbs(A[i*N+j]) > rsAbs(A[p*N+j]))
+          p = i;
+      if(p != j) {
+        for(k = 0; k < N; k++) {
+          rsSwap(A[j*N+k],  A[p*N+k]);
+          rsSwap(Ai[j*N+k], Ai[p*N+k]); }}
+      rsAssert(A[j*N+j] != T(0), "Singular metric");
+      T s = T(1) / A[j*N+j];
+      for(k = 0; k < N; k++) {
+        A[j*N+k]  *= s;
+        Ai[j*N+k] *= s; }
+      for(i = 0; i < N; i++) {
+        if(i == j) continue;
+        T f = A[i*N+j];
+        for(k = 0; k < N; k++) {
+          A[i*N+k]  -= f * A[j*N+k];
+          Ai[i*N+k] -= f * Ai[j*N+k]; }}
+    }
+  }
+  // maybe move to rsLinearAlgebra - it's useful for small matrices stored in raw arrays
+
+  /** Convenience function to evaluate fields on a 2D grid of coordinates u1[i], u2[j] in a 2D
+  manifold. The grid point (i,j) has the flat point index p = i*numU2 + j. The coordinate array
+  is allocated once here - the per-point computations are allocation-free. */
+  void evaluateFieldsOnGrid(const T* u1, int numU1, const T* u2, int numU2, T* metrics,
+    T* christoffels, T* riccis, T* ricciScalars, int numThreads = 1) const
+  {
+    rsAssert(N == 2, "Grid evaluation is only for 2D manifolds");
+    std::vector<T> u(2*numU1*numU2);
+    for(int i = 0; i < numU1; i++) {
+      for(int j = 0; j < numU2; j++) {
+        int p = i*numU2 + j;
+        u[2*p]   = u1[i];
+        u[2*p+1] = u2[j]; }}
+    evaluateFields(&u[0], numU1*numU2, metrics, christoffels, riccis, ricciScalars, numThreads);
+  }
+
+
 
   //-----------------------------------------------------------------------------------------------
   // \name Tests. After configuring the object with the various conversion functions, you can run 
@@ -1918,6 +2871,80 @@ protected:
     rsAssert((int)x.size() == M);
   }
 
+  /** Returns true, if a coordinate map for automatic differentiation is assigned. */
+  bool hasAD() const { return u2xAD || u2xTaylor; }
+
+  /** Shorthand for the packed index of a symmetric pair. */
+  int sym(int i, int j) const { return rsTensorPacking::symmetricIndex(i, j, N); }
+
+  /** Packs full NxNxN Christoffel symbols of 1st kind C(i,j,l) into packed form. */
+  void packChristoffel1stKind(const Vec& C, Vec& Cp) const
+  {
+    for(int i = 0; i < N; i++)
+      for(int j = i; j < N; j++)
+        for(int l = 0; l < N; l++)
+          Cp[sym(i, j)*N + l] = C[(i*N+j)*N+l];
+  }
+
+  /** Packs full NxNxN Christoffel symbols of 2nd kind G(k,i,j) into packed form. */
+  void packChristoffel2ndKind(const Vec& G, Vec& Gp) const
+  {
+    int S = rsTensorPacking::numSymmetricPairs(N);
+    for(int k = 0; k < N; k++)
+      for(int i = 0; i < N; i++)
+        for(int j = i; j < N; j++)
+          Gp[k*S + sym(i, j)] = G[(k*N+i)*N+j];
+  }
+
+  /** Computes packed Christoffel symbols of 2nd kind G from packed ones of 1st kind C and the 
+  contravariant metric g, (1), Eq. 308. */
+  void raiseChristoffelIndex(const Mat& g, const Vec& C, Vec& G) const
+  {
+    int S = rsTensorPacking::numSymmetricPairs(N);
+    G.resize(S*N);
+    for(int k = 0; k < N; k++)
+      for(int p = 0; p < S; p++) {
+        T sum = T(0);
+        for(int l = 0; l < N; l++)
+          sum += g(k, l) * C[p*N + l];
+        G[k*S + p] = sum; }
+  }
+
+  /** Converts a flat array of length N^3 into an NxNxN tensor. */
+  Tens toTensor3(const Vec& v) const
+  {
+    Tens t({N,N,N});
+    for(int i = 0; i < N; i++)
+      for(int j = 0; j < N; j++)
+        for(int k = 0; k < N; k++)
+          t(i,j,k) = v[(i*N+j)*N+k];
+    return t;
+  }
+
+  /** Evaluates the fields for the points with indices from start (inclusive) to end (exclusive)
+  using the given workspace. This is what each of the threads in evaluateFields runs. */
+  void evaluateFields(const T* u, int start, int end, T* metrics, T* christoffels, T* riccis,
+    T* ricciScalars, Workspace& w) const
+  {
+    int NN = N*N, NNN = N*N*N;
+    bool needRicci = riccis != nullptr || ricciScalars != nullptr;
+    for(int p = start; p < end; p++)
+    {
+      const T* up = &u[p*N];
+      if(needRicci) {
+        T* r = riccis != nullptr ? &riccis[p*NN] : &w.gt[0];  // gt is free at this point
+        T  s = fillRicciTensor(up, r, w, christoffels != nullptr ? &christoffels[p*NNN] : nullptr);
+        if(ricciScalars != nullptr) ricciScalars[p] = s;
+        if(metrics      != nullptr) rsArrayTools::copy(&w.g[0], &metrics[p*NN], NN); }
+      else if(christoffels != nullptr) {
+        fillChristoffelSymbols2ndKind(up, &christoffels[p*NNN], w);
+        if(metrics != nullptr) rsArrayTools::copy(&w.g[0], &metrics[p*NN], NN); }
+      else if(metrics != nullptr)
+        fillCovariantMetric(up, &metrics[p*NN], w);
+    }
+  }
+
+
 
   int N;   // dimensionality of the manifold           (see (1), pg 46 for the conventions)
   int M;   // dimensionality of the embedding space
@@ -1950,6 +2977,10 @@ protected:
   // functions for analytic Jacobians:
   FuncVecToMat u2xJ, x2uJ;
 
+  // coordinate maps for automatic differentiation:
+  FuncVecToVecAD     u2xAD;
+  FuncVecToVecTaylor u2xTaylor;
+
 };
 // todo: make it possible that the input and output dimensionalities are different - for example, 
 // to specify points on the surface of a sphere, we would have two curvilinear input coordinates 
@@ -1957,28 +2988,921 @@ protected:
 // maybe have N and M as dimensionalities of the space/manifold under cosideration (e.g. the 
 // sphere) and the embedding space (e.g. R^3, the 3D Euclidean space)
 
-/*
-template<class T>
-void cartesianToSpherical(T x, T y, T z, T* r, T* theta, T* phi)
-{
-  *r     = sqrt(x*x + y*y + z*z);
-  *phi   = acos(x / sqrt(x*x + y*y));        // ?= atan2(y,x)
-  *theta = acos(z / sqrt(x*x + y*y + z*z));  // == acos(z / *r)
-}
-// see Mathematical Physics Eq. 3.12
-// https://en.wikipedia.org/wiki/Spherical_coordinate_system
+//-------------------------------------------------------------------------------------------------
 
-template<class T>
-void sphericalToCartesian(T r, T theta, T phi, T* x, T* y, T* z)
+/** A variant of rsManifold with dimensionalities N (of the manifold) and M (of the embedding 
+space) fixed at compile time. Coordinate vectors, Jacobians and tensors are std::arrays that live 
+on the stack and the coordinate map u2x is a template parameter, so it can be a lambda that gets 
+inlined at the call site instead of being called through a std::function. All loops have 
+compile-time bounds, so the compiler can fully unroll them for the small dimensions that we 
+typically deal with (N,M <= 4). The map must be callable as u2x(const Vec& u, Pos& x). The 
+index conventions for the basis, metric and Christoffel symbols are the same as in rsManifold. 
+Use rsMakeFixedManifold to create an object from a lambda. 
+
+todo: numerical derivatives of higher order (Riemann tensor, etc.) - we may need to make the 
+stepsize a template parameter or use AD with the nested dual numbers, too  */
+
+template<class T, int N, int M, class TMap>
+class rsFixedManifold
 {
-  *x = r * sin(theta) * cos(phi);
-  *y = r * sin(theta) * sin(phi);
-  *z = r * cos(theta);
-}
-// see Mathematical Physics Eq. 3.11
-*/
 
-// see also:
+public:
+
+  using Vec   = std::array<T, N>;                   // curvilinear coordinates
+  using Pos   = std::array<T, M>;                   // cartesian coordinates
+  using Mat   = std::array<std::array<T, N>, N>;    // metric
+  using Basis = std::array<std::array<T, N>, M>;    // MxN Jacobian
+  using Tens3 = std::array<Mat, N>;                 // Christoffel symbols
+  using Tens4 = std::array<Tens3, N>;               // Riemann tensor
+
+  rsFixedManifold(const TMap& coordinateMap) : u2x(coordinateMap)
+  {
+    static_assert(M >= N, "Can't embedd manifolds in lower dimensional spaces");
+  }
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Setup
+
+  /** Sets the approximation stepsize for computing numerical derivatives. */
+  void setApproximationStepSize(T newSize) { h = newSize; }
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Computations
+
+  /** Converts curvilinear coordinates u to cartesian coordinates x. */
+  void toCartesian(const Vec& u, Pos& x) const { u2x(u, x); }
+
+  /** Computes the MxN matrix E of covariant basis vectors, E[i][j] = dx_i / du_j, by central 
+  differences. */
+  void getCovariantBasis(const Vec& u, Basis& E) const
+  {
+    T s = 1/(2*h);
+    Vec up = u, um = u;
+    Pos xp, xm;
+    for(int j = 0; j < N; j++) {
+      up[j] = u[j] + h; u2x(up, xp); up[j] = u[j];
+      um[j] = u[j] - h; u2x(um, xm); um[j] = u[j];
+      for(int i = 0; i < M; i++)
+        E[i][j] = s * (xp[i] - xm[i]); }
+  }
+
+  /** Computes the covariant metric g = E^T * E, (1), Eq. 213. */
+  void getCovariantMetric(const Vec& u, Mat& g) const
+  {
+    Basis E;
+    getCovariantBasis(u, E);
+    for(int i = 0; i < N; i++)
+      for(int j = i; j < N; j++) {
+        T sum = T(0);
+        for(int k = 0; k < M; k++)
+          sum += E[k][i] * E[k][j];
+        g[i][j] = g[j][i] = sum; }
+  }
+
+  /** Computes the contravariant metric by inverting the covariant metric. */
+  void getContravariantMetric(const Vec& u, Mat& gi) const
+  {
+    Mat g;
+    getCovariantMetric(u, g);
+    invert(g, gi);
+  }
+
+  /** Computes the Christoffel symbols of the 1st kind C[i][j][l] = [ij,l], (1), Eq. 307. */
+  void getChristoffelSymbols1stKind(const Vec& u, Tens3& C) const
+  {
+    Tens3 dg;  // dg[m][i][j] = d g_ij / du_m
+    Mat gp, gm;
+    Vec up = u, um = u;
+    T s = 1/(2*h);
+    for(int m = 0; m < N; m++) {
+      up[m] = u[m] + h; getCovariantMetric(up, gp); up[m] = u[m];
+      um[m] = u[m] - h; getCovariantMetric(um, gm); um[m] = u[m];
+      for(int i = 0; i < N; i++)
+        for(int j = 0; j < N; j++)
+          dg[m][i][j] = s * (gp[i][j] - gm[i][j]); }
+    for(int i = 0; i < N; i++)
+      for(int j = i; j < N; j++)
+        for(int l = 0; l < N; l++)
+          C[i][j][l] = C[j][i][l] = T(0.5) * (dg[j][i][l] + dg[i][j][l] - dg[l][i][j]);
+  }
+
+  /** Computes the Christoffel symbols of the 2nd kind G[k][i][j] = G^k_ij, (1), Eq. 308. */
+  void getChristoffelSymbols2ndKind(const Vec& u, Tens3& G) const
+  {
+    Tens3 C;
+    Mat gi;
+    getChristoffelSymbols1stKind(u, C);
+    getContravariantMetric(u, gi);
+    for(int k = 0; k < N; k++)
+      for(int i = 0; i < N; i++)
+        for(int j = i; j < N; j++) {
+          T sum = T(0);
+          for(int l = 0; l < N; l++)
+            sum += gi[k][l] * C[i][j][l];
+          G[k][i][j] = G[k][j][i] = sum; }
+  }
+
+  /** Computes the Riemann tensor of the 2nd kind R[i][j][k][l] = R^i_jkl, (1), Eq. 560. */
+  void getRiemannTensor2ndKind(const Vec& u, Tens4& R) const
+  {
+    Tens3 c, cp, cm;
+    std::array<Tens3, N> dc;  // dc[m] = derivative of Christoffel symbols with respect to u_m
+    Vec up = u, um = u;
+    T s = 1/(2*h);
+    for(int m = 0; m < N; m++) {
+      up[m] = u[m] + h; getChristoffelSymbols2ndKind(up, cp); up[m] = u[m];
+      um[m] = u[m] - h; getChristoffelSymbols2ndKind(um, cm); um[m] = u[m];
+      for(int i = 0; i < N; i++)
+        for(int j = 0; j < N; j++)
+          for(int k = 0; k < N; k++)
+            dc[m][i][j][k] = s * (cp[i][j][k] - cm[i][j][k]); }
+    getChristoffelSymbols2ndKind(u, c);
+    for(int i = 0; i < N; i++)
+      for(int j = 0; j < N; j++)
+        for(int k = 0; k < N; k++) {
+          R[i][j][k][k] = T(0);
+          for(int l = k+1; l < N; l++) {
+            T sum = dc[k][i][j][l] - dc[l][i][j][k];
+            for(int r = 0; r < N; r++)
+              sum += c[r][j][l]*c[i][r][k] - c[r][j][k]*c[i][r][l];
+            R[i][j][k][l] = sum; R[i][j][l][k] = -sum; }}
+  }
+
+  /** Inverts the NxN matrix A by Gauss-Jordan elimination with partial pivoting. */
+  static void invert(Mat A, Mat& Ai)
+  {
+    for(int i = 0; i < N; i++)
+      for(int j = 0; j < N; j++)
+        Ai[i][j] = i == j ? T(1) : T(0);
+    for(int j = 0; j < N; j++) {
+      int p = j;
+      for(int i = j+1; i < N; i++)
+        if(rsAbs(A[i][j]) > rsAbs(A[p][j]))
+          p = i;
+      rsSwap(A[j], A[p]);
+      rsSwap(Ai[j], Ai[p]);
+      T s = T(1) / A[j][j];
+      for(int k = 0; k < N; k++) { A[j][k] *= s; Ai[j][k] *= s; }
+      for(int i = 0; i < N; i++) {
+        if(i == j) continue;
+        T f = A[i][j];
+        for(int k = 0; k < N; k++) { A[i][k] -= f * A[j][k]; Ai[i][k] -= f * Ai[j][k]; }}}
+  }
+
+
+protected:
+
+  TMap u2x;
+  T h = T(1.e-8);
+
+};
+
+/** Creates an rsFixedManifold object from a coordinate map (typically a lambda), inferring the 
+type of the map. Usage: auto mf = rsMakeFixedManifold<double, 2, 3>(myLambda); */
+template<class T, int N, int M, class TMap>
+rsFixedManifold<T, N, M, TMap> rsMakeFixedManifold(const TMap& coordinateMap)
+{
+  return rsFixedManifold<T, N, M, TMap>(coordinateMap);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/** Numerically integrates geodesics on an rsManifold, i.e. solves the geodesic equation
+
+  d^2 u^k / dt^2 = -G^k_ij (du^i/dt) (du^j/dt)
+
+where G^k_ij are the Christoffel symbols of the 2nd kind. Many geodesics with different initial 
+positions and velocities are integrated in one call, distributed over several threads. Two 
+integration methods are available:
+
+  rungeKutta45:     Dormand-Prince 5(4) with adaptive stepsize control. The state is (u, v) where
+                    v = du/dt. This is the accurate general purpose choice.
+  implicitMidpoint: The implicit midpoint rule with fixed stepsize applied to the equivalent 
+                    Hamiltonian system with H(u,p) = g^ij p_i p_j / 2 and p_k = g_kj v^j. This
+                    method is symplectic, so the speed g_ij v^i v^j does not drift even over very 
+                    long integration times, which is what we want for ray tracing. 
+
+The Christoffel symbols are either computed directly via rsManifold::fillChristoffelSymbols2ndKind
+at each stage or taken from an optional cache, which holds the Christoffel symbols and the metric 
+on a regular coordinate grid and interpolates (multi)linearly between the grid nodes. With the 
+cache, geodesics that pass through the same grid cells share the expensive Christoffel 
+evaluations - at the cost of the interpolation error. The user-supplied coordinate functions of 
+the manifold must be thread-safe.
+
+todo: dense output for RK45 such that trajectories can be streamed out at regular intervals of t,
+maybe a lazily filled cache that only evaluates the nodes that are actually visited */
+
+template<class T>
+class rsGeodesicSolver
+{
+
+public:
+
+  enum class Method
+  {
+    rungeKutta45,
+    implicitMidpoint
+  };
+
+  /** Type for a function that receives the trajectory data while it is being computed. It gets 
+  called with the index of the geodesic, the curve parameter t and pointers to the N coordinates u
+  and the N velocities v = du/dt at t. */
+  using Callback = std::function<void(int index, T t, const T* u, const T* v)>;
+
+
+  rsGeodesicSolver(const rsManifold<T>& manifold) : mf(manifold)
+  {
+    N = mf.getNumManifoldDimensions();
+    M = mf.getNumEmbeddingSpaceDimensions();
+  }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Setup
+
+  void setMethod(Method newMethod) { method = newMethod; }
+
+  /** For the implicit midpoint method, this is the (maximum) stepsize - the actual stepsize is 
+  chosen such that the integration interval is divided into an integer number of equal steps. For 
+  RK45, it's only the initial stepsize, which will then be adapted. */
+  void setStepSize(T newSize) { stepSize = newSize; }
+
+  /** Sets the tolerance for the local error per step in RK45. The error is measured relative to 
+  1 + |y| where y is the state component in question. */
+  void setTolerance(T newTolerance) { tol = newTolerance; }
+
+  /** Sets the tolerance and maximum number of iterations for the fixed-point iteration that solves
+  the implicit equation in each step of the implicit midpoint method. */
+  void setMidpointIteration(T tolerance, int maxIterations)
+  { 
+    midTol = tolerance; 
+    midMaxIts = maxIterations; 
+  }
+
+  /** Sets the maximum number of steps per geodesic, to prevent infinite loops when RK45 gets stuck
+  near a coordinate singularity. */
+  void setMaxNumSteps(int newMax) { maxSteps = newMax; }
+
+  void setNumThreads(int newNumThreads)
+  {
+    rsAssert(newNumThreads >= 1, "Need at least one thread");
+    numThreads = newNumThreads;
+  }
+
+  /** Creates the cache of Christoffel symbols and metrics on a regular grid with numNodes[i] nodes
+  along the i-th coordinate, spanning the range uMin[i]..uMax[i]. The nodes are evaluated with 
+  rsManifold::evaluateFields using the number of threads that is set up here. Positions outside 
+  the grid use the values at the boundary. */
+  void createChristoffelCache(const T* uMin, const T* uMax, const int* numNodes)
+  {
+    int d, p;
+    gridMin.resize(N); gridStep.resize(N); gridSize.resize(N); gridStride.resize(N);
+    int numPoints = 1;
+    for(d = N-1; d >= 0; d--) {
+      rsAssert(numNodes[d] >= 2 && uMax[d] > uMin[d], "Invalid grid");
+      gridMin[d]    = uMin[d];
+      gridStep[d]   = (uMax[d] - uMin[d]) / T(numNodes[d] - 1);
+      gridSize[d]   = numNodes[d];
+      gridStride[d] = numPoints;           // last coordinate runs fastest
+      numPoints    *= numNodes[d]; }
+
+    std::vector<T> nodes(numPoints*N);
+    for(p = 0; p < numPoints; p++)
+      for(d = 0; d < N; d++)
+        nodes[p*N+d] = gridMin[d] + gridStep[d] * T((p / gridStride[d]) % gridSize[d]);
+
+    int NN = N*N;
+    cacheG.resize(numPoints*NN*N);
+    cacheMetric.resize(numPoints*NN);
+    cacheInverse.resize(numPoints*NN);
+    mf.evaluateFields(&nodes[0], numPoints, &cacheMetric[0], &cacheG[0], nullptr, nullptr, 
+      numThreads);
+    std::vector<T> tmp(NN);
+    for(p = 0; p < numPoints; p++) {
+      rsArrayTools::copy(&cacheMetric[p*NN], &tmp[0], NN);
+      rsManifold<T>::invertInPlace(&tmp[0], &cacheInverse[p*NN], N); }
+  }
+
+  /** Clears the cache such that the Christoffel symbols will be computed directly again. */
+  void clearChristoffelCache()
+  {
+    cacheG.clear(); cacheMetric.clear(); cacheInverse.clear();
+  }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Inquiry
+
+  bool hasChristoffelCache() const { return !cacheG.empty(); }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Processing
+
+  /** Integrates numGeodesics geodesics from t = 0 to t = tEnd. The initial positions and 
+  velocities are given in structure-of-arrays layout: u[i*numGeodesics + n] is the i-th coordinate
+  of the n-th geodesic and v[i*numGeodesics + n] is its derivative du^i/dt. On return, u and v 
+  contain the positions and velocities at tEnd. If a callback is passed, it gets called for each 
+  geodesic at t = 0 and after each step. The geodesics are split into contiguous chunks that are 
+  processed by the worker threads, so the callback will be called concurrently from several 
+  threads (but each geodesic from one thread only, in order of increasing t) - writing into 
+  separate buffers per geodesic index is safe. Returns the total number of steps taken. */
+  int integrate(T* u, T* v, int numGeodesics, T tEnd, const Callback& callback = Callback()) const
+  {
+    int numThr = rsMin(numThreads, numGeodesics);
+    if(numThr <= 1) {
+      Workspace w(N, M);
+      return integrate(u, v, numGeodesics, 0, numGeodesics, tEnd, callback, w); }
+
+    std::vector<Workspace> ws(numThr, Workspace(N, M));
+    std::vector<int> numSteps(numThr);
+    std::vector<std::thread> threads;
+    threads.reserve(numThr);
+    int chunkSize = numGeodesics / numThr;
+    int remainder = numGeodesics % numThr;
+    int start = 0;
+    for(int t = 0; t < numThr; t++) {
+      int end = start + chunkSize + (t < remainder ? 1 : 0);
+      threads.push_back(std::thread([=, &ws, &numSteps, &callback]() {
+        numSteps[t] = integrate(u, v, numGeodesics, start, end, tEnd, callback, ws[t]); }));
+      start = end; }
+    int total = 0;
+    for(int t = 0; t < numThr; t++) {
+      threads[t].join();
+      total += numSteps[t]; }
+    return total;
+  }
+  // todo: share the thread handling with rsManifold::evaluateFields
+
+
+protected:
+
+  /** Buffers for the per-geodesic computations. Each thread needs its own. */
+  class Workspace
+  {
+  public:
+
+    Workspace(int N, int M) : mw(N, M)
+    {
+      G.resize(N*N*N); g.resize(N*N); gi.resize(N*N); frac.resize(N);
+      y.resize(2*N); yt.resize(2*N); k.resize(7*2*N); z.resize(2*N); zm.resize(2*N);
+    }
+
+    typename rsManifold<T>::Workspace mw;  // for the direct Christoffel computation
+    std::vector<T> G, g, gi;               // Christoffel symbols, metric and its inverse
+    std::vector<T> frac;                   // fractional grid positions for the interpolation
+    std::vector<T> y, yt, k;               // RK45 state, temporary state, stage derivatives
+    std::vector<T> z, zm;                  // state and midpoint state for the implicit method
+  };
+
+  /** Fills w.G with the Christoffel symbols of 2nd kind at u and, if withMetric is true, w.g and 
+  w.gi with the metric and its inverse - either from the cache or by direct computation. */
+  void fillField(const T* u, Workspace& w, bool withMetric) const
+  {
+    if(hasChristoffelCache()) {
+      interpolateField(u, w, withMetric);
+      return; }
+    mf.fillChristoffelSymbols2ndKind(u, &w.G[0], w.mw);
+    if(withMetric) {
+      rsArrayTools::copy(&w.mw.g[0],  &w.g[0],  N*N);
+      rsArrayTools::copy(&w.mw.gi[0], &w.gi[0], N*N); }
+  }
+
+  /** Multilinear interpolation in the cache. */
+  void interpolateField(const T* u, Workspace& w, bool withMetric) const
+  {
+    int NN = N*N, NNN = N*N*N;
+    int d, j, base = 0;
+    for(d = 0; d < N; d++) {
+      T x = (u[d] - gridMin[d]) / gridStep[d];
+      int i = rsClip((int) floor(x), 0, gridSize[d]-2);
+      w.frac[d] = rsClip(x - T(i), T(0), T(1));
+      base += i * gridStride[d]; }
+
+    rsArrayTools::fillWithZeros(&w.G[0], NNN);
+    if(withMetric) {
+      rsArrayTools::fillWithZeros(&w.g[0],  NN);
+      rsArrayTools::fillWithZeros(&w.gi[0], NN); }
+    for(int c = 0; c < (1 << N); c++) {       // loop over the 2^N corners of the cell
+      T wc = T(1);
+      int p = base;
+      for(d = 0; d < N; d++) {
+        if(c & (1 << d)) { wc *= w.frac[d]; p += gridStride[d]; }
+        else               wc *= T(1) - w.frac[d];  }
+      const T* Gc = &cacheG[p*NNN];
+      for(j = 0; j < NNN; j++)
+        w.G[j] += wc * Gc[j];
+      if(withMetric) {
+        const T* gc  = &cacheMetric[p*NN];
+        const T* gic = &cacheInverse[p*NN];
+        for(j = 0; j < NN; j++) {
+          w.g[j]  += wc * gc[j];
+          w.gi[j] += wc * gic[j]; }}}
+  }
+
+  /** Derivative of the state y = (u, v) for the geodesic equation: dy = (v, a) where 
+  a^k = -G^k_ij v^i v^j. */
+  void geodesicDerivative(const T* y, T* dy, Workspace& w) const
+  {
+    const T* v = &y[N];
+    fillField(y, w, false);
+    for(int k = 0; k < N; k++) {
+      T sum = T(0);
+      for(int i = 0; i < N; i++)
+        for(int j = 0; j < N; j++)
+          sum += w.G[(k*N+i)*N+j] * v[i] * v[j];
+      dy[k]   = v[k];
+      dy[N+k] = -sum; }
+  }
+
+  /** Derivative of the state z = (u, p) of the Hamiltonian system: du^k/dt = g^kl p_l and 
+  dp_k/dt = G^m_kj p_m v^j. */
+  void hamiltonianDerivative(const T* z, T* dz, Workspace& w) const
+  {
+    const T* p = &z[N];
+    T* v = dz;                        // du/dt = v, so we can compute v directly into dz
+    fillField(z, w, true);
+    int k, j, m;
+    for(k = 0; k < N; k++) {
+      v[k] = T(0);
+      for(j = 0; j < N; j++)
+        v[k] += w.gi[k*N+j] * p[j]; }
+    for(k = 0; k < N; k++) {
+      T sum = T(0);
+      for(m = 0; m < N; m++)
+        for(j = 0; j < N; j++)
+          sum += w.G[(m*N+k)*N+j] * p[m] * v[j];
+      dz[N+k] = sum; }
+  }
+
+  /** Integrates the geodesics with indices start..end-1. */
+  int integrate(T* u, T* v, int numGeodesics, int start, int end, T tEnd, 
+    const Callback& callback, Workspace& w) const
+  {
+    int numSteps = 0;
+    for(int n = start; n < end; n++)
+    {
+      for(int i = 0; i < N; i++) {
+        w.y[i]   = u[i*numGeodesics + n];
+        w.y[N+i] = v[i*numGeodesics + n]; }
+      if(callback)
+        callback(n, T(0), &w.y[0], &w.y[N]);
+      if(method == Method::implicitMidpoint)
+        numSteps += integrateImplicitMidpoint(n, tEnd, callback, w);
+      else
+        numSteps += integrateRungeKutta45(n, tEnd, callback, w);
+      for(int i = 0; i < N; i++) {
+        u[i*numGeodesics + n] = w.y[i];
+        v[i*numGeodesics + n] = w.y[N+i]; }
+    }
+    return numSteps;
+  }
+
+  /** Integrates a single geodesic with initial state in w.y from 0 to tEnd with the adaptive 
+  Dormand-Prince method, leaving the final state in w.y. Returns the number of accepted steps. */
+  int integrateRungeKutta45(int index, T tEnd, const Callback& callback, Workspace& w) const
+  {
+    // Butcher tableau and error coefficients (difference of 5th and 4th order weights):
+    static const T a[7][6] = {
+      { T(0),             T(0),            T(0),             T(0),          T(0),               T(0)        },
+      { T(1)/5,           T(0),            T(0),             T(0),          T(0),               T(0)        },
+      { T(3)/40,          T(9)/40,         T(0),             T(0),          T(0),               T(0)        },
+      { T(44)/45,         T(-56)/15,       T(32)/9,          T(0),          T(0),               T(0)        },
+      { T(19372)/6561,    T(-25360)/2187,  T(64448)/6561,    T(-212)/729,   T(0),               T(0)        },
+      { T(9017)/3168,     T(-355)/33,      T(46732)/5247,    T(49)/176,     T(-5103)/18656,     T(0)        },
+      { T(35)/384,        T(0),            T(500)/1113,      T(125)/192,    T(-2187)/6784,      T(11)/84    }};
+    static const T e[7] = { T(71)/57600, T(0), T(-71)/16695, T(71)/1920, T(-17253)/339200, 
+                            T(22)/525, T(-1)/40 };
+
+    int L = 2*N;
+    int i, j, s, numSteps = 0;
+    T* y  = &w.y[0];
+    T* yt = &w.yt[0];
+    T* k  = &w.k[0];                  // stage s derivative is at k[s*L]
+    T  t  = T(0);
+    T  h  = rsMin(stepSize, tEnd);
+    geodesicDerivative(y, k, w);
+    while(t < tEnd && numSteps < maxSteps)
+    {
+      h = rsMin(h, tEnd - t);
+
+      // stages 2..7 - the argument of the 7th stage is the 5th order solution:
+      for(s = 1; s < 7; s++) {
+        for(i = 0; i < L; i++) {
+          T sum = T(0);
+          for(j = 0; j < s; j++)
+            sum += a[s][j] * k[j*L+i];
+          yt[i] = y[i] + h * sum; }
+        geodesicDerivative(yt, &k[s*L], w); }
+
+      // error estimate:
+      T err = T(0);
+      for(i = 0; i < L; i++) {
+        T sum = T(0);
+        for(s = 0; s < 7; s++)
+          sum += e[s] * k[s*L+i];
+        err = rsMax(err, rsAbs(h * sum) / (tol * (T(1) + rsMax(rsAbs(y[i]), rsAbs(yt[i]))))); }
+
+      // accept the step, if the error is small enough - the last stage derivative is the first 
+      // one for the next step ("first same as last"):
+      if(err <= T(1)) {
+        t += h;
+        rsArrayTools::copy(yt, y, L);
+        rsArrayTools::copy(&k[6*L], k, L);
+        numSteps++;
+        if(callback)
+          callback(index, t, &y[0], &y[N]); }
+
+      // adapt the stepsize:
+      T scaler = err > T(0) ? T(0.9) * pow(err, T(-0.2)) : T(5);
+      h *= rsClip(scaler, T(0.2), T(5));
+    }
+    rsAssert(t >= tEnd, "Maximum number of steps reached");
+    return numSteps;
+  }
+
+  /** Integrates a single geodesic with initial state in w.y from 0 to tEnd with the implicit 
+  midpoint method, leaving the final state in w.y. Returns the number of steps. */
+  int integrateImplicitMidpoint(int index, T tEnd, const Callback& callback, Workspace& w) const
+  {
+    int L = 2*N;
+    int i, j, it;
+    T* y  = &w.y[0];
+    T* z  = &w.z[0];
+    T* zm = &w.zm[0];
+    T* dz = &w.yt[0];
+
+    // convert velocities v^k to momenta p_k = g_kj v^j:
+    fillField(y, w, true);
+    for(i = 0; i < N; i++) {
+      z[i]   = y[i];
+      z[N+i] = T(0);
+      for(j = 0; j < N; j++)
+        z[N+i] += w.g[i*N+j] * y[N+j]; }
+
+    if(tEnd <= T(0))
+      return 0;
+    int numSteps = rsClip((int) ceil(tEnd / stepSize), 1, maxSteps);
+    T h = tEnd / T(numSteps);
+    hamiltonianDerivative(z, dz, w);
+    for(int n = 1; n <= numSteps; n++)
+    {
+      // solve zm = z + (h/2) * f(zm) by fixed-point iteration, starting with an explicit Euler 
+      // half-step:
+      for(i = 0; i < L; i++)
+        zm[i] = z[i] + T(0.5) * h * dz[i];
+      for(it = 0; it < midMaxIts; it++) {
+        hamiltonianDerivative(zm, dz, w);
+        T delta = T(0), scale = T(0);
+        for(i = 0; i < L; i++) {
+          T tmp = z[i] + T(0.5) * h * dz[i];
+          delta = rsMax(delta, rsAbs(tmp - zm[i]));
+          scale = rsMax(scale, rsAbs(tmp));
+          zm[i] = tmp; }
+        if(delta <= midTol * (T(1) + scale))
+          break; }
+
+      // z_{n+1} = z_n + h * f(zm) = 2*zm - z_n:
+      for(i = 0; i < L; i++)
+        z[i] = T(2) * zm[i] - z[i];
+
+      // f(z) at the new point is needed for the predictor in the next step and its 1st half is 
+      // the velocity, which we need for the output:
+      hamiltonianDerivative(z, dz, w);
+      if(callback || n == numSteps) {
+        for(i = 0; i < N; i++) {
+          y[i]   = z[i];
+          y[N+i] = dz[i]; }
+        if(callback)
+          callback(index, h * T(n), &y[0], &y[N]); }
+    }
+    return numSteps;
+  }
+
+
+  const rsManifold<T>& mf;
+  int N, M;
+
+  Method method  = Method::rungeKutta45;
+  T   stepSize   = T(0.01);
+  T   tol        = T(1.e-8);
+  T   midTol     = T(1.e-12);
+  int midMaxIts  = 20;
+  int maxSteps   = 1000000;
+  int numThreads = 1;
+
+  // the cache:
+  std::vector<T>   cacheG, cacheMetric, cacheInverse;  // Christoffel symbols, metric, inverse
+  std::vector<T>   gridMin, gridStep;
+  std::vector<int> gridSize, gridStride;
+
+};
+
+/** Converts arrays of points between cartesian coordinates and polar (2D), cylindrical and 
+spherical (3D) coordinates. The points are passed in structure-of-arrays layout, i.e. one array 
+per coordinate. The conventions are:
+
+  polar:       (r, phi)        x = r*cos(phi), y = r*sin(phi)
+  cylindrical: (rho, phi, z)   x = rho*cos(phi), y = rho*sin(phi), z = z
+  spherical:   (r, theta, phi) x = r*sin(theta)*cos(phi), y = r*sin(theta)*sin(phi), 
+                               z = r*cos(theta)
+
+where theta in [0, pi] is the polar angle measured from the z-axis and phi = atan2(y, x) in 
+[-pi, pi] is the azimuth (see Mathematical Physics Eq. 3.11, 3.12 and 
+https://en.wikipedia.org/wiki/Spherical_coordinate_system). The polar angle is computed as 
+atan2(rho, z) rather than acos(z/r), which is more accurate near the poles.
+
+The trigonometric functions are evaluated by polynomial kernels that work on blocks of points in 
+local buffers with branch-free loops of fixed length, so the compiler can vectorize them. The 
+accuracy can be selected:
+
+  libm: calls std::sin, std::cos, std::atan2 for each point (the reference)
+  high: error within 1.5 ulp for sin/cos and 2.5 ulp for atan2 (for double)
+  fast: relative error below 1.e-7, which is good enough for float
+
+The polynomials are Taylor polynomials after argument reduction, not minimax fits, so they need a 
+couple more terms than necessary. sin and cos reduce the argument modulo pi/2 with a 5-part 
+constant (Cody-Waite), which is accurate for |x| up to around 1.e5. The rounding to the nearest 
+multiple of pi/2 uses the "add and subtract 1.5*2^52" trick, which breaks under -ffast-math. atan 
+reduces its argument to |a| <= tan(pi/16) by the addition theorem. Signed zeros are handled like 
+in std::atan2. The outputs may be the same arrays as the inputs. */
+
+template<class T>
+class rsCoordinateConverter
+{
+
+public:
+
+  enum class Accuracy { libm, high, fast };
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Setup
+
+  void setAccuracy(Accuracy newAccuracy) { accuracy = newAccuracy; }
+
+  Accuracy getAccuracy() const { return accuracy; }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Conversions
+
+  void cartesianToPolar(const T* x, const T* y, T* r, T* phi, int N) const
+  {
+    forBlocks(N, [&](int i0, int L)
+    {
+      T xb[B], yb[B], rb[B], pb[B];
+      load(x+i0, xb, L); load(y+i0, yb, L);
+      for(int i = 0; i < B; i++)
+        rb[i] = rsSqrt(xb[i]*xb[i] + yb[i]*yb[i]);
+      atan2Block(yb, xb, pb, accuracy);
+      store(rb, r+i0, L); store(pb, phi+i0, L);
+    });
+  }
+
+  void polarToCartesian(const T* r, const T* phi, T* x, T* y, int N) const
+  {
+    forBlocks(N, [&](int i0, int L)
+    {
+      T rb[B], pb[B], s[B], c[B], xb[B], yb[B];
+      load(r+i0, rb, L); load(phi+i0, pb, L);
+      sinCosBlock(pb, s, c, accuracy);
+      for(int i = 0; i < B; i++) {
+        xb[i] = rb[i] * c[i]; yb[i] = rb[i] * s[i]; }
+      store(xb, x+i0, L); store(yb, y+i0, L);
+    });
+  }
+
+  void cartesianToCylindrical(const T* x, const T* y, const T* z, T* rho, T* phi, T* zc, 
+    int N) const
+  {
+    cartesianToPolar(x, y, rho, phi, N);
+    copyIfDistinct(z, zc, N);
+  }
+
+  void cylindricalToCartesian(const T* rho, const T* phi, const T* z, T* x, T* y, T* zc, 
+    int N) const
+  {
+    polarToCartesian(rho, phi, x, y, N);
+    copyIfDistinct(z, zc, N);
+  }
+
+  void cartesianToSpherical(const T* x, const T* y, const T* z, T* r, T* theta, T* phi, 
+    int N) const
+  {
+    forBlocks(N, [&](int i0, int L)
+    {
+      T xb[B], yb[B], zb[B], rho[B], rb[B], tb[B], pb[B];
+      load(x+i0, xb, L); load(y+i0, yb, L); load(z+i0, zb, L);
+      for(int i = 0; i < B; i++) {
+        rho[i] = rsSqrt(xb[i]*xb[i] + yb[i]*yb[i]);
+        rb[i]  = rsSqrt(rho[i]*rho[i] + zb[i]*zb[i]); }
+      atan2Block(rho, zb, tb, accuracy);
+      atan2Block(yb,  xb, pb, accuracy);
+      store(rb, r+i0, L); store(tb, theta+i0, L); store(pb, phi+i0, L);
+    });
+  }
+
+  void sphericalToCartesian(const T* r, const T* theta, const T* phi, T* x, T* y, T* z, 
+    int N) const
+  {
+    forBlocks(N, [&](int i0, int L)
+    {
+      T rb[B], tb[B], pb[B], st[B], ct[B], sp[B], cp[B], xb[B], yb[B], zb[B];
+      load(r+i0, rb, L); load(theta+i0, tb, L); load(phi+i0, pb, L);
+      sinCosBlock(tb, st, ct, accuracy);
+      sinCosBlock(pb, sp, cp, accuracy);
+      for(int i = 0; i < B; i++) {
+        xb[i] = rb[i] * st[i] * cp[i];
+        yb[i] = rb[i] * st[i] * sp[i];
+        zb[i] = rb[i] * ct[i]; }
+      store(xb, x+i0, L); store(yb, y+i0, L); store(zb, z+i0, L);
+    });
+  }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Kernels
+
+  /** Computes s[i] = sin(x[i]) and c[i] = cos(x[i]) for i = 0...N-1. */
+  static void sinCos(const T* x, T* s, T* c, int N, Accuracy acc)
+  {
+    forBlocks(N, [&](int i0, int L)
+    {
+      T xb[B], sb[B], cb[B];
+      load(x+i0, xb, L);
+      sinCosBlock(xb, sb, cb, acc);
+      store(sb, s+i0, L); store(cb, c+i0, L);
+    });
+  }
+
+  /** Computes a[i] = atan2(y[i], x[i]) for i = 0...N-1. */
+  static void atan2(const T* y, const T* x, T* a, int N, Accuracy acc)
+  {
+    forBlocks(N, [&](int i0, int L)
+    {
+      T yb[B], xb[B], ab[B];
+      load(y+i0, yb, L); load(x+i0, xb, L);
+      atan2Block(yb, xb, ab, acc);
+      store(ab, a+i0, L);
+    });
+  }
+
+
+protected:
+
+  static constexpr int B = 16;  // block size
+
+  /** Calls f(i0, L) for the blocks starting at i0 = 0, B, 2B, ... of lengths L <= B. */
+  template<class F>
+  static void forBlocks(int N, F f)
+  {
+    for(int i0 = 0; i0 < N; i0 += B)
+      f(i0, rsMin(B, N-i0));
+  }
+
+  /** Copies L <= B values into the block buffer and pads it with zeros. */
+  static void load(const T* src, T (&dst)[B], int L)
+  {
+    if(L == B) {
+      memcpy(dst, src, B * sizeof(T));  // constant size, so it gets inlined
+      return; }
+    for(int i = 0; i < L; i++) dst[i] = src[i];
+    for(int i = L; i < B; i++) dst[i] = T(0);
+  }
+
+  /** Copies the first L <= B values of the block buffer to dst. */
+  static void store(const T (&src)[B], T* dst, int L)
+  {
+    if(L == B) {
+      memcpy(dst, src, B * sizeof(T));
+      return; }
+    for(int i = 0; i < L; i++) dst[i] = src[i];
+  }
+
+  static void copyIfDistinct(const T* src, T* dst, int N)
+  {
+    if(src != dst)
+      for(int i = 0; i < N; i++)
+        dst[i] = src[i];
+  }
+
+  static void sinCosBlock(const T (&x)[B], T (&s)[B], T (&c)[B], Accuracy acc)
+  {
+    if(acc == Accuracy::libm) {
+      for(int i = 0; i < B; i++) {
+        s[i] = std::sin(x[i]); c[i] = std::cos(x[i]); }
+      return; }
+
+    // Taylor coefficients of (sin(r)/r - 1)/r^2 and (cos(r) - 1)/r^2 as polynomials in r^2:
+    static const T cs[9] = { T(-1./6), T(1./120), T(-1./5040), T(1./362880), 
+      T(-1./39916800), T(1./6227020800), T(-1./1307674368000), T(1./355687428096000), 
+      T(-1./121645100408832000) };
+    static const T cc[9] = { T(-1./2), T(1./24), T(-1./720), T(1./40320), T(-1./3628800), 
+      T(1./479001600), T(-1./87178291200), T(1./20922789888000), T(-1./6402373705728000) };
+    int ns = acc == Accuracy::fast ? 4 : 8;   // up to r^9 or r^17
+    int nc = acc == Accuracy::fast ? 4 : 9;   // up to r^8 or r^18
+
+    // Reduce x to r in [-pi/4, pi/4] with x = r + k*pi/2:
+    const T twoOverPi = T(0.636619772367581343075535);
+    const T C1 = T(1.5703125);                   // pi/2 = C1 + ... + C5, where C1...C4 have 
+    const T C2 = T(4.837512969970703125e-4);     // only a few bits, so k*C1 etc. are exact (for
+    const T C3 = T(7.549790126404332113452e-8);  // double)
+    const T C4 = T(-1.715124510005881872804e-15);
+    const T C5 = T(1.056299906698742711242e-23);
+    const T magic = T(1.5) * std::ldexp(T(1), std::numeric_limits<T>::digits - 1);
+    T r[B], z[B], q[B], ps[B], pc[B];
+    for(int i = 0; i < B; i++) {
+      T k  = (x[i] * twoOverPi + magic) - magic;            // round to nearest integer
+      q[i] = k - 4 * (((k - T(1.5)) * T(0.25) + magic) - magic);  // k mod 4 in 0...3
+      r[i] = ((((x[i] - k*C1) - k*C2) - k*C3) - k*C4) - k*C5;
+      z[i] = r[i] * r[i]; }
+
+    // Evaluate the polynomials by Horner's rule:
+    for(int i = 0; i < B; i++) { ps[i] = cs[ns-1]; pc[i] = cc[nc-1]; }
+    for(int j = ns-2; j >= 0; j--)
+      for(int i = 0; i < B; i++) ps[i] = ps[i] * z[i] + cs[j];
+    for(int j = nc-2; j >= 0; j--)
+      for(int i = 0; i < B; i++) pc[i] = pc[i] * z[i] + cc[j];
+    for(int i = 0; i < B; i++) {
+      ps[i] = r[i] + r[i] * z[i] * ps[i];
+      pc[i] = T(1) + z[i] * pc[i]; }
+
+    // Select and negate according to the quadrant k mod 4. We compute k mod 4 in floating point 
+    // to keep all lanes of the same width and write to local buffers, so the loop vectorizes:
+    T sb[B], cb[B];
+    for(int i = 0; i < B; i++) {
+      T qi = q[i];
+      bool odd = (qi - T(1)) * (qi - T(3)) == T(0);
+      T si = odd ? pc[i] : ps[i];
+      T ci = odd ? ps[i] : pc[i];
+      sb[i] = (qi >= T(2) ? T(-1) : T(1)) * si;                        // negate for qi = 2, 3
+      cb[i] = ((qi - T(0.5)) * (qi - T(2.5)) < T(0) ? T(-1) : T(1)) * ci; } // and for qi = 1, 2
+    memcpy(s, sb, B * sizeof(T));
+    memcpy(c, cb, B * sizeof(T));
+  }
+
+  static void atan2Block(const T (&y)[B], const T (&x)[B], T (&a)[B], Accuracy acc)
+  {
+    if(acc == Accuracy::libm) {
+      for(int i = 0; i < B; i++)
+        a[i] = std::atan2(y[i], x[i]);
+      return; }
+
+    // Taylor coefficients of (atan(b)/b - 1)/b^2 as polynomial in b^2:
+    static const T ca[10] = { T(-1./3), T(1./5), T(-1./7), T(1./9), T(-1./11), T(1./13), 
+      T(-1./15), T(1./17), T(-1./19), T(1./21) };
+    int na = acc == Accuracy::fast ? 4 : 10;  // up to b^9 or b^21
+
+    // pi and pi/2 split into a high part in T and a low part that holds the rest:
+    auto lo = [](double h, double l) { return T((h - double(T(h))) + l); };
+    const T piHi  = T(3.141592653589793),  piLo  = lo(3.141592653589793,  1.2246467991473532e-16);
+    const T pi2Hi = T(1.5707963267948966), pi2Lo = lo(1.5707963267948966, 6.123233995736766e-17);
+    const T pi8   = T(0.39269908169872415480783042);
+    const T tan1   = T(0.19891236737965800691159762);  // tan(1*pi/16)
+    const T tan2   = T(0.41421356237309504880168872);  // tan(2*pi/16)
+    const T tan3   = T(0.66817863791929891999775768);  // tan(3*pi/16)
+
+    // Reduce to a = min(|x|,|y|) / max(|x|,|y|) in [0, 1] and then to b = tan(atan(a) - j*pi/8)
+    // with j = 0, 1, 2 such that |b| <= tan(pi/16). Under the default -ftrapping-math, gcc turns
+    // selections between computed values into branches, which prevents vectorization, so we 
+    // use step functions made from copysign instead:
+    const T tiny = std::numeric_limits<T>::denorm_min();  // to avoid 0/0
+    T b[B], z[B], p[B], j[B];
+    for(int i = 0; i < B; i++) {
+      T ax = std::abs(x[i]), ay = std::abs(y[i]);    // not rsAbs, which keeps -0
+      T ai = rsMin(ax, ay) / rsMax(rsMax(ax, ay), tiny);
+      T s1 = T(0.5) + T(0.5) * std::copysign(T(1), ai - tan1);   // 1 if ai >= tan1, else 0
+      T s3 = T(0.5) + T(0.5) * std::copysign(T(1), ai - tan3);
+      T t  = rsMax(s1 * tan2, s3);                               // 0, tan(pi/8) or 1
+      j[i] = s1 + s3;
+      b[i] = (ai - t) / (T(1) + ai * t);
+      z[i] = b[i] * b[i]; }
+
+    for(int i = 0; i < B; i++) p[i] = ca[na-1];
+    for(int j = na-2; j >= 0; j--)
+      for(int i = 0; i < B; i++) p[i] = p[i] * z[i] + ca[j];
+
+    // Undo the reductions. For |y| > |x|, we need pi/2 - a and for x < 0, we need pi - a. The
+    // factors g = -1 (and h = 1) select these without branches:
+    T ab[B];
+    for(int i = 0; i < B; i++) {
+      T ai = j[i] * pi8 + (b[i] + b[i] * z[i] * p[i]);
+      T g  = std::copysign(T(1), std::abs(x[i]) - std::abs(y[i]));
+      T h  = T(0.5) - T(0.5) * g;
+      ai   = (h * pi2Hi + g * ai) + h * pi2Lo;
+      g    = std::copysign(T(1), x[i]);
+      h    = T(0.5) - T(0.5) * g;
+      ai   = (h * piHi + g * ai) + h * piLo;
+      ab[i] = std::copysign(ai, y[i]); }
+    memcpy(a, ab, B * sizeof(T));
+  }
+
+  Accuracy accuracy = Accuracy::high;
+
+};
+
+// see also:
 // https://en.wikipedia.org/wiki/Hyperbolic_coordinates
 // https://en.wikipedia.org/wiki/Elliptic_coordinate_system
 // https://en.wikipedia.org/wiki/Toroidal_coordinates
@@ -2070,6 +3994,21 @@ public:
   rsSortedSet(const std::vector<T>& setData) : data(setData)
   { rsAssert(isValid(data)); }
 
+  // Copying copies only the data, not the scratch buffer that is used by the in-place operations:
+  rsSortedSet(const rsSortedSet<T>& B) : data(B.data) {}
+  rsSortedSet(rsSortedSet<T>&& B) = default;
+  rsSortedSet<T>& operator=(const rsSortedSet<T>& B) { data = B.data; return *this; }
+  rsSortedSet<T>& operator=(rsSortedSet<T>&& B) = default;
+
+  /** Creates a set from data that is already known to be a valid set, for example because it is 
+  the result of one of the set operations below. This skips the O(N) check in the constructor. */
+  static rsSortedSet<T> fromValidData(std::vector<T>&& setData)
+  {
+    rsSortedSet<T> S;
+    S.data = std::move(setData);
+    return S;
+  }
+
   /** Returns true, iff the given vector is a valid representation of a sorted set. For this, it 
   must be ascendingly sorted and each element may occur only once. */
   static bool isValid(const std::vector<T>& A)
@@ -2080,83 +4019,88 @@ public:
     return sorted;
   }
 
-  /** An element is in the intersection set of A and B if it is in A or in B. */
+  /** An element is in the union set of A and B if it is in A or in B. */
   static std::vector<T> unionSet(const std::vector<T>& A, const std::vector<T>& B)
   {
-    size_t Na = A.size(), Nb = B.size();
-    size_t ia = 0, ib = 0; // indices into A and B, maybe use i,j
-    std::vector<T> C;
-    C.reserve(Na+Nb);
-    while(ia < Na && ib < Nb) {
-      if(     B[ib] < A[ia]) { C.push_back(B[ib]); ib++;       }   // A[ia] >  B[ib]
-      else if(A[ia] < B[ib]) { C.push_back(A[ia]); ia++;       }   // A[ia] <  B[ib]
-      else                   { C.push_back(A[ia]); ia++; ib++; }}  // A[ia] == B[ib]
-    while(ia < A.size()) { C.push_back(A[ia]); ia++; }
-    while(ib < B.size()) { C.push_back(B[ib]); ib++; }
+    std::vector<T> C(A.size() + B.size());
+    C.resize(unionKernel(A.data(), A.size(), B.data(), B.size(), C.data()) - C.data());
     return C;
   }
-  // maybe rename to unionSet, etc. to avoid confusion with setters
 
   /** An element is in the intersection set of A and B if it is in A and in B. */
   static std::vector<T> intersectionSet(const std::vector<T>& A, const std::vector<T>& B)
   {
-    size_t Na = A.size(), Nb = B.size();
-    size_t ia = 0, ib = 0;
-    std::vector<T> C;
-    C.reserve(rsMin(Na, Nb));
-    while(ia < Na && ib < Nb) {
-      while(ia < Na && ib < Nb && A[ia] <  B[ib])   ia++;   // is ib < B.size() needed?
-      while(ia < Na && ib < Nb && B[ib] <  A[ia])   ib++;   // is ia < A.size() needed?
-      while(ia < Na && ib < Nb && B[ib] == A[ia]) { C.push_back(A[ia]); ia++; ib++; }}
+    std::vector<T> C(rsMin(A.size(), B.size()));
+    C.resize(intersectionKernel(A.data(), A.size(), B.data(), B.size(), C.data()) - C.data());
     return C;
   }
 
   /** An element is in the difference set A "without" B if it is in A but not in B. */
   static std::vector<T> differenceSet(const std::vector<T>& A, const std::vector<T>& B)
   {
-    size_t Na = A.size(), Nb = B.size();
-    size_t ia = 0, ib = 0;
-    std::vector<T> C;
-    C.reserve(Na);
-    while(ia < Na && ib < B.size()) {
-      while(ia < Na && ib < Nb && A[ia] <  B[ib]) { C.push_back(A[ia]); ia++; }  // is ib < Nb needed?
-      while(ia < Na && ib < Nb && A[ia] == B[ib]) { ia++; ib++;               }
-      while(ia < Na && ib < Nb && B[ib] <  A[ia]) { ib++;                     }} // is ia < Na needed?
-    while(ia < Na) { C.push_back(A[ia]); ia++; } 
+    std::vector<T> C(A.size());
+    C.resize(differenceKernel(A.data(), A.size(), B.data(), B.size(), C.data()) - C.data());
     return C;
   }
-  // while(ia < Na && ib < Na)
-  //   add all elements from A that are less than our current element in B
-  //   skip all elements in A and B that are equal
-  //   skip all elements in B that are less than our current element in A
-  // endwhile
 
-  /** An element is in the intersection set of A and B if it is in A or in B but not in both, so 
-  it's like the union but with the exclusive instead of the inclusive or. The symmetric difference
-  is the union minus the intersection. */
+  /** An element is in the symmetric difference set of A and B if it is in A or in B but not in 
+  both, so it's like the union but with the exclusive instead of the inclusive or. The symmetric 
+  difference is the union minus the intersection. */
   static std::vector<T> symmetricDifferenceSet(const std::vector<T>& A, const std::vector<T>& B)
   {
-    size_t Na = A.size(), Nb = B.size();
-    size_t ia = 0, ib = 0;
-    std::vector<T> C;
-    C.reserve(Na+Nb);
-    while(ia < Na && ib < Nb) {
-      while(ia < Na && ib < Nb && A[ia] <  B[ib]) { C.push_back(A[ia]); ia++; }   // is ib < B.size() needed?
-      while(ia < Na && ib < Nb && B[ib] <  A[ia]) { C.push_back(B[ib]); ib++; }   // is ia < A.size() needed?
-      while(ia < Na && ib < Nb && B[ib] == A[ia]) { ia++; ib++;               }}
-    while(ia < A.size()) { C.push_back(A[ia]); ia++; }
-    while(ib < B.size()) { C.push_back(B[ib]); ib++; }
+    std::vector<T> C(A.size() + B.size());
+    C.resize(symmetricDifferenceKernel(A.data(), A.size(), B.data(), B.size(), C.data()) - C.data());
     return C;
   }
-  // needs more tests
 
-  static std::vector<std::pair<T,T>> cartesianProduct(
-    const std::vector<T>& A, const std::vector<T>& B)
-  {
-    size_t Na = A.size(), Nb = B.size();
-    std::vector<std::pair<T,T>> C(Na * Nb);
-    for(size_t ia = 0; ia < Na; ia++)
-      for(size_t ib = 0; ib < Nb; ib++)
+  // The functions above allocate the result. The ones below write it into a caller provided 
+  // buffer C which must have room for the maximum possible size of the result. They return the 
+  // number of elements that were written:
+
+  /** Union of A[0..Na-1] and B[0..Nb-1]. C needs room for Na+Nb elements. */
+  static size_t unionSet(const T* A, size_t Na, const T* B, size_t Nb, T* C)
+  { return unionKernel(A, Na, B, Nb, C) - C; }
+
+  /** Intersection of A[0..Na-1] and B[0..Nb-1]. C needs room for min(Na, Nb) elements. */
+  static size_t intersectionSet(const T* A, size_t Na, const T* B, size_t Nb, T* C)
+  { return intersectionKernel(A, Na, B, Nb, C) - C; }
+
+  /** Difference of A[0..Na-1] and B[0..Nb-1]. C needs room for Na elements. */
+  static size_t differenceSet(const T* A, size_t Na, const T* B, size_t Nb, T* C)
+  { return differenceKernel(A, Na, B, Nb, C) - C; }
+
+  /** Symmetric difference of A[0..Na-1] and B[0..Nb-1]. C needs room for Na+Nb elements. */
+  static size_t symmetricDifferenceSet(const T* A, size_t Na, const T* B, size_t Nb, T* C)
+  { return symmetricDifferenceKernel(A, Na, B, Nb, C) - C; }
+
+  // ...and these write the result to an output iterator like std::back_inserter(v) or 
+  // std::ostream_iterator and return the iterator past the last written element:
+
+  template<class TOut>
+  static TOut unionSet(const std::vector<T>& A, const std::vector<T>& B, TOut out)
+  { return unionKernel(A.data(), A.size(), B.data(), B.size(), out); }
+
+  template<class TOut>
+  static TOut intersectionSet(const std::vector<T>& A, const std::vector<T>& B, TOut out)
+  { return intersectionKernel(A.data(), A.size(), B.data(), B.size(), out); }
+
+  template<class TOut>
+  static TOut differenceSet(const std::vector<T>& A, const std::vector<T>& B, TOut out)
+  { return differenceKernel(A.data(), A.size(), B.data(), B.size(), out); }
+
+  template<class TOut>
+  static TOut symmetricDifferenceSet(const std::vector<T>& A, const std::vector<T>& B, TOut out)
+  { return symmetricDifferenceKernel(A.data(), A.size(), B.data(), B.size(), out); }
+
+  /** Returns all Na*Nb pairs of elements of A and B. For large sets, rsCartesianProductView is 
+  better, because it computes the pairs on the fly instead of storing them. */
+  static std::vector<std::pair<T,T>> cartesianProduct(
+    const std::vector<T>& A, const std::vector<T>& B)
+  {
+    size_t Na = A.size(), Nb = B.size();
+    std::vector<std::pair<T,T>> C(Na * Nb);
+    for(size_t ia = 0; ia < Na; ia++)
+      for(size_t ib = 0; ib < Nb; ib++)
         C[ia*Nb+ib] = std::pair(A[ia], B[ib]);
     return C;
   }
@@ -2190,28 +4134,120 @@ public:
   //  operator that doesn't satisfy trichotomy
   // -maybe the operators should be implemented as functions A.intersectWith(B), etc.
 
-  // maybe implement relations as subsets of the cartesian product - then we may inquire if a 
-  // particular tuple of elements is in a given relation - this can also be determined quickly by 
-  // two successive binary searches...maybe we can do interesting computaions with relations, too
+  // Relations as subsets of the cartesian product are implemented in rsRelation. Membership of a
+  // pair is determined by two successive binary searches there.
 
 
   const std::vector<T>& getData() const { return data; }
 
   /** Addition operator implements set union. */
   rsSortedSet<T> operator+(const rsSortedSet<T>& B) const
-  { return rsSortedSet<T>(unionSet(this->data, B.data)); }
+  { return fromValidData(unionSet(this->data, B.data)); }
 
   /** Subtraction operator implements set difference. */
   rsSortedSet<T> operator-(const rsSortedSet<T>& B) const
-  { return rsSortedSet<T>(differenceSet(this->data, B.data)); }
+  { return fromValidData(differenceSet(this->data, B.data)); }
 
   /** Multiplication operator implements set intersection. */
   rsSortedSet<T> operator*(const rsSortedSet<T>& B) const
-  { return rsSortedSet<T>(intersectionSet(this->data, B.data)); }
+  { return fromValidData(intersectionSet(this->data, B.data)); }
 
   /** Division operator implements set symmetric difference. */
   rsSortedSet<T> operator/(const rsSortedSet<T>& B) const
-  { return rsSortedSet<T>(symmetricDifferenceSet(this->data, B.data)); }
+  { return fromValidData(symmetricDifferenceSet(this->data, B.data)); }
+
+  rsSortedSet<T>& operator+=(const rsSortedSet<T>& B) { unionWith(B);         return *this; }
+  rsSortedSet<T>& operator-=(const rsSortedSet<T>& B) { subtract(B);          return *this; }
+  rsSortedSet<T>& operator*=(const rsSortedSet<T>& B) { intersectWith(B);     return *this; }
+  rsSortedSet<T>& operator/=(const rsSortedSet<T>& B) { symmetricSubtract(B); return *this; }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name In-place operations
+
+  /* These replace this set with the result of the operation. The result is computed into a 
+  scratch buffer and then moved into the data, so the memory of both gets reused. In a sequence of
+  operations like A += B; A *= C; A -= D; etc. only the first few will allocate. */
+
+  void unionWith(const rsSortedSet<T>& B)
+  {
+    replaceData(B.data, data.size() + B.data.size(), 
+      [](const T* A, size_t Na, const T* B, size_t Nb, T* C) 
+      { return unionKernel(A, Na, B, Nb, C); });
+  }
+
+  void intersectWith(const rsSortedSet<T>& B)
+  {
+    replaceData(B.data, rsMin(data.size(), B.data.size()),
+      [](const T* A, size_t Na, const T* B, size_t Nb, T* C) 
+      { return intersectionKernel(A, Na, B, Nb, C); });
+  }
+
+  void subtract(const rsSortedSet<T>& B)
+  {
+    replaceData(B.data, data.size(),
+      [](const T* A, size_t Na, const T* B, size_t Nb, T* C) 
+      { return differenceKernel(A, Na, B, Nb, C); });
+  }
+
+  void symmetricSubtract(const rsSortedSet<T>& B)
+  {
+    replaceData(B.data, data.size() + B.data.size(),
+      [](const T* A, size_t Na, const T* B, size_t Nb, T* C) 
+      { return symmetricDifferenceKernel(A, Na, B, Nb, C); });
+  }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Multi-way operations
+
+  /** Writes the union of the numSets sets into C which needs room for the sum of their sizes and
+  returns the number of written elements. The sets are merged in a balanced tree of pairwise 
+  merges, which costs O(N*log(k)) for k sets with a total size of N. Folding them one after 
+  another into the result would cost O(N*k) and allocate k intermediate results. The levels of
+  the tree alternate between writing into C and into one internal scratch buffer of size N such
+  that the last level lands in C. A loser tree would write each element only once, but it can't use the 
+  branchless pairwise kernels and turned out to be 3 to 4 times slower. With numThreads > 1, the
+  range of values is split into chunks by pivots that are sampled from all sets. Each thread 
+  merges the parts of all sets that fall into its chunk and writes the result into its own region
+  of C. The regions are finally moved together. */
+  static size_t unionSet(const rsSortedSet<T>* sets, int numSets, T* C, int numThreads = 1)
+  {
+    return multiWay(sets, numSets, C, numThreads, false);
+  }
+
+  /** Writes the intersection of the numSets sets into C which needs room for the size of the 
+  smallest set and returns the number of written elements. For intersections, a heap is not the
+  best choice: we go through the smallest set and look up each of its elements in the other sets
+  by galloping search, which costs O(Nmin*k*log(N/Nmin)) and stops early when any of the sets 
+  is exhausted. Threading works as in unionSet. */
+  static size_t intersectionSet(const rsSortedSet<T>* sets, int numSets, T* C, 
+    int numThreads = 1)
+  {
+    return multiWay(sets, numSets, C, numThreads, true);
+  }
+
+  /** Convenience function that allocates the result once and returns it as set. */
+  static rsSortedSet<T> unionOf(const std::vector<rsSortedSet<T>>& sets, int numThreads = 1)
+  {
+    size_t N = 0;
+    for(auto& S : sets) N += S.data.size();
+    std::vector<T> C(N);
+    C.resize(unionSet(sets.data(), (int) sets.size(), C.data(), numThreads));
+    return fromValidData(std::move(C));
+  }
+
+  /** Convenience function that allocates the result once and returns it as set. */
+  static rsSortedSet<T> intersectionOf(const std::vector<rsSortedSet<T>>& sets, 
+    int numThreads = 1)
+  {
+    if(sets.empty()) return rsSortedSet<T>();
+    size_t N = sets[0].data.size();
+    for(auto& S : sets) N = rsMin(N, S.data.size());
+    std::vector<T> C(N);
+    C.resize(intersectionSet(sets.data(), (int) sets.size(), C.data(), numThreads));
+    return fromValidData(std::move(C));
+  }
 
 
   bool operator==(const rsSortedSet<T>& B) const
@@ -2220,7 +4256,335 @@ public:
 
 protected:
 
+  //-----------------------------------------------------------------------------------------------
+  // \name Merge kernels
+
+  /* The kernels compute the set operations on raw arrays and write the result to the output 
+  iterator C. They return the iterator past the last written element. They choose between 3 
+  strategies:
+
+  -When one set is much larger than the other (see copyRatio, skipRatio), we go through the 
+   smaller set and find the position of each of its elements in the larger set by exponential 
+   ("galloping") search, starting from the previous position. The runs of the larger set in 
+   between are copied as a whole or skipped. That costs O(Ns * log(Nl/Ns)) comparisons instead of
+   O(Nl + Ns), so intersecting a set of 100 elements with one of 10M elements costs a couple of 
+   thousand comparisons instead of 10M.
+  -For arithmetic types with similar sizes and when C is a pointer, we use branchless merges: the
+   comparison results are used as 0/1 increments for the indices, which avoids the mispredicted 
+   branches that dominate the two-pointer merge. This needs random access to the output because 
+   we always write the candidate element and advance the output pointer only when it belongs to 
+   the result. The intersection additionally skips blocks of the other set with a single 
+   comparison and locates the element inside the block by counting comparisons, a loop which 
+   compilers turn into SIMD compares.
+  -Otherwise, we use the plain two-pointer merge. */
+
+  template<class TOut>
+  static TOut unionKernel(const T* A, size_t Na, const T* B, size_t Nb, TOut C)
+  {
+    if(Na < Nb) { std::swap(A, B); std::swap(Na, Nb); }  // now, A is the larger set
+    size_t ia = 0, ib = 0;
+    if(Na > copyRatio * Nb) {
+      for(ib = 0; ib < Nb; ib++) {
+        size_t j = gallop(A, ia, Na, B[ib]);
+        C  = std::copy(A + ia, A + j, C);
+        ia = j;
+        *C++ = B[ib];
+        if(ia < Na && !(B[ib] < A[ia])) ia++; }}          // skip the duplicate in A
+    else if constexpr(isBranchless<TOut>()) {
+      while(ia < Na && ib < Nb) {
+        T a = A[ia], b = B[ib];
+        *C++ = b < a ? b : a;
+        ia += !(b < a);
+        ib += !(a < b); }}
+    else {
+      while(ia < Na && ib < Nb) {
+        if(     B[ib] < A[ia]) { *C++ = B[ib]; ib++;       }
+        else if(A[ia] < B[ib]) { *C++ = A[ia]; ia++;       }
+        else                   { *C++ = A[ia]; ia++; ib++; }}}
+    C = std::copy(A + ia, A + Na, C);
+    return std::copy(B + ib, B + Nb, C);
+  }
+
+  template<class TOut>
+  static TOut intersectionKernel(const T* A, size_t Na, const T* B, size_t Nb, TOut C)
+  {
+    if(Na > Nb) { std::swap(A, B); std::swap(Na, Nb); }  // now, A is the smaller set
+    size_t ia = 0, ib = 0;
+    if(Nb > skipRatio * Na) {
+      for(ia = 0; ia < Na; ia++) {
+        ib = gallop(B, ib, Nb, A[ia]);
+        if(ib == Nb) break;
+        if(!(A[ia] < B[ib])) { *C++ = A[ia]; ib++; }}}
+    else if constexpr(isBranchless<TOut>()) {
+      const size_t W = blockSize;
+      while(ia < Na && ib + W <= Nb) {
+        T a = A[ia];
+        if(B[ib+W-1] < a) { ib += W; continue; }            // whole block is less than a
+        size_t c = 0;
+        for(size_t k = 0; k < W; k++)                       // SIMD compare
+          c += B[ib+k] < a;
+        ib += c;                                            // B[ib] >= a now
+        bool found = !(a < B[ib]);
+        *C  = a;
+        C  += found;
+        ib += found;
+        ia++; }
+      while(ia < Na && ib < Nb) {
+        T a = A[ia], b = B[ib];
+        *C  = a;
+        C  += !(a < b) && !(b < a);
+        ia += !(b < a);
+        ib += !(a < b); }}
+    else {
+      while(ia < Na && ib < Nb) {
+        if(     A[ia] < B[ib]) ia++;
+        else if(B[ib] < A[ia]) ib++;
+        else { *C++ = A[ia]; ia++; ib++; }}}
+    return C;
+  }
+
+  template<class TOut>
+  static TOut differenceKernel(const T* A, size_t Na, const T* B, size_t Nb, TOut C)
+  {
+    size_t ia = 0, ib = 0;
+    if(Na > copyRatio * Nb) {                               // A is much larger than B
+      for(ib = 0; ib < Nb; ib++) {
+        size_t j = gallop(A, ia, Na, B[ib]);
+        C  = std::copy(A + ia, A + j, C);
+        ia = j;
+        if(ia < Na && !(B[ib] < A[ia])) ia++; }}          // skip A[ia] == B[ib]
+    else if(Nb > skipRatio * Na) {                          // B is much larger than A
+      for(; ia < Na; ia++) {
+        ib = gallop(B, ib, Nb, A[ia]);
+        if(ib == Nb) break;
+        if(A[ia] < B[ib]) *C++ = A[ia]; }}
+    else if constexpr(isBranchless<TOut>()) {
+      while(ia < Na && ib < Nb) {
+        T a = A[ia], b = B[ib];
+        *C  = a;
+        C  += a < b;
+        ia += !(b < a);
+        ib += !(a < b); }}
+    else {
+      while(ia < Na && ib < Nb) {
+        if(     A[ia] < B[ib]) { *C++ = A[ia]; ia++; }
+        else if(B[ib] < A[ia]) { ib++;               }
+        else                   { ia++; ib++;         }}}
+    return std::copy(A + ia, A + Na, C);
+  }
+
+  template<class TOut>
+  static TOut symmetricDifferenceKernel(const T* A, size_t Na, const T* B, size_t Nb, TOut C)
+  {
+    if(Na < Nb) { std::swap(A, B); std::swap(Na, Nb); }  // now, A is the larger set
+    size_t ia = 0, ib = 0;
+    if(Na > copyRatio * Nb) {
+      for(ib = 0; ib < Nb; ib++) {
+        size_t j = gallop(A, ia, Na, B[ib]);
+        C  = std::copy(A + ia, A + j, C);
+        ia = j;
+        if(ia < Na && !(B[ib] < A[ia])) ia++;             // in both sets
+        else *C++ = B[ib]; }}
+    else if constexpr(isBranchless<TOut>()) {
+      while(ia < Na && ib < Nb) {
+        T a = A[ia], b = B[ib];
+        *C  = b < a ? b : a;
+        C  += (a < b) || (b < a);
+        ia += !(b < a);
+        ib += !(a < b); }}
+    else {
+      while(ia < Na && ib < Nb) {
+        if(     A[ia] < B[ib]) { *C++ = A[ia]; ia++; }
+        else if(B[ib] < A[ia]) { *C++ = B[ib]; ib++; }
+        else                   { ia++; ib++;         }}}
+    C = std::copy(A + ia, A + Na, C);
+    return std::copy(B + ib, B + Nb, C);
+  }
+
+  /** Returns the index of the first element in A[lo..N-1] that is not less than x (or N, if there
+  is none), i.e. like std::lower_bound. The search range is first found by exponential search 
+  starting at lo and then narrowed down by binary search, so the cost is O(log(d)) where d is 
+  the distance of the result from lo. */
+  static size_t gallop(const T* A, size_t lo, size_t N, const T& x)
+  {
+    size_t hi = lo, step = 1;
+    while(hi < N && A[hi] < x) {     // invariant: A[lo-1] < x
+      lo    = hi + 1;
+      hi   += step;
+      step *= 2; }
+    hi = rsMin(hi, N);
+    return std::lower_bound(A + lo, A + hi, x) - A;
+  }
+
+  /** The branchless merges need arithmetic elements and a pointer as output. */
+  template<class TOut>
+  static constexpr bool isBranchless() 
+  { 
+    return std::is_arithmetic<T>::value && std::is_same<TOut, T*>::value; 
+  }
+
+  /** Replaces our data with the result of the operation op(data, B, C) where C points to a buffer
+  with room for maxSize elements. The scratch buffer tmp only ever grows, so its elements get 
+  initialized only once and the cost is O(size of the result) rather than O(maxSize). The result 
+  is then moved into the data which reallocates only when its capacity is exceeded. */
+  template<class TOp>
+  void replaceData(const std::vector<T>& B, size_t maxSize, TOp op)
+  {
+    if(tmp.size() < maxSize)
+      tmp.resize(maxSize);
+    T* end = op(data.data(), data.size(), B.data(), B.size(), tmp.data());
+    data.assign(std::make_move_iterator(tmp.data()), std::make_move_iterator(end));
+  }
+
+  using Range = std::pair<const T*, const T*>;  // begin and end of a (part of a) set
+
+  /** Implements unionSet and intersectionSet. */
+  static size_t multiWay(const rsSortedSet<T>* sets, int k, T* C, int numThreads, 
+    bool intersect)
+  {
+    std::vector<Range> r(k);
+    size_t N = 0;
+    for(int i = 0; i < k; i++) {
+      r[i] = Range(sets[i].data.data(), sets[i].data.data() + sets[i].data.size());
+      N += sets[i].data.size(); }
+    if(k == 0 || (intersect && N == 0)) 
+      return 0;
+    std::vector<T> W(intersect ? 0 : N);             // scratch buffer for the union
+    auto kernel = [&](Range* rt, T* Ct, T* Wt) 
+    { return (intersect ? intersectionKernel(rt, k, Ct) : unionKernel(rt, k, Ct, Wt)) - Ct; };
+    if(numThreads <= 1 || N < 16384)                 // not worth the thread overhead
+      return kernel(r.data(), C, W.data());
+
+    // Split the sets into chunks at the pivots, such that chunk t contains the values in 
+    // [pivot[t-1], pivot[t]) of all sets:
+    std::vector<T> pivots = samplePivots(r.data(), k, numThreads);
+    int numChunks = (int) pivots.size() + 1;
+    std::vector<Range> chunks(numChunks * k);        // chunks[t*k + i]: chunk t of set i
+    for(int i = 0; i < k; i++) {
+      const T* p = r[i].first;
+      for(int t = 0; t < numChunks; t++) {
+        const T* q = t < numChunks-1 ? std::lower_bound(p, r[i].second, pivots[t]) : r[i].second;
+        chunks[t*k + i] = Range(p, q);
+        p = q; }}
+
+    // Each chunk gets a region of C that is large enough for its result. For the union, that's 
+    // the sum of the sizes of its parts, for the intersection, the size of the smallest part:
+    std::vector<size_t> offsets(numChunks+1, 0), counts(numChunks, 0);
+    for(int t = 0; t < numChunks; t++) {
+      size_t size = intersect ? std::numeric_limits<size_t>::max() : 0;
+      for(int i = 0; i < k; i++) {
+        size_t n = chunks[t*k + i].second - chunks[t*k + i].first;
+        size = intersect ? rsMin(size, n) : size + n; }
+      offsets[t+1] = offsets[t] + size; }
+    std::vector<std::thread> threads;
+    threads.reserve(numChunks);
+    for(int t = 0; t < numChunks; t++)
+      threads.push_back(std::thread([&, t]() { 
+        T* Wt = intersect ? nullptr : W.data() + offsets[t];  // W is empty for the intersection
+        counts[t] = kernel(&chunks[t*k], C + offsets[t], Wt); }));
+    for(auto& t : threads)
+      t.join();
+
+    // Move the results of the chunks together:
+    size_t n = counts[0];
+    for(int t = 1; t < numChunks; t++) {
+      if(offsets[t] != n)
+        std::copy(C + offsets[t], C + offsets[t] + counts[t], C + n);
+      n += counts[t]; }
+    return n;
+  }
+
+  /** Merges the k ranges into C and returns the pointer past the last written element. The 
+  merges are done in a balanced binary tree ("tournament") of pairwise merges: at each level, the
+  ranges are merged in pairs, which halves their number, so each element passes through 
+  ceil(log2(k)) merges. Unlike a heap, which also needs O(log(k)) per element, this can use the
+  branchless and galloping pairwise kernels. The levels alternate between writing into C and into
+  the scratch buffer W (of the same size) such that the last level writes into C. The ranges are 
+  modified. */
+  static T* unionKernel(Range* r, int k, T* C, T* W)
+  {
+    if(k == 0) return C;
+    if(k == 1) return std::copy(r[0].first, r[0].second, C);
+    int numLevels = 0;
+    for(int m = k; m > 1; m = (m+1)/2) numLevels++;
+    T* p = C;
+    for(int level = numLevels; level >= 1; level--) {
+      p = level % 2 == 1 ? C : W;                  // level 1 is the last one
+      int m = 0;
+      for(int i = 0; i < k; i += 2) {
+        T* q = i+1 < k ? unionKernel(r[i].first,   r[i].second   - r[i].first, 
+                                     r[i+1].first, r[i+1].second - r[i+1].first, p)
+                       : std::copy(r[i].first, r[i].second, p);
+        r[m++] = Range(p, q);
+        p = q; }
+      k = m; }
+    return p;
+  }
+
+  /** Intersects the k ranges by looking up the elements of the smallest range in all others via 
+  galloping. Returns the pointer past the last written element. The ranges are modified. */
+  static T* intersectionKernel(Range* r, int k, T* C)
+  {
+    auto size = [](const Range& a) { return (size_t) (a.second - a.first); };
+    std::sort(r, r + k, [&](const Range& a, const Range& b) { return size(a) < size(b); });
+    if(k == 1)
+      return std::copy(r[0].first, r[0].second, C);
+    for(const T* p = r[0].first; p != r[0].second; p++) {
+      const T& x = *p;
+      int i;
+      for(i = 1; i < k; i++) {
+        r[i].first += gallop(r[i].first, 0, size(r[i]), x);
+        if(r[i].first == r[i].second) return C;    // nothing more to find
+        if(x < *r[i].first) break; }               // x is not in set i
+      if(i == k) 
+        *C++ = x; }
+    return C;
+  }
+
+  /** Returns numThreads-1 (or fewer, if there are many duplicates) strictly ascending pivots 
+  that split the union of the ranges into numThreads chunks of approximately equal size. They 
+  are found by taking evenly spaced samples from each range, weighting each sample by the size 
+  of its range divided by the number of samples from it and picking the weighted quantiles. */
+  static std::vector<T> samplePivots(const Range* r, int k, int numThreads)
+  {
+    const int samplesPerSet = 8 * numThreads;
+    std::vector<std::pair<T, double>> samples;
+    samples.reserve(k * samplesPerSet);
+    double totalWeight = 0;
+    for(int i = 0; i < k; i++) {
+      size_t n = r[i].second - r[i].first;
+      if(n == 0) continue;
+      int s = (int) rsMin(n, (size_t) samplesPerSet);
+      double w = double(n) / s;
+      for(int j = 0; j < s; j++)
+        samples.push_back(std::pair<T, double>(r[i].first[(j * n) / s], w));
+      totalWeight += n; }
+    std::sort(samples.begin(), samples.end(), 
+      [](const std::pair<T, double>& a, const std::pair<T, double>& b) 
+      { return a.first < b.first; });
+    std::vector<T> pivots;
+    double acc = 0;
+    int t = 1;
+    for(auto& s : samples) {
+      acc += s.second;
+      if(t < numThreads && acc >= t * totalWeight / numThreads) {
+        if(pivots.empty() || pivots.back() < s.first)
+          pivots.push_back(s.first);
+        t++; }}
+    return pivots;
+  }
+
+  // Size ratios above which we gallop through the larger set. When the runs of the larger set 
+  // between the elements of the smaller one are copied to the output, the copying costs O(Nl) 
+  // anyway and galloping already pays off at lower ratios than when the runs are skipped:
+  static constexpr size_t copyRatio = 8;
+  static constexpr size_t skipRatio = 32;
+
+  static constexpr size_t blockSize = 8;   // for the block compares in the intersection
+
+
   std::vector<T> data;
+  std::vector<T> tmp;   // scratch buffer for the in-place operations, never shrinks
 
 };
 // goal: all basic set operations like union, intersection, difference, etc. should be O(N), 
@@ -2240,512 +4604,2552 @@ protected:
 
 // https://github.com/coin-or/ADOL-C
 
-//=================================================================================================
+//-------------------------------------------------------------------------------------------------
 
-/** Implements a datatype suitable for automatic differentiation or AD for short. In AD, a number 
-is seen as the result of a function evaluation and in addition to the actual output value of the 
-function, the value of the derivative is also computed and carried along through all subsequent 
-operations and function applications. Derivative values can be useful in algorithms for numerical 
-optimization (e.g. gradient descent), iterative nonlinear equation solvers (e.g. Newton iteration),
-ordinary and partial differential equations solvers, differential geometry etc. In general, 
-derivatives can be calculated by various means: 
+/** A set of integers in a compressed representation that is suited for large, dense sets. It 
+follows the idea of "roaring bitmaps": the range of values is divided into chunks of 2^16 values 
+that share their upper bits and each nonempty chunk stores the lower 16 bits of its elements in 
+one of 3 forms, whichever needs the least memory:
 
-  (1) Analytically, by directly implementing a symbolically derived formula. This is tedious, 
-      error-prone and needs human effort for each individual case (unless a symbolic math engine 
-      is available, but the expressions tend to swell quickly rendering the approach inefficient).
-  (2) Numerically, by using finite difference approximations. This can be computationally 
-      expensive and inaccurate.
-  (3) Automatically, by overloading operators and functions for a number type that is augmented by
-      a derivative field. The resulting algebra of such augmented numbers makes use of the well 
-      known differentiation rules and derivatives of elementary functions.
+  -array:  sorted array of the elements, 2 bytes per element (used for sparse chunks)
+  -bitmap: 1024 words of 64 bits where bit i is set iff element i is present, 8 kB per chunk
+  -runs:   sorted array of (start, length-1) pairs of runs of consecutive elements, 4 bytes per run
 
-The so called dual numbers are a way to implement the 3rd option. Each dual number has one field 
-"v" representing the actual (value of the) number itself and an additional field "d" for 
-representing the derivative. In all arithmetic operations that we do with a pair of operands, the 
-first value component "v" is computed as usual and the derivative component "d" is computed using
-the well known differentiation rules: sum-rule, difference-rule, product-rule and quotient-rule. 
-Likewise, in univariate function evaluations, we apply the chain-rule. 
+A dense set thus needs 1/8 byte per element instead of sizeof(T) in rsSortedSet. Set operations 
+between bitmaps work on 64 elements at once via bitwise AND, OR, etc. and those between arrays use
+the merge kernels of rsSortedSet<uint16_t>. Run chunks are converted to bitmaps for the 
+operations. The representation is canonical, i.e. equal sets have equal chunks. T must be an 
+integer type. */
 
-Mathematically, we can think of the dual numbers as being constructed from the real numbers in a 
-way similar to the complex numbers. For these, we postulate the existence of a number i which has
-the property i^2 = -1. No real number has this property, so i can't be a real number. For the dual
-numbers, we postulate a nonzero number epsilon (denoted here as E) with the property E^2 = 0. No 
-real number (except zero, which was excluded) has this property, so E can't be a real number. The 
-dual numbers are then numbers of the form a + b*E, just like the complex numbers are of the form 
-a + b*i, where a and b are real numbers. ..i think, this has relations to nonstandard analysis with
-hyperreal numbers and E can be thought of as being the infinitesimal....figure that out and 
-explain more...maybe mention also also hyperbolic numbers...they do not form a field, only a ring,
-because the quotient rule demands that the v-part of divisor must be nonzero - so any dual number
-with zero v-part is a number that we cant divide by - and these are not the neutral element(s)
-of addition (there can be only one anyway)
+template<class T>
+class rsRoaringSet
+{
 
+  static_assert(std::is_integral<T>::value, "rsRoaringSet needs an integer type");
 
-To implement multidimensional derivatives (gradients, Jacobians, etc.), we can use rsMatrix as 
-template type T. Then, the input is an Mx1 matrix, the output is an Nx1 matrix and the Jacobian is 
-an NxM matrix. ...hmm...this is not how i did it in the examples...
-...what about higher derivative via nesting?
+public:
 
-...At some point, the derivative value must be seeded...i think, this is called 
-"forward mode"...We seed the derivative field with 1 by default-constructing a dual number from a 
-real number...explain also what reverse mode is..tbc...
+  enum class ChunkKind { array, bitmap, runs };
 
-...under construction... */
 
-template<class TVal, class TDer>
-class rsDualNumber 
-{
+  rsRoaringSet() {}
 
-public:
+  /** Creates the set from an ascendingly sorted vector of elements. */
+  rsRoaringSet(const std::vector<T>& A)
+  {
+    rsAssert(rsSortedSet<T>::isValid(A));
+    std::vector<uint16_t> v;
+    size_t i = 0;
+    while(i < A.size()) {
+      U key = keyOf(A[i]);
+      v.clear();
+      for(; i < A.size() && keyOf(A[i]) == key; i++)
+        if(v.empty() || v.back() != lowOf(A[i]))     // skip duplicates
+          v.push_back(lowOf(A[i]));
+      chunks.push_back(fromArray(key, v.data(), v.size())); }
+  }
 
+  rsRoaringSet(const rsSortedSet<T>& A) : rsRoaringSet(A.getData()) {}
 
+  /** Returns the elements as ascendingly sorted vector. */
+  std::vector<T> toVector() const
+  {
+    std::vector<T> A;
+    A.reserve(getNumElements());
+    for(auto& c : chunks) {
+      U base = U(U(c.key) << 16);
+      auto push = [&](uint32_t low) { A.push_back(fromU(U(base | low))); };
+      if(c.kind == ChunkKind::array)
+        for(uint16_t x : c.values) push(x);
+      else if(c.kind == ChunkKind::runs)
+        for(size_t r = 0; r < c.values.size(); r += 2)
+          for(uint32_t x = c.values[r]; x <= uint32_t(c.values[r] + c.values[r+1]); x++) push(x);
+      else
+        for(int i = 0; i < numWords; i++)
+          for(uint64_t b = c.bits[i]; b != 0; b &= b - 1)
+            push(64*i + lowestBit(b)); }
+    return A;
+  }
 
-  TVal v;  // function value, "real part" or "standard part"
-  TDer d;  // derivative, "infinitesimal part" (my word)
+  rsSortedSet<T> toSortedSet() const { return rsSortedSet<T>::fromValidData(toVector()); }
 
-  rsDualNumber(TVal value = TVal(0), TDer derivative = TDer(1)) : v(value), d(derivative) {}
-  // maybe the derivative should default to 1? what is most convenient? to seed or not to seed?
 
+  //-----------------------------------------------------------------------------------------------
+  // \name Inquiry
 
-  using DN = rsDualNumber<TVal, TDer>;   // shorthand for convenience
+  /** Returns true, iff x is in the set. The chunk is found by binary search over the chunks and
+  the lookup within the chunk is O(1) for bitmaps and O(log(n)) for arrays and runs. */
+  bool contains(T x) const
+  {
+    U key = keyOf(x);
+    auto it = std::lower_bound(chunks.begin(), chunks.end(), key, 
+      [](const Chunk& c, U k) { return c.key < k; });
+    return it != chunks.end() && it->key == key && it->contains(lowOf(x));
+  }
 
+  size_t getNumElements() const
+  {
+    size_t n = 0;
+    for(auto& c : chunks) n += c.card;
+    return n;
+  }
 
+  /** Returns the number of bytes used by the chunks. */
+  size_t getMemoryUsage() const
+  {
+    size_t m = chunks.size() * sizeof(Chunk);
+    for(auto& c : chunks) m += c.values.size() * sizeof(uint16_t) + c.bits.size() * sizeof(uint64_t);
+    return m;
+  }
 
-  //-----------------------------------------------------------------------------------------------
-  // \name Inquiry
+  /** Returns the number of chunks of the given kind. */
+  int getNumChunks(ChunkKind kind) const
+  {
+    int n = 0;
+    for(auto& c : chunks) n += c.kind == kind;
+    return n;
+  }
 
-  TVal getValue()      const { return v; }
-  TDer getDerivative() const { return d; }
 
   //-----------------------------------------------------------------------------------------------
-  // \name Arithmetic operators
+  // \name Operators
+  
+  /** Addition operator implements set union. */
+  rsRoaringSet<T> operator+(const rsRoaringSet<T>& B) const { return combine(*this, B, Op::Or); }
 
-  /** Unary minus just applies minus sign to both parts. */
-  DN operator-() const { return DN(-v, -d); }
+  /** Subtraction operator implements set difference. */
+  rsRoaringSet<T> operator-(const rsRoaringSet<T>& B) const { return combine(*this, B, Op::AndNot); }
 
-  /** Implements sum rule: (f+g)' = f' + g'. */
-  DN operator+(const DN& y) const { return DN(v + y.v, d + y.d); }
+  /** Multiplication operator implements set intersection. */
+  rsRoaringSet<T> operator*(const rsRoaringSet<T>& B) const { return combine(*this, B, Op::And); }
 
-  /** Implements difference rule: (f-g)' = f' - g'. */
-  DN operator-(const DN& y) const { return DN(v - y.v, d - y.d); }
+  /** Division operator implements set symmetric difference. */
+  rsRoaringSet<T> operator/(const rsRoaringSet<T>& B) const { return combine(*this, B, Op::Xor); }
 
-  /** Implements product rule: (f*g)' = f' * g + g' * f. */
-  DN operator*(const DN& y) const { return DN(v * y.v, d*y.v + v*y.d ); }
+  bool operator==(const rsRoaringSet<T>& B) const { return chunks == B.chunks; }
 
-  /** Implements quotient rule: (f/g)' = (f' * g - g' * f) / g^2. */
-  DN operator/(const DN& y) const { return DN(v / y.v, (d*y.v - v*y.d)/(y.v*y.v) ); }
-    // requires that y.v is nonzero - what does this mean for the algebraic structure od dual 
-    // numbers? do they form a ring? it's not a field because *any* number y for which v is zero 
-    // can't be a divisor - but if the d-field of y is nonzero, then y is not 0 (the neutral 
-    // element of addition)...right? ..so we have nonzero elements that we can't divide by, so we
-    // have no field
-    // maybe we could do something else when y.v == 0. in this case, the infinitesimal part gets 
-    // blown up to infinity, so maybe it could make sense to add the numerator 
-    // (d*y.v - v*y.d) = -v*y.d to the real part? ...highly speculative - maybe try it and see 
-    // what happens...but actually, the 0 in the denomiantor is squared, so it gets blown up to
-    // "infinity-squared" ...so maybe it should overblow the real part...oh - that's what it 
-    // already does anyway...maybe it should be v - v*y.d = v*(1-y.d)...maybe consider the limits
-    // when y.v goes to 0
 
-  template<class Ty> DN operator+(const Ty& y) const { return DN(v + TVal(y), d                ); }
-  template<class Ty> DN operator-(const Ty& y) const { return DN(v - TVal(y), d                ); }
-  template<class Ty> DN operator*(const Ty& y) const { return DN(v * TVal(y), d * TDer(TVal(y))); }
-  template<class Ty> DN operator/(const Ty& y) const { return DN(v / TVal(y), d / TDer(TVal(y))); }
+protected:
 
-  // maybe rename operands from x,y to a,b - x,y should be used for function inputs and ouputs in
-  // expressions like y = f(x)
+  using U = typename std::make_unsigned<T>::type;
 
-  // todo: add boilerplate for +=,-=,*=,...
+  enum class Op { Or, And, AndNot, Xor };
 
+  static constexpr int numWords = 1024;            // 64-bit words per bitmap
+  static constexpr size_t bitmapBytes = numWords * 8;
+  static constexpr size_t maxArraySize = bitmapBytes / 2;
 
+  struct Chunk
+  {
+    U key;                         // upper bits that are shared by all elements of the chunk
+    ChunkKind kind;
+    size_t card;                   // cardinality, i.e. number of elements
+    std::vector<uint16_t> values;  // sorted elements (array) or (start, length-1) pairs (runs)
+    std::vector<uint64_t> bits;    // bitmap
 
-  //-----------------------------------------------------------------------------------------------
-  // \name Comparison operators
+    bool contains(uint16_t x) const
+    {
+      if(kind == ChunkKind::bitmap)
+        return (bits[x >> 6] >> (x & 63)) & 1;
+      if(kind == ChunkKind::array)
+        return std::binary_search(values.begin(), values.end(), x);
+      size_t lo = 0, hi = values.size() / 2;       // find the first run that starts after x
+      while(lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if(values[2*mid] <= x) lo = mid + 1; else hi = mid; }
+      return lo > 0 && x - values[2*lo-2] <= values[2*lo-1];
+    }
 
-  bool operator==(const DN& y) const { return v == y.v && d == y.d; } // maybe we should only compare v
-  bool operator!=(const DN& y) const { return !(*this == y); }
-  bool operator< (const DN& y) const { return v <  y.v; }
-  bool operator<=(const DN& y) const { return v <= y.v; }
-  bool operator> (const DN& y) const { return v >  y.v; }
-  bool operator>=(const DN& y) const { return v >= y.v; }
+    bool operator==(const Chunk& c) const
+    { return key == c.key && kind == c.kind && values == c.values && bits == c.bits; }
+  };
 
-  // maybe we should take the d-part into account in the case of equal v-parts. this video says 
-  // something about the hyperreal numbers being an *ordered* field:
-  // https://www.youtube.com/watch?v=ArAjEq8uFvA
-  // when we do it like this, the set of relations {<,==,>} satisfy the trichotomy law: any pair 
-  // of numbers is in one and only one of those 3 relations
 
-};
+  // Signed values are mapped to unsigned ones by flipping the sign bit, which preserves the 
+  // order:
+  static constexpr U signBit = std::is_signed<T>::value ? U(U(1) << (8*sizeof(T)-1)) : U(0);
+  static U toU(T x)                 { return U(U(x) ^ signBit); }
+  static T fromU(U u)               { return T(U(u ^ signBit)); }
+  static U keyOf(T x)               { return U(toU(x) >> 16); }
+  static uint16_t lowOf(T x)        { return uint16_t(toU(x) & 0xFFFF); }
 
-//-------------------------------------------------------------------------------------------------
-// Operators for left argument of type Tx that can be converted into TVal:
+  static int bitCount(uint64_t x)
+  {
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return int((x * 0x0101010101010101ULL) >> 56);
+#endif
+  }
 
-template<class TVal, class TDer, class Tx>
-rsDualNumber<TVal, TDer> operator+(const Tx& x, const rsDualNumber<TVal, TDer>& y)
-{ return rsDualNumber<TVal, TDer>(TVal(x) + y.v, y.d); } // ok
+  /** Index of the lowest set bit of x, which must be nonzero. */
+  static int lowestBit(uint64_t x)
+  {
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#else
+    return bitCount((x & (~x + 1)) - 1);
+#endif
+  }
 
-template<class TVal, class TDer, class Tx>
-rsDualNumber<TVal, TDer> operator-(const Tx& x, const rsDualNumber<TVal, TDer>& y)
-{ return rsDualNumber<TVal, TDer>(TVal(x) - y.v, -y.d) ; } // ok
+  /** Chooses the representation that needs the least memory. */
+  static ChunkKind chooseKind(size_t card, size_t numRuns)
+  {
+    if(4*numRuns < rsMin(2*card, bitmapBytes)) return ChunkKind::runs;
+    return card <= maxArraySize ? ChunkKind::array : ChunkKind::bitmap;
+  }
 
-template<class TVal, class TDer, class Tx>
-rsDualNumber<TVal, TDer> operator*(const Tx& x, const rsDualNumber<TVal, TDer>& y)
-{ return rsDualNumber<TVal, TDer>(TVal(x) * y.v, TDer(TVal(x)) * y.d); } // ok
+  /** Creates a chunk from the sorted lower 16 bits v[0..n-1] of its elements. */
+  static Chunk fromArray(U key, const uint16_t* v, size_t n)
+  {
+    Chunk c;
+    c.key  = key;
+    c.card = n;
+    size_t numRuns = 0;
+    for(size_t i = 0; i < n; i++)
+      numRuns += i == 0 || v[i] != v[i-1] + 1;
+    c.kind = chooseKind(n, numRuns);
+    if(c.kind == ChunkKind::array)
+      c.values.assign(v, v + n);
+    else if(c.kind == ChunkKind::runs) {
+      c.values.reserve(2*numRuns);
+      for(size_t i = 0; i < n; ) {
+        size_t j = i + 1;
+        while(j < n && v[j] == v[j-1] + 1) j++;
+        c.values.push_back(v[i]);
+        c.values.push_back(uint16_t(j - i - 1));
+        i = j; }}
+    else {
+      c.bits.assign(numWords, 0);
+      for(size_t i = 0; i < n; i++)
+        c.bits[v[i] >> 6] |= uint64_t(1) << (v[i] & 63); }
+    return c;
+  }
 
-template<class TVal, class TDer, class Tx>
-rsDualNumber<TVal, TDer> operator/(const Tx& x, const rsDualNumber<TVal, TDer>& y)
-{ return rsDualNumber<TVal, TDer>(TVal(x) / y.v, -TDer(x)*y.d/(y.v*y.v) ); } // ok
+  /** Creates a chunk from a bitmap. */
+  static Chunk fromBits(U key, const uint64_t* w)
+  {
+    size_t card = 0, numRuns = 0;
+    uint64_t carry = 0;                            // top bit of the previous word
+    for(int i = 0; i < numWords; i++) {
+      card    += bitCount(w[i]);
+      numRuns += bitCount(w[i] & ~((w[i] << 1) | carry));   // bits that start a run
+      carry    = w[i] >> 63; }
+    if(chooseKind(card, numRuns) == ChunkKind::bitmap) {
+      Chunk c;
+      c.key  = key;
+      c.kind = ChunkKind::bitmap;
+      c.card = card;
+      c.bits.assign(w, w + numWords);
+      return c; }
+    std::vector<uint16_t> v(card);
+    size_t n = 0;
+    for(int i = 0; i < numWords; i++)
+      for(uint64_t b = w[i]; b != 0; b &= b - 1)
+        v[n++] = uint16_t(64*i + lowestBit(b));
+    return fromArray(key, v.data(), n);
+  }
 
-// maybe reduce the noise via #defines here, too
+  /** Returns a pointer to the bitmap of chunk c. If it's not a bitmap chunk, the bitmap is 
+  created in w. */
+  static const uint64_t* getBits(const Chunk& c, uint64_t* w)
+  {
+    if(c.kind == ChunkKind::bitmap)
+      return c.bits.data();
+    std::fill(w, w + numWords, uint64_t(0));
+    if(c.kind == ChunkKind::array)
+      for(uint16_t x : c.values)
+        w[x >> 6] |= uint64_t(1) << (x & 63);
+    else
+      for(size_t r = 0; r < c.values.size(); r += 2) {
+        int lo = c.values[r], hi = lo + c.values[r+1];         // inclusive
+        int i0 = lo >> 6, i1 = hi >> 6;
+        uint64_t m0 = ~uint64_t(0) << (lo & 63), m1 = ~uint64_t(0) >> (63 - (hi & 63));
+        if(i0 == i1) 
+          w[i0] |= m0 & m1;
+        else {
+          w[i0] |= m0;
+          for(int i = i0+1; i < i1; i++) w[i] = ~uint64_t(0);
+          w[i1] |= m1; }}
+    return w;
+  }
+
+  /** Combines two chunks with the same key. The result may be empty. */
+  static Chunk combine(const Chunk& a, const Chunk& b, Op op)
+  {
+    // Two arrays are merged with the kernels of rsSortedSet:
+    if(a.kind == ChunkKind::array && b.kind == ChunkKind::array) {
+      using S = rsSortedSet<uint16_t>;
+      const uint16_t *va = a.values.data(), *vb = b.values.data();
+      size_t na = a.values.size(), nb = b.values.size(), n = 0;
+      std::vector<uint16_t> v(na + nb);
+      switch(op) {
+      case Op::Or:     n = S::unionSet(              va, na, vb, nb, v.data()); break;
+      case Op::And:    n = S::intersectionSet(       va, na, vb, nb, v.data()); break;
+      case Op::AndNot: n = S::differenceSet(         va, na, vb, nb, v.data()); break;
+      case Op::Xor:    n = S::symmetricDifferenceSet(va, na, vb, nb, v.data()); break; }
+      return fromArray(a.key, v.data(), n); }
+
+    // When the result is a subset of an array, we look up its elements in the other chunk:
+    const Chunk* s = nullptr;
+    if(a.kind == ChunkKind::array && (op == Op::And || op == Op::AndNot)) s = &a;
+    else if(b.kind == ChunkKind::array && op == Op::And) s = &b;
+    if(s != nullptr) {
+      const Chunk& o = s == &a ? b : a;
+      bool keep = op == Op::And;
+      std::vector<uint16_t> v;
+      v.reserve(s->card);
+      for(uint16_t x : s->values)
+        if(o.contains(x) == keep)
+          v.push_back(x);
+      return fromArray(a.key, v.data(), v.size()); }
+
+    // Otherwise, we operate on the bitmaps, 64 elements at a time:
+    uint64_t wa[numWords], wb[numWords], wc[numWords];
+    const uint64_t* pa = getBits(a, wa);
+    const uint64_t* pb = getBits(b, wb);
+    switch(op) {
+    case Op::Or:     for(int i = 0; i < numWords; i++) wc[i] = pa[i] |  pb[i]; break;
+    case Op::And:    for(int i = 0; i < numWords; i++) wc[i] = pa[i] &  pb[i]; break;
+    case Op::AndNot: for(int i = 0; i < numWords; i++) wc[i] = pa[i] & ~pb[i]; break;
+    case Op::Xor:    for(int i = 0; i < numWords; i++) wc[i] = pa[i] ^  pb[i]; break; }
+    return fromBits(a.key, wc);
+  }
+
+  /** Combines two sets by merging their chunk lists by key. */
+  static rsRoaringSet<T> combine(const rsRoaringSet<T>& A, const rsRoaringSet<T>& B, Op op)
+  {
+    bool keepA = op != Op::And;                    // keep chunks that are only in A
+    bool keepB = op == Op::Or || op == Op::Xor;    // keep chunks that are only in B
+    const std::vector<Chunk> &a = A.chunks, &b = B.chunks;
+    rsRoaringSet<T> C;
+    size_t i = 0, j = 0;
+    while(i < a.size() && j < b.size()) {
+      if(a[i].key < b[j].key) {
+        if(keepA) C.chunks.push_back(a[i]);
+        i++; }
+      else if(b[j].key < a[i].key) {
+        if(keepB) C.chunks.push_back(b[j]);
+        j++; }
+      else {
+        Chunk c = combine(a[i++], b[j++], op);
+        if(c.card > 0) 
+          C.chunks.push_back(std::move(c)); }}
+    if(keepA) C.chunks.insert(C.chunks.end(), a.begin() + i, a.end());
+    if(keepB) C.chunks.insert(C.chunks.end(), b.begin() + j, b.end());
+    return C;
+  }
+
+
+  std::vector<Chunk> chunks;       // sorted by key
+
+};
 
 //-------------------------------------------------------------------------------------------------
-// Elementary functions of dual numbers. The v-parts are computed as usual and the d-parts are 
-// computed via the chain rule: (f(g(x)))' = g'(x) * f'(g(x)). We use some preprocessor 
-// #definitions to reduce the verbosity of the boilerplate code. They are #undef'd when we are done
-// with them:
+
+/** A sorted set that can be efficiently modified element by element. In rsSortedSet, inserting 
+or removing a single element moves all the elements behind it, so building a set incrementally 
+costs O(N^2). Here, the elements are stored in small sorted chunks of at most L elements (by 
+default 64 elements, i.e. 4 cache lines for 32-bit types) which are the leaves of a B+-tree with 
+up to F children per inner node. Insert, remove and find are O(log(N)) and the leaves are linked
+into a list, so the elements can be iterated in order. The set operations merge two sets chunk 
+by chunk with the kernels of rsSortedSet and build the result bottom-up. Conversions from and to
+rsSortedSet let you switch between both representations, e.g. to collect elements here and do 
+the set algebra there. */
+
+template<class T, int L = (256 / sizeof(T) > 8 ? 256 / sizeof(T) : 8), int F = 32>
+class rsChunkedSortedSet
+{
+
+  static_assert(L >= 4 && F >= 4, "Chunks must have room for at least 4 elements or children");
+
+protected:
+
+  struct Leaf;
+
+public:
+
+
+  rsChunkedSortedSet() { root = new Leaf; }
+
+  /** Creates the set from a strictly ascending vector of elements. */
+  rsChunkedSortedSet(const std::vector<T>& A)
+  {
+    rsAssert(std::adjacent_find(A.begin(), A.end(), 
+      [](const T& a, const T& b) { return !(a < b); }) == A.end());
+    Builder b;
+    b.push(A.data(), A.size());
+    b.finish(*this);
+  }
+
+  rsChunkedSortedSet(const rsSortedSet<T>& A) : rsChunkedSortedSet(A.getData()) {}
+
+  rsChunkedSortedSet(const rsChunkedSortedSet& B)
+  {
+    Builder b;
+    for(const Leaf* l = B.firstLeaf(); l != nullptr; l = l->next)
+      b.push(l->v, l->n);
+    b.finish(*this);
+  }
+
+  rsChunkedSortedSet(rsChunkedSortedSet&& B) : root(B.root), numElements(B.numElements)
+  {
+    B.root = new Leaf;
+    B.numElements = 0;
+  }
+
+  rsChunkedSortedSet& operator=(rsChunkedSortedSet B)  // copy-and-swap
+  {
+    std::swap(root, B.root);
+    std::swap(numElements, B.numElements);
+    return *this;
+  }
+
+  ~rsChunkedSortedSet() { freeNode(root); }
+
+  /** Returns the elements as ascendingly sorted vector. */
+  std::vector<T> toVector() const { return std::vector<T>(begin(), end()); }
+
+  rsSortedSet<T> toSortedSet() const { return rsSortedSet<T>::fromValidData(toVector()); }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Iteration
+
+  /** Forward iterator over the elements in ascending order. */
+  class const_iterator
+  {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = T;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const T*;
+    using reference         = const T&;
+
+    const_iterator(const Leaf* leaf = nullptr, int index = 0) : leaf(leaf), i(index) {}
+    const T& operator*()  const { return leaf->v[i]; }
+    const T* operator->() const { return &leaf->v[i]; }
+    const_iterator& operator++() 
+    { 
+      if(++i == leaf->n) { leaf = leaf->next; i = 0; } 
+      return *this; 
+    }
+    const_iterator operator++(int) { const_iterator tmp = *this; ++(*this); return tmp; }
+    bool operator==(const const_iterator& it) const { return leaf == it.leaf && i == it.i; }
+    bool operator!=(const const_iterator& it) const { return !(*this == it); }
+
+  protected:
+    const Leaf* leaf;
+    int i;
+  };
+
+  const_iterator begin() const { return const_iterator(firstLeaf(), 0); }
+  const_iterator end()   const { return const_iterator(); }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Element access
+
+  /** Inserts x into the set and returns true, if it wasn't already in it. */
+  bool insert(const T& x)
+  {
+    bool inserted = false;
+    T splitKey;
+    Node* right = insertInto(root, x, inserted, splitKey);
+    if(right != nullptr) {                         // the root was split: grow a new root
+      Inner* p = new Inner;
+      p->n = 2;
+      p->child[0] = root; p->keys[0] = splitKey;   // keys[0] is not used for routing
+      p->child[1] = right; p->keys[1] = splitKey;
+      root = p; }
+    numElements += inserted;
+    return inserted;
+  }
+
+  /** Removes x from the set and returns true, if it was in it. */
+  bool remove(const T& x)
+  {
+    if(!removeFrom(root, x)) 
+      return false;
+    numElements--;
+    if(!root->leaf && root->n == 1) {              // shrink the tree
+      Inner* p = static_cast<Inner*>(root);
+      root = p->child[0];
+      delete p; }
+    return true;
+  }
+
+  /** Returns an iterator to the element x or end(), if x is not in the set. */
+  const_iterator find(const T& x) const
+  {
+    const Leaf* l = findLeaf(x);
+    int i = int(std::lower_bound(l->v, l->v + l->n, x) - l->v);
+    return i < l->n && !(x < l->v[i]) ? const_iterator(l, i) : end();
+  }
+
+  bool contains(const T& x) const { return find(x) != end(); }
+
+  size_t getNumElements() const { return numElements; }
+
+  /** Checks the invariants of the tree: the elements are strictly ascending, all leaves are at 
+  the same depth and linked in order, the keys of the inner nodes bound the elements below them 
+  and the number of elements is right. Meant for tests. */
+  bool isConsistent() const
+  {
+    const Leaf* leaf = firstLeaf();
+    size_t count = 0;
+    int depth = -1;
+    if(numElements == 0)
+      return root->leaf && root->n == 0;
+    return isConsistent(root, nullptr, nullptr, 0, depth, leaf, count) && leaf == nullptr 
+      && count == numElements;
+  }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Operators
+
+  /** Addition operator implements set union. */
+  rsChunkedSortedSet operator+(const rsChunkedSortedSet& B) const
+  { 
+    return combine(*this, B, [](const T* a, size_t na, const T* b, size_t nb, T* c)
+      { return rsSortedSet<T>::unionSet(a, na, b, nb, c); }, true, true);
+  }
+
+  /** Subtraction operator implements set difference. */
+  rsChunkedSortedSet operator-(const rsChunkedSortedSet& B) const
+  { 
+    return combine(*this, B, [](const T* a, size_t na, const T* b, size_t nb, T* c)
+      { return rsSortedSet<T>::differenceSet(a, na, b, nb, c); }, true, false);
+  }
+
+  /** Multiplication operator implements set intersection. */
+  rsChunkedSortedSet operator*(const rsChunkedSortedSet& B) const
+  { 
+    return combine(*this, B, [](const T* a, size_t na, const T* b, size_t nb, T* c)
+      { return rsSortedSet<T>::intersectionSet(a, na, b, nb, c); }, false, false);
+  }
+
+  /** Division operator implements set symmetric difference. */
+  rsChunkedSortedSet operator/(const rsChunkedSortedSet& B) const
+  { 
+    return combine(*this, B, [](const T* a, size_t na, const T* b, size_t nb, T* c)
+      { return rsSortedSet<T>::symmetricDifferenceSet(a, na, b, nb, c); }, true, true);
+  }
+
+  bool operator==(const rsChunkedSortedSet& B) const
+  { return numElements == B.numElements && std::equal(begin(), end(), B.begin()); }
+
+
+protected:
+
+  struct Node
+  {
+    bool leaf;
+    int  n = 0;                    // number of elements (leaf) or children (inner node)
+    Node(bool isLeaf) : leaf(isLeaf) {}
+  };
+
+  struct Leaf : Node
+  {
+    T v[L];                        // the elements
+    Leaf* next = nullptr;          // the leaf with the next larger elements
+    Leaf() : Node(true) {}
+  };
+
+  struct Inner : Node
+  {
+    T keys[F];                     // lower bounds of the elements in the children
+    Node* child[F];
+    Inner() : Node(false) {}
+  };
+  // The elements in child[i] are >= keys[i] and < keys[i+1]. keys[0] is not needed for routing 
+  // and may be stale. The parent's key for a node is always valid.
+
+  static constexpr int minLeafSize  = L / 2;
+  static constexpr int minInnerSize = F / 2;
+
+
+  /** Index of the child of p that contains x, if it's in the set. */
+  static int route(const Inner* p, const T& x)
+  {
+    return int(std::upper_bound(p->keys + 1, p->keys + p->n, x) - (p->keys + 1));
+  }
+
+  const Leaf* findLeaf(const T& x) const
+  {
+    const Node* node = root;
+    while(!node->leaf) {
+      const Inner* p = static_cast<const Inner*>(node);
+      node = p->child[route(p, x)]; }
+    return static_cast<const Leaf*>(node);
+  }
+
+  const Leaf* firstLeaf() const
+  {
+    if(numElements == 0) return nullptr;
+    const Node* node = root;
+    while(!node->leaf) node = static_cast<const Inner*>(node)->child[0];
+    return static_cast<const Leaf*>(node);
+  }
+
+  static void freeNode(Node* node)
+  {
+    if(node->leaf) { delete static_cast<Leaf*>(node); return; }
+    Inner* p = static_cast<Inner*>(node);
+    for(int i = 0; i < p->n; i++)
+      freeNode(p->child[i]);
+    delete p;
+  }
+
+  /** Inserts x into the subtree at node. When the node had to be split, the new right sibling is
+  returned and its smallest key is written into splitKey. Otherwise, it returns nullptr. */
+  static Node* insertInto(Node* node, const T& x, bool& inserted, T& splitKey)
+  {
+    if(node->leaf) {
+      Leaf* l = static_cast<Leaf*>(node);
+      int pos = int(std::lower_bound(l->v, l->v + l->n, x) - l->v);
+      if(pos < l->n && !(x < l->v[pos]))
+        return nullptr;                            // already there
+      inserted = true;
+      if(l->n < L) {
+        insertAt(l->v, l->n, pos, x);
+        return nullptr; }
+      Leaf* r = new Leaf;                          // split the full leaf in halves
+      int h = L / 2;
+      std::copy(l->v + h, l->v + L, r->v);
+      r->n = L - h;
+      l->n = h;
+      r->next = l->next;
+      l->next = r;
+      if(pos < h) insertAt(l->v, l->n, pos,     x);
+      else        insertAt(r->v, r->n, pos - h, x);
+      splitKey = r->v[0];
+      return r; }
+
+    Inner* p = static_cast<Inner*>(node);
+    int i = route(p, x);
+    T key;
+    Node* c = insertInto(p->child[i], x, inserted, key);
+    if(c == nullptr)
+      return nullptr;
+    int pos = i + 1;                               // the new child goes behind child i
+    if(p->n < F) {
+      insertChild(p, pos, key, c);
+      return nullptr; }
+    Inner* r = new Inner;                          // split the full node in halves
+    int h = F / 2;
+    std::copy(p->keys  + h, p->keys  + F, r->keys);
+    std::copy(p->child + h, p->child + F, r->child);
+    r->n = F - h;
+    p->n = h;
+    if(pos <= h) insertChild(p, pos,     key, c);
+    else         insertChild(r, pos - h, key, c);
+    splitKey = r->keys[0];
+    return r;
+  }
+
+  static void insertAt(T* v, int& n, int pos, const T& x)
+  {
+    std::copy_backward(v + pos, v + n, v + n + 1);
+    v[pos] = x;
+    n++;
+  }
+
+  static void insertChild(Inner* p, int pos, const T& key, Node* c)
+  {
+    std::copy_backward(p->keys  + pos, p->keys  + p->n, p->keys  + p->n + 1);
+    std::copy_backward(p->child + pos, p->child + p->n, p->child + p->n + 1);
+    p->keys[pos]  = key;
+    p->child[pos] = c;
+    p->n++;
+  }
+
+  static void eraseChild(Inner* p, int pos)
+  {
+    std::copy(p->keys  + pos + 1, p->keys  + p->n, p->keys  + pos);
+    std::copy(p->child + pos + 1, p->child + p->n, p->child + pos);
+    p->n--;
+  }
+
+  /** Removes x from the subtree at node and returns true, if it was there. Children that become
+  too small are merged with or refilled from a sibling. */
+  static bool removeFrom(Node* node, const T& x)
+  {
+    if(node->leaf) {
+      Leaf* l = static_cast<Leaf*>(node);
+      int pos = int(std::lower_bound(l->v, l->v + l->n, x) - l->v);
+      if(pos == l->n || x < l->v[pos])
+        return false;
+      std::copy(l->v + pos + 1, l->v + l->n, l->v + pos);
+      l->n--;
+      return true; }
+    Inner* p = static_cast<Inner*>(node);
+    int i = route(p, x);
+    if(!removeFrom(p->child[i], x))
+      return false;
+    Node* c = p->child[i];
+    if(c->n < (c->leaf ? minLeafSize : minInnerSize))
+      rebalance(p, i);
+    return true;
+  }
+
+  /** Child i of p has become too small. It gets merged with a neighbour, if both fit into one 
+  node. Otherwise, the elements (or children) of both are distributed evenly. */
+  static void rebalance(Inner* p, int i)
+  {
+    if(p->n < 2) return;
+    int j = i > 0 ? i - 1 : i;                     // we handle the pair of children j, j+1
+    Node *a = p->child[j], *b = p->child[j+1];
+    if(a->leaf) {
+      Leaf *la = static_cast<Leaf*>(a), *lb = static_cast<Leaf*>(b);
+      if(la->n + lb->n <= L) {
+        std::copy(lb->v, lb->v + lb->n, la->v + la->n);
+        la->n += lb->n;
+        la->next = lb->next;
+        delete lb;
+        eraseChild(p, j+1); }
+      else {
+        shift(la->v, la->n, lb->v, lb->n);
+        p->keys[j+1] = lb->v[0]; }}
+    else {
+      Inner *ia = static_cast<Inner*>(a), *ib = static_cast<Inner*>(b);
+      ib->keys[0] = p->keys[j+1];                  // make the key of its first child valid
+      if(ia->n + ib->n <= F) {
+        std::copy(ib->keys,  ib->keys  + ib->n, ia->keys  + ia->n);
+        std::copy(ib->child, ib->child + ib->n, ia->child + ia->n);
+        ia->n += ib->n;
+        delete ib;
+        eraseChild(p, j+1); }
+      else {
+        int na = ia->n, nb = ib->n;
+        shift(ia->keys,  na,    ib->keys,  nb);
+        shift(ia->child, ia->n, ib->child, ib->n);
+        p->keys[j+1] = ib->keys[0]; }}
+  }
+
+  /** Moves elements between the ends of the adjacent arrays a, b such that both get the same 
+  size (up to 1). */
+  template<class Ty>
+  static void shift(Ty* a, int& na, Ty* b, int& nb)
+  {
+    int ma = (na + nb) / 2, mb = na + nb - ma;
+    if(na < ma) {                                  // move the first ma-na elements of b to a
+      int k = ma - na;
+      std::copy(b, b + k, a + na);
+      std::copy(b + k, b + nb, b); }
+    else if(na > ma) {                             // move the last na-ma elements of a to b
+      int k = na - ma;
+      std::copy_backward(b, b + nb, b + nb + k);
+      std::copy(a + ma, a + na, b); }
+    na = ma;
+    nb = mb;
+  }
+
+  /** Builds a tree bottom-up from elements that are pushed in ascending order. */
+  class Builder
+  {
+  public:
+    void push(const T* p, size_t n)
+    {
+      while(n > 0) {
+        if(leaves.empty() || leaves.back()->n == L) {
+          Leaf* l = new Leaf;
+          if(!leaves.empty()) leaves.back()->next = l;
+          leaves.push_back(l); }
+        Leaf* l = leaves.back();
+        int m = (int) rsMin(n, size_t(L - l->n));
+        std::copy(p, p + m, l->v + l->n);
+        l->n += m; p += m; n -= m; count += m; }
+    }
+
+    /** Replaces the content of the set S with the tree. */
+    void finish(rsChunkedSortedSet& S)
+    {
+      if(leaves.size() > 1) {                      // don't leave the last leaf too small
+        Leaf *a = leaves[leaves.size()-2], *b = leaves.back();
+        if(b->n < minLeafSize) shift(a->v, a->n, b->v, b->n); }
+      std::vector<Node*> level(leaves.begin(), leaves.end());
+      while(level.size() > 1) {                    // build the inner nodes level by level
+        std::vector<Node*> up;
+        size_t N = level.size(), numGroups = (N + F - 1) / F;
+        for(size_t g = 0; g < numGroups; g++) {
+          size_t i0 = g * F, i1 = rsMin(i0 + F, N);
+          if(numGroups > 1 && N - (numGroups-1)*F < minInnerSize) {   // balance the last 2
+            size_t split = (numGroups-2)*F + (F + N - (numGroups-1)*F) / 2;
+            if(g == numGroups-2) i1 = split;
+            if(g == numGroups-1) i0 = split; }
+          Inner* q = new Inner;
+          for(size_t i = i0; i < i1; i++) {
+            q->child[q->n] = level[i];
+            q->keys[q->n]  = minKey(level[i]);
+            q->n++; }
+          up.push_back(q); }
+        level.swap(up); }
+      if(S.root != nullptr) 
+        freeNode(S.root);
+      S.root = level.empty() ? new Leaf : level[0];
+      S.numElements = count;
+    }
+
+  protected:
+    static const T& minKey(const Node* node)
+    {
+      return node->leaf ? static_cast<const Leaf*>(node)->v[0] 
+                        : static_cast<const Inner*>(node)->keys[0];
+    }
+
+    std::vector<Leaf*> leaves;
+    size_t count = 0;
+  };
+
+  /** Computes a set operation by merging A and B chunk by chunk: the parts of the current 
+  chunks of A and B up to the smaller of their last elements can be combined without looking at 
+  the rest, which finishes at least one of the chunks. keepA, keepB decide whether the remaining
+  elements of A or B are kept when the other set is exhausted. */
+  template<class TKernel>
+  static rsChunkedSortedSet combine(const rsChunkedSortedSet& A, const rsChunkedSortedSet& B, 
+    TKernel kernel, bool keepA, bool keepB)
+  {
+    Builder out;
+    const Leaf *a = A.firstLeaf(), *b = B.firstLeaf();
+    int ia = 0, ib = 0;
+    T buf[2*L];
+    while(a != nullptr && b != nullptr) {
+      T m = rsMin(a->v[a->n-1], b->v[b->n-1]);
+      int ja = int(std::upper_bound(a->v + ia, a->v + a->n, m) - a->v);
+      int jb = int(std::upper_bound(b->v + ib, b->v + b->n, m) - b->v);
+      out.push(buf, kernel(a->v + ia, ja - ia, b->v + ib, jb - ib, buf));
+      ia = ja; ib = jb;
+      if(ia == a->n) { a = a->next; ia = 0; }
+      if(ib == b->n) { b = b->next; ib = 0; }}
+    for(; keepA && a != nullptr; a = a->next, ia = 0) out.push(a->v + ia, a->n - ia);
+    for(; keepB && b != nullptr; b = b->next, ib = 0) out.push(b->v + ib, b->n - ib);
+    rsChunkedSortedSet C;
+    out.finish(C);
+    return C;
+  }
+
+  bool isConsistent(const Node* node, const T* lo, const T* hi, int d, int& depth, 
+    const Leaf*& leaf, size_t& count) const
+  {
+    if(node->leaf) {
+      const Leaf* l = static_cast<const Leaf*>(node);
+      bool ok = l == leaf && l->n > 0 && (depth == -1 || depth == d);
+      for(int i = 0; i < l->n; i++) {
+        ok &= i == 0 || l->v[i-1] < l->v[i];
+        ok &= (lo == nullptr || !(l->v[i] < *lo)) && (hi == nullptr || l->v[i] < *hi); }
+      depth = d;
+      leaf  = l->next;
+      count += l->n;
+      return ok; }
+    const Inner* p = static_cast<const Inner*>(node);
+    bool ok = p->n >= (node == root ? 2 : 1);
+    for(int i = 0; i < p->n && ok; i++)
+      ok &= isConsistent(p->child[i], i == 0 ? lo : &p->keys[i], i == p->n-1 ? hi : &p->keys[i+1],
+        d+1, depth, leaf, count);
+    return ok;
+  }
+
+
+  Node* root = nullptr;
+  size_t numElements = 0;
+
+};
+
+//-------------------------------------------------------------------------------------------------
+
+/** A lazy view of the cartesian product A x B of two sorted sets. The pairs are not stored but 
+computed on the fly from their rank k = ia*Nb + ib where ia, ib are the indices of the elements in
+A and B. Because A and B are sorted, the pairs come in lexicographic order, so the rank of a given
+pair (and whether it's in the product at all) can be found by two binary searches. The view 
+refers to the data of the sets, so these must outlive it. */
+
+template<class TA, class TB>
+class rsCartesianProductView
+{
+
+public:
+
+  using Pair = std::pair<TA, TB>;
+
+  rsCartesianProductView(const std::vector<TA>& setA, const std::vector<TB>& setB) 
+    : A(&setA), B(&setB) {}
+
+  /** Returns the number of pairs, i.e. Na*Nb. */
+  size_t size() const { return A->size() * B->size(); }
+
+  /** Returns the pair with rank k. */
+  Pair operator[](size_t k) const 
+  { 
+    size_t Nb = B->size();
+    return Pair((*A)[k / Nb], (*B)[k % Nb]); 
+  }
+
+  /** Returns the rank of the pair (x, y) or size(), if it's not in the product. */
+  size_t getRank(const TA& x, const TB& y) const
+  {
+    auto ia = std::lower_bound(A->begin(), A->end(), x);
+    auto ib = std::lower_bound(B->begin(), B->end(), y);
+    if(ia == A->end() || x < *ia || ib == B->end() || y < *ib) 
+      return size();
+    return (ia - A->begin()) * B->size() + (ib - B->begin());
+  }
+
+  bool contains(const TA& x, const TB& y) const { return getRank(x, y) != size(); }
+
+
+  /** Forward iterator over the pairs in lexicographic order. */
+  class const_iterator
+  {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = Pair;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const Pair*;
+    using reference         = Pair;        // pairs are computed on the fly
+
+    const_iterator(const rsCartesianProductView* view, size_t ia, size_t ib) 
+      : P(view), ia(ia), ib(ib) {}
+    Pair operator*() const { return Pair((*P->A)[ia], (*P->B)[ib]); }
+    const_iterator& operator++() 
+    { 
+      if(++ib == P->B->size()) { ib = 0; ia++; } 
+      return *this; 
+    }
+    const_iterator operator++(int) { const_iterator tmp = *this; ++(*this); return tmp; }
+    bool operator==(const const_iterator& it) const { return ia == it.ia && ib == it.ib; }
+    bool operator!=(const const_iterator& it) const { return !(*this == it); }
+
+  protected:
+    const rsCartesianProductView* P;
+    size_t ia, ib;
+  };
+
+  /** Returns an iterator to the pair with rank k, so the pairs with ranks k0..k1-1 can be 
+  iterated from getIterator(k0) to getIterator(k1). */
+  const_iterator getIterator(size_t k) const
+  {
+    if(k >= size()) return end();
+    return const_iterator(this, k / B->size(), k % B->size());
+  }
+
+  const_iterator begin() const { return getIterator(0); }
+  const_iterator end()   const { return const_iterator(this, A->size(), 0); }
+
+
+protected:
+
+  const std::vector<TA>* A;
+  const std::vector<TB>* B;
+
+};
+
+/** Returns a lazy view of the cartesian product of A and B. */
+template<class TA, class TB>
+rsCartesianProductView<TA, TB> rsCartesianProduct(
+  const rsSortedSet<TA>& A, const rsSortedSet<TB>& B)
+{
+  return rsCartesianProductView<TA, TB>(A.getData(), B.getData());
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/** A relation between the elements of two sets A and B, i.e. a subset R of the cartesian product
+A x B. We say x is related to y, iff (x, y) is in R. The relation is stored in compressed sparse 
+row (CSR) form: the sorted elements x that are related to anything, for each of them the start 
+index of its sorted image {y : (x, y) in R} and all the images one after another. So the 
+memory is proportional to the number of pairs in R (not in A x B) and testing a pair for 
+membership takes two binary searches. */
+
+template<class TA, class TB>
+class rsRelation
+{
+
+public:
+
+  using Pair = std::pair<TA, TB>;
+
+  rsRelation() {}
+
+  /** Creates the relation from a list of pairs in any order. Duplicates are ignored. */
+  rsRelation(std::vector<Pair> pairs)
+  {
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+    for(auto& p : pairs)
+      append(p.first, p.second);
+  }
+
+  /** Creates the relation of the pairs (x, y) of the product P for which pred(x, y) is true. The
+  product is iterated lazily, so only the pairs of the relation are stored. */
+  template<class TPred>
+  static rsRelation fromPredicate(const rsCartesianProductView<TA, TB>& P, TPred pred)
+  {
+    rsRelation R;
+    for(auto it = P.begin(); it != P.end(); ++it) {
+      Pair p = *it;
+      if(pred(p.first, p.second))
+        R.append(p.first, p.second); }
+    return R;
+  }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Inquiry
+
+  /** Returns true, iff x is related to y. */
+  bool contains(const TA& x, const TB& y) const
+  {
+    const TB *first, *last;
+    getImage(x, first, last);
+    return std::binary_search(first, last, y);
+  }
+
+  /** Lets first, last point to the begin and end of the sorted array of the elements that x is 
+  related to. It's empty, if x is related to nothing. */
+  void getImage(const TA& x, const TB*& first, const TB*& last) const
+  {
+    auto it = std::lower_bound(keys.begin(), keys.end(), x);
+    if(it == keys.end() || x < *it) { 
+      first = last = values.data(); 
+      return; }
+    size_t i = it - keys.begin();
+    first = values.data() + start[i];
+    last  = values.data() + start[i+1];
+  }
+
+  /** Returns the set {y : (x, y) in R}. */
+  rsSortedSet<TB> getImage(const TA& x) const
+  {
+    const TB *first, *last;
+    getImage(x, first, last);
+    return rsSortedSet<TB>::fromValidData(std::vector<TB>(first, last));
+  }
+
+  size_t getNumPairs() const { return values.size(); }
+
+  /** Returns all pairs in lexicographic order. */
+  std::vector<Pair> getPairs() const
+  {
+    std::vector<Pair> pairs;
+    pairs.reserve(values.size());
+    for(size_t i = 0; i < keys.size(); i++)
+      for(size_t j = start[i]; j < start[i+1]; j++)
+        pairs.push_back(Pair(keys[i], values[j]));
+    return pairs;
+  }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Operations
+
+  /** Projection onto A: the set of all x that are related to some y. */
+  rsSortedSet<TA> projectFirst() const { return rsSortedSet<TA>::fromValidData(
+    std::vector<TA>(keys)); }
+
+  /** Projection onto B: the set of all y that some x is related to. */
+  rsSortedSet<TB> projectSecond() const
+  {
+    std::vector<TB> v = values;
+    std::sort(v.begin(), v.end());
+    v.erase(std::unique(v.begin(), v.end()), v.end());
+    return rsSortedSet<TB>::fromValidData(std::move(v));
+  }
+
+  /** The inverse relation contains the pairs (y, x) for all (x, y) in R. */
+  rsRelation<TB, TA> getInverse() const
+  {
+    std::vector<std::pair<TB, TA>> pairs;
+    pairs.reserve(values.size());
+    for(size_t i = 0; i < keys.size(); i++)
+      for(size_t j = start[i]; j < start[i+1]; j++)
+        pairs.push_back(std::pair<TB, TA>(values[j], keys[i]));
+    return rsRelation<TB, TA>(std::move(pairs));
+  }
+
+  /** Composition with a relation S between B and C: x is related to z in the result, iff there 
+  is an y such that x is related to y in R and y is related to z in S. The image of each x is the
+  union of the images of its y in S. The cost is proportional to the sizes of these images, not
+  to the size of A x C. */
+  template<class TC>
+  rsRelation<TA, TC> compose(const rsRelation<TB, TC>& S) const
+  {
+    rsRelation<TA, TC> RS;
+    std::vector<TC> tmp;
+    for(size_t i = 0; i < keys.size(); i++) {
+      tmp.clear();
+      for(size_t j = start[i]; j < start[i+1]; j++) {
+        const TC *first, *last;
+        S.getImage(values[j], first, last);
+        tmp.insert(tmp.end(), first, last); }
+      if(start[i+1] - start[i] > 1) {               // a single image is already a set
+        std::sort(tmp.begin(), tmp.end());
+        tmp.erase(std::unique(tmp.begin(), tmp.end()), tmp.end()); }
+      for(auto& z : tmp)
+        RS.append(keys[i], z); }
+    return RS;
+  }
+
+  bool operator==(const rsRelation& S) const
+  { return keys == S.keys && start == S.start && values == S.values; }
+
+
+protected:
+
+  /** Appends the pair (x, y) which must come lexicographically after all pairs so far. */
+  void append(const TA& x, const TB& y)
+  {
+    if(keys.empty() || keys.back() < x) {
+      keys.push_back(x);
+      start.push_back(start.back()); }
+    values.push_back(y);
+    start.back()++;
+  }
+
+  std::vector<TA>     keys;            // the x that are related to something, sorted
+  std::vector<size_t> start = { 0 };   // image of keys[i] is values[start[i]..start[i+1]-1]
+  std::vector<TB>     values;          // the sorted images, one after another
+
+  template<class TX, class TY> friend class rsRelation;
+
+};
+
+//=================================================================================================
+
+/** Converts a scalar into a value of type T. For plain number types, this is just a type 
+conversion. For (possibly nested) dual numbers, it produces a constant, i.e. a dual number with 
+zero derivative parts at all nesting levels - in contrast to the constructor which seeds the 
+derivative with 1. For non-dual TVal and TDer (like float, rsVector2D or std::vector), make(y) is 
+just the plain conversion TVal(y) or TDer(y), so for such dual numbers, the mixed operators with 
+scalars behave the same as with the plain conversions. */
+template<class T>
+struct rsDualConstant
+{
+  template<class Ty> static T make(const Ty& y) { return T(y); }
+};
+
+template<class TVal, class TDer>
+struct rsDualConstant<rsDualNumber<TVal, TDer>>
+{
+  template<class Ty> static rsDualNumber<TVal, TDer> make(const Ty& y)
+  { 
+    return rsDualNumber<TVal, TDer>(
+      rsDualConstant<TVal>::make(y), rsDualConstant<TDer>::make(0)); 
+  }
+};
+
+//-------------------------------------------------------------------------------------------------
+
+/** Implements a datatype suitable for automatic differentiation or AD for short. In AD, a number 
+is seen as the result of a function evaluation and in addition to the actual output value of the 
+function, the value of the derivative is also computed and carried along through all subsequent 
+operations and function applications. Derivative values can be useful in algorithms for numerical 
+optimization (e.g. gradient descent), iterative nonlinear equation solvers (e.g. Newton iteration),
+ordinary and partial differential equations solvers, differential geometry etc. In general, 
+derivatives can be calculated by various means: 
+
+  (1) Analytically, by directly implementing a symbolically derived formula. This is tedious, 
+      error-prone and needs human effort for each individual case (unless a symbolic math engine 
+      is available, but the expressions tend to swell quickly rendering the approach inefficient).
+  (2) Numerically, by using finite difference approximations. This can be computationally 
+      expensive and inaccurate.
+  (3) Automatically, by overloading operators and functions for a number type that is augmented by
+      a derivative field. The resulting algebra of such augmented numbers makes use of the well 
+      known differentiation rules and derivatives of elementary functions.
+
+The so called dual numbers are a way to implement the 3rd option. Each dual number has one field 
+"v" representing the actual (value of the) number itself and an additional field "d" for 
+representing the derivative. In all arithmetic operations that we do with a pair of operands, the 
+first value component "v" is computed as usual and the derivative component "d" is computed using
+the well known differentiation rules: sum-rule, difference-rule, product-rule and quotient-rule. 
+Likewise, in univariate function evaluations, we apply the chain-rule. 
+
+Mathematically, we can think of the dual numbers as being constructed from the real numbers in a 
+way similar to the complex numbers. For these, we postulate the existence of a number i which has
+the property i^2 = -1. No real number has this property, so i can't be a real number. For the dual
+numbers, we postulate a nonzero number epsilon (denoted here as E) with the property E^2 = 0. No 
+real number (except zero, which was excluded) has this property, so E can't be a real number. The 
+dual numbers are then numbers of the form a + b*E, just like the complex numbers are of the form 
+a + b*i, where a and b are real numbers. ..i think, this has relations to nonstandard analysis with
+hyperreal numbers and E can be thought of as being the infinitesimal....figure that out and 
+explain more...maybe mention also also hyperbolic numbers...they do not form a field, only a ring,
+because the quotient rule demands that the v-part of divisor must be nonzero - so any dual number
+with zero v-part is a number that we cant divide by - and these are not the neutral element(s)
+of addition (there can be only one anyway)
+
+
+To implement multidimensional derivatives (gradients, Jacobians, etc.), we can use rsMatrix as 
+template type T. Then, the input is an Mx1 matrix, the output is an Nx1 matrix and the Jacobian is 
+an NxM matrix. ...hmm...this is not how i did it in the examples...
+...what about higher derivative via nesting?
+
+...At some point, the derivative value must be seeded...i think, this is called 
+"forward mode"...We seed the derivative field with 1 by default-constructing a dual number from a 
+real number...explain also what reverse mode is..tbc...
+
+...under construction... */
+
+template<class TVal, class TDer, class TNode> class rsDualExpr;  // expression template, see below
+
+template<class TVal, class TDer>
+class rsDualNumber 
+{
+
+public:
+
+
+
+  TVal v;  // function value, "real part" or "standard part"
+  TDer d;  // derivative, "infinitesimal part" (my word)
+
+  rsDualNumber(TVal value = TVal(0), TDer derivative = TDer(1)) : v(value), d(derivative) {}
+  // maybe the derivative should default to 1? what is most convenient? to seed or not to seed?
+
+
+  using DN = rsDualNumber<TVal, TDer>;   // shorthand for convenience
+
+  /** Evaluates an expression template, see rsDualExpr. */
+  template<class TNode> 
+  rsDualNumber(const rsDualExpr<TVal, TDer, TNode>& e) { e.evaluate(*this); }
+
+  template<class TNode> 
+  DN& operator=(const rsDualExpr<TVal, TDer, TNode>& e)
+  {
+    if(e.dependsOn(this)) *this = DN(e);  // we are a leaf of e, as in x = x*x
+    else                  e.evaluate(*this);
+    return *this;
+  }
+
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Inquiry
+
+  TVal getValue()      const { return v; }
+  TDer getDerivative() const { return d; }
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Arithmetic operators
+
+  /** Unary minus just applies minus sign to both parts. */
+  DN operator-() const { return DN(-v, -d); }
+
+  /** Implements sum rule: (f+g)' = f' + g'. */
+  DN operator+(const DN& y) const { return DN(v + y.v, d + y.d); }
+
+  /** Implements difference rule: (f-g)' = f' - g'. */
+  DN operator-(const DN& y) const { return DN(v - y.v, d - y.d); }
+
+  /** Implements product rule: (f*g)' = f' * g + g' * f. */
+  DN operator*(const DN& y) const { return DN(v * y.v, d*y.v + v*y.d ); }
+
+  /** Implements quotient rule: (f/g)' = (f' * g - g' * f) / g^2. */
+  DN operator/(const DN& y) const { return DN(v / y.v, (d*y.v - v*y.d)/(y.v*y.v) ); }
+    // requires that y.v is nonzero - what does this mean for the algebraic structure od dual 
+    // numbers? do they form a ring? it's not a field because *any* number y for which v is zero 
+    // can't be a divisor - but if the d-field of y is nonzero, then y is not 0 (the neutral 
+    // element of addition)...right? ..so we have nonzero elements that we can't divide by, so we
+    // have no field
+    // maybe we could do something else when y.v == 0. in this case, the infinitesimal part gets 
+    // blown up to infinity, so maybe it could make sense to add the numerator 
+    // (d*y.v - v*y.d) = -v*y.d to the real part? ...highly speculative - maybe try it and see 
+    // what happens...but actually, the 0 in the denomiantor is squared, so it gets blown up to
+    // "infinity-squared" ...so maybe it should overblow the real part...oh - that's what it 
+    // already does anyway...maybe it should be v - v*y.d = v*(1-y.d)...maybe consider the limits
+    // when y.v goes to 0
+
+  template<class Ty> DN operator+(const Ty& y) const { return DN(v + cv(y), d        ); }
+  template<class Ty> DN operator-(const Ty& y) const { return DN(v - cv(y), d        ); }
+  template<class Ty> DN operator*(const Ty& y) const { return DN(v * cv(y), d * cd(y)); }
+  template<class Ty> DN operator/(const Ty& y) const { return DN(v / cv(y), d / cd(y)); }
+  // The conversions of the scalar y into TVal and TDer go through rsDualConstant to make sure that
+  // for nested dual numbers, the inner derivative parts are zero. Plain TVal(y) would seed them 
+  // with 1 which caused the wrong (doubled) higher derivatives with nested dual numbers.
+
+  template<class Ty> static TVal cv(const Ty& y) { return rsDualConstant<TVal>::make(y); }
+  template<class Ty> static TDer cd(const Ty& y) { return rsDualConstant<TDer>::make(y); }
+
+  // maybe rename operands from x,y to a,b - x,y should be used for function inputs and ouputs in
+  // expressions like y = f(x)
+
+  // todo: add boilerplate for +=,-=,*=,...
+
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Comparison operators
+
+  bool operator==(const DN& y) const { return v == y.v && d == y.d; } // maybe we should only compare v
+  bool operator!=(const DN& y) const { return !(*this == y); }
+  bool operator< (const DN& y) const { return v <  y.v; }
+  bool operator<=(const DN& y) const { return v <= y.v; }
+  bool operator> (const DN& y) const { return v >  y.v; }
+  bool operator>=(const DN& y) const { return v >= y.v; }
+
+  // maybe we should take the d-part into account in the case of equal v-parts. this video says 
+  // something about the hyperreal numbers being an *ordered* field:
+  // https://www.youtube.com/watch?v=ArAjEq8uFvA
+  // when we do it like this, the set of relations {<,==,>} satisfy the trichotomy law: any pair 
+  // of numbers is in one and only one of those 3 relations
+
+};
+
+//-------------------------------------------------------------------------------------------------
+// Operators for left argument of type Tx that can be converted into TVal:
+
+template<class TVal, class TDer, class Tx>
+rsDualNumber<TVal, TDer> operator+(const Tx& x, const rsDualNumber<TVal, TDer>& y)
+{ using DN = rsDualNumber<TVal, TDer>; return DN(DN::cv(x) + y.v, y.d); } // ok
+
+template<class TVal, class TDer, class Tx>
+rsDualNumber<TVal, TDer> operator-(const Tx& x, const rsDualNumber<TVal, TDer>& y)
+{ using DN = rsDualNumber<TVal, TDer>; return DN(DN::cv(x) - y.v, -y.d) ; } // ok
+
+template<class TVal, class TDer, class Tx>
+rsDualNumber<TVal, TDer> operator*(const Tx& x, const rsDualNumber<TVal, TDer>& y)
+{ using DN = rsDualNumber<TVal, TDer>; return DN(DN::cv(x) * y.v, DN::cd(x) * y.d); } // ok
+
+template<class TVal, class TDer, class Tx>
+rsDualNumber<TVal, TDer> operator/(const Tx& x, const rsDualNumber<TVal, TDer>& y)
+{ using DN = rsDualNumber<TVal, TDer>; return DN(DN::cv(x) / y.v, -DN::cd(x)*y.d/(y.v*y.v) ); } // ok
+
+// maybe reduce the noise via #defines here, too
+
+//-------------------------------------------------------------------------------------------------
+// Elementary functions of dual numbers. The v-parts are computed as usual and the d-parts are 
+// computed via the chain rule: (f(g(x)))' = g'(x) * f'(g(x)). We use some preprocessor 
+// #definitions to reduce the verbosity of the boilerplate code. They are #undef'd when we are done
+// with them:
 
 #define RS_CTD template<class TVal, class TDer>  // class template declarations
 #define RS_DN  rsDualNumber<TVal, TDer>          // dual number
 #define RS_PFX RS_CTD RS_DN                      // prefix for the function definitions
 
-RS_PFX rsSin(RS_DN x) { return RS_DN(rsSin(x.v),  x.d*rsCos(x.v)); }
-RS_PFX rsCos(RS_DN x) { return RS_DN(rsCos(x.v), -x.d*rsSin(x.v)); }
-RS_PFX rsExp(RS_DN x) { return RS_DN(rsExp(x.v),  x.d*rsExp(x.v)); }
+RS_PFX rsSin(RS_DN x) { return RS_DN(rsSin(x.v),  x.d*rsCos(x.v)); }
+RS_PFX rsCos(RS_DN x) { return RS_DN(rsCos(x.v), -x.d*rsSin(x.v)); }
+RS_PFX rsExp(RS_DN x) { return RS_DN(rsExp(x.v),  x.d*rsExp(x.v)); }
+
+// not tested:
+RS_PFX rsLog( RS_DN x) { return RS_DN(rsLog(x.v),  x.d/x.v); } // requires x.v > 0
+RS_PFX rsSqrt(RS_DN x) { return RS_DN(rsSqrt(x.v), x.d*TVal(0.5)/sqrt(x.v)); } 
+// requires x.v > 0 - todo: make it work for x.v >= 0 - the derivative part at 0 should be computed
+// by using a limit
+
+
+// todo: tan, cbrt, pow, abs, sinh, cosh, tanh, asin, acos, atan, atan2, etc.
+// what about floor and ceil? should their derivatives be a delta-comb? well - maybe i should not
+// care about them - they are not differentiable anyway
+
+#undef RS_CTD
+#undef RS_DN
+#undef RS_PFX
+
+
+
+
+//-------------------------------------------------------------------------------------------------
+// Functions for nested dual numbers - can be used to compute 2nd derivatives:
+// ...works only with simply nested dual numbers - nesting twice doesn't work - maybe nesting 
+// should be postponed - it's a mess
+
+#define RS_CTD template<class T1, class T2, class T3>  // class template declarations
+#define RS_IDN rsDualNumber<T2, T3>                    // inner dual number
+#define RS_ODN rsDualNumber<T1, RS_IDN>                // outer dual number
+
+// types: x.v: T1, x.d.v: T2, x.d.d: T3
+
+RS_CTD RS_ODN rsSin(RS_ODN x) { return RS_ODN(rsSin(x.v),  x.d.v*rsCos(RS_IDN(x.v))); }
+RS_CTD RS_ODN rsCos(RS_ODN x) { return RS_ODN(rsCos(x.v), -x.d.v*rsSin(RS_IDN(x.v))); }
+
+
+//RS_CTD RS_ODN rsExp(RS_ODN x) { return RS_ODN(rsExp(x.v),  x.d.v*rsExp(RS_IDN(x.v))); }
+//RS_CTD RS_ODN rsExp(RS_ODN x) { return RS_ODN(rsExp(x.v),  RS_IDN(x.d.v)*rsExp(RS_IDN(x.v))); }
+//RS_CTD RS_ODN rsExp(RS_ODN x) { return RS_ODN(rsExp(x.v),  RS_IDN(x.d.v,0)*rsExp(RS_IDN(x.v))); }  // 3rd wrong
+//RS_CTD RS_ODN rsExp(RS_ODN x) { return RS_ODN(rsExp(x.v),  RS_IDN(x.d.v,1)*rsExp(RS_IDN(x.v))); }    // 2nd,3rd wrong
+//RS_CTD RS_ODN rsExp(RS_ODN x) { return RS_ODN(rsExp(x.v),  T2(x.d.v)*rsExp(RS_IDN(x.v))); } // 3rd wrong
+//RS_CTD RS_ODN rsExp(RS_ODN x) { return RS_ODN(rsExp(x.v),  RS_IDN(T2(x.d.v))*rsExp(RS_IDN(x.v))); }
+//RS_CTD RS_ODN rsExp(RS_ODN x) { return RS_ODN(rsExp(x.v),  RS_IDN(T2(x.d.v),0)*rsExp(RS_IDN(x.v))); }
+//RS_CTD RS_ODN rsExp(RS_ODN x) { return RS_ODN(rsExp(x.v), RS_IDN(T3(x.d.v))*rsExp(RS_IDN(x.v))); } 
+//RS_CTD RS_ODN rsExp(RS_ODN x) { return RS_ODN(rsExp(x.v), T3(x.d.v)*rsExp(RS_IDN(x.v))); }
+// 3rd derivative is wrong - seems to be multiplied by factor 2
+
+RS_CTD RS_ODN rsExp(RS_ODN x) 
+{ 
+  T1     v = rsExp(x.v);                      // T1
+  //RS_IDN d = T2(x.d.v) * rsExp(RS_IDN(x.v));  // T2 * Dual<T2,T3> -> Dual(x.d.v,1) * exp(Dual(x.v,1))
+
+  // if T2 is itself a dual number, this does not work - both factors get constructed with a 1 for the
+  // d part and in the product rule f'*g + g'*f, we end up producing twice the desired value due to 
+  // adding two equal terms
+
+  RS_IDN d = RS_IDN(x.d.v,0) * rsExp(RS_IDN(x.v));
+  // hmm...this also doesn't work - we still get the extra factor of 2
+
+  //RS_IDN d = T2(x.d.v,0) * rsExp(RS_IDN(x.v)); // no compile with T2=float
+
+  //RS_IDN d = RS_IDN(x.d.v * rsExp(RS_IDN(x.v)));
+
+  //RS_IDN d = x.d.v * rsExp(RS_IDN(T3(x.v)));
+  //RS_IDN d = T2(x.d.v) * rsExp(RS_IDN(T2(x.v)));
+  //RS_IDN d = RS_IDN(T3(x.d.v)) * rsExp(RS_IDN(T2(x.v)));
+  // somewhere, there's a constructor call missing and one d-element is not seeded, i think
+
+  return RS_ODN(v,  d); 
+}
+
+// Why does it actually work when using x.d.v as inner derivative? It probably should not be 
+// surprising, but i'm not sure about why. Maybe try nesting twice - doesn't work...maybe we need
+// to wrap something else into a constructor call? i tried -RS_IDN(x.d.v), RS_IDN(-x.d.v) for 
+// d-part of rsCos - but that doesn't work...maybe we need to use 0 as 2nd argument?
+
+// todo: log, tan, sqrt, pow, abs, sinh, cosh, tanh, asin, acos, atan, atan2, etc.
+
+#undef RS_CTD
+#undef RS_IDN
+#undef RS_NDN
+
+// maybe for doubly nested dual numbers, we will need yet another specialzation? ...if so, will it 
+// end there or will we need another for triply nested ones and so on? that would be bad!
+
+//-------------------------------------------------------------------------------------------------
+// Functions for symmetrically nested dual numbers of the form rsDualNumber<D, D> where D is itself
+// a dual number. Here, the value and derivative parts have the same type and each nesting level 
+// carries its own infinitesimal, so the generic chain rule just works recursively and the nesting 
+// can go arbitrarily deep (this is also known as hyper-dual numbers, when nested once). These 
+// overloads are more specialized than the ones above, so they take precedence. Derivatives of 
+// order k can be obtained by nesting k times - for example, rsManifold uses 3 levels to get the 
+// 3rd derivatives of the coordinate map that are needed for the Riemann tensor.
+
+#define RS_CTD template<class T1, class T2>             // class template declarations
+#define RS_IDN rsDualNumber<T1, T2>                      // inner dual number
+#define RS_HDN rsDualNumber<RS_IDN, RS_IDN>              // hyper-dual number
+
+RS_CTD RS_HDN rsSin( RS_HDN x) { return RS_HDN(rsSin(x.v),   x.d*rsCos(x.v));   }
+RS_CTD RS_HDN rsCos( RS_HDN x) { return RS_HDN(rsCos(x.v),  -x.d*rsSin(x.v));   }
+RS_CTD RS_HDN rsExp( RS_HDN x) { return RS_HDN(rsExp(x.v),   x.d*rsExp(x.v));   }
+RS_CTD RS_HDN rsLog( RS_HDN x) { return RS_HDN(rsLog(x.v),   x.d/x.v);          } // x.v > 0
+RS_CTD RS_HDN rsSqrt(RS_HDN x) 
+{ RS_IDN s = rsSqrt(x.v); return RS_HDN(s, x.d/(2*s)); }                           // x.v > 0
+
+#undef RS_CTD
+#undef RS_IDN
+#undef RS_HDN
+
+
+
+
+
+/*
+// not yet tested:
+template<class TVal, class TDer>
+rsDualNumber<TVal, TDer> rsSqrt(rsDualNumber<TVal, TDer> x) 
+{ return rsDualNumber<TVal, TDer>(sqrt(x.v), x.d*T(0.5)/sqrt(x.v)); }  // verify
+
+template<class TVal, class TDer>
+rsDualNumber<TVal, TDer> rsLog(rsDualNumber<TVal, TDer> x) 
+{ return rsDualNumber<TVal, TDer>(log(x.v), x.d/x.v); }  // requires x.v > 0
+
+template<class TVal, class TDer>
+rsDualNumber<TVal, TDer> rsPow(rsDualNumber<TVal, TDer> x, TVal p)
+{ return rsDualNumber<TVal, TDer>(pow(x.v, p), x.d*TDer(p)*pow(x.v, p-1)); }  // requires x.v != 0
+// what, if p is also an dual number? ...this requires more thought....
+
+template<class TVal, class TDer>
+rsDualNumber<TVal, TDer> rsAbs(rsDualNumber<TVal, TDer> x) 
+{ return rsDualNumber<TVal, TDer>(rsAbs(x.v), x.d*rsSign(x.v)); }  // requires x.v != 0..really?
+*/
+
+
+
+//-------------------------------------------------------------------------------------------------
+
+/** A fixed-size vector of K lanes of type T that is meant to be used as derivative type TDer in 
+rsDualNumber for vector-mode forward AD: rsDualNumber<T, rsDerivativeLanes<T, K>> carries K 
+directional derivatives (e.g. K components of a gradient) along with each value. All operators 
+act lane-wise in simple loops with compile-time trip count over a suitably aligned array, such 
+that the compiler can map them onto SIMD registers (for example, 4 doubles into one AVX register 
+for K = 4). Because the rsDualNumber operators and elementary functions only need the arithmetic 
+operators of TDer and products with TVal, they work lane-parallel out of the box. The value part 
+(including the expensive function evaluations like rsSin, rsExp, etc.) is computed only once for
+all K lanes. See rsForwardGradient for the driver that computes gradients and Jacobians in chunks
+of K input directions. */
+
+template<class T, int K>
+class rsDerivativeLanes
+{
+
+public:
+
+  using DL = rsDerivativeLanes<T, K>;
+
+  /** Default constructor. Leaves the lanes uninitialized. */
+  rsDerivativeLanes() {}
+
+  /** Broadcasts the scalar x into all lanes. */
+  explicit rsDerivativeLanes(const T& x) { for(int k = 0; k < K; k++) a[k] = x; }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Setup
+
+  void setZero() { for(int k = 0; k < K; k++) a[k] = T(0); }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Inquiry
+
+  static constexpr int getNumLanes() { return K; }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Operators
+
+  T& operator[](int k) { return a[k]; }
+  const T& operator[](int k) const { return a[k]; }
+
+  DL operator-() const { DL r; for(int k = 0; k < K; k++) r.a[k] = -a[k]; return r; }
+
+  DL operator+(const DL& y) const { DL r; for(int k = 0; k < K; k++) r.a[k] = a[k] + y.a[k]; return r; }
+  DL operator-(const DL& y) const { DL r; for(int k = 0; k < K; k++) r.a[k] = a[k] - y.a[k]; return r; }
+  DL operator*(const DL& y) const { DL r; for(int k = 0; k < K; k++) r.a[k] = a[k] * y.a[k]; return r; }
+  DL operator/(const DL& y) const { DL r; for(int k = 0; k < K; k++) r.a[k] = a[k] / y.a[k]; return r; }
+
+  DL operator*(const T& y) const { DL r; for(int k = 0; k < K; k++) r.a[k] = a[k] * y; return r; }
+  DL operator/(const T& y) const { return *this * (T(1) / y); }
+
+  DL& operator+=(const DL& y) { for(int k = 0; k < K; k++) a[k] += y.a[k]; return *this; }
+  DL& operator-=(const DL& y) { for(int k = 0; k < K; k++) a[k] -= y.a[k]; return *this; }
+
+  bool operator==(const DL& y) const
+  {
+    for(int k = 0; k < K; k++)
+      if(a[k] != y.a[k])
+        return false;
+    return true;
+  }
+  bool operator!=(const DL& y) const { return !(*this == y); }
+
+
+protected:
+
+  alignas(sizeof(T)*K > 64 ? 64 : sizeof(T)*K) T a[K];  // 64: cache line and AVX-512 size
+
+};
+
+template<class T, int K>
+rsDerivativeLanes<T, K> operator*(const T& x, const rsDerivativeLanes<T, K>& y) { return y * x; }
+
+//-------------------------------------------------------------------------------------------------
+
+/** Driver for vector-mode forward AD with rsDualNumber<T, rsDerivativeLanes<T, K>>. It computes 
+full gradients of functions R^n -> R and Jacobians of functions R^n -> R^m in ceil(n/K) sweeps 
+where each sweep evaluates the function once and seeds K of the n input directions. With plain 
+rsDualNumber<T, T>, it would take n sweeps. The functions must be callable with arrays of dual 
+numbers - a generic lambda like [](const auto* x, int n) { ... } is the most convenient way to 
+write them such that they can also be called with plain numbers or other AD types. 
+
+For very large n (thousands of inputs) and a single output, reverse mode (rsAutoDiffNumber) is 
+still much faster. Vector-mode forward AD is the better choice for small to moderate n and for 
+Jacobians with many outputs because it has no tape overhead. */
+
+template<class T, int K>
+class rsForwardGradient
+{
+
+public:
+
+  using Lanes = rsDerivativeLanes<T, K>;
+  using DN    = rsDualNumber<T, Lanes>;
+
+  /** Computes the gradient of f: R^n -> R at x and writes it into grad. Returns the function 
+  value. The function must be callable as f(const DN* x, int n) and return a DN. */
+  template<class F>
+  static T gradient(const F& f, const T* x, int n, T* grad)
+  {
+    std::vector<DN> xd(n);
+    init(x, xd);
+    T y = T(0);
+    for(int i0 = 0; i0 < n; i0 += K) {
+      int numLanes = rsMin(K, n-i0);
+      seed(xd, i0, numLanes, T(1));
+      DN r = f(&xd[0], n);
+      seed(xd, i0, numLanes, T(0));
+      for(int k = 0; k < numLanes; k++)
+        grad[i0+k] = r.d[k];
+      y = r.v; }
+    return y;
+  }
+
+  /** Computes the value y and the m x n Jacobian matrix J (row-major, J[i*n+j] = dy_i/dx_j) of 
+  f: R^n -> R^m at x. The function must be callable as f(const DN* x, int n, DN* y, int m). */
+  template<class F>
+  static void jacobian(const F& f, const T* x, int n, T* y, int m, T* J)
+  {
+    std::vector<DN> xd(n), yd(m);
+    init(x, xd);
+    for(int i0 = 0; i0 < n; i0 += K) {
+      int numLanes = rsMin(K, n-i0);
+      seed(xd, i0, numLanes, T(1));
+      f(&xd[0], n, &yd[0], m);
+      seed(xd, i0, numLanes, T(0));
+      for(int i = 0; i < m; i++)
+        for(int k = 0; k < numLanes; k++)
+          J[i*n + i0+k] = yd[i].d[k]; }
+    for(int i = 0; i < m; i++)
+      y[i] = yd[i].v;
+  }
+
+
+protected:
+
+  /** Initializes the dual numbers with the values x and zero derivatives. */
+  static void init(const T* x, std::vector<DN>& xd)
+  {
+    for(size_t i = 0; i < xd.size(); i++) {
+      xd[i].v = x[i];
+      xd[i].d.setZero(); }
+  }
+
+  /** Sets lane k of the input i0+k to the value s for k = 0..numLanes-1. Seeding with 1 and 
+  resetting with 0 after the sweep avoids touching all n inputs in each sweep. */
+  static void seed(std::vector<DN>& xd, int i0, int numLanes, T s)
+  {
+    for(int k = 0; k < numLanes; k++)
+      xd[i0+k].d[k] = s;
+  }
+
+};
+
+
+
+//-------------------------------------------------------------------------------------------------
+
+/** Expression templates for rsDualNumber. The operators of rsDualNumber return a new dual number 
+for each operation, so an expression like rsExp(-x/31)*rsSin(5*x/2) / (2 + x*x*(1+rsCos(x)) + 1) 
+creates 14 intermediate derivatives. For scalar TDer, that's just some wasted flops but for
+vector valued TDer, each of them is a whole vector (and heap allocated for std::vector). Wrapping 
+the variables into rsDualLeaf turns the same expression into a tree of nodes that each store 
+their value and the partial derivatives with respect to their operands, computed when the node is
+created. When the tree is assigned to a dual number, the value is just read off from the root and 
+the derivative is computed in one pass from the root to the leaves: the leaf derivatives are 
+scaled by the products of the partials along the path (i.e. the chain rule) and accumulated into 
+the result. So, only scalars are multiplied in the inner nodes and each occurrence of a variable 
+costs one scaled addition of its derivative into the result, done by rsDualAccumulator:
+
+  using DN = rsDualNumber<double, std::vector<double>>;
+  DN x = ..., y;
+  auto X = rsDualLeaf(x);
+  y = rsExp(-X/31) * rsSin(5*X/2) / (2 + X*X*(1+rsCos(X)) + 1);
+
+The leaves refer to the dual numbers by reference, so the expression object should not outlive the
+full expression in which it was created (i.e. use auto only for the leaves). The node types are 
+intended for scalar TVal, not for nested dual numbers. */
+
+template<class TDer>
+struct rsDualAccumulator
+{
+  template<class TVal> static void assign(TDer& acc, const TVal& w, const TDer& d) { acc = d * w; }
+  template<class TVal> static void add(   TDer& acc, const TVal& w, const TDer& d) { acc = acc + d * w; }
+};
+// The general implementation is fine for scalars and small fixed size vectors. Types that have 
+// their own storage management should reuse the storage of acc:
+
+template<class T>
+struct rsDualAccumulator<std::vector<T>>
+{
+  static void assign(std::vector<T>& acc, const T& w, const std::vector<T>& d)
+  {
+    acc.resize(d.size());  // allocates only when the size changes
+    for(size_t k = 0; k < d.size(); k++)
+      acc[k] = w * d[k];
+  }
+  static void add(std::vector<T>& acc, const T& w, const std::vector<T>& d)
+  {
+    rsAssert(acc.size() == d.size());
+    for(size_t k = 0; k < d.size(); k++)
+      acc[k] += w * d[k];
+  }
+};
+
+template<class T, int K>
+struct rsDualAccumulator<rsDerivativeLanes<T, K>>
+{
+  static void assign(rsDerivativeLanes<T, K>& acc, const T& w, const rsDerivativeLanes<T, K>& d)
+  { for(int k = 0; k < K; k++) acc[k] = w * d[k]; }
+  static void add(rsDerivativeLanes<T, K>& acc, const T& w, const rsDerivativeLanes<T, K>& d)
+  { for(int k = 0; k < K; k++) acc[k] += w * d[k]; }
+};
+
+/** Leaf of an expression tree: refers to a dual number variable. */
+template<class TVal, class TDer>
+struct rsDualLeafNode
+{
+  const rsDualNumber<TVal, TDer>& x;
+  TVal v;
+  void assignTo(const TVal& w, TDer& r) const { rsDualAccumulator<TDer>::assign(r, w, x.d); }
+  void addTo(   const TVal& w, TDer& r) const { rsDualAccumulator<TDer>::add(   r, w, x.d); }
+  bool dependsOn(const void* p) const { return p == &x; }
+};
+
+/** Node for a function of one expression a (which includes operations with a scalar). Stores the 
+value and the partial derivative with respect to a. */
+template<class TVal, class A>
+struct rsDualUnaryNode
+{
+  A a;
+  TVal v, da;
+  template<class TDer> void assignTo(const TVal& w, TDer& r) const { a.assignTo(w*da, r); }
+  template<class TDer> void addTo(   const TVal& w, TDer& r) const { a.addTo(   w*da, r); }
+  bool dependsOn(const void* p) const { return a.dependsOn(p); }
+};
+
+/** Node for a function of two expressions a, b. */
+template<class TVal, class A, class B>
+struct rsDualBinaryNode
+{
+  A a; 
+  B b;
+  TVal v, da, db;
+  template<class TDer> void assignTo(const TVal& w, TDer& r) const 
+  { 
+    a.assignTo(w*da, r);   // the leftmost leaf initializes r
+    b.addTo(   w*db, r); 
+  }
+  template<class TDer> void addTo(const TVal& w, TDer& r) const 
+  { 
+    a.addTo(w*da, r); 
+    b.addTo(w*db, r); 
+  }
+  bool dependsOn(const void* p) const { return a.dependsOn(p) || b.dependsOn(p); }
+};
+
+/** Wraps the node types such that the operators and functions below can be restricted to 
+expression templates. */
+template<class TVal, class TDer, class TNode>
+class rsDualExpr
+{
+
+public:
+
+  rsDualExpr(const TNode& node) : n(node) {}
+
+  TVal getValue() const { return n.v; }
+
+  /** Returns true, if the dual number at address p is a leaf of the expression. */
+  bool dependsOn(const void* p) const { return n.dependsOn(p); }
+
+  /** Writes the value and derivative of the expression into r which must not be a leaf of the 
+  expression (rsDualNumber::operator= takes care of that). */
+  void evaluate(rsDualNumber<TVal, TDer>& r) const
+  {
+    r.v = n.v;
+    n.assignTo(TVal(1), r.d);
+  }
+
+  TNode n;
+
+};
+
+/** Creates a leaf of an expression template from a dual number. */
+template<class TVal, class TDer>
+rsDualExpr<TVal, TDer, rsDualLeafNode<TVal, TDer>> rsDualLeaf(const rsDualNumber<TVal, TDer>& x)
+{
+  return rsDualLeafNode<TVal, TDer>{ x, x.v };
+}
+
+#define RS_CTD  template<class TVal, class TDer, class A>
+#define RS_CTD2 template<class TVal, class TDer, class A, class B>
+#define RS_CTDS template<class TVal, class TDer, class A, class Ty>
+#define RS_EA   rsDualExpr<TVal, TDer, A>
+#define RS_EB   rsDualExpr<TVal, TDer, B>
+#define RS_UN   rsDualExpr<TVal, TDer, rsDualUnaryNode<TVal, A>>
+#define RS_BN   rsDualExpr<TVal, TDer, rsDualBinaryNode<TVal, A, B>>
+
+// Operations of two expressions:
+RS_CTD2 RS_BN operator+(const RS_EA& a, const RS_EB& b) 
+{ return RS_BN({ a.n, b.n, a.n.v + b.n.v, TVal(1), TVal( 1) }); }
+RS_CTD2 RS_BN operator-(const RS_EA& a, const RS_EB& b) 
+{ return RS_BN({ a.n, b.n, a.n.v - b.n.v, TVal(1), TVal(-1) }); }
+RS_CTD2 RS_BN operator*(const RS_EA& a, const RS_EB& b) 
+{ return RS_BN({ a.n, b.n, a.n.v * b.n.v, b.n.v, a.n.v }); }
+RS_CTD2 RS_BN operator/(const RS_EA& a, const RS_EB& b) 
+{ TVal r = TVal(1) / b.n.v, q = a.n.v * r; return RS_BN({ a.n, b.n, q, r, -q*r }); }
+
+// Operations with a scalar:
+RS_CTD  RS_UN operator-(const RS_EA& a) { return RS_UN({ a.n, -a.n.v, TVal(-1) }); }
+RS_CTDS RS_UN operator+(const RS_EA& a, const Ty& c) { return RS_UN({ a.n, a.n.v + TVal(c), TVal( 1) }); }
+RS_CTDS RS_UN operator+(const Ty& c, const RS_EA& a) { return RS_UN({ a.n, TVal(c) + a.n.v, TVal( 1) }); }
+RS_CTDS RS_UN operator-(const RS_EA& a, const Ty& c) { return RS_UN({ a.n, a.n.v - TVal(c), TVal( 1) }); }
+RS_CTDS RS_UN operator-(const Ty& c, const RS_EA& a) { return RS_UN({ a.n, TVal(c) - a.n.v, TVal(-1) }); }
+RS_CTDS RS_UN operator*(const RS_EA& a, const Ty& c) { return RS_UN({ a.n, a.n.v * TVal(c), TVal(c) }); }
+RS_CTDS RS_UN operator*(const Ty& c, const RS_EA& a) { return RS_UN({ a.n, TVal(c) * a.n.v, TVal(c) }); }
+RS_CTDS RS_UN operator/(const RS_EA& a, const Ty& c) 
+{ TVal r = TVal(1) / TVal(c); return RS_UN({ a.n, a.n.v * r, r }); }
+RS_CTDS RS_UN operator/(const Ty& c, const RS_EA& a) 
+{ TVal r = TVal(1) / a.n.v, q = TVal(c) * r; return RS_UN({ a.n, q, -q*r }); }
+
+// Elementary functions:
+RS_CTD RS_UN rsSin(const RS_EA& a) { return RS_UN({ a.n,  rsSin(a.n.v),  rsCos(a.n.v) }); }
+RS_CTD RS_UN rsCos(const RS_EA& a) { return RS_UN({ a.n,  rsCos(a.n.v), -rsSin(a.n.v) }); }
+RS_CTD RS_UN rsExp(const RS_EA& a) { TVal e = rsExp(a.n.v); return RS_UN({ a.n, e, e }); }
+RS_CTD RS_UN rsLog(const RS_EA& a) { return RS_UN({ a.n, rsLog(a.n.v), TVal(1) / a.n.v }); }
+RS_CTD RS_UN rsSqrt(const RS_EA& a) 
+{ TVal s = rsSqrt(a.n.v); return RS_UN({ a.n, s, TVal(0.5) / s }); } // requires a > 0
+
+#undef RS_CTD
+#undef RS_CTD2
+#undef RS_CTDS
+#undef RS_EA
+#undef RS_EB
+#undef RS_UN
+#undef RS_BN
+
+
+
+//-------------------------------------------------------------------------------------------------
+
+/** A number type for univariate automatic differentiation of higher order via truncated Taylor 
+series. An rsTaylorNumber of degree D represents a function f near some point x0 by the 
+coefficients c[0..D] of its Taylor polynomial, i.e. c[k] = f^(k)(x0) / k!. Sums and differences 
+are computed coefficient-wise, products are truncated convolutions and quotients and elementary 
+functions are computed by the well known recurrences that follow from their differential 
+equations (see Griewank, Walther - Evaluating Derivatives, Ch. 13). Each operation costs O(D^2), 
+so all derivatives up to order D are obtained much more cheaply than by nesting dual numbers D 
+times, which costs O(2^D) per operation. Usage:
+
+  using TN = rsTaylorNumber<double, 5>;
+  TN x = TN::variable(0.5);          // seed: c = (0.5, 1, 0, 0, 0, 0)
+  TN y = rsExp(-x) * rsSin(3.0*x);
+  double d3 = y.getDerivative(3);    // 3rd derivative of y at x = 0.5
+
+Mixed partial derivatives of multivariate functions can be obtained from univariate Taylor series
+along suitably chosen directions, see rsManifold::getCoordinateDerivativesTaylor. */
+
+template<class T, int D>
+class rsTaylorNumber
+{
+
+public:
+
+  using TN = rsTaylorNumber<T, D>;   // shorthand for convenience
+
+  /** Creates a constant, i.e. all coefficients except c[0] are zero. */
+  rsTaylorNumber(T value = T(0))
+  {
+    c[0] = value;
+    for(int k = 1; k <= D; k++)
+      c[k] = T(0);
+  }
+
+  /** Creates a number with given value and 1st order coefficient. Use derivative = 1 for the 
+  independent variable. */
+  rsTaylorNumber(T value, T derivative) : rsTaylorNumber(value)
+  {
+    if(D >= 1) c[1] = derivative;
+  }
+
+  /** Creates the independent variable at x. */
+  static TN variable(T x) { return TN(x, T(1)); }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Inquiry
+
+  T getValue() const { return c[0]; }
+
+  /** Returns the k-th Taylor coefficient, i.e. the k-th derivative divided by k!. */
+  T getCoefficient(int k) const { return c[k]; }
+
+  /** Returns the k-th derivative. */
+  T getDerivative(int k = 1) const 
+  { 
+    T f = T(1);
+    for(int i = 2; i <= k; i++)
+      f *= T(i);
+    return f * c[k];
+  }
+
+  static constexpr int getDegree() { return D; }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Arithmetic operators
+
+  TN operator-() const { TN r; for(int k = 0; k <= D; k++) r.c[k] = -c[k]; return r; }
+
+  TN operator+(const TN& y) const { TN r; for(int k = 0; k <= D; k++) r.c[k] = c[k] + y.c[k]; return r; }
+  TN operator-(const TN& y) const { TN r; for(int k = 0; k <= D; k++) r.c[k] = c[k] - y.c[k]; return r; }
+
+  /** Truncated convolution of the coefficient arrays. */
+  TN operator*(const TN& y) const
+  {
+    TN r;
+    for(int k = 0; k <= D; k++) {
+      T sum = T(0);
+      for(int j = 0; j <= k; j++)
+        sum += c[j] * y.c[k-j];
+      r.c[k] = sum; }
+    return r;
+  }
+
+  /** Solves r * y = x for the coefficients of r, one after another. Requires y.c[0] != 0. */
+  TN operator/(const TN& y) const
+  {
+    TN r;
+    T s = T(1) / y.c[0];
+    for(int k = 0; k <= D; k++) {
+      T sum = c[k];
+      for(int j = 0; j < k; j++)
+        sum -= r.c[j] * y.c[k-j];
+      r.c[k] = s * sum; }
+    return r;
+  }
+
+  TN operator+(const T& y) const { TN r = *this; r.c[0] += y; return r; }
+  TN operator-(const T& y) const { TN r = *this; r.c[0] -= y; return r; }
+  TN operator*(const T& y) const { TN r; for(int k = 0; k <= D; k++) r.c[k] = c[k] * y; return r; }
+  TN operator/(const T& y) const { return *this * (T(1) / y); }
+
+  TN& operator+=(const TN& y) { return *this = *this + y; }
+  TN& operator-=(const TN& y) { return *this = *this - y; }
+  TN& operator*=(const TN& y) { return *this = *this * y; }
+  TN& operator/=(const TN& y) { return *this = *this / y; }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Comparison operators (they compare only the values)
+
+  bool operator< (const TN& y) const { return c[0] <  y.c[0]; }
+  bool operator> (const TN& y) const { return c[0] >  y.c[0]; }
+
+
+  T c[D+1];  // Taylor coefficients
+
+};
+
+#define RS_CTD template<class T, int D>   // class template declarations
+#define RS_TN  rsTaylorNumber<T, D>        // Taylor number
+
+RS_CTD RS_TN operator+(const T& x, const RS_TN& y) { return  y + x; }
+RS_CTD RS_TN operator-(const T& x, const RS_TN& y) { return -y + x; }
+RS_CTD RS_TN operator*(const T& x, const RS_TN& y) { return  y * x; }
+RS_CTD RS_TN operator/(const T& x, const RS_TN& y) { return RS_TN(x) / y; }
+
+/** Computes the sine s and cosine c of x at once via s' = c*x', c' = -s*x'. */
+RS_CTD void rsSinCos(const RS_TN& x, RS_TN* s, RS_TN* c)
+{
+  s->c[0] = rsSin(x.c[0]);
+  c->c[0] = rsCos(x.c[0]);
+  for(int k = 1; k <= D; k++) {
+    T ss = T(0), sc = T(0);
+    for(int j = 1; j <= k; j++) {
+      ss += T(j) * x.c[j] * c->c[k-j];
+      sc += T(j) * x.c[j] * s->c[k-j]; }
+    s->c[k] =  ss / T(k);
+    c->c[k] = -sc / T(k); }
+}
+
+RS_CTD RS_TN rsSin(const RS_TN& x) { RS_TN s, c; rsSinCos(x, &s, &c); return s; }
+RS_CTD RS_TN rsCos(const RS_TN& x) { RS_TN s, c; rsSinCos(x, &s, &c); return c; }
+
+/** y = exp(x) satisfies y' = y*x'. */
+RS_CTD RS_TN rsExp(const RS_TN& x)
+{
+  RS_TN y;
+  y.c[0] = rsExp(x.c[0]);
+  for(int k = 1; k <= D; k++) {
+    T sum = T(0);
+    for(int j = 1; j <= k; j++)
+      sum += T(j) * x.c[j] * y.c[k-j];
+    y.c[k] = sum / T(k); }
+  return y;
+}
+
+/** y = log(x) satisfies x*y' = x'. Requires x.c[0] > 0. */
+RS_CTD RS_TN rsLog(const RS_TN& x)
+{
+  RS_TN y;
+  y.c[0] = rsLog(x.c[0]);
+  T s = T(1) / x.c[0];
+  for(int k = 1; k <= D; k++) {
+    T sum = T(0);
+    for(int j = 1; j < k; j++)
+      sum += T(j) * y.c[j] * x.c[k-j];
+    y.c[k] = s * (x.c[k] - sum / T(k)); }
+  return y;
+}
+
+/** y = sqrt(x) satisfies y*y = x. Requires x.c[0] > 0. */
+RS_CTD RS_TN rsSqrt(const RS_TN& x)
+{
+  RS_TN y;
+  y.c[0] = rsSqrt(x.c[0]);
+  T s = T(0.5) / y.c[0];
+  for(int k = 1; k <= D; k++) {
+    T sum = T(0);
+    for(int j = 1; j < k; j++)
+      sum += y.c[j] * y.c[k-j];
+    y.c[k] = s * (x.c[k] - sum); }
+  return y;
+}
+
+/** y = x^p satisfies x*y' = p*y*x'. Requires x.c[0] > 0 (or integer p and x.c[0] != 0). */
+RS_CTD RS_TN rsPow(const RS_TN& x, const T& p)
+{
+  RS_TN y;
+  y.c[0] = pow(x.c[0], p);
+  T s = T(1) / x.c[0];
+  for(int k = 1; k <= D; k++) {
+    T sum = T(0);
+    for(int j = 1; j <= k; j++)
+      sum += (p*T(j) - T(k-j)) * x.c[j] * y.c[k-j];
+    y.c[k] = s * sum / T(k); }
+  return y;
+}
+
+// todo: tan, tanh, atan, asin, ... (they need auxiliary series like 1/(1+x^2))
 
-// not tested:
-RS_PFX rsLog( RS_DN x) { return RS_DN(rsLog(x.v),  x.d/x.v); } // requires x.v > 0
-RS_PFX rsSqrt(RS_DN x) { return RS_DN(rsSqrt(x.v), x.d*TVal(0.5)/sqrt(x.v)); } 
-// requires x.v > 0 - todo: make it work for x.v >= 0 - the derivative part at 0 should be computed
-// by using a limit
+#undef RS_CTD
+#undef RS_TN
 
+//-------------------------------------------------------------------------------------------------
 
-// todo: tan, cbrt, pow, abs, sinh, cosh, tanh, asin, acos, atan, atan2, etc.
-// what about floor and ceil? should their derivatives be a delta-comb? well - maybe i should not
-// care about them - they are not differentiable anyway
+/** Root finders that get their derivatives from rsTaylorNumber, so the user only needs to provide
+the function itself, typically as a generic lambda that can be called with rsTaylorNumber<T, D> 
+arguments. Newton iteration needs D = 1 and converges quadratically, Halley iteration needs D = 2
+and converges cubically. */
 
-#undef RS_CTD
-#undef RS_DN
-#undef RS_PFX
+template<class T>
+class rsRootFinderAD
+{
 
+public:
 
+  /** Finds a root of f near x0 via Newton iteration x -= f/f'. Stops when the update is below 
+  tol*(1+|x|) or after maxIts iterations. If numIts is not a nullptr, the number of iterations is
+  written into it. */
+  template<class F>
+  static T newton(const F& f, T x0, T tol = T(1.e-14), int maxIts = 100, int* numIts = nullptr)
+  {
+    using TN = rsTaylorNumber<T, 1>;
+    T x = x0;
+    int i;
+    for(i = 1; i <= maxIts; i++) {
+      TN y  = f(TN::variable(x));
+      T  dx = y.c[0] / y.c[1];
+      x -= dx;
+      if(rsAbs(dx) <= tol * (T(1) + rsAbs(x)))
+        break; }
+    if(numIts) *numIts = rsMin(i, maxIts);
+    return x;
+  }
 
+  /** Finds a root of f near x0 via Halley iteration x -= 2*f*f' / (2*f'^2 - f*f''). With the 
+  Taylor coefficients c1 = f', c2 = f''/2, the update becomes c0*c1 / (c1^2 - c0*c2). */
+  template<class F>
+  static T halley(const F& f, T x0, T tol = T(1.e-14), int maxIts = 100, int* numIts = nullptr)
+  {
+    using TN = rsTaylorNumber<T, 2>;
+    T x = x0;
+    int i;
+    for(i = 1; i <= maxIts; i++) {
+      TN y  = f(TN::variable(x));
+      T  dx = y.c[0] * y.c[1] / (y.c[1]*y.c[1] - y.c[0]*y.c[2]);
+      x -= dx;
+      if(rsAbs(dx) <= tol * (T(1) + rsAbs(x)))
+        break; }
+    if(numIts) *numIts = rsMin(i, maxIts);
+    return x;
+  }
 
-//-------------------------------------------------------------------------------------------------
-// Functions for nested dual numbers - can be used to compute 2nd derivatives:
-// ...works only with simply nested dual numbers - nesting twice doesn't work - maybe nesting 
-// should be postponed - it's a mess
+};
 
-#define RS_CTD template<class T1, class T2, class T3>  // class template declarations
-#define RS_IDN rsDualNumber<T2, T3>                    // inner dual number
-#define RS_ODN rsDualNumber<T1, RS_IDN>                // outer dual number
 
-// types: x.v: T1, x.d.v: T2, x.d.d: T3
+/** The tape (a.k.a. Wengert list) for reverse mode automatic differentiation with 
+rsAutoDiffNumber. Each number that takes part in a computation - inputs as well as intermediate 
+and final results - has a record on the tape which stores the type of the operation that produced
+it, the indices of its (up to two) operands and the local partial derivatives of the operation with
+respect to these operands. The records are stored contiguously in a std::vector which is used as 
+an arena: clear() just resets the size and keeps the memory, so recording the same computation 
+again doesn't allocate. After recording, computeAdjoints() runs a single backward sweep over the 
+tape that accumulates the adjoints (i.e. the partial derivatives of the output with respect to 
+each recorded number) into an adjoint array. This gives the full gradient with respect to all 
+inputs at the cost of a small constant multiple of the function evaluation itself - independent 
+of the number of inputs. Because the adjoints are accumulated (+=) rather than assigned, numbers 
+that are used several times (i.e. the computation is a DAG rather than a tree) are handled 
+correctly. */
 
-RS_CTD RS_ODN rsSin(RS_ODN x) { return RS_ODN(rsSin(x.v),  x.d.v*rsCos(RS_IDN(x.v))); }
-RS_CTD RS_ODN rsCos(RS_ODN x) { return RS_ODN(rsCos(x.v), -x.d.v*rsSin(RS_IDN(x.v))); }
+template<class TVal, class TDer>
+class rsAutoDiffTape
+{
 
+public:
 
-//RS_CTD RS_ODN rsExp(RS_ODN x) { return RS_ODN(rsExp(x.v),  x.d.v*rsExp(RS_IDN(x.v))); }
-//RS_CTD RS_ODN rsExp(RS_ODN x) { return RS_ODN(rsExp(x.v),  RS_IDN(x.d.v)*rsExp(RS_IDN(x.v))); }
-//RS_CTD RS_ODN rsExp(RS_ODN x) { return RS_ODN(rsExp(x.v),  RS_IDN(x.d.v,0)*rsExp(RS_IDN(x.v))); }  // 3rd wrong
-//RS_CTD RS_ODN rsExp(RS_ODN x) { return RS_ODN(rsExp(x.v),  RS_IDN(x.d.v,1)*rsExp(RS_IDN(x.v))); }    // 2nd,3rd wrong
-//RS_CTD RS_ODN rsExp(RS_ODN x) { return RS_ODN(rsExp(x.v),  T2(x.d.v)*rsExp(RS_IDN(x.v))); } // 3rd wrong
-//RS_CTD RS_ODN rsExp(RS_ODN x) { return RS_ODN(rsExp(x.v),  RS_IDN(T2(x.d.v))*rsExp(RS_IDN(x.v))); }
-//RS_CTD RS_ODN rsExp(RS_ODN x) { return RS_ODN(rsExp(x.v),  RS_IDN(T2(x.d.v),0)*rsExp(RS_IDN(x.v))); }
-//RS_CTD RS_ODN rsExp(RS_ODN x) { return RS_ODN(rsExp(x.v), RS_IDN(T3(x.d.v))*rsExp(RS_IDN(x.v))); } 
-//RS_CTD RS_ODN rsExp(RS_ODN x) { return RS_ODN(rsExp(x.v), T3(x.d.v)*rsExp(RS_IDN(x.v))); }
-// 3rd derivative is wrong - seems to be multiplied by factor 2
+  enum class OperationType : unsigned char
+  {
+    input, neg, add, sub, mul, div, sqrt, sin, cos, exp, log  // more to come
+  };
 
-RS_CTD RS_ODN rsExp(RS_ODN x) 
-{ 
-  T1     v = rsExp(x.v);                      // T1
-  //RS_IDN d = T2(x.d.v) * rsExp(RS_IDN(x.v));  // T2 * Dual<T2,T3> -> Dual(x.d.v,1) * exp(Dual(x.v,1))
+  /** One entry on the tape. An index of -1 means "no operand" - that's the case for inputs, for 
+  the 2nd operand of unary operations and for constant operands of binary operations. */
+  struct Record
+  {
+    OperationType type;
+    int  i1, i2;    // indices of the operands
+    TDer d1, d2;    // partial derivatives of the result with respect to the operands
+  };
 
-  // if T2 is itself a dual number, this does not work - both factors get constructed with a 1 for the
-  // d part and in the product rule f'*g + g'*f, we end up producing twice the desired value due to 
-  // adding two equal terms
 
-  RS_IDN d = RS_IDN(x.d.v,0) * rsExp(RS_IDN(x.v));
-  // hmm...this also doesn't work - we still get the extra factor of 2
+  //-----------------------------------------------------------------------------------------------
+  // \name Setup
 
-  //RS_IDN d = T2(x.d.v,0) * rsExp(RS_IDN(x.v)); // no compile with T2=float
+  /** Clears the tape without releasing its memory. */
+  void clear() { records.clear(); }
 
-  //RS_IDN d = RS_IDN(x.d.v * rsExp(RS_IDN(x.v)));
+  /** Preallocates memory for the given number of records to avoid re-allocations during the 
+  recording. */
+  void reserve(int numRecords) { records.reserve(numRecords); }
 
-  //RS_IDN d = x.d.v * rsExp(RS_IDN(T3(x.v)));
-  //RS_IDN d = T2(x.d.v) * rsExp(RS_IDN(T2(x.v)));
-  //RS_IDN d = RS_IDN(T3(x.d.v)) * rsExp(RS_IDN(T2(x.v)));
-  // somewhere, there's a constructor call missing and one d-element is not seeded, i think
 
-  return RS_ODN(v,  d); 
-}
+  //-----------------------------------------------------------------------------------------------
+  // \name Inquiry
 
-// Why does it actually work when using x.d.v as inner derivative? It probably should not be 
-// surprising, but i'm not sure about why. Maybe try nesting twice - doesn't work...maybe we need
-// to wrap something else into a constructor call? i tried -RS_IDN(x.d.v), RS_IDN(-x.d.v) for 
-// d-part of rsCos - but that doesn't work...maybe we need to use 0 as 2nd argument?
+  int getNumRecords() const { return (int) records.size(); }
 
-// todo: log, tan, sqrt, pow, abs, sinh, cosh, tanh, asin, acos, atan, atan2, etc.
+  const Record& getRecord(int i) const { return records[i]; }
 
-#undef RS_CTD
-#undef RS_IDN
-#undef RS_NDN
+  /** Returns the adjoint of the number with given index, i.e. the partial derivative of the 
+  output that was passed to the last call of computeAdjoints with respect to that number. */
+  TDer getAdjoint(int i) const { return adjoints[i]; }
 
-// maybe for doubly nested dual numbers, we will need yet another specialzation? ...if so, will it 
-// end there or will we need another for triply nested ones and so on? that would be bad!
+  /** Returns a pointer to the whole array of adjoints. */
+  const TDer* getAdjoints() const { return &adjoints[0]; }
 
 
+  //-----------------------------------------------------------------------------------------------
+  // \name Recording and evaluation
 
+  /** Appends a record to the tape and returns its index. */
+  int push(OperationType type, int i1, TDer d1, int i2, TDer d2)
+  {
+    records.push_back(Record{ type, i1, i2, d1, d2 });
+    return (int) records.size() - 1;
+  }
 
+  /** Runs the backward sweep from the number with given index (typically the final result of the
+  computation). Afterwards, getAdjoint(i) returns the partial derivative of that output with 
+  respect to the number with index i. */
+  void computeAdjoints(int output)
+  {
+    adjoints.resize(records.size());  // allocates only when the tape has grown
+    rsArrayTools::fillWithZeros(&adjoints[0], output+1);
+    adjoints[output] = TDer(1);
+    sweep(output);
+  }
 
-/*
-// not yet tested:
-template<class TVal, class TDer>
-rsDualNumber<TVal, TDer> rsSqrt(rsDualNumber<TVal, TDer> x) 
-{ return rsDualNumber<TVal, TDer>(sqrt(x.v), x.d*T(0.5)/sqrt(x.v)); }  // verify
+  /** Runs the backward sweep for several outputs at once where the adjoint of the k-th output is
+  seeded with seeds[k]. Afterwards, getAdjoint(i) returns sum_k seeds[k] * d(output_k)/d(x_i), 
+  i.e. the vector-Jacobian product. This is what we need to propagate adjoints backwards through 
+  a time step of a simulation. The same index may appear several times among the outputs (for 
+  example, when a step function just copies an input to an output). */
+  void computeAdjoints(const int* outputs, const TDer* seeds, int numOutputs)
+  {
+    int last = 0;
+    for(int k = 0; k < numOutputs; k++)
+      last = rsMax(last, outputs[k]);
+    adjoints.resize(records.size());
+    rsArrayTools::fillWithZeros(&adjoints[0], last+1);
+    for(int k = 0; k < numOutputs; k++)
+      adjoints[outputs[k]] += seeds[k];
+    sweep(last);
+  }
 
-template<class TVal, class TDer>
-rsDualNumber<TVal, TDer> rsLog(rsDualNumber<TVal, TDer> x) 
-{ return rsDualNumber<TVal, TDer>(log(x.v), x.d/x.v); }  // requires x.v > 0
 
-template<class TVal, class TDer>
-rsDualNumber<TVal, TDer> rsPow(rsDualNumber<TVal, TDer> x, TVal p)
-{ return rsDualNumber<TVal, TDer>(pow(x.v, p), x.d*TDer(p)*pow(x.v, p-1)); }  // requires x.v != 0
-// what, if p is also an dual number? ...this requires more thought....
+protected:
 
-template<class TVal, class TDer>
-rsDualNumber<TVal, TDer> rsAbs(rsDualNumber<TVal, TDer> x) 
-{ return rsDualNumber<TVal, TDer>(rsAbs(x.v), x.d*rsSign(x.v)); }  // requires x.v != 0..really?
-*/
+  /** The backward sweep from index last down to 0. */
+  void sweep(int last)
+  {
+    for(int i = last; i >= 0; i--)
+    {
+      const Record& r = records[i];
+      TDer a = adjoints[i];
+      if(r.i1 >= 0) adjoints[r.i1] += r.d1 * a;
+      if(r.i2 >= 0) adjoints[r.i2] += r.d2 * a;
+    }
+  }
 
+  std::vector<Record> records;
+  std::vector<TDer>   adjoints;
 
+};
 
 /** A number type for automatic differentiation in reverse mode. The operators and functions are 
-implemented in a way so keep a record of the whole computation. At the end of the computation, a 
-call to getDerivative() triggers the computation of the derivative by running through the whole 
-computation backwards
+implemented in a way to keep a record of the whole computation on an rsAutoDiffTape. The number 
+itself is just a lightweight handle consisting of its value, the index of its record on the tape 
+and a pointer to the tape, so it can be copied around freely. Usage:
 
-....i don't know yet, if the implementation is on the right track - i just started without much
-of a plan...
+  rsAutoDiffTape<double, double> tape;
+  ADN x(2.0, tape), y(3.0, tape);   // declare the inputs
+  ADN f = x*y + rsSin(x);           // record the computation
+  f.computeDerivatives();           // backward sweep
+  double fx = x.getDerivative();    // df/dx = y + cos(x)
+  double fy = y.getDerivative();    // df/dy = x
 
-*/
+All numbers that take part in the same computation must use the same tape. When the computation 
+is to be repeated with other input values, clear the tape and create the inputs again. Constants 
+(of type TVal) may be mixed in and don't produce operand entries. */
 
 template<class TVal, class TDer>
 class rsAutoDiffNumber
 {
 
-//protected:
-
 public:
 
+  using ADN  = rsAutoDiffNumber<TVal, TDer>;   // shorthand for convenience
+  using Tape = rsAutoDiffTape<TVal, TDer>;
+  using OT   = typename Tape::OperationType;
 
+  /** Default constructor. Creates a number that is not associated with any tape. It may be 
+  assigned to later. */
+  rsAutoDiffNumber() {}
 
-  enum class OperationType
+  /** Creates an input (i.e. an independent variable) with given value on the given tape. */
+  rsAutoDiffNumber(TVal value, Tape& tape) : v(value), t(&tape)
   {
-    neg, add, sub, mul, div, sqrt, sin, cos, exp  // more to come
-  };
+    i = tape.push(OT::input, -1, TDer(0), -1, TDer(0));
+  }
 
-  inline static const TVal NaN = RS_NAN(TVal);
-  using ADN = rsAutoDiffNumber<TVal, TDer>;   // shorthand for convenience
+  /** Creates a number from the result of an operation that is recorded at index in the tape. 
+  Mainly for internal use. */
+  rsAutoDiffNumber(TVal value, int index, Tape* tape) : v(value), i(index), t(tape) {}
 
 
-  /** Structure to store the operations */
-  struct Operation
-  {
-    OperationType type; // type of operation
-    ADN op1;            // first operand
-    ADN op2;            // second operand
-    TVal res;           // result
-    Operation(OperationType _type, ADN _op1, ADN _op2, TVal _res)
-      : type(_type), op1(_op1), op2(_op2), res(_res) {}
-  };
+  //-----------------------------------------------------------------------------------------------
+  // \name Inquiry
 
+  TVal getValue() const { return v; }
 
-  std::vector<Operation>& ops;  // "tape" of recorded operations
+  int getIndex() const { return i; }
 
+  Tape* getTape() const { return t; }
 
+  /** Returns the partial derivative of the output on which computeDerivatives was called last 
+  with respect to this number. */
+  TDer getDerivative() const { return t->getAdjoint(i); }
 
-  using OT  = OperationType;
-  using OP  = Operation;
 
+  //-----------------------------------------------------------------------------------------------
+  // \name Evaluation
 
+  /** Runs the backward sweep on the tape, treating this number as the output. Afterwards, the 
+  derivatives of this number with respect to all inputs (and intermediates) can be retrieved via
+  getDerivative() on those. */
+  void computeDerivatives() const { t->computeAdjoints(i); }
 
-  /** Pushes an operation record consisting of a type, two operands and a result onto the operation 
-  tape ops and returns the result of the operation as rsAutoDiffNumber. */
-  ADN push(OperationType type, ADN op1, ADN op2, TVal res)
+  /** Records a unary operation with result value r and derivative d (with respect to this). */
+  ADN unary(OT type, TVal r, TDer d) const
   {
-    ops.push_back(OP(type, op1, op2, res)); 
-    return ADN(res, ops);
+    return ADN(r, t->push(type, i, d, -1, TDer(0)), t);
   }
 
-public:
-
-  TVal v;        // value
-  TDer d = NaN;  // (partial) derivative
-
-  rsAutoDiffNumber(TVal value, std::vector<Operation>& tape) : v(value), /*a(NaN),*/ ops(tape) {}
+  /** Records a binary operation with result value r and partial derivatives d1, d2 (with respect
+  to this and y). */
+  ADN binary(OT type, const ADN& y, TVal r, TDer d1, TDer d2) const
+  {
+    rsAssert(t == y.t, "Operands must live on the same tape");
+    return ADN(r, t->push(type, i, d1, y.i, d2), t);
+  }
 
 
+  //-----------------------------------------------------------------------------------------------
+  // \name Arithmetic operators
 
+  ADN operator-() const { return unary(OT::neg, -v, TDer(-1)); }
 
-  void initLoc() { loc = this; }
-  // inits the location pointer - this is a bad API and temporary
-  // get rid of this - or at least avoid having to call it from client code - client created 
-  // numbers with memory locations should always automatically assign the location and temporaries
-  // shouldn't ...maybe we need to pass a flag to the constructor to indicate a memory variable
-  // if this is not possible, find a better name - like enable
-  // i think, maybe it's possible by making sure that push() sets loc to nullptr - then the 
-  // standard constructor may automatically set loc = this. ...but is it really safe to assume,
-  // that all variable locations are still valid - no: the user may define their own functions 
-  // using temporary variables - these will be invalid, when the function returns - maybe we 
-  // indeed need manual enable calls
+  ADN operator+(const ADN& y) const { return binary(OT::add, y, v + y.v, TDer(1), TDer( 1)); }
+  ADN operator-(const ADN& y) const { return binary(OT::sub, y, v - y.v, TDer(1), TDer(-1)); }
+  ADN operator*(const ADN& y) const { return binary(OT::mul, y, v * y.v, TDer(y.v), TDer(v)); }
+  ADN operator/(const ADN& y) const 
+  { 
+    TVal q = TVal(1) / y.v;
+    return binary(OT::div, y, v * q, TDer(q), TDer(-v*q*q));  // (x/y)_x = 1/y, (x/y)_y = -x/y^2
+  }
 
-  //-----------------------------------------------------------------------------------------------
-  // \name Inquiry
+  ADN operator+(const TVal& y) const { return unary(OT::add, v + y, TDer(1)); }
+  ADN operator-(const TVal& y) const { return unary(OT::sub, v - y, TDer(1)); }
+  ADN operator*(const TVal& y) const { return unary(OT::mul, v * y, TDer(y)); }
+  ADN operator/(const TVal& y) const { return unary(OT::div, v / y, TDer(TVal(1)/y)); }
 
-  TVal getValue()      const { return v; }
+  ADN& operator+=(const ADN& y) { return *this = *this + y; }
+  ADN& operator-=(const ADN& y) { return *this = *this - y; }
+  ADN& operator*=(const ADN& y) { return *this = *this * y; }
+  ADN& operator/=(const ADN& y) { return *this = *this / y; }
 
 
-  void computeDerivatives()
-  {
-    TDer d(1);
-    // i think, this accumulator is wrong - we whould use only the v,d fields of the operand(s) and
-    // the result - so the result may also have to be an ADN...or maybe not?
+  TVal  v = TVal(0);    // value
+  int   i = -1;         // index of the record on the tape
+  Tape* t = nullptr;    // the tape
 
-    //TDer d1, d2;
+};
 
-    int i = (int) ops.size()-1;
+#define RS_CTD template<class TVal, class TDer>  // class template declarations
+#define RS_ADN rsAutoDiffNumber<TVal, TDer>      // 
+#define RS_OT  RS_ADN::OT
+#define RS_PFX RS_CTD RS_ADN                      // prefix for the function definitions
 
-    if(i < 0)
-      return;
+// operators for left operands of type TVal:
+RS_PFX operator+(const TVal& x, const RS_ADN& y) { return y.unary(RS_OT::add, x + y.v, TDer( 1)); }
+RS_PFX operator-(const TVal& x, const RS_ADN& y) { return y.unary(RS_OT::sub, x - y.v, TDer(-1)); }
+RS_PFX operator*(const TVal& x, const RS_ADN& y) { return y.unary(RS_OT::mul, x * y.v, TDer( x)); }
+RS_PFX operator/(const TVal& x, const RS_ADN& y) 
+{ TVal q = TVal(1) / y.v; return y.unary(RS_OT::div, x * q, TDer(-x*q*q)); }
 
-    //ops[i].res.d = TVal(1);  // init - may not always be suitable
+// elementary functions:
+RS_PFX rsSqrt(RS_ADN x) { TVal r = rsSqrt(x.v); return x.unary(RS_OT::sqrt, r, TDer(TVal(0.5)/r)); }
+RS_PFX rsSin( RS_ADN x) { return x.unary(RS_OT::sin, rsSin(x.v), TDer( rsCos(x.v))); }
+RS_PFX rsCos( RS_ADN x) { return x.unary(RS_OT::cos, rsCos(x.v), TDer(-rsSin(x.v))); }
+RS_PFX rsExp( RS_ADN x) { TVal r = rsExp(x.v); return x.unary(RS_OT::exp, r, TDer(r)); }
+RS_PFX rsLog( RS_ADN x) { return x.unary(RS_OT::log, rsLog(x.v), TDer(TVal(1)/x.v)); }
 
+#undef RS_CTD
+#undef RS_ADN
+#undef RS_OT
+#undef RS_PFX
 
-    while(i >= 0)
-    {
+//-------------------------------------------------------------------------------------------------
 
-      //ops[i].op1d = getOpDerivative(ops[i]);
+/** Computes gradients of the final state of long time-stepping simulations in reverse mode with 
+binomial checkpointing (Griewank's "revolve" schedule). The simulation is given by a step function
+that maps a state x_n (of size numStates) and a parameter vector p (of size numParams) to the next
+state x_{n+1}, n = 0..numSteps-1, and an objective function J(x_N) of the final state. Costs that 
+accumulate over time (like a sum of squared errors) can be handled by augmenting the state with an
+accumulator. 
 
-      if(ops[i].type == OT::add)
-      {
-        ops[i].op1.d = d;
-        ops[i].op2.d = d;
-      }
-      else if(ops[i].type == OT::sub)
-      {
-        ops[i].op1.d =  d;
-        ops[i].op2.d = -d;
-      }
-      else if(ops[i].type == OT::mul)
-      {
-        ops[i].op1.d = d * ops[i].op2.v;  // (x*y)_x = y
-        ops[i].op2.d = d * ops[i].op1.v;  // (x*y)_y = x
-      }
-      else if(ops[i].type == OT::div)
-      {
-        ops[i].op1.d =  d                /  ops[i].op2.v;                  // (x/y)_x =  1/y
-        ops[i].op2.d = -d * ops[i].op1.v / (ops[i].op2.v * ops[i].op2.v);  // (x/y)_y = -x/y^2
-      }
-      else
-      {
-        // operation is a unary function
-        d *= getOpDerivative(ops[i]);
-        ops[i].op1.d = d;
-        ops[i].op2.d = NaN;
-      }
+Recording all steps on one reverse mode tape would need memory proportional to numSteps times the
+number of operations per step, which quickly gets prohibitive. Instead, we store only a limited 
+number of snapshots of the state at chosen steps during the forward sweep. During the backward 
+sweep, we recompute the states in between from the nearest snapshot and record only a single step 
+at a time on the tape to propagate the adjoint state backwards. With c snapshots and r being the 
+smallest number with binomial(c+r, c) >= numSteps, each step is recomputed at most r times, which 
+is optimal. So, the caller can trade memory for recomputation via setNumCheckpoints (or 
+setMemoryBudget): with c = numSteps, nothing is recomputed, with c = 0, the cost is quadratic in 
+numSteps.
 
-      
+Both functions must be written generically (e.g. as generic lambdas) such that they can be called 
+with plain numbers T (for the forward sweeps) and with rsAutoDiffNumber<T, T> (for the recording):
 
-      // assign derivative fields in memory variables, if applicable:
-      if(ops[i].op1.loc != nullptr) ops[i].op1.loc->d = ops[i].op1.d;
-      if(ops[i].op2.loc != nullptr) ops[i].op2.loc->d = ops[i].op2.d;
+  step(const auto* x, auto* y, const auto* p, int n)  // computes y = x_{n+1} from x = x_n
+  objective(const auto* x) -> number                  // J(x_N)
 
+Reference: A. Griewank, A. Walther - Algorithm 799: Revolve (ACM TOMS, 2000) */
 
+template<class T>
+class rsCheckpointedGradient
+{
 
+public:
 
+  using ADN  = rsAutoDiffNumber<T, T>;
+  using Tape = rsAutoDiffTape<T, T>;
 
 
-      i--;
+  //-----------------------------------------------------------------------------------------------
+  // \name Setup
 
-    }
+  /** Sets the sizes of the problem. This allocates all the memory. */
+  void setup(int newNumSteps, int newNumStates, int newNumParams)
+  {
+    numSteps  = newNumSteps;
+    numStates = newNumStates;
+    numParams = newNumParams;
+    xa.resize(numStates); ya.resize(numStates); pa.resize(numParams);
+    tmp1.resize(numStates); tmp2.resize(numStates); work.resize(numStates);
+    lambda.resize(numStates); outputs.resize(numStates);
+    allocateSnapshots();
+  }
 
+  /** Sets the number of snapshots of the state that may be stored at the same time. */
+  void setNumCheckpoints(int newNumCheckpoints)
+  {
+    rsAssert(newNumCheckpoints >= 0);
+    numCheckpoints = newNumCheckpoints;
+    allocateSnapshots();
   }
 
-  // rename to getFunctionDerivative and use it only for unary functions
-  TDer getOpDerivative(const Operation& op) const
+  /** Sets the number of snapshots such that they fit into the given number of bytes. Call it 
+  after setup. */
+  void setMemoryBudget(size_t numBytes)
   {
-    switch(op.type)
-    {
-    //case OT::add: return   op.op1.v + op.op2.v;  // is this correct?
+    setNumCheckpoints((int) (numBytes / (sizeof(T) * rsMax(numStates, 1))));
+  }
 
-      // for mul..do we have to call getOpDerivative twice with both operands
-      // or maybe reverse mode is only good for univariate operations? they always only talk about
-      // multiplying the Jacobians left-to-right or right-to-left - but here, we need to add two
-      // Jacobians...maybe we have to use recursion in getDerivative
-      // or maybe the Operation struct needs derivative fields for both operands? that are filled
-      // in the backward pass?
 
+  //-----------------------------------------------------------------------------------------------
+  // \name Inquiry
 
-    case OT::sqrt: return  TVal(0.5)/rsSqrt(op.op1.v); // maybe we could also use TVal(0.5)/op.res
-    case OT::sin:  return  rsCos(op.op1.v);
-    case OT::cos:  return -rsSin(op.op1.v);
-    case OT::exp:  return  rsExp(op.op1.v);
+  int getNumCheckpoints() const { return numCheckpoints; }
 
-      // but what about the binary operators? 
+  /** Returns the number of (plain, non-recorded) forward steps that were taken in the last call 
+  to computeGradient. Without recomputation, that would be numSteps. */
+  int getNumForwardSteps() const { return numForward; }
 
-    default: return TDer(0);
-    }
+  /** Returns the maximum number of snapshots that were in use at the same time in the last call 
+  to computeGradient. */
+  int getMaxNumSnapshotsUsed() const { return maxUsed; }
+
+  /** Returns the maximum number of tape records that were used for a single step or the 
+  objective. */
+  int getMaxTapeSize() const { return maxTape; }
+
+  /** Returns the repetition number r, i.e. the maximum number of times that a step is recomputed, 
+  for given numbers of steps and checkpoints. */
+  static int getRepetitionNumber(int numSteps, int numCheckpoints)
+  {
+    if(numCheckpoints == 0)
+      return rsMax(numSteps - 1, 0);  // everything is recomputed from x0
+    int r = 0;
+    while(binomial(numCheckpoints, r) < numSteps)
+      r++;
+    return r;
   }
 
+
   //-----------------------------------------------------------------------------------------------
-  // \name Arithmetic operators
+  // \name Processing
 
-  ADN operator-() { return push(neg, v, NaN, -v); }
+  /** Runs the simulation from the initial state x0 with parameters p, computes the objective 
+  J(x_N) and its gradients with respect to x0 and p and writes them into gradX0, gradP (either may
+  be a nullptr). Returns J. */
+  template<class FStep, class FObj>
+  T computeGradient(FStep& step, FObj& objective, const T* x0, const T* p, T* gradX0, T* gradP)
+  {
+    rsAssert(numSteps >= 1, "Call setup first");
+    params = p;
+    mu.assign(numParams, T(0));
+    numForward = numUsed = maxUsed = maxTape = 0;
+    turned = false;
+    J = T(0);
+    reverse(step, objective, 0, numSteps, numCheckpoints, x0);
+    if(gradX0) rsArrayTools::copy(&lambda[0], gradX0, numStates);
+    if(gradP)  rsArrayTools::copy(&mu[0],     gradP,  numParams);
+    return J;
+  }
 
-  ADN operator+(const ADN& y) { return push(OT::add, *this, y, v + y.v); }
-  ADN operator-(const ADN& y) { return push(OT::sub, *this, y, v - y.v); }
-  ADN operator*(const ADN& y) { return push(OT::mul, *this, y, v * y.v); }
-  ADN operator/(const ADN& y) { return push(OT::div, *this, y, v / y.v); }
 
+protected:
 
-  ADN operator=(const ADN& y) 
-  { 
-    v = y.v;
-    ops = y.ops;
-    return *this;
+  /** Binomial coefficient (c+r choose c), the maximum number of steps that can be reversed with c
+  snapshots and r repetitions. Computed in double to avoid overflow. */
+  static double binomial(int c, int r)
+  {
+    double b = 1;
+    for(int i = 1; i <= c; i++)
+      b = b * (r + i) / i;
+    return b;
   }
 
-  // void setOperationTape(std::vector<Operation>& newTape) { ops = newTape; }
+  /** Reverses the steps a..b-1 with c free snapshots, given the state xs at step a. */
+  template<class FStep, class FObj>
+  void reverse(FStep& step, FObj& objective, int a, int b, int c, const T* xs)
+  {
+    int l = b - a;
+    if(l == 1) {
+      backwardStep(step, objective, a, xs);
+      return; }
+    if(c == 0) {
+      for(int n = b-1; n >= a; n--) {
+        advance(step, a, n, xs, &work[0]);
+        backwardStep(step, objective, n, &work[0]); }
+      return; }
+
+    // Place a snapshot at m such that the right part can be reversed with c-1 snapshots and the 
+    // left part with c snapshots (after the one at m is released) with at most r repetitions:
+    int r = getRepetitionNumber(l, c);
+    int m = a + rsClip(l - (int) binomial(c-1, r), 1, l-1);
+    T* snap = &snapshots[numUsed * numStates];
+    numUsed++;
+    maxUsed = rsMax(maxUsed, numUsed);
+    advance(step, a, m, xs, snap);
+    reverse(step, objective, m, b, c-1, snap);
+    numUsed--;
+    reverse(step, objective, a, m, c, xs);
+  }
 
+  /** Computes the state at step n from the state xs at step a and writes it into xn. */
+  template<class FStep>
+  void advance(FStep& step, int a, int n, const T* xs, T* xn)
+  {
+    const T* x = xs;
+    T* y = &tmp1[0];
+    for(int k = a; k < n; k++) {
+      step(x, y, params, k);
+      x = y;
+      y = (y == &tmp1[0]) ? &tmp2[0] : &tmp1[0]; }
+    numForward += n - a;
+    rsArrayTools::copy(x, xn, numStates);
+  }
 
-  
-//protected:  // try to make protected - but that may need a lot of boilerplat friend declarations
+  /** Propagates the adjoint state lambda backwards through step n, i.e. from x_{n+1} to x_n, 
+  where xn is the state at step n. The very first call happens for the last step - there, we 
+  compute the objective and initialize lambda with its gradient ("taking the turn"). */
+  template<class FStep, class FObj>
+  void backwardStep(FStep& step, FObj& objective, int n, const T* xn)
+  {
+    int i;
+    if(!turned) {
+      step(xn, &tmp1[0], params, n);
+      numForward++;
+      tape.clear();
+      for(i = 0; i < numStates; i++)
+        xa[i] = ADN(tmp1[i], tape);
+      ADN Ja = objective(&xa[0]);
+      Ja.computeDerivatives();
+      for(i = 0; i < numStates; i++)
+        lambda[i] = xa[i].getDerivative();
+      J = Ja.getValue();
+      maxTape = rsMax(maxTape, tape.getNumRecords());
+      turned = true; }
+
+    // record the step and compute the vector-Jacobian products:
+    tape.clear();
+    for(i = 0; i < numStates; i++) xa[i] = ADN(xn[i],     tape);
+    for(i = 0; i < numParams; i++) pa[i] = ADN(params[i], tape);
+    step(&xa[0], &ya[0], &pa[0], n);
+    for(i = 0; i < numStates; i++)
+      outputs[i] = ya[i].getIndex();
+    tape.computeAdjoints(&outputs[0], &lambda[0], numStates);
+    for(i = 0; i < numStates; i++) lambda[i] = xa[i].getDerivative();
+    for(i = 0; i < numParams; i++) mu[i]    += pa[i].getDerivative();
+    maxTape = rsMax(maxTape, tape.getNumRecords());
+  }
 
-  rsAutoDiffNumber* loc = nullptr;
+  void allocateSnapshots()
+  {
+    snapshots.resize(rsMin(numCheckpoints, numSteps) * numStates);
+  }
 
-};
 
-#define RS_CTD template<class TVal, class TDer>  // class template declarations
-#define RS_ADN rsAutoDiffNumber<TVal, TDer>      // 
-#define RS_OP RS_ADN::OperationType
-#define RS_PFX RS_CTD RS_ADN                      // prefix for the function definitions
+  int numSteps = 0, numStates = 0, numParams = 0, numCheckpoints = 10;
 
-RS_PFX rsSqrt(RS_ADN x) { return x.push(RS_OP::sqrt, x, RS_ADN(0.f, x.ops), rsSqrt(x.v)); }
-RS_PFX rsSin( RS_ADN x) { return x.push(RS_OP::sin,  x, RS_ADN(0.f, x.ops), rsSin( x.v)); }
-RS_PFX rsCos( RS_ADN x) { return x.push(RS_OP::cos,  x, RS_ADN(0.f, x.ops), rsCos( x.v)); }
-RS_PFX rsExp( RS_ADN x) { return x.push(RS_OP::exp,  x, RS_ADN(0.f, x.ops), rsExp( x.v)); }
-// the 2nd operand is a dummy - maybe define a macro for it
+  Tape tape;
+  std::vector<ADN> xa, ya, pa;            // recorded states and parameters
+  std::vector<int> outputs;               // tape indices of the outputs of the recorded step
+  std::vector<T> snapshots;               // numCheckpoints states, used as a stack
+  std::vector<T> tmp1, tmp2, work;        // buffers for the forward steps
+  std::vector<T> lambda, mu;              // adjoints of the state and the parameters
+  const T* params = nullptr;
+  T J = T(0);
+  bool turned = false;
 
+  int numForward = 0, numUsed = 0, maxUsed = 0, maxTape = 0;  // statistics
 
-//RS_PFX rsSqrt(RS_ADN x) { return x.push(RS_OP::sqrt, x, RS_ADN(RS_ADN::NaN), rsSqrt(x.v)); }
-//RS_PFX rsSin( RS_ADN x) { return x.push(RS_OP::sin,  x, RS_ADN(RS_ADN::NaN), rsSin( x.v)); }
-//RS_PFX rsCos( RS_ADN x) { return x.push(RS_OP::cos,  x, RS_ADN(RS_ADN::NaN), rsCos( x.v)); }
-//RS_PFX rsExp( RS_ADN x) { return x.push(RS_OP::exp,  x, RS_ADN(RS_ADN::NaN), rsExp( x.v)); }
+};
 
-#undef RS_CTD
-#undef RS_DN
-#undef RS_OP
-#undef RS_PFX
 
 
 
@@ -2782,7 +7186,17 @@ public:
     : a(real), b(imag), c(dual), d(imagDual) {}
 
 
+  //-----------------------------------------------------------------------------------------------
+  // \name Inquiry
+
+  std::complex<T> getValue()      const { return std::complex<T>(a, b); }
+  std::complex<T> getDerivative() const { return std::complex<T>(c, d); }
+
+
+  //-----------------------------------------------------------------------------------------------
+  // \name Operators
 
+  DCN operator-() const { return DCN(-a, -b, -c, -d); }
 
   DCN operator+(const DCN& z) const { return DCN(a + z.a, b + z.b, c + z.c, d + z.d); }
   DCN operator-(const DCN& z) const { return DCN(a - z.a, b - z.b, c - z.c, d - z.d); }
@@ -2794,63 +7208,237 @@ public:
                a*z.d + z.a*d + b*z.c + z.b*c);
   }
 
+  /** With v = a + i*b, u = c + i*d for this and w, e for z, the quotient is q = v/w and the 
+  quotient rule gives (u*w - v*e)/w^2 = (u - q*e)/w for its dual part. Multiplying by r = 1/w 
+  twice costs 1 division and 16 multiplications in total. Earlier, we augmented the fraction 
+  twice to make the denominator real which needed 2 full products, so 32 multiplications, 
+  plus 4 scalings. */
   DCN operator/(const DCN& z) const
   {
-    T A = z.a*z.a + z.b*z.b;
-    T D = T(2)*(z.a*z.d - z.b*z.c);
-
-    DCN tmp = *this * DCN(z.a, -z.b, -z.c, z.d);  // product after first augmentation
-    tmp = tmp * DCN(A, T(0), T(0), -D);        // product after second augmentation
-    T s = T(1) / (A*A);
-    tmp.a *= s;
-    tmp.b *= s;
-    tmp.c *= s;
-    tmp.d *= s;
-
-    return tmp;
+    T s  = T(1) / (z.a*z.a + z.b*z.b);
+    T ra = z.a*s, rb = -z.b*s;             // r = 1/w
+    T qa = a*ra - b*rb, qb = a*rb + b*ra;  // q = v*r
+    T ua = c - (qa*z.c - qb*z.d);          // u - q*e
+    T ub = d - (qa*z.d + qb*z.c);
+    return DCN(qa, qb, ua*ra - ub*rb, ua*rb + ub*ra);
   }
-  // todo: simplify, optimize - the second multiplication contains lots of zeros, the scaling
-  // should use an operator / that takes a 2nd parameter of type T
 
-  /*
-  DCN operator/(const T& z) const { }
-  */
+  DCN operator+(const T& y) const { return DCN(a + y, b, c, d); }
+  DCN operator-(const T& y) const { return DCN(a - y, b, c, d); }
+  DCN operator*(const T& y) const { return DCN(a * y, b * y, c * y, d * y); }
+  DCN operator/(const T& y) const { return *this * (T(1) / y); }
+
+  DCN& operator+=(const DCN& z) { return *this = *this + z; }
+  DCN& operator-=(const DCN& z) { return *this = *this - z; }
+  DCN& operator*=(const DCN& z) { return *this = *this * z; }
+  DCN& operator/=(const DCN& z) { return *this = *this / z; }
 
+  bool operator==(const DCN& z) const { return a == z.a && b == z.b && c == z.c && d == z.d; }
+  bool operator!=(const DCN& z) const { return !(*this == z); }
 
 };
 
+template<class T> 
+rsDualComplexNumber<T> operator+(const T& x, const rsDualComplexNumber<T>& z) { return z + x; }
+
+template<class T> 
+rsDualComplexNumber<T> operator-(const T& x, const rsDualComplexNumber<T>& z) { return -z + x; }
+
+template<class T> 
+rsDualComplexNumber<T> operator*(const T& x, const rsDualComplexNumber<T>& z) { return z * x; }
+
+template<class T> 
+rsDualComplexNumber<T> operator/(const T& x, const rsDualComplexNumber<T>& z) 
+{ return rsDualComplexNumber<T>(x) / z; }
+
+//-------------------------------------------------------------------------------------------------
+// Elementary functions. They all work like: take the complex value v = a + i*b, compute f(v) and
+// multiply the complex dual part c + i*d by f'(v) (chain rule):
+
 #define RS_CTD template<class T> 
 #define RS_DCN rsDualComplexNumber<T> 
 #define RS_CMP std::complex<T> 
 #define RS_PFX RS_CTD RS_DCN 
 
-RS_PFX rsSin(RS_DCN x)
+/** Creates the result from the function value f and the derivative fp of the function at the 
+value of x. */
+RS_PFX rsDualComplexChain(const RS_DCN& x, const RS_CMP& f, const RS_CMP& fp)
 {
-  // extract complex value and derivative of inputs:
-  RS_CMP v(x.a, x.b);
-  RS_CMP d(x.c, x.d);
-
-  // compute derivative and value of output:
-  d *= cos(v);    // chain rule
-  v  = sin(v);    // regular function application
+  RS_CMP d = RS_CMP(x.c, x.d) * fp;
+  return RS_DCN(f.real(), f.imag(), d.real(), d.imag());
+}
 
-  // construct DCN from the 2 complex numbers:
-  return RS_DCN(v.real(), v.imag(), d.real(), d.imag());
+RS_PFX rsExp(RS_DCN x) { RS_CMP y = exp(x.getValue()); return rsDualComplexChain(x, y, y); }
+RS_PFX rsLog(RS_DCN x) { RS_CMP v = x.getValue(); return rsDualComplexChain(x, log(v), T(1)/v); }
+RS_PFX rsSqrt(RS_DCN x) 
+{ RS_CMP y = sqrt(x.getValue()); return rsDualComplexChain(x, y, T(0.5)/y); }
+RS_PFX rsPow(RS_DCN x, RS_CMP p) 
+{ RS_CMP v = x.getValue(), y = pow(v, p); return rsDualComplexChain(x, y, p*y/v); }  // v != 0
+
+RS_PFX rsSin(RS_DCN x) { RS_CMP v = x.getValue(); return rsDualComplexChain(x, sin(v),  cos(v)); }
+RS_PFX rsCos(RS_DCN x) { RS_CMP v = x.getValue(); return rsDualComplexChain(x, cos(v), -sin(v)); }
+RS_PFX rsTan(RS_DCN x) 
+{ RS_CMP y = tan(x.getValue()); return rsDualComplexChain(x, y, T(1) + y*y); }
+RS_PFX rsSinh(RS_DCN x) 
+{ RS_CMP v = x.getValue(); return rsDualComplexChain(x, sinh(v), cosh(v)); }
+RS_PFX rsCosh(RS_DCN x) 
+{ RS_CMP v = x.getValue(); return rsDualComplexChain(x, cosh(v), sinh(v)); }
+RS_PFX rsTanh(RS_DCN x) 
+{ RS_CMP y = tanh(x.getValue()); return rsDualComplexChain(x, y, T(1) - y*y); }
+
+RS_PFX rsAsin(RS_DCN x) 
+{ RS_CMP v = x.getValue(); return rsDualComplexChain(x, asin(v),  T(1)/sqrt(T(1) - v*v)); }
+RS_PFX rsAcos(RS_DCN x) 
+{ RS_CMP v = x.getValue(); return rsDualComplexChain(x, acos(v), -T(1)/sqrt(T(1) - v*v)); }
+RS_PFX rsAtan(RS_DCN x) 
+{ RS_CMP v = x.getValue(); return rsDualComplexChain(x, atan(v),  T(1)/(T(1) + v*v)); }
+RS_PFX rsAsinh(RS_DCN x) 
+{ RS_CMP v = x.getValue(); return rsDualComplexChain(x, asinh(v), T(1)/sqrt(v*v + T(1))); }
+RS_PFX rsAcosh(RS_DCN x) 
+{ 
+  RS_CMP v = x.getValue(); 
+  return rsDualComplexChain(x, acosh(v), T(1)/(sqrt(v - T(1)) * sqrt(v + T(1)))); 
 }
-// needs verification
+RS_PFX rsAtanh(RS_DCN x) 
+{ RS_CMP v = x.getValue(); return rsDualComplexChain(x, atanh(v), T(1)/(T(1) - v*v)); }
+// The derivatives of the inverse functions use the same branch cuts as std::complex
 
 #undef RS_CTD
 #undef RS_DCN
 #undef RS_CMP 
 #undef RS_PFX
 
+//-------------------------------------------------------------------------------------------------
+
+/** Evaluates a complex function and its complex derivative at many points. The points and results
+are given as separate arrays for real and imaginary parts (structure of arrays). K points are 
+processed at a time by using rsDualComplexNumber with rsDerivativeLanes<T, K> as its number type
+such that each arithmetic operation works on K points at once, which the compiler can map to SIMD
+instructions. The remaining N % K points are processed one at a time. So, the function must be 
+written generically and may only use arithmetic operations because the elementary functions above
+are based on std::complex which has no lane type. That's sufficient for rational functions, such 
+as the transfer functions of filters, for which evaluateRational is a convenience function:
+
+  rsDualComplexBatch<double>::evaluateRational(b, nb, a, na, zr, zi, N, Hr, Hi, dHr, dHi);
+
+How much faster this is than a loop over plain rsDualComplexNumber<T> depends on K and the SIMD 
+width of the target - testDualComplexFunctions prints a comparison. */
+
+template<class T, int K = 8>
+class rsDualComplexBatch
+{
+
+public:
+
+  using Lanes = rsDerivativeLanes<T, K>;
+  using DCN   = rsDualComplexNumber<T>;
+  using DCNL  = rsDualComplexNumber<Lanes>;
+
+
+  /** Evaluates f(z) and f'(z) at the points z = zRe[n] + i*zIm[n], n = 0..N-1 and writes the 
+  results into fRe, fIm, dRe, dIm. f is called with DCNL and with DCN arguments, so it's typically
+  a generic lambda. */
+  template<class F>
+  static void evaluate(const F& f, const T* zRe, const T* zIm, int N, 
+    T* fRe, T* fIm, T* dRe, T* dIm)
+  {
+    int n = 0;
+    for(; n <= N-K; n += K)
+    {
+      DCNL z;
+      for(int k = 0; k < K; k++) {
+        z.a[k] = zRe[n+k]; z.b[k] = zIm[n+k];
+        z.c[k] = T(1);     z.d[k] = T(0); }     // seed with dz/dz = 1
+      DCNL w = f(z);
+      for(int k = 0; k < K; k++) {
+        fRe[n+k] = w.a[k]; fIm[n+k] = w.b[k];
+        dRe[n+k] = w.c[k]; dIm[n+k] = w.d[k]; }
+    }
+    for(; n < N; n++)
+    {
+      DCN w = f(DCN(zRe[n], zIm[n], T(1), T(0)));
+      fRe[n] = w.a; fIm[n] = w.b; dRe[n] = w.c; dIm[n] = w.d;
+    }
+  }
+
+  /** Evaluates the rational function H(z) = B(z) / A(z) and its derivative where B, A are 
+  polynomials with nb, na real coefficients in ascending order, i.e. B(z) = b[0] + b[1]*z + ... 
+  For digital filters with coefficients for powers of z^-1, pass the points q = 1/z - the 
+  derivative dH/dq can then be turned into dH/dz = -q^2 * dH/dq. This doesn't go through 
+  evaluate but does the same operations as horner (i.e. a dual complex multiply-add per 
+  coefficient) with the loops over the K points innermost. That avoids the temporary lane 
+  vectors that the operators of rsDualComplexNumber<Lanes> create, so the compiler can keep 
+  everything in registers. */
+  static void evaluateRational(const T* b, int nb, const T* a, int na, 
+    const T* zRe, const T* zIm, int N, T* HRe, T* HIm, T* dRe, T* dIm)
+  {
+    int n = 0;
+    for(; n <= N-K; n += K)
+    {
+      T Br[K], Bi[K], Bc[K], Bd[K], Ar[K], Ai[K], Ac[K], Ad[K];
+      hornerLanes(b, nb, &zRe[n], &zIm[n], Br, Bi, Bc, Bd);
+      hornerLanes(a, na, &zRe[n], &zIm[n], Ar, Ai, Ac, Ad);
+      for(int k = 0; k < K; k++)
+      {
+        // H = B/A, H' = (B' - H*A')/A, see rsDualComplexNumber::operator/:
+        T s  = T(1) / (Ar[k]*Ar[k] + Ai[k]*Ai[k]);
+        T rr = Ar[k]*s, ri = -Ai[k]*s;
+        T Hr = Br[k]*rr - Bi[k]*ri, Hi = Br[k]*ri + Bi[k]*rr;
+        T ur = Bc[k] - (Hr*Ac[k] - Hi*Ad[k]);
+        T ui = Bd[k] - (Hr*Ad[k] + Hi*Ac[k]);
+        HRe[n+k] = Hr; HIm[n+k] = Hi;
+        dRe[n+k] = ur*rr - ui*ri; dIm[n+k] = ur*ri + ui*rr;
+      }
+    }
+    for(; n < N; n++)
+    {
+      DCN z(zRe[n], zIm[n], T(1), T(0));
+      DCN H = horner(b, nb, z) / horner(a, na, z);
+      HRe[n] = H.a; HIm[n] = H.b; dRe[n] = H.c; dIm[n] = H.d;
+    }
+  }
+
+  /** Evaluates the polynomial with coefficients c[0..N-1] at z via Horner's rule. TC is 
+  rsDualComplexNumber with T or Lanes as number type. */
+  template<class TC>
+  static TC horner(const T* c, int N, const TC& z)
+  {
+    using TL = decltype(z.a);
+    TC r(TL(c[N-1]), TL(0), TL(0), TL(0));
+    for(int k = N-2; k >= 0; k--) {
+      r = r*z;
+      r.a += TL(c[k]); }
+    return r;
+  }
+
+
+protected:
+
+  /** Evaluates the polynomial with coefficients c[0..N-1] and its derivative at the K points 
+  zr[k] + i*zi[k]. Writes the values into pr, pi and the derivatives into dr, di. */
+  static void hornerLanes(const T* c, int N, const T* zr, const T* zi, 
+    T* pr, T* pi, T* dr, T* di)
+  {
+    int k;
+    for(k = 0; k < K; k++) {
+      pr[k] = c[N-1]; pi[k] = dr[k] = di[k] = T(0); }
+    for(int j = N-2; j >= 0; j--) {
+      for(k = 0; k < K; k++) {
+        T tr = dr[k]*zr[k] - di[k]*zi[k] + pr[k];   // p' = p' * z + p
+        T ti = dr[k]*zi[k] + di[k]*zr[k] + pi[k];
+        T ur = pr[k]*zr[k] - pi[k]*zi[k] + c[j];    // p  = p  * z + c[j]
+        T ui = pr[k]*zi[k] + pi[k]*zr[k];
+        dr[k] = tr; di[k] = ti; pr[k] = ur; pi[k] = ui; }}
+  }
+
+};
+
 // is this a restricted case of this?: https://en.wikipedia.org/wiki/Dual_quaternion
 // oh - there are already dual complex numbers - but they work differently:
 // https://en.wikipedia.org/wiki/Dual-complex_number
 // ...so we should use another name - how about DiffComplex or DiComplex - when they are useful for
 // automatic differentiation in the complex domain - we'll see
-// todo: define elementary functions exp, sin, cos, sqrt
-// implement operators that allow mixed operations with std::complex
+// todo: implement operators that allow mixed operations with std::complex
 
 
 /*